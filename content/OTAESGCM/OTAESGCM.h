@@ -34,10 +34,33 @@ Author(s) / Copyright (s): Deniz Erbilgin 2015--2017
 
 // Core support/APIs.
 #include "utility/OTAESGCM_OTAES128.h"
+#include "utility/OTAESGCM_OTGHASH128.h"
 #include "utility/OTAESGCM_OTAESGCM.h"
 
 // Implementations.
 #include "utility/OTAESGCM_OTAES128Impls.h"
+#include "utility/OTAESGCM_OTGHASH128Impls.h"
+
+// Header-only devirtualised GCM engine.
+#include "utility/OTAESGCM_OTAESGCMInline.h"
+
+// Compile-time key setup for keys fixed at build time.
+#include "utility/OTAESGCM_OTAES128GCMFixedKey.h"
+
+// Straight-line codecs for fixed-size frames.
+#include "utility/OTAESGCM_OTAES128GCMFixedFrame.h"
+
+// Key contexts shared read-only between threads.
+#include "utility/OTAESGCM_OTAES128GCMShared.h"
+
+// Concurrent sharded key context cache (not on AVR).
+#include "utility/OTAESGCM_OTAES128GCMKeyCache.h"
+
+// Worker thread pool for GCM jobs (not on AVR).
+#include "utility/OTAESGCM_OTAES128GCMThreadPool.h"
+
+// C++20 coroutine front end (only where coroutines are supported).
+#include "utility/OTAESGCM_OTAES128GCMAsync.h"
 
 
 #endif
@@ -0,0 +1,70 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Deniz Erbilgin 2015--2017
+                           Damon Hart-Davis 2015--2017
+*/
+
+/* Run-time CPU feature detection for optional hardware-accelerated impls. */
+
+#include "OTAESGCM_CPUFeatures.h"
+
+#if defined(OTAESGCM_X86_INTRINSICS)
+
+#include <cpuid.h>
+
+
+// Use namespaces to help avoid collisions.
+namespace OTAESGCM
+    {
+
+// CPUID leaf 1 ECX feature bits.
+static constexpr unsigned int CPUID1_ECX_AES = 1U << 25;
+static constexpr unsigned int CPUID1_ECX_PCLMULQDQ = 1U << 1;
+static constexpr unsigned int CPUID1_ECX_SSSE3 = 1U << 9;
+
+// Fetch CPUID leaf 1 ECX, or 0 if unavailable.
+static unsigned int cpuid1ecx()
+    {
+    unsigned int eax, ebx, ecx, edx;
+    if(0 == __get_cpuid(1, &eax, &ebx, &ecx, &edx)) { return(0); }
+    return(ecx);
+    }
+
+// Check once; function-local static initialisation is thread-safe.
+bool cpuHasAESNI()
+    {
+    static const bool hasAESNI = (0 != (cpuid1ecx() & CPUID1_ECX_AES));
+    return(hasAESNI);
+    }
+
+// Check once; function-local static initialisation is thread-safe.
+bool cpuHasPCLMUL()
+    {
+    static constexpr unsigned int needed = CPUID1_ECX_PCLMULQDQ | CPUID1_ECX_SSSE3;
+    static const bool hasPCLMUL = (needed == (cpuid1ecx() & needed));
+    return(hasPCLMUL);
+    }
+
+// Check once; function-local static initialisation is thread-safe.
+bool cpuHasSSSE3()
+    {
+    static const bool hasSSSE3 = (0 != (cpuid1ecx() & CPUID1_ECX_SSSE3));
+    return(hasSSSE3);
+    }
+
+    }
+
+#endif // defined(OTAESGCM_X86_INTRINSICS)
@@ -0,0 +1,66 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Deniz Erbilgin 2015--2017
+                           Damon Hart-Davis 2015--2017
+*/
+
+/* Run-time CPU feature detection for optional hardware-accelerated impls. */
+
+#ifndef ARDUINO_LIB_OTAESGCM_CPUFEATURES_H
+#define ARDUINO_LIB_OTAESGCM_CPUFEATURES_H
+
+// IF DEFINED: x86/x86-64 intrinsics-based implementations can be compiled.
+// They are built with per-function target attributes
+// so that no special compiler flags are needed,
+// and are only used when the CPU is found to support them at run time.
+#if !defined(__AVR_ARCH__) && !defined(ARDUINO_ARCH_AVR) && \
+    (defined(__x86_64__) || defined(__i386__)) && \
+    (defined(__GNUC__) || defined(__clang__))
+#define OTAESGCM_X86_INTRINSICS
+#endif
+
+
+// Use namespaces to help avoid collisions.
+namespace OTAESGCM
+    {
+
+#if defined(OTAESGCM_X86_INTRINSICS)
+    // True if the CPU supports the AES-NI instructions.
+    // The CPUID check is made once and cached.
+    // Thread-safe.
+    bool cpuHasAESNI();
+    // True if the CPU supports the PCLMULQDQ carry-less multiply instruction
+    // and SSSE3 (for byte shuffles), as needed by the CLMUL GHASH.
+    // The CPUID check is made once and cached.
+    // Thread-safe.
+    bool cpuHasPCLMUL();
+    // True if the CPU supports the SSSE3 byte shuffle (pshufb),
+    // as needed by the vector-permute AES.
+    // The CPUID check is made once and cached.
+    // Thread-safe.
+    bool cpuHasSSSE3();
+#else
+    // No AES-NI support possible in this build.
+    inline constexpr bool cpuHasAESNI() { return(false); }
+    // No PCLMULQDQ support possible in this build.
+    inline constexpr bool cpuHasPCLMUL() { return(false); }
+    // No SSSE3 support possible in this build.
+    inline constexpr bool cpuHasSSSE3() { return(false); }
+#endif
+
+    }
+
+#endif
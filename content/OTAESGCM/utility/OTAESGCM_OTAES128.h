@@ -24,6 +24,7 @@ Author(s) / Copyright (s): Deniz Erbilgin 2015--2017
 
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
 
 // Use namespaces to help avoid collisions.
@@ -38,6 +39,10 @@ namespace OTAESGCM
     // Neither re-entrant nor ISR-safe except where stated.
     class OTAES128E
         {
+        private:
+            // Key of the active default (fallback) session, else NULL; not copied.
+            const uint8_t *fallbackKey = NULL;
+
         protected:
             // Only derived classes can construct an instance.
             constexpr OTAES128E() { }
@@ -51,6 +56,74 @@ namespace OTAESGCM
              */
             virtual void blockEncrypt(const uint8_t* input, const uint8_t* key, uint8_t *output) = 0;
 
+            // Keyed session support.
+            // Allows the key set-up (eg expansion of the round keys) to be done once
+            // and reused for any number of blocks until the session is ended.
+            // A session is private to the instance; blockEncrypt()
+            // (and blockDecrypt() where available) must not be called
+            // while a session is active as they may overwrite/clear its state.
+
+            /**
+             *    @brief    start a keyed session, eg expand the round keys once
+             *    @param    key takes a pointer to a 128-bit (16-byte) secret key; never NULL
+             *    @retval   true if the session was started, false on error (eg no workspace)
+             *
+             * Any previous session is implicitly replaced.
+             *
+             * The default, for engines with no key set-up to amortise,
+             * only remembers the key pointer for blockEncrypt(),
+             * so the key must then remain valid until endSession().
+             */
+            virtual bool setKey(const uint8_t *key)
+                { if(NULL == key) { return(false); } fallbackKey = key; return(true); }
+            /**
+             *    @brief    AES128 encryption of whole blocks with the session key
+             *    @param    input takes a pointer to an array containing plaintext, of size 16*nBlocks bytes; never NULL
+             *    @param    output takes a pointer to an array to fill with ciphertext, of size 16*nBlocks bytes; never NULL
+             *    @param    nBlocks number of 16-byte blocks to encrypt, can be zero
+             *
+             * input and output may be the same buffer, but must not otherwise overlap.
+             * Does nothing if no session is active.
+             *
+             * The default calls blockEncrypt() once per block.
+             */
+            virtual void encryptBlocks(const uint8_t *input, uint8_t *output, size_t nBlocks)
+                {
+                if(NULL == fallbackKey) { return; }
+                for( ; nBlocks > 0; --nBlocks, input += 16, output += 16)
+                    { blockEncrypt(input, fallbackKey, output); }
+                }
+            /**
+             *    @brief    end the keyed session and clear sensitive (eg round key) state
+             *
+             * Safe to call when no session is active.
+             */
+            virtual void endSession() { fallbackKey = NULL; }
+
+            /**
+             *    @brief    CTR mode key stream with the session key
+             *    @param    ctrBlock takes a pointer to the 16-byte next counter block,
+             *              incremented modulo 2^32 (inc32) per block and updated; never NULL
+             *    @param    output takes a pointer to an array to fill with key stream, of size 16*nBlocks bytes; never NULL
+             *    @param    nBlocks number of 16-byte blocks of key stream, can be zero
+             *
+             * Allows an engine to pipeline many counter blocks per call.
+             * The default lays out the counter blocks in the output
+             * and ciphers them in place with encryptBlocks().
+             * Does nothing useful if no session is active.
+             */
+            virtual void ctrKeystream(uint8_t *ctrBlock, uint8_t *output, size_t nBlocks)
+                {
+                uint8_t *p = output;
+                for(size_t i = nBlocks; i > 0; --i, p += 16)
+                    {
+                    memcpy(p, ctrBlock, 16);
+                    // inc32: increment the rightmost 32 bits, big-endian.
+                    for(uint8_t j = 15; (j >= 12) && (0 == ++ctrBlock[j]); --j) { }
+                    }
+                encryptBlocks(output, output, nBlocks);
+                }
+
 #if 0 // Defining the virtual destructor uses ~800+ bytes of Flash by forcing use of malloc()/free().
             // Ensure safe instance destruction when derived from.
             // by default attempts to shut down the sensor and otherwise free resources when done.
@@ -68,6 +141,10 @@ namespace OTAESGCM
     // Neither re-entrant nor ISR-safe except where stated.
     class OTAES128D
         {
+        private:
+            // Key of the active default (fallback) session, else NULL; not copied.
+            const uint8_t *fallbackKey = NULL;
+
         protected:
             // Only derived classes can construct an instance.
             constexpr OTAES128D() { }
@@ -80,6 +157,44 @@ namespace OTAESGCM
              *    @param    output takes a pointer to an array to fill with plaintext, of size 16 bytes; never NULL
              */
             virtual void blockDecrypt(const uint8_t* input, const uint8_t* key, uint8_t *output) = 0;
+
+            // Keyed session support, as for OTAES128E.
+            // In a combined enc/dec implementation the session is shared
+            // between encryption and decryption.
+
+            /**
+             *    @brief    start a keyed session, eg expand the round keys once
+             *    @param    key takes a pointer to a 128-bit (16-byte) secret key; never NULL
+             *    @retval   true if the session was started, false on error (eg no workspace)
+             *
+             * The default only remembers the key pointer for blockDecrypt(),
+             * so the key must then remain valid until endSession().
+             */
+            virtual bool setKey(const uint8_t *key)
+                { if(NULL == key) { return(false); } fallbackKey = key; return(true); }
+            /**
+             *    @brief    AES128 decryption of whole blocks with the session key
+             *    @param    input takes a pointer to an array containing ciphertext, of size 16*nBlocks bytes; never NULL
+             *    @param    output takes a pointer to an array to fill with plaintext, of size 16*nBlocks bytes; never NULL
+             *    @param    nBlocks number of 16-byte blocks to decrypt, can be zero
+             *
+             * input and output may be the same buffer, but must not otherwise overlap.
+             * Does nothing if no session is active.
+             *
+             * The default calls blockDecrypt() once per block.
+             */
+            virtual void decryptBlocks(const uint8_t *input, uint8_t *output, size_t nBlocks)
+                {
+                if(NULL == fallbackKey) { return; }
+                for( ; nBlocks > 0; --nBlocks, input += 16, output += 16)
+                    { blockDecrypt(input, fallbackKey, output); }
+                }
+            /**
+             *    @brief    end the keyed session and clear sensitive (eg round key) state
+             *
+             * Safe to call when no session is active.
+             */
+            virtual void endSession() { fallbackKey = NULL; }
         };
 
 
@@ -0,0 +1,297 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Deniz Erbilgin 2015--2017
+                           Damon Hart-Davis 2015--2017
+*/
+
+/* x86 AES-NI AES(128) implementation. */
+
+#include "OTAESGCM_CPUFeatures.h"
+
+#if defined(OTAESGCM_X86_INTRINSICS)
+
+#include <stdint.h>
+#include <string.h>
+#include <emmintrin.h>
+#include <wmmintrin.h>
+
+#include "OTAESGCM_OTAES128.h"
+#include "OTAESGCM_OTAES128AESNI.h"
+
+// Compile individual functions for AES-NI without needing -maes globally.
+#define OTAESGCM_TARGET_AESNI __attribute__((target("aes,sse2")))
+
+
+// Use namespaces to help avoid collisions.
+namespace OTAESGCM
+    {
+
+
+/*
+
+AES128 using the Intel AES New Instructions,
+after the Intel white paper "Intel Advanced Encryption Standard (AES)
+New Instructions Set" (Gueron, rev 3.01, 2012).
+
+Round keys are stored unaligned in the caller's workspace
+and loaded into registers once per encryptBlocks() call.
+
+*/
+
+// Number of independent blocks kept in flight to cover aesenc latency.
+static constexpr uint8_t PIPELINE_BLOCKS = 4;
+// Blocks in flight in encryptBlocksMultiKey(), where each block
+// also loads its own round keys, so more are needed to fill the pipeline.
+static constexpr uint8_t MULTI_KEY_BLOCKS = 8;
+
+/**
+ * @brief   one step of the key schedule:
+ *          fold the previous round key and the aeskeygenassist output
+ */
+OTAESGCM_TARGET_AESNI
+static inline __m128i expandStep(__m128i key, __m128i assist)
+{
+    assist = _mm_shuffle_epi32(assist, 0xff);
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    key = _mm_xor_si128(key, _mm_slli_si128(key, 4));
+    return(_mm_xor_si128(key, assist));
+}
+
+/**
+ * @brief   expand the 128-bit key into 11 round keys
+ */
+OTAESGCM_TARGET_AESNI
+void OTAES128E_AESNI::expandKey(const uint8_t *key, uint8_t *rkOut)
+{
+    __m128i *const out = (__m128i *)rkOut;
+    __m128i k = _mm_loadu_si128((const __m128i *)key);
+    _mm_storeu_si128(out, k);
+    // The round constant must be an immediate, so unroll.
+#define OTAESGCM_EXPAND(i, rcon) \
+    k = expandStep(k, _mm_aeskeygenassist_si128(k, rcon)); \
+    _mm_storeu_si128(out + (i), k)
+    OTAESGCM_EXPAND(1, 0x01);
+    OTAESGCM_EXPAND(2, 0x02);
+    OTAESGCM_EXPAND(3, 0x04);
+    OTAESGCM_EXPAND(4, 0x08);
+    OTAESGCM_EXPAND(5, 0x10);
+    OTAESGCM_EXPAND(6, 0x20);
+    OTAESGCM_EXPAND(7, 0x40);
+    OTAESGCM_EXPAND(8, 0x80);
+    OTAESGCM_EXPAND(9, 0x1b);
+    OTAESGCM_EXPAND(10, 0x36);
+#undef OTAESGCM_EXPAND
+}
+
+/**
+ * @brief   encrypt nBlocks, PIPELINE_BLOCKS at a time where possible
+ */
+OTAESGCM_TARGET_AESNI
+void OTAES128E_AESNI::encryptBlocks(const uint8_t *rkIn, const uint8_t *in, uint8_t *out, size_t nBlocks)
+{
+    const __m128i *const r = (const __m128i *)rkIn;
+    __m128i k[11];
+    for(uint8_t i = 0; i < 11; ++i) { k[i] = _mm_loadu_si128(r + i); }
+
+    // Interleave independent blocks so that each aesenc issues
+    // while the previous ones are still in the pipeline.
+    for( ; nBlocks >= PIPELINE_BLOCKS; nBlocks -= PIPELINE_BLOCKS)
+    {
+        __m128i b0 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)in), k[0]);
+        __m128i b1 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(in + 16)), k[0]);
+        __m128i b2 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(in + 32)), k[0]);
+        __m128i b3 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(in + 48)), k[0]);
+        for(uint8_t i = 1; i < 10; ++i)
+        {
+            b0 = _mm_aesenc_si128(b0, k[i]);
+            b1 = _mm_aesenc_si128(b1, k[i]);
+            b2 = _mm_aesenc_si128(b2, k[i]);
+            b3 = _mm_aesenc_si128(b3, k[i]);
+        }
+        _mm_storeu_si128((__m128i *)out, _mm_aesenclast_si128(b0, k[10]));
+        _mm_storeu_si128((__m128i *)(out + 16), _mm_aesenclast_si128(b1, k[10]));
+        _mm_storeu_si128((__m128i *)(out + 32), _mm_aesenclast_si128(b2, k[10]));
+        _mm_storeu_si128((__m128i *)(out + 48), _mm_aesenclast_si128(b3, k[10]));
+        in += PIPELINE_BLOCKS * 16;
+        out += PIPELINE_BLOCKS * 16;
+    }
+    for( ; nBlocks > 0; --nBlocks)
+    {
+        __m128i b = _mm_xor_si128(_mm_loadu_si128((const __m128i *)in), k[0]);
+        for(uint8_t i = 1; i < 10; ++i) { b = _mm_aesenc_si128(b, k[i]); }
+        _mm_storeu_si128((__m128i *)out, _mm_aesenclast_si128(b, k[10]));
+        in += 16;
+        out += 16;
+    }
+    // Don't leave round keys on the stack;
+    // volatile so that the stores to this dead local are not elided.
+    volatile __m128i *const kv = k;
+    for(uint8_t i = 0; i < 11; ++i) { kv[i] = _mm_setzero_si128(); }
+}
+
+/**
+ * @brief   encrypt nBlocks each with its own expanded key,
+ *          MULTI_KEY_BLOCKS in lockstep where possible
+ *
+ * The round keys are loaded per block and round rather than held in registers;
+ * the loads are independent of the aesenc chain so cost little.
+ */
+OTAESGCM_TARGET_AESNI
+void OTAES128E_AESNI::encryptBlocksMultiKey(const uint8_t *const *rkIn, const uint8_t *in, uint8_t *out, size_t nBlocks)
+{
+    while(nBlocks > 0)
+    {
+        const uint8_t n = (nBlocks < MULTI_KEY_BLOCKS) ? uint8_t(nBlocks) : MULTI_KEY_BLOCKS;
+        __m128i b[MULTI_KEY_BLOCKS];
+        for(uint8_t j = 0; j < n; ++j)
+            { b[j] = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(in + 16 * j)), _mm_loadu_si128((const __m128i *)rkIn[j])); }
+        for(uint8_t i = 1; i < 10; ++i)
+        {
+            for(uint8_t j = 0; j < n; ++j)
+                { b[j] = _mm_aesenc_si128(b[j], _mm_loadu_si128((const __m128i *)rkIn[j] + i)); }
+        }
+        for(uint8_t j = 0; j < n; ++j)
+            { _mm_storeu_si128((__m128i *)(out + 16 * j), _mm_aesenclast_si128(b[j], _mm_loadu_si128((const __m128i *)rkIn[j] + 10))); }
+        in += 16 * n;
+        out += 16 * n;
+        rkIn += n;
+        nBlocks -= n;
+    }
+}
+
+/**
+ * @brief   derive the decryption schedule for aesdec:
+ *          reverse order with aesimc applied to the middle round keys
+ */
+OTAESGCM_TARGET_AESNI
+void OTAES128DE_AESNI::invertKey(const uint8_t *rkIn, uint8_t *drkOut)
+{
+    const __m128i *const r = (const __m128i *)rkIn;
+    __m128i *const d = (__m128i *)drkOut;
+    _mm_storeu_si128(d, _mm_loadu_si128(r + 10));
+    for(uint8_t i = 1; i < 10; ++i)
+        { _mm_storeu_si128(d + i, _mm_aesimc_si128(_mm_loadu_si128(r + 10 - i))); }
+    _mm_storeu_si128(d + 10, _mm_loadu_si128(r));
+}
+
+/**
+ * @brief   decrypt nBlocks, PIPELINE_BLOCKS at a time where possible
+ */
+OTAESGCM_TARGET_AESNI
+void OTAES128DE_AESNI::decryptBlocks(const uint8_t *drkIn, const uint8_t *in, uint8_t *out, size_t nBlocks)
+{
+    const __m128i *const r = (const __m128i *)drkIn;
+    __m128i k[11];
+    for(uint8_t i = 0; i < 11; ++i) { k[i] = _mm_loadu_si128(r + i); }
+
+    for( ; nBlocks >= PIPELINE_BLOCKS; nBlocks -= PIPELINE_BLOCKS)
+    {
+        __m128i b0 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)in), k[0]);
+        __m128i b1 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(in + 16)), k[0]);
+        __m128i b2 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(in + 32)), k[0]);
+        __m128i b3 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(in + 48)), k[0]);
+        for(uint8_t i = 1; i < 10; ++i)
+        {
+            b0 = _mm_aesdec_si128(b0, k[i]);
+            b1 = _mm_aesdec_si128(b1, k[i]);
+            b2 = _mm_aesdec_si128(b2, k[i]);
+            b3 = _mm_aesdec_si128(b3, k[i]);
+        }
+        _mm_storeu_si128((__m128i *)out, _mm_aesdeclast_si128(b0, k[10]));
+        _mm_storeu_si128((__m128i *)(out + 16), _mm_aesdeclast_si128(b1, k[10]));
+        _mm_storeu_si128((__m128i *)(out + 32), _mm_aesdeclast_si128(b2, k[10]));
+        _mm_storeu_si128((__m128i *)(out + 48), _mm_aesdeclast_si128(b3, k[10]));
+        in += PIPELINE_BLOCKS * 16;
+        out += PIPELINE_BLOCKS * 16;
+    }
+    for( ; nBlocks > 0; --nBlocks)
+    {
+        __m128i b = _mm_xor_si128(_mm_loadu_si128((const __m128i *)in), k[0]);
+        for(uint8_t i = 1; i < 10; ++i) { b = _mm_aesdec_si128(b, k[i]); }
+        _mm_storeu_si128((__m128i *)out, _mm_aesdeclast_si128(b, k[10]));
+        in += 16;
+        out += 16;
+    }
+    // Don't leave round keys on the stack;
+    // volatile so that the stores to this dead local are not elided.
+    volatile __m128i *const kv = k;
+    for(uint8_t i = 0; i < 11; ++i) { kv[i] = _mm_setzero_si128(); }
+}
+
+
+/*****************************************************************************/
+/* Public functions:                                                         */
+/*****************************************************************************/
+
+/**
+ *    @brief    start keyed session: expand the round keys once into the workspace
+ *    @retval   true if the session was started, false if no workspace or key
+ */
+bool OTAES128E_AESNI::setKey(const uint8_t *key)
+{
+    // Abort if no workspace to avoid crashing.
+    if((NULL == rk) || (NULL == key)) { return(false); }
+    expandKey(key, rk);
+    keyed = true;
+    return(true);
+}
+
+/**
+ *    @brief    AES128 block encryption
+ *
+ * One-block session.
+ * Cleans up internal sensitive state when done.
+ */
+void OTAES128E_AESNI::blockEncrypt(const uint8_t* input, const uint8_t* key, uint8_t *output)
+{
+    // Abort if no workspace to avoid crashing..
+    if(!OTAES128E_AESNI::setKey(key)) { return; }
+    encryptBlocks(rk, input, output, 1);
+    // Clean up private state.
+    OTAES128E_AESNI::cleanup();
+}
+
+/**
+ *    @brief    start keyed session: expand both round-key schedules once
+ *    @retval   true if the session was started, false if no workspace or key
+ */
+bool OTAES128DE_AESNI::setKey(const uint8_t *key)
+{
+    if(!OTAES128E_AESNI::setKey(key)) { return(false); }
+    invertKey(rk, drk);
+    return(true);
+}
+
+/**
+ *    @brief    AES128 block decryption
+ *
+ * One-block session.
+ * Cleans up internal sensitive state when done.
+ */
+void OTAES128DE_AESNI::blockDecrypt(const uint8_t* input, const uint8_t* key, uint8_t *output)
+{
+    // Abort if no workspace to avoid crashing..
+    if(!setKey(key)) { return; }
+    decryptBlocks(drk, input, output, 1);
+    // Clean up private state.
+    cleanup();
+}
+
+
+    }
+
+#endif // defined(OTAESGCM_X86_INTRINSICS)
@@ -0,0 +1,241 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Deniz Erbilgin 2015--2017
+                           Damon Hart-Davis 2015--2017
+*/
+
+/* x86 AES-NI AES(128) implementation, and run-time dispatch to it. */
+
+#ifndef ARDUINO_LIB_OTAESGCM_OTAES128AESNI_H
+#define ARDUINO_LIB_OTAESGCM_OTAES128AESNI_H
+
+#include <stdint.h>
+#include <string.h>
+#include "OTAESGCM_OTAES128.h"
+#include "OTAESGCM_CPUFeatures.h"
+#include "OTAESGCM_OTAES128TTable.h"
+#include "OTAESGCM_OTAES128VPerm.h"
+
+#if defined(OTAESGCM_X86_INTRINSICS)
+
+// Use namespaces to help avoid collisions.
+namespace OTAESGCM
+    {
+
+
+    // AES-NI encrypt-only implementation.
+    // Constant-time, and pipelines several independent blocks in encryptBlocks().
+    // Must only be used if cpuHasAESNI() is true,
+    // else will fault with an illegal instruction;
+    // use OTAES128E_RuntimeDispatch to select automatically.
+    // Neither re-entrant nor ISR-safe except where stated.
+    // Carries workspace but logically no state is carried from one operation to the next,
+    // except the expanded key between setKey() and endSession().
+    // Residual state should be regarded as sensitive, and eg overwritten before being released to heap.
+    class OTAES128E_AESNI : public OTAES128E
+        {
+        protected:
+            // Size of the expanded (encryption) key (bytes), 11 x 128 bits.
+            static constexpr uint8_t RoundKeySize = 176;
+
+            // Round keys within the caller's workspace, no alignment needed;
+            // NULL if insufficient workspace is passed in.
+            uint8_t * const rk;
+            // True while a keyed session is active.
+            bool keyed = false;
+
+        public:
+            // Minimum workspace required, unaligned; strictly positive.
+            // This constant, defined per class, is effectively part of the API.
+            static constexpr size_t workspaceRequired = RoundKeySize;
+
+            // Construct an instance: supplied workspace must be large enough.
+            OTAES128E_AESNI(uint8_t *const workspace, const size_t workspaceLen)
+              : rk(((NULL == workspace) || (workspaceLen < workspaceRequired)) ? NULL : workspace)
+                { }
+
+            // Expand a 16-byte key into RoundKeySize bytes at rkOut using aeskeygenassist.
+            static void expandKey(const uint8_t *key, uint8_t *rkOut);
+            // Encrypt nBlocks with the expanded key; in and out may be the same.
+            static void encryptBlocks(const uint8_t *rkIn, const uint8_t *in, uint8_t *out, size_t nBlocks);
+            // Encrypt nBlocks, block i with the expanded key rkIn[i],
+            // interleaving blocks of different keys (eg of independent GCM frames)
+            // to keep the pipeline full; in and out may be the same.
+            static void encryptBlocksMultiKey(const uint8_t *const *rkIn, const uint8_t *in, uint8_t *out, size_t nBlocks);
+
+            // Clean up sensitive state.
+            void cleanup() { if((NULL != rk) && keyed)
+                { memset(rk, 0, RoundKeySize); keyed = false; } }
+
+            // One-block session; cleans up internal sensitive state when done.
+            virtual void blockEncrypt(const uint8_t* input, const uint8_t* key, uint8_t *output) override;
+
+            // Keyed session: the round keys are expanded once by setKey()
+            // and retained in the workspace until endSession()/cleanup().
+            virtual bool setKey(const uint8_t *key) override;
+            virtual void encryptBlocks(const uint8_t *input, uint8_t *output, size_t nBlocks) override
+                { if(keyed) { encryptBlocks(rk, input, output, nBlocks); } }
+            virtual void endSession() override { cleanup(); }
+
+            // Expanded key of the active session, else NULL; for stitched GCM kernels.
+            const uint8_t *sessionRoundKeys() const { return(keyed ? rk : NULL); }
+        };
+
+    // AES-NI decrypt and encrypt implementation.
+    // Decryption uses aesdec with the equivalent inverse cipher schedule
+    // (aesimc applied to the middle round keys), derived once per setKey().
+    // Must only be used if cpuHasAESNI() is true.
+    class OTAES128DE_AESNI final : public OTAES128D, public OTAES128E_AESNI
+        {
+        public:
+            // External workspace/scratch required minimum size, unaligned; strictly positive.
+            // This constant, defined per class, is effectively part of the API.
+            static constexpr size_t workspaceRequired = 2 * (size_t)RoundKeySize;
+
+        protected:
+            // Decryption round keys, immediately following the encryption keys.
+            uint8_t * const drk;
+
+        public:
+            // Construct an instance: supplied workspace must be large enough.
+            OTAES128DE_AESNI(uint8_t *const workspace, const size_t workspaceLen)
+              : OTAES128E_AESNI(workspace, (workspaceLen >= workspaceRequired) ? workspaceLen : 0),
+                drk((NULL == rk) ? NULL : rk + RoundKeySize)
+                { }
+
+            // Derive the decryption schedule from the encryption one.
+            static void invertKey(const uint8_t *rkIn, uint8_t *drkOut);
+            // Decrypt nBlocks with the inverted key; in and out may be the same.
+            static void decryptBlocks(const uint8_t *drkIn, const uint8_t *in, uint8_t *out, size_t nBlocks);
+
+            // Clean up sensitive state.
+            void cleanup() { if((NULL != drk) && keyed)
+                { memset(drk, 0, RoundKeySize); } OTAES128E_AESNI::cleanup(); }
+
+            // One-block session; cleans up internal sensitive state when done.
+            virtual void blockDecrypt(const uint8_t* input, const uint8_t* key, uint8_t *output) override;
+
+            // Keyed session shared with encryption.
+            virtual bool setKey(const uint8_t *key) override;
+            virtual void decryptBlocks(const uint8_t *input, uint8_t *output, size_t nBlocks) override
+                { if(keyed) { decryptBlocks(drk, input, output, nBlocks); } }
+            virtual void endSession() override { cleanup(); }
+        };
+
+    // Larger of two workspace sizes.
+    constexpr size_t maxWorkspace(const size_t a, const size_t b) { return((a > b) ? a : b); }
+
+    // Run-time dispatch: uses AES-NI if the CPU supports it,
+    // else the constant-time vector-permute implementation if the CPU has SSSE3,
+    // else falls back to the portable T-table implementation.
+    // The CPU checks are made once per process (see cpuHasAESNI()),
+    // and the choice is fixed at construction.
+    // All candidates share the one workspace, only one being used.
+    // Neither re-entrant nor ISR-safe except where stated.
+    class OTAES128E_RuntimeDispatch : public OTAES128E
+        {
+        private:
+            OTAES128E_AESNI hw;
+            OTAES128E_VPerm vp;
+            OTAES128E_TTable sw;
+            // Selected implementation; never NULL.
+            OTAES128E * const impl;
+
+        public:
+            // Minimum workspace required: enough for any candidate.
+            static constexpr size_t workspaceRequired =
+                maxWorkspace(OTAES128E_AESNI::workspaceRequired,
+                    maxWorkspace(OTAES128E_VPerm::workspaceRequired, OTAES128E_TTable::workspaceRequired));
+
+            // Construct an instance: supplied workspace must be large enough.
+            // If allowHardware is false then the portable implementation
+            // is always used, eg for testing.
+            OTAES128E_RuntimeDispatch(uint8_t *const workspace, const size_t workspaceLen, const bool allowHardware = true)
+              : hw(workspace, workspaceLen), vp(workspace, workspaceLen), sw(workspace, workspaceLen),
+                impl(!allowHardware ? static_cast<OTAES128E *>(&sw) :
+                     cpuHasAESNI() ? static_cast<OTAES128E *>(&hw) :
+                     cpuHasSSSE3() ? static_cast<OTAES128E *>(&vp) : static_cast<OTAES128E *>(&sw))
+                { }
+
+            // True if the hardware implementation was selected.
+            bool isHardware() const { return(impl == &hw); }
+            // AES-NI expanded key of the active session, else NULL.
+            const uint8_t *sessionRoundKeysHW() const { return(isHardware() ? hw.sessionRoundKeys() : NULL); }
+
+            virtual void blockEncrypt(const uint8_t* input, const uint8_t* key, uint8_t *output) override
+                { impl->blockEncrypt(input, key, output); }
+            virtual bool setKey(const uint8_t *key) override { return(impl->setKey(key)); }
+            virtual void encryptBlocks(const uint8_t *input, uint8_t *output, size_t nBlocks) override
+                { impl->encryptBlocks(input, output, nBlocks); }
+            virtual void ctrKeystream(uint8_t *ctrBlock, uint8_t *output, size_t nBlocks) override
+                { impl->ctrKeystream(ctrBlock, output, nBlocks); }
+            virtual void endSession() override { impl->endSession(); }
+        };
+
+    // Run-time dispatch, decrypt and encrypt:
+    // AES-NI if available, else vector-permute with SSSE3, else T-table.
+    class OTAES128DE_RuntimeDispatch : public OTAES128D, public OTAES128E
+        {
+        private:
+            OTAES128DE_AESNI hw;
+            OTAES128DE_VPerm vp;
+            OTAES128DE_TTable sw;
+            // Selected implementation, as each interface; never NULL.
+            OTAES128E * const implE;
+            OTAES128D * const implD;
+
+        public:
+            // Minimum workspace required: enough for any candidate.
+            static constexpr size_t workspaceRequired =
+                maxWorkspace(OTAES128DE_AESNI::workspaceRequired,
+                    maxWorkspace(OTAES128DE_VPerm::workspaceRequired, OTAES128DE_TTable::workspaceRequired));
+
+            // Construct an instance: supplied workspace must be large enough.
+            // If allowHardware is false then the portable implementation
+            // is always used, eg for testing.
+            OTAES128DE_RuntimeDispatch(uint8_t *const workspace, const size_t workspaceLen, const bool allowHardware = true)
+              : hw(workspace, workspaceLen), vp(workspace, workspaceLen), sw(workspace, workspaceLen),
+                implE(!allowHardware ? static_cast<OTAES128E *>(&sw) :
+                      cpuHasAESNI() ? static_cast<OTAES128E *>(&hw) :
+                      cpuHasSSSE3() ? static_cast<OTAES128E *>(&vp) : static_cast<OTAES128E *>(&sw)),
+                implD(!allowHardware ? static_cast<OTAES128D *>(&sw) :
+                      cpuHasAESNI() ? static_cast<OTAES128D *>(&hw) :
+                      cpuHasSSSE3() ? static_cast<OTAES128D *>(&vp) : static_cast<OTAES128D *>(&sw))
+                { }
+
+            // True if the hardware implementation was selected.
+            bool isHardware() const { return(implE == &hw); }
+
+            virtual void blockEncrypt(const uint8_t* input, const uint8_t* key, uint8_t *output) override
+                { implE->blockEncrypt(input, key, output); }
+            virtual void blockDecrypt(const uint8_t* input, const uint8_t* key, uint8_t *output) override
+                { implD->blockDecrypt(input, key, output); }
+            virtual bool setKey(const uint8_t *key) override { return(implD->setKey(key)); }
+            virtual void encryptBlocks(const uint8_t *input, uint8_t *output, size_t nBlocks) override
+                { implE->encryptBlocks(input, output, nBlocks); }
+            virtual void decryptBlocks(const uint8_t *input, uint8_t *output, size_t nBlocks) override
+                { implD->decryptBlocks(input, output, nBlocks); }
+            virtual void ctrKeystream(uint8_t *ctrBlock, uint8_t *output, size_t nBlocks) override
+                { implE->ctrKeystream(ctrBlock, output, nBlocks); }
+            virtual void endSession() override { implD->endSession(); }
+        };
+
+
+    }
+
+#endif // defined(OTAESGCM_X86_INTRINSICS)
+
+#endif
@@ -95,12 +95,8 @@ NOTE:   String length must be evenly divisible by 16byte (str_len % 16 == 0)
 // the size of the AES block in bytes. (128/8)
 #define AES_BLOCK_SIZE 16
 
-// jcallan@github points out that declaring Multiply as a function
-// reduces code size considerably with the Keil ARM compiler.
-// See this link for more information: https://github.com/kokke/tiny-AES128-C/pull/3
-#ifndef MULTIPLY_AS_A_FUNCTION
-  #define MULTIPLY_AS_A_FUNCTION 0
-#endif
+// Intermediate results, column by column.
+typedef uint8_t state_t[4][4];
 
 
 /*****************************************************************************/
@@ -255,9 +251,21 @@ void OTAES128E_AVR::KeyExpansion(void)
  * @todo    is it worth removing nested loop? matrix should be stored in consecutive memory locations anyway
  * @param    round    current AES encryption round
  */
-void OTAES128E_AVR::AddRoundKey(uint8_t round)
+void OTAES128E_AVR::AddRoundKey(state_t *state, uint8_t round) const
 {
   uint8_t i,j;
+  if(NULL != FlashRoundKey)
+  {
+    const uint8_t *rk = FlashRoundKey + round * Nb * 4;
+    for(i=0;i<4;++i)
+    {
+      for(j = 0; j < 4; ++j)
+      {
+        (*state)[i][j] ^= pgm_read_byte(rk++);
+      }
+    }
+    return;
+  }
   for(i=0;i<4;++i)
   {
     for(j = 0; j < 4; ++j)
@@ -271,7 +279,7 @@ void OTAES128E_AVR::AddRoundKey(uint8_t round)
  * @brief    Substitute state matrix values with S-box values
  * @todo    is it worth removing nested loop? matrix should be stored in consecutive memory locations anyway
  */
-void OTAES128E_AVR::SubBytes(void)
+static void SubBytes(state_t *state)
 {
   uint8_t i, j;
   for(i = 0; i < 4; ++i)
@@ -287,7 +295,7 @@ void OTAES128E_AVR::SubBytes(void)
  * @brief    shifts rows in state to the left by the row number (first row not shifted, last row shifted by 3)
  * @todo    is it worth removing nested loop? matrix should be stored in consecutive memory locations anyway
  */
-void OTAES128E_AVR::ShiftRows(void)
+static void ShiftRows(state_t *state)
 {
   uint8_t temp;
 
@@ -323,34 +331,11 @@ static uint8_t xtime(uint8_t x)
   return(uint8_t((x<<1) ^ (((x>>7) & 1) * 0x1b)));
 }
 
-/**
- * @todo    work out what to do about this
- */
-// Multiply is used to multiply numbers in the field GF(2^8)
-#if MULTIPLY_AS_A_FUNCTION
-static uint8_t Multiply(uint8_t x, uint8_t y)
-{
-  return (((y & 1) * x) ^
-       ((y>>1 & 1) * xtime(x)) ^
-       ((y>>2 & 1) * xtime(xtime(x))) ^
-       ((y>>3 & 1) * xtime(xtime(xtime(x)))) ^
-       ((y>>4 & 1) * xtime(xtime(xtime(xtime(x))))));
-  }
-#else
-#define Multiply(x, y)                                \
-      (  ((y & 1) * x) ^                              \
-      ((y>>1 & 1) * xtime(x)) ^                       \
-      ((y>>2 & 1) * xtime(xtime(x))) ^                \
-      ((y>>3 & 1) * xtime(xtime(xtime(x)))) ^         \
-      ((y>>4 & 1) * xtime(xtime(xtime(xtime(x))))))   \
-
-#endif
-
 /**
  * @brief    mixes columns according AES spec
  * @todo    better description
  */
-void OTAES128E_AVR::MixColumns(void)
+static void MixColumns(state_t *state)
 {
   uint8_t i;
   uint8_t Tmp,Tm,t;
@@ -368,29 +353,78 @@ void OTAES128E_AVR::MixColumns(void)
 /**
  * @brief    encrypts one 128 bit block
  */
-void OTAES128E_AVR::Cipher(void)
+void OTAES128E_AVR::Cipher(state_t *state) const
 {
   uint8_t round = 0;
 
   // Add the First round key to the state before starting the rounds.
-  AddRoundKey(0);
+  AddRoundKey(state, 0);
 
   // There will be Nr rounds.
   // The first Nr-1 rounds are identical.
   // These Nr-1 rounds are executed in the loop below.
   for(round = 1; round < Nr; ++round)
   {
-    SubBytes();
-    ShiftRows();
-    MixColumns();
-    AddRoundKey(round);
+    SubBytes(state);
+    ShiftRows(state);
+    MixColumns(state);
+    AddRoundKey(state, round);
   }
 
   // The last round is given below.
   // The MixColumns function is not here in the last round.
-  SubBytes();
-  ShiftRows();
-  AddRoundKey(Nr);
+  SubBytes(state);
+  ShiftRows(state);
+  AddRoundKey(state, Nr);
+}
+
+/**
+ * @brief    XOR a 16-byte round key into the block
+ */
+static void AddRollingKey(uint8_t *block, const uint8_t *rk)
+{
+  for(uint8_t i = 0; i < AES_BLOCK_SIZE; ++i)
+  {
+    block[i] ^= rk[i];
+  }
+}
+
+/**
+ * @brief    advances a rolling round key in place from one round to the next
+ * @param    rk      round key of the previous round, replaced with that of this round
+ * @param    round   this round, 1 to Nr
+ */
+static void NextRoundKey(uint8_t *rk, uint8_t round)
+{
+  // First word: RotWord(), SubWord() and Rcon on the last word of the previous round key.
+  rk[0] = uint8_t(rk[0] ^ getSBoxValue(rk[13]) ^ pgm_read_byte(&Rcon[round]));
+  rk[1] ^= getSBoxValue(rk[14]);
+  rk[2] ^= getSBoxValue(rk[15]);
+  rk[3] ^= getSBoxValue(rk[12]);
+  // Each later word folds in the new word before it.
+  for(uint8_t i = 4; i < 16; ++i)
+  {
+    rk[i] ^= rk[i - 4];
+  }
+}
+
+/**
+ * @brief    steps a rolling round key in place back from one round to the previous
+ * @param    rk      round key of this round, replaced with that of the previous round
+ * @param    round   this round, 1 to Nr
+ */
+static void PrevRoundKey(uint8_t *rk, uint8_t round)
+{
+  // Undo the later words first, from the end, while the words before are still new.
+  for(uint8_t i = 15; i >= 4; --i)
+  {
+    rk[i] ^= rk[i - 4];
+  }
+  // The last word of the previous round key is now restored.
+  rk[0] = uint8_t(rk[0] ^ getSBoxValue(rk[13]) ^ pgm_read_byte(&Rcon[round]));
+  rk[1] ^= getSBoxValue(rk[14]);
+  rk[2] ^= getSBoxValue(rk[15]);
+  rk[3] ^= getSBoxValue(rk[12]);
 }
 
 //#ifndef NO_DECRYPT
@@ -410,32 +444,34 @@ static uint8_t getSBoxInvert(uint8_t num)
 
 /**
  * @brief    inverse mix columns for unencrypting data
+ *
+ * The InvMixColumns polynomial {0b}x^3 + {0d}x^2 + {09}x + {0e}
+ * is the MixColumns one times {04}x^2 + {05},
+ * so multiply each column by the latter (two xtime()s per pair of bytes)
+ * then use MixColumns, avoiding generic GF(2^8) multiplications.
+ * See "The Design of Rijndael" (Daemen & Rijmen) section 4.1.3.
  */
-void OTAES128DE_AVR::InvMixColumns(void)
+static void InvMixColumns(state_t *state)
 {
-    // The method used to multiply may be difficult to understand for the inexperienced.
-    // Please use the references to gain more information.
-  int i;
-  uint8_t a,b,c,d;
+  uint8_t i;
+  uint8_t u,v;
   for(i=0;i<4;++i)
   {
-    a = (*state)[i][0];
-    b = (*state)[i][1];
-    c = (*state)[i][2];
-    d = (*state)[i][3];
-
-    (*state)[i][0] = Multiply(a, 0x0e) ^ Multiply(b, 0x0b) ^ Multiply(c, 0x0d) ^ Multiply(d, 0x09);
-    (*state)[i][1] = Multiply(a, 0x09) ^ Multiply(b, 0x0e) ^ Multiply(c, 0x0b) ^ Multiply(d, 0x0d);
-    (*state)[i][2] = Multiply(a, 0x0d) ^ Multiply(b, 0x09) ^ Multiply(c, 0x0e) ^ Multiply(d, 0x0b);
-    (*state)[i][3] = Multiply(a, 0x0b) ^ Multiply(b, 0x0d) ^ Multiply(c, 0x09) ^ Multiply(d, 0x0e);
+    u = xtime(xtime(uint8_t((*state)[i][0] ^ (*state)[i][2])));
+    v = xtime(xtime(uint8_t((*state)[i][1] ^ (*state)[i][3])));
+    (*state)[i][0] ^= u;
+    (*state)[i][1] ^= v;
+    (*state)[i][2] ^= u;
+    (*state)[i][3] ^= v;
   }
+  MixColumns(state);
 }
 
 
 /**
  * @brief    inverses S-box substitution of state
  */
-void OTAES128DE_AVR::InvSubBytes(void)
+static void InvSubBytes(state_t *state)
 {
   uint8_t i,j;
   for(i=0;i<4;++i)
@@ -450,7 +486,7 @@ void OTAES128DE_AVR::InvSubBytes(void)
 /**
  * @brief    inverse of shiftRows
  */
-void OTAES128DE_AVR::InvShiftRows(void)
+static void InvShiftRows(state_t *state)
 {
   uint8_t temp;
 
@@ -481,29 +517,29 @@ void OTAES128DE_AVR::InvShiftRows(void)
 /**
  * @brief    decrypts one 128 bit block
  */
-void OTAES128DE_AVR::InvCipher(void)
+void OTAES128DE_AVR::InvCipher(state_t *state) const
 {
   uint8_t round=0;
 
   // Add the First round key to the state before starting the rounds.
-  AddRoundKey(Nr);
+  AddRoundKey(state, Nr);
 
   // There will be Nr rounds.
   // The first Nr-1 rounds are identical.
   // These Nr-1 rounds are executed in the loop below.
   for(round=Nr-1;round>0;round--)
   {
-    InvShiftRows();
-    InvSubBytes();
-    AddRoundKey(round);
-    InvMixColumns();
+    InvShiftRows(state);
+    InvSubBytes(state);
+    AddRoundKey(state, round);
+    InvMixColumns(state);
   }
 
   // The last round is given below.
   // The MixColumns function is not here in the last round.
-  InvShiftRows();
-  InvSubBytes();
-  AddRoundKey(0);
+  InvShiftRows(state);
+  InvSubBytes(state);
+  AddRoundKey(state, 0);
 }
 //#endif // NO_DECRYPT
 
@@ -513,30 +549,105 @@ void OTAES128DE_AVR::InvCipher(void)
 /* Public functions:                                                         */
 /*****************************************************************************/
 
+/**
+ *    @brief    start keyed session: expand the round keys once into the workspace
+ *    @param    key takes a pointer to a 128bit secret key
+ *    @retval   true if the session was started, false if no workspace or key
+ *
+ * The round keys are retained until endSession() (ie cleanup()) is called.
+ */
+bool OTAES128E_AVR::setKey(const uint8_t *key)
+{
+  // Abort if no workspace to avoid crashing.
+  if((NULL == RoundKey) || (NULL == key)) { return(false); }
+
+  // The KeyExpansion routine must be called before encryption.
+  Key = key;
+  KeyExpansion();
+  return(true);
+}
+
+/**
+ *    @brief    start keyed session with round keys expanded in advance
+ *    @param    roundKeys takes a pointer to the 176-byte expanded key schedule in flash
+ *    @retval   true if the session was started, false if roundKeys is NULL
+ *
+ * The schedule is read in place (from PROGMEM on AVR) and never copied to RAM.
+ */
+bool OTAES128E_AVRFixed::setKey(const uint8_t *roundKeys)
+{
+  cleanup();
+  if(NULL == roundKeys) { return(false); }
+
+  // The first round key is the key itself, and marks a live session.
+  FlashRoundKey = roundKeys;
+  Key = roundKeys;
+  return(true);
+}
+
+/**
+ *    @brief    AES128 encryption of whole blocks with the session round keys
+ *    @param    input takes a pointer to an array containing plaintext
+ *    @param    output takes a pointer to an array to fill with ciphertext
+ *    @param    nBlocks number of 16 byte blocks to encrypt
+ */
+void OTAES128E_AVR::encryptBlocks(const uint8_t *input, uint8_t *output, size_t nBlocks)
+{
+  // Abort if no session to avoid crashing or leaking.
+  if(NULL == Key) { return; }
+
+  for( ; nBlocks > 0; --nBlocks)
+  {
+    // Copy input to output, and work in-memory on output.
+    if(input != output) { memcpy(output, input, AES_BLOCK_SIZE); }
+
+    // Encrypt the plaintext with the Key using the AES algorithm.
+    Cipher((state_t*)output);
+
+    input += AES_BLOCK_SIZE;
+    output += AES_BLOCK_SIZE;
+  }
+}
+
+/**
+ *    @brief    AES128 decryption of whole blocks with the session round keys
+ *    @param    input takes a pointer to an array containing ciphertext
+ *    @param    output takes a pointer to an array to fill with plaintext
+ *    @param    nBlocks number of 16 byte blocks to decrypt
+ */
+void OTAES128DE_AVR::decryptBlocks(const uint8_t *input, uint8_t *output, size_t nBlocks)
+{
+  // Abort if no session to avoid crashing or leaking.
+  if((NULL == RoundKey) || (NULL == Key)) { return; }
+
+  for( ; nBlocks > 0; --nBlocks)
+  {
+    // Copy input to output, and work in-memory on output.
+    if(input != output) { memcpy(output, input, AES_BLOCK_SIZE); }
+
+    InvCipher((state_t*)output);
+
+    input += AES_BLOCK_SIZE;
+    output += AES_BLOCK_SIZE;
+  }
+}
+
 /**
  *    @brief    AES128 block encryption
  *    @param    input takes a pointer to an array containing plaintext
  *    @param    key takes a pointer to a 128bit secret key
  *    @param    output takes a pointer to an array to fill with ciphertext
  *
+ * One-block session.
  * Cleans up internal sensitive state when done.
  */
 void OTAES128E_AVR::blockEncrypt(const uint8_t* input, const uint8_t* key, uint8_t* output)
 {
   // Abort if no workspace to avoid crashing..
   // TODO: find a way of signalling the problem.
-  if(NULL == RoundKey) { return; }
-
-  // Copy input to output, and work in-memory on output.
-  //BlockCopy(output, input);
-  memcpy(output, input, AES_BLOCK_SIZE);
-  state = (state_t*)output;
-
-  Key = key;
-  KeyExpansion();
+  if(!setKey(key)) { return; }
 
-  // Encrypt the plaintext with the Key using the AES algorithm.
-  Cipher();
+  encryptBlocks(input, output, 1);
 
   // Clean up private state.
   cleanup();
@@ -549,24 +660,91 @@ void OTAES128E_AVR::blockEncrypt(const uint8_t* input, const uint8_t* key, uint8
  *    @param    key takes a pointer to a 128bit secret key
  *    @param    output takes a pointer to an array to fill with plaintext
  *
+ * One-block session.
  * Cleans up internal sensitive state when done.
  */
 void OTAES128DE_AVR::blockDecrypt(const uint8_t* input, const uint8_t* key, uint8_t *output)
 {
   // Abort if no workspace to avoid crashing..
   // TODO: find a way of signalling the problem.
-  if(NULL == RoundKey) { return; }
+  if(!setKey(key)) { return; }
 
-  // Copy input to output, and work in-memory on output.
-  //BlockCopy(output, input);
-  memcpy(output, input, AES_BLOCK_SIZE);
-  state = (state_t*)output;
+  decryptBlocks(input, output, 1);
 
-  // The KeyExpansion routine must be called before encryption.
-  Key = key;
-  KeyExpansion();
+  // Clean up private state.
+  cleanup();
+}
+
+/**
+ *    @brief    start keyed session: copy the key into the rolling round key
+ *    @param    key takes a pointer to a 128bit secret key
+ *    @retval   true if the session was started, false if no workspace or key
+ */
+bool OTAES128E_AVRSmall::setKey(const uint8_t *key)
+{
+  // Abort if no workspace to avoid crashing.
+  if((NULL == rk) || (NULL == key)) { return(false); }
+
+  // The first round key is the key itself.
+  memcpy(rk, key, KEYLEN);
+  keyed = true;
+  return(true);
+}
+
+/**
+ *    @brief    AES128 encryption of whole blocks deriving round keys on the fly
+ *    @param    input takes a pointer to an array containing plaintext
+ *    @param    output takes a pointer to an array to fill with ciphertext
+ *    @param    nBlocks number of 16 byte blocks to encrypt
+ */
+void OTAES128E_AVRSmall::encryptBlocks(const uint8_t *input, uint8_t *output, size_t nBlocks)
+{
+  // Abort if no session to avoid crashing or leaking.
+  if(!keyed) { return; }
+
+  for( ; nBlocks > 0; --nBlocks)
+  {
+    // Copy input to output, and work in-memory on output.
+    if(input != output) { memcpy(output, input, AES_BLOCK_SIZE); }
+    state_t *const state = (state_t*)output;
+
+    AddRollingKey(output, rk);
+    for(uint8_t round = 1; round <= Nr; ++round)
+    {
+      SubBytes(state);
+      ShiftRows(state);
+      // The MixColumns function is not in the last round.
+      if(round < Nr) { MixColumns(state); }
+      NextRoundKey(rk, round);
+      AddRollingKey(output, rk);
+    }
+
+    // Run the schedule back to the key itself for the next block.
+    for(uint8_t round = Nr; round > 0; --round)
+    {
+      PrevRoundKey(rk, round);
+    }
+
+    input += AES_BLOCK_SIZE;
+    output += AES_BLOCK_SIZE;
+  }
+}
+
+/**
+ *    @brief    AES128 block encryption
+ *    @param    input takes a pointer to an array containing plaintext
+ *    @param    key takes a pointer to a 128bit secret key
+ *    @param    output takes a pointer to an array to fill with ciphertext
+ *
+ * One-block session.
+ * Cleans up internal sensitive state when done.
+ */
+void OTAES128E_AVRSmall::blockEncrypt(const uint8_t* input, const uint8_t* key, uint8_t* output)
+{
+  // Abort if no workspace to avoid crashing..
+  if(!setKey(key)) { return; }
 
-  InvCipher();
+  encryptBlocks(input, output, 1);
 
   // Clean up private state.
   cleanup();
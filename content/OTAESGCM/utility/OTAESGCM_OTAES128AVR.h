@@ -35,7 +35,10 @@ namespace OTAESGCM
 
     // AVR (8-bit MCU optimised) encrypt-only implementation.
     // Neither re-entrant nor ISR-safe except where stated.
-    // Carries workspace but logically no state is carried from one operation to the next.
+    // Carries workspace but logically no state is carried from one operation to the next,
+    // except the expanded key between setKey() and endSession().
+    // Once keyed, encryptBlocks() only reads the instance and workspace,
+    // so may be called concurrently on one instance (see OTAESGCMReadOnlyWhenKeyed).
     // Residual state should be regarded as sensitive, and eg overwritten before being released to heap.
     class OTAES128E_AVR : public OTAES128E
         {
@@ -43,24 +46,26 @@ namespace OTAESGCM
             // Size of RoundKey (bytes).
             static constexpr uint8_t RoundKeySize = 176;
 
-            // The AES key (128 bits, 16 bytes); never NULL.
+            // The AES key (128 bits, 16 bytes); NULL when no key is set up.
             // Note that Key is space passed in by caller.
+            // Only read during KeyExpansion(); thereafter marks a live session.
             const uint8_t *Key = NULL;
-            // Intermediate results during decryption.
+            // Intermediate results during encryption/decryption,
+            // held in the caller's output buffer so that
+            // (once keyed) encryption writes nothing in the instance.
             typedef uint8_t state_t[4][4];
-            // Note that state is space passed in by caller.
-            state_t *state = NULL;
             // Nr+1 round keys; NULL if insufficient workspace is passed in.
             // Should be cleared before releasing space to (say) heap.
             //uint8_t RoundKey[RoundKeySize];
             uint8_t * const RoundKey;
+            // Nr+1 round keys expanded in advance and held in flash
+            // (PROGMEM on AVR), used instead of RoundKey when not NULL;
+            // see OTAES128E_AVRFixed.
+            const uint8_t *FlashRoundKey = NULL;
 
             void KeyExpansion();
-            void AddRoundKey(uint8_t round);
-            void SubBytes();
-            void ShiftRows();
-            void MixColumns();
-            void Cipher();
+            void AddRoundKey(state_t *state, uint8_t round) const;
+            void Cipher(state_t *state) const;
 
         public:
             // Minimum workspace required, unaligned; strictly positive.
@@ -78,8 +83,10 @@ namespace OTAESGCM
             // Clean up sensitive state and remove pointers to external state.
             // If the Key pointer is NULL then assume that the clear
             // is already have been done and need not be repeated.
-            void cleanup() { if((NULL != RoundKey) && (NULL != Key))
-                { memset(RoundKey, 0, RoundKeySize); state=NULL; Key=NULL; } }
+            // Round keys in flash are not (and cannot be) cleared.
+            void cleanup() { if(NULL != Key)
+                { if(NULL != RoundKey) { memset(RoundKey, 0, RoundKeySize); }
+                  Key=NULL; FlashRoundKey=NULL; } }
 
             /**
              *    @brief    AES128 block encryption
@@ -89,13 +96,97 @@ namespace OTAESGCM
              *
              * Cleans up internal sensitive state when done.
              */
-            virtual void blockEncrypt(const uint8_t* input, const uint8_t* key, uint8_t *output);
+            virtual void blockEncrypt(const uint8_t* input, const uint8_t* key, uint8_t *output) override;
 
+            // Keyed session: the round keys are expanded once by setKey()
+            // and retained in the workspace until endSession()/cleanup().
+            virtual bool setKey(const uint8_t *key) override;
+            virtual void encryptBlocks(const uint8_t *input, uint8_t *output, size_t nBlocks) override;
+            virtual void endSession() override { cleanup(); }
+        };
+
+    // AVR encrypt-only implementation for a key fixed at build time,
+    // reading round keys expanded in advance (eg at compile time with
+    // makeOTAES128GCMFixedKey()) directly from flash (PROGMEM on AVR).
+    // The 'key' passed to setKey() and blockEncrypt() is that 176-byte schedule,
+    // so there is no KeyExpansion() at run time and no RoundKey in RAM.
+    // Neither re-entrant nor ISR-safe except where stated.
+    // The key schedule in flash is not secret from anyone who can read the flash.
+    class OTAES128E_AVRFixed : public OTAES128E_AVR
+        {
+        public:
+            // Size of the expanded key schedule to pass to setKey() (bytes).
+            static constexpr uint8_t KeyScheduleSize = RoundKeySize;
+
+            // Nominal workspace: none is used, but the size is kept strictly positive.
+            // This constant, defined per class, is effectively part of the API.
+            static constexpr uint8_t workspaceRequired = 1;
+
+            // Construct an instance; any workspace passed in is ignored.
+            OTAES128E_AVRFixed(uint8_t *const /*workspace*/, uint8_t /*workspaceLen*/)
+              : OTAES128E_AVR(NULL, 0)
+                { }
+
+            // Keyed session: roundKeys is the 176-byte expanded key schedule
+            // in flash (PROGMEM on AVR), retained (not copied) until endSession().
+            virtual bool setKey(const uint8_t *roundKeys) override;
+        };
+
+    // AVR (8-bit MCU optimised) encrypt-only implementation with minimal workspace.
+    // Rather than the whole key schedule being expanded up front,
+    // each round key is derived just in time from a 16-byte rolling state,
+    // and the schedule is then run backwards to recover the key for the next block.
+    // Each block also runs the key schedule forwards and back (40 more S-box lookups),
+    // but needs 16 rather than 176 bytes of workspace,
+    // eg for MCUs with 2kB of RAM.
+    // The rolling state is written for each block, so a keyed instance cannot be shared.
+    // Neither re-entrant nor ISR-safe except where stated.
+    // Residual state should be regarded as sensitive, and eg overwritten before being released to heap.
+    class OTAES128E_AVRSmall : public OTAES128E
+        {
+        protected:
+            // Rolling round key within the caller's workspace, holding the key itself
+            // between blocks; NULL if insufficient workspace is passed in.
+            uint8_t * const rk;
+            // True while a keyed session is active.
+            bool keyed = false;
+
+        public:
+            // Minimum workspace required, unaligned; strictly positive.
+            // Just the one round key.
+            // This constant, defined per class, is effectively part of the API.
+            static constexpr uint8_t workspaceRequired = 16;
+
+            // Construct an instance: supplied workspace must be large enough.
+            OTAES128E_AVRSmall(uint8_t *const workspace, const size_t workspaceLen)
+              : rk(((NULL == workspace) || (workspaceLen < workspaceRequired)) ? NULL : workspace)
+                { }
+
+            // Clean up sensitive state.
+            void cleanup() { if(keyed) { memset(rk, 0, workspaceRequired); keyed = false; } }
+
+            /**
+             *    @brief    AES128 block encryption
+             *    @param    input takes a pointer to an array containing plaintext, of size 16 bytes; never NULL
+             *    @param    key takes a pointer to a 128-bit (16-byte) secret key; never NULL
+             *    @param    output takes a pointer to an array to fill with ciphertext, of size 16 bytes; never NULL
+             *
+             * Cleans up internal sensitive state when done.
+             */
+            virtual void blockEncrypt(const uint8_t* input, const uint8_t* key, uint8_t *output) override;
+
+            // Keyed session: the key is copied into the workspace by setKey()
+            // and retained until endSession()/cleanup().
+            virtual bool setKey(const uint8_t *key) override;
+            virtual void encryptBlocks(const uint8_t *input, uint8_t *output, size_t nBlocks) override;
+            virtual void endSession() override { cleanup(); }
         };
 
     // AVR decrypt and encrypt implementation.
     // Neither re-entrant nor ISR-safe except where stated.
-    // Carries workspace but logically no state is carried from one operation to the next.
+    // Carries workspace but logically no state is carried from one operation to the next,
+    // except the expanded key between setKey() and endSession().
+    // The same session serves both encryption and decryption.
     // Residual state should be regarded as sensitive, and eg overwritten before being released to heap.
     class OTAES128DE_AVR final : public OTAES128D, public OTAES128E_AVR
         {
@@ -106,10 +197,7 @@ namespace OTAESGCM
             static constexpr uint8_t workspaceRequired = OTAES128E_AVR::workspaceRequired;
 
         protected:
-            void InvMixColumns();
-            void InvSubBytes();
-            void InvShiftRows();
-            void InvCipher();
+            void InvCipher(state_t *state) const;
 
         public:
             // Expose (version of) base-class constructor.
@@ -123,7 +211,13 @@ namespace OTAESGCM
              *
              * Cleans up internal sensitive state when done.
              */
-            virtual void blockDecrypt(const uint8_t* input, const uint8_t* key, uint8_t *output);
+            virtual void blockDecrypt(const uint8_t* input, const uint8_t* key, uint8_t *output) override;
+
+            // Keyed session shared with encryption.
+            // Overriding here resolves the session methods of both interfaces.
+            virtual bool setKey(const uint8_t *key) override { return(OTAES128E_AVR::setKey(key)); }
+            virtual void decryptBlocks(const uint8_t *input, uint8_t *output, size_t nBlocks) override;
+            virtual void endSession() override { cleanup(); }
         };
 
 
@@ -0,0 +1,469 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Deniz Erbilgin 2015--2017
+                           Damon Hart-Davis 2015--2017
+*/
+
+
+/* Constant-time bitsliced AES(128) implementation for hosts. */
+
+#if !defined(__AVR_ARCH__) && !defined(ARDUINO_ARCH_AVR) // Not for Atmel AVR.
+
+#include <stdint.h>
+#include <string.h>
+
+#include "OTAESGCM_OTAES128.h"
+#include "OTAESGCM_OTAES128Bitsliced.h"
+
+
+// Use namespaces to help avoid collisions.
+namespace OTAESGCM
+    {
+
+
+/*
+
+Bitsliced AES128 on 64-bit words, after Käsper & Schwabe,
+"Faster and Timing-Attack Resistant AES-GCM" (CHES 2009),
+in the 64-bit form popularised by T. Pornin's BearSSL "ct64" code.
+
+The state of 4 blocks (64 bytes, 512 bits) is held in 8 words q[0..7],
+q[i] holding bit i of every byte, after an orthogonalisation (transpose).
+The S-box is the 113-gate circuit of Boyar & Peralta,
+"A depth-16 circuit for the AES S-box" (2011),
+so there are no table lookups and no data-dependent branches.
+ShiftRows and MixColumns become shifts and rotations within each word.
+
+The round keys are stored fully expanded (bitsliced, and replicated
+across the 4 block positions) so that AddRoundKey is 8 XORs.
+
+encrypt8() runs two independent sets of 4 blocks through each round
+together, giving the CPU two independent dependency chains.
+
+*/
+
+
+/*****************************************************************************/
+/* Bitsliced primitives:                                                     */
+/*****************************************************************************/
+
+// Boyar-Peralta S-box circuit on 8 bitsliced words, in place.
+// q[7] is the least significant bit of each byte, q[0] the most.
+static void sbox(uint64_t *q)
+{
+    uint64_t x0, x1, x2, x3, x4, x5, x6, x7;
+    uint64_t y1, y2, y3, y4, y5, y6, y7, y8, y9;
+    uint64_t y10, y11, y12, y13, y14, y15, y16, y17, y18, y19;
+    uint64_t y20, y21;
+    uint64_t z0, z1, z2, z3, z4, z5, z6, z7, z8, z9;
+    uint64_t z10, z11, z12, z13, z14, z15, z16, z17;
+    uint64_t t0, t1, t2, t3, t4, t5, t6, t7, t8, t9;
+    uint64_t t10, t11, t12, t13, t14, t15, t16, t17, t18, t19;
+    uint64_t t20, t21, t22, t23, t24, t25, t26, t27, t28, t29;
+    uint64_t t30, t31, t32, t33, t34, t35, t36, t37, t38, t39;
+    uint64_t t40, t41, t42, t43, t44, t45, t46, t47, t48, t49;
+    uint64_t t50, t51, t52, t53, t54, t55, t56, t57, t58, t59;
+    uint64_t t60, t61, t62, t63, t64, t65, t66, t67;
+    uint64_t s0, s1, s2, s3, s4, s5, s6, s7;
+
+    x0 = q[7]; x1 = q[6]; x2 = q[5]; x3 = q[4];
+    x4 = q[3]; x5 = q[2]; x6 = q[1]; x7 = q[0];
+
+    // Top linear transformation.
+    y14 = x3 ^ x5;
+    y13 = x0 ^ x6;
+    y9 = x0 ^ x3;
+    y8 = x0 ^ x5;
+    t0 = x1 ^ x2;
+    y1 = t0 ^ x7;
+    y4 = y1 ^ x3;
+    y12 = y13 ^ y14;
+    y2 = y1 ^ x0;
+    y5 = y1 ^ x6;
+    y3 = y5 ^ y8;
+    t1 = x4 ^ y12;
+    y15 = t1 ^ x5;
+    y20 = t1 ^ x1;
+    y6 = y15 ^ x7;
+    y10 = y15 ^ t0;
+    y11 = y20 ^ y9;
+    y7 = x7 ^ y11;
+    y17 = y10 ^ y11;
+    y19 = y10 ^ y8;
+    y16 = t0 ^ y11;
+    y21 = y13 ^ y16;
+    y18 = x0 ^ y16;
+
+    // Non-linear section.
+    t2 = y12 & y15;
+    t3 = y3 & y6;
+    t4 = t3 ^ t2;
+    t5 = y4 & x7;
+    t6 = t5 ^ t2;
+    t7 = y13 & y16;
+    t8 = y5 & y1;
+    t9 = t8 ^ t7;
+    t10 = y2 & y7;
+    t11 = t10 ^ t7;
+    t12 = y9 & y11;
+    t13 = y14 & y17;
+    t14 = t13 ^ t12;
+    t15 = y8 & y10;
+    t16 = t15 ^ t12;
+    t17 = t4 ^ t14;
+    t18 = t6 ^ t16;
+    t19 = t9 ^ t14;
+    t20 = t11 ^ t16;
+    t21 = t17 ^ y20;
+    t22 = t18 ^ y19;
+    t23 = t19 ^ y21;
+    t24 = t20 ^ y18;
+
+    t25 = t21 ^ t22;
+    t26 = t21 & t23;
+    t27 = t24 ^ t26;
+    t28 = t25 & t27;
+    t29 = t28 ^ t22;
+    t30 = t23 ^ t24;
+    t31 = t22 ^ t26;
+    t32 = t31 & t30;
+    t33 = t32 ^ t24;
+    t34 = t23 ^ t33;
+    t35 = t27 ^ t33;
+    t36 = t24 & t35;
+    t37 = t36 ^ t34;
+    t38 = t27 ^ t36;
+    t39 = t29 & t38;
+    t40 = t25 ^ t39;
+
+    t41 = t40 ^ t37;
+    t42 = t29 ^ t33;
+    t43 = t29 ^ t40;
+    t44 = t33 ^ t37;
+    t45 = t42 ^ t41;
+    z0 = t44 & y15;
+    z1 = t37 & y6;
+    z2 = t33 & x7;
+    z3 = t43 & y16;
+    z4 = t40 & y1;
+    z5 = t29 & y7;
+    z6 = t42 & y11;
+    z7 = t45 & y17;
+    z8 = t41 & y10;
+    z9 = t44 & y12;
+    z10 = t37 & y3;
+    z11 = t33 & y4;
+    z12 = t43 & y13;
+    z13 = t40 & y5;
+    z14 = t29 & y2;
+    z15 = t42 & y9;
+    z16 = t45 & y14;
+    z17 = t41 & y8;
+
+    // Bottom linear transformation.
+    t46 = z15 ^ z16;
+    t47 = z10 ^ z11;
+    t48 = z5 ^ z13;
+    t49 = z9 ^ z10;
+    t50 = z2 ^ z12;
+    t51 = z2 ^ z5;
+    t52 = z7 ^ z8;
+    t53 = z0 ^ z3;
+    t54 = z6 ^ z7;
+    t55 = z16 ^ z17;
+    t56 = z12 ^ t48;
+    t57 = t50 ^ t53;
+    t58 = z4 ^ t46;
+    t59 = z3 ^ t54;
+    t60 = t46 ^ t57;
+    t61 = z14 ^ t57;
+    t62 = t52 ^ t58;
+    t63 = t49 ^ t58;
+    t64 = z4 ^ t59;
+    t65 = t61 ^ t62;
+    t66 = z1 ^ t63;
+    s0 = t59 ^ t63;
+    s6 = t56 ^ ~t62;
+    s7 = t48 ^ ~t60;
+    t67 = t64 ^ t65;
+    s3 = t53 ^ t66;
+    s4 = t51 ^ t66;
+    s5 = t47 ^ t65;
+    s1 = t64 ^ ~s3;
+    s2 = t55 ^ ~t67;
+
+    q[7] = s0; q[6] = s1; q[5] = s2; q[4] = s3;
+    q[3] = s4; q[2] = s5; q[1] = s6; q[0] = s7;
+}
+
+// Swap the bits of x and y selected by the masks, s apart.
+static inline void swapBits(uint64_t &x, uint64_t &y, const uint64_t cl, const uint64_t ch, const uint8_t s)
+{
+    const uint64_t a = x, b = y;
+    x = (a & cl) | ((b & cl) << s);
+    y = ((a & ch) >> s) | (b & ch);
+}
+
+// Transpose between byte-interleaved and bitsliced forms; its own inverse.
+static void ortho(uint64_t *q)
+{
+    static const uint64_t m2l = 0x5555555555555555ULL, m2h = 0xAAAAAAAAAAAAAAAAULL;
+    static const uint64_t m4l = 0x3333333333333333ULL, m4h = 0xCCCCCCCCCCCCCCCCULL;
+    static const uint64_t m8l = 0x0F0F0F0F0F0F0F0FULL, m8h = 0xF0F0F0F0F0F0F0F0ULL;
+    swapBits(q[0], q[1], m2l, m2h, 1); swapBits(q[2], q[3], m2l, m2h, 1);
+    swapBits(q[4], q[5], m2l, m2h, 1); swapBits(q[6], q[7], m2l, m2h, 1);
+    swapBits(q[0], q[2], m4l, m4h, 2); swapBits(q[1], q[3], m4l, m4h, 2);
+    swapBits(q[4], q[6], m4l, m4h, 2); swapBits(q[5], q[7], m4l, m4h, 2);
+    swapBits(q[0], q[4], m8l, m8h, 4); swapBits(q[1], q[5], m8l, m8h, 4);
+    swapBits(q[2], q[6], m8l, m8h, 4); swapBits(q[3], q[7], m8l, m8h, 4);
+}
+
+// Little-endian 32-bit load/store, independent of host byte order.
+static inline uint32_t getU32LE(const uint8_t *p)
+    { return(uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24)); }
+static inline void putU32LE(uint8_t *p, const uint32_t v)
+    { p[0] = uint8_t(v); p[1] = uint8_t(v >> 8); p[2] = uint8_t(v >> 16); p[3] = uint8_t(v >> 24); }
+
+// Spread one block (as 4 little-endian words) into two words, interleaving bytes.
+static void interleaveIn(uint64_t *q0, uint64_t *q1, const uint32_t *w)
+{
+    uint64_t x0 = w[0], x1 = w[1], x2 = w[2], x3 = w[3];
+    x0 |= (x0 << 16); x1 |= (x1 << 16); x2 |= (x2 << 16); x3 |= (x3 << 16);
+    x0 &= 0x0000FFFF0000FFFFULL; x1 &= 0x0000FFFF0000FFFFULL;
+    x2 &= 0x0000FFFF0000FFFFULL; x3 &= 0x0000FFFF0000FFFFULL;
+    x0 |= (x0 << 8); x1 |= (x1 << 8); x2 |= (x2 << 8); x3 |= (x3 << 8);
+    x0 &= 0x00FF00FF00FF00FFULL; x1 &= 0x00FF00FF00FF00FFULL;
+    x2 &= 0x00FF00FF00FF00FFULL; x3 &= 0x00FF00FF00FF00FFULL;
+    *q0 = x0 | (x2 << 8);
+    *q1 = x1 | (x3 << 8);
+}
+
+// Inverse of interleaveIn().
+static void interleaveOut(uint32_t *w, const uint64_t q0, const uint64_t q1)
+{
+    uint64_t x0 = q0 & 0x00FF00FF00FF00FFULL;
+    uint64_t x1 = q1 & 0x00FF00FF00FF00FFULL;
+    uint64_t x2 = (q0 >> 8) & 0x00FF00FF00FF00FFULL;
+    uint64_t x3 = (q1 >> 8) & 0x00FF00FF00FF00FFULL;
+    x0 |= (x0 >> 8); x1 |= (x1 >> 8); x2 |= (x2 >> 8); x3 |= (x3 >> 8);
+    x0 &= 0x0000FFFF0000FFFFULL; x1 &= 0x0000FFFF0000FFFFULL;
+    x2 &= 0x0000FFFF0000FFFFULL; x3 &= 0x0000FFFF0000FFFFULL;
+    w[0] = uint32_t(x0) | uint32_t(x0 >> 16);
+    w[1] = uint32_t(x1) | uint32_t(x1 >> 16);
+    w[2] = uint32_t(x2) | uint32_t(x2 >> 16);
+    w[3] = uint32_t(x3) | uint32_t(x3 >> 16);
+}
+
+// Load 4 blocks into bitsliced form.
+static void load4(uint64_t *q, const uint8_t *in)
+{
+    uint32_t w[4];
+    for(uint8_t i = 0; i < 4; ++i)
+    {
+        for(uint8_t j = 0; j < 4; ++j) { w[j] = getU32LE(in + 16*i + 4*j); }
+        interleaveIn(&q[i], &q[i + 4], w);
+    }
+    ortho(q);
+}
+
+// Store 4 blocks from bitsliced form; q is destroyed.
+static void store4(uint64_t *q, uint8_t *out)
+{
+    uint32_t w[4];
+    ortho(q);
+    for(uint8_t i = 0; i < 4; ++i)
+    {
+        interleaveOut(w, q[i], q[i + 4]);
+        for(uint8_t j = 0; j < 4; ++j) { putU32LE(out + 16*i + 4*j, w[j]); }
+    }
+}
+
+static inline void addRoundKey(uint64_t *q, const uint64_t *k)
+{
+    for(uint8_t i = 0; i < 8; ++i) { q[i] ^= k[i]; }
+}
+
+static inline void shiftRows(uint64_t *q)
+{
+    for(uint8_t i = 0; i < 8; ++i)
+    {
+        const uint64_t x = q[i];
+        q[i] = (x & 0x000000000000FFFFULL)
+            | ((x & 0x00000000FFF00000ULL) >> 4)
+            | ((x & 0x00000000000F0000ULL) << 12)
+            | ((x & 0x0000FF0000000000ULL) >> 8)
+            | ((x & 0x000000FF00000000ULL) << 8)
+            | ((x & 0xF000000000000000ULL) >> 12)
+            | ((x & 0x0FFF000000000000ULL) << 4);
+    }
+}
+
+static inline uint64_t rotr32(const uint64_t x) { return((x << 32) | (x >> 32)); }
+
+static inline void mixColumns(uint64_t *q)
+{
+    const uint64_t q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3];
+    const uint64_t q4 = q[4], q5 = q[5], q6 = q[6], q7 = q[7];
+    const uint64_t r0 = (q0 >> 16) | (q0 << 48);
+    const uint64_t r1 = (q1 >> 16) | (q1 << 48);
+    const uint64_t r2 = (q2 >> 16) | (q2 << 48);
+    const uint64_t r3 = (q3 >> 16) | (q3 << 48);
+    const uint64_t r4 = (q4 >> 16) | (q4 << 48);
+    const uint64_t r5 = (q5 >> 16) | (q5 << 48);
+    const uint64_t r6 = (q6 >> 16) | (q6 << 48);
+    const uint64_t r7 = (q7 >> 16) | (q7 << 48);
+    q[0] = q7 ^ r7 ^ r0 ^ rotr32(q0 ^ r0);
+    q[1] = q0 ^ r0 ^ q7 ^ r7 ^ r1 ^ rotr32(q1 ^ r1);
+    q[2] = q1 ^ r1 ^ r2 ^ rotr32(q2 ^ r2);
+    q[3] = q2 ^ r2 ^ q7 ^ r7 ^ r3 ^ rotr32(q3 ^ r3);
+    q[4] = q3 ^ r3 ^ q7 ^ r7 ^ r4 ^ rotr32(q4 ^ r4);
+    q[5] = q4 ^ r4 ^ r5 ^ rotr32(q5 ^ r5);
+    q[6] = q5 ^ r5 ^ r6 ^ rotr32(q6 ^ r6);
+    q[7] = q6 ^ r6 ^ r7 ^ rotr32(q7 ^ r7);
+}
+
+// Encrypt two independent bitsliced states (8 blocks) together.
+static void encryptState2(const uint64_t *rk, uint64_t *qa, uint64_t *qb)
+{
+    addRoundKey(qa, rk);
+    addRoundKey(qb, rk);
+    for(uint8_t round = 1; round < 10; ++round)
+    {
+        sbox(qa); sbox(qb);
+        shiftRows(qa); shiftRows(qb);
+        mixColumns(qa); mixColumns(qb);
+        addRoundKey(qa, rk + 8*round); addRoundKey(qb, rk + 8*round);
+    }
+    sbox(qa); sbox(qb);
+    shiftRows(qa); shiftRows(qb);
+    addRoundKey(qa, rk + 80); addRoundKey(qb, rk + 80);
+}
+
+// SubWord() of the key schedule, through the bitsliced S-box.
+static uint32_t subWord(const uint32_t x)
+{
+    uint64_t q[8];
+    memset(q, 0, sizeof(q));
+    q[0] = x;
+    ortho(q);
+    sbox(q);
+    ortho(q);
+    return(uint32_t(q[0]));
+}
+
+
+/*****************************************************************************/
+/* Public functions:                                                         */
+/*****************************************************************************/
+
+/**
+ *    @brief    expand the key into the bitsliced round keys
+ */
+void OTAES128E_Bitsliced::expandKey(const uint8_t *key, uint64_t *rkOut)
+{
+    static const uint8_t Rcon[10] = { 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36 };
+    // Conventional schedule, as little-endian words.
+    uint32_t w[44];
+    for(uint8_t i = 0; i < 4; ++i) { w[i] = getU32LE(key + 4*i); }
+    for(uint8_t i = 4; i < 44; ++i)
+    {
+        uint32_t tmp = w[i - 1];
+        if(0 == (i & 3)) { tmp = subWord((tmp << 24) | (tmp >> 8)) ^ Rcon[(i >> 2) - 1]; }
+        w[i] = w[i - 4] ^ tmp;
+    }
+    // Bitslice each round key, replicated for each of the 4 block positions.
+    for(uint8_t r = 0; r < 11; ++r)
+    {
+        uint64_t q[8];
+        interleaveIn(&q[0], &q[4], w + 4*r);
+        q[1] = q[0]; q[2] = q[0]; q[3] = q[0];
+        q[5] = q[4]; q[6] = q[4]; q[7] = q[4];
+        ortho(q);
+        memcpy(rkOut + 8*r, q, sizeof(q));
+        memset(q, 0, sizeof(q));
+    }
+    memset(w, 0, sizeof(w));
+}
+
+/**
+ *    @brief    encrypt 8 blocks
+ */
+void OTAES128E_Bitsliced::encrypt8(const uint64_t *rkIn, const uint8_t *in, uint8_t *out)
+{
+    uint64_t qa[8], qb[8];
+    load4(qa, in);
+    load4(qb, in + 64);
+    encryptState2(rkIn, qa, qb);
+    store4(qa, out);
+    store4(qb, out + 64);
+    // Clean up private state.
+    memset(qa, 0, sizeof(qa));
+    memset(qb, 0, sizeof(qb));
+}
+
+/**
+ *    @brief    encrypt whole blocks, 8 at a time, padding the last pass
+ */
+void OTAES128E_Bitsliced::encryptBlocks(const uint64_t *rkIn, const uint8_t *in, uint8_t *out, size_t nBlocks)
+{
+    for( ; nBlocks >= ParallelBlocks; nBlocks -= ParallelBlocks)
+    {
+        encrypt8(rkIn, in, out);
+        in += 16 * ParallelBlocks;
+        out += 16 * ParallelBlocks;
+    }
+    if(0 == nBlocks) { return; }
+    // Remaining blocks via a buffer, the rest of which is don't-care.
+    uint8_t buf[16 * ParallelBlocks];
+    memset(buf, 0, sizeof(buf));
+    memcpy(buf, in, 16 * nBlocks);
+    encrypt8(rkIn, buf, buf);
+    memcpy(out, buf, 16 * nBlocks);
+    memset(buf, 0, sizeof(buf));
+}
+
+/**
+ *    @brief    start keyed session: expand the round keys once into the workspace
+ *    @retval   true if the session was started, false if no workspace or key
+ */
+bool OTAES128E_Bitsliced::setKey(const uint8_t *key)
+{
+    // Abort if no workspace to avoid crashing.
+    if((NULL == rk) || (NULL == key)) { return(false); }
+    expandKey(key, rk);
+    keyed = true;
+    return(true);
+}
+
+/**
+ *    @brief    AES128 block encryption
+ *
+ * One-block session.
+ * Cleans up internal sensitive state when done.
+ */
+void OTAES128E_Bitsliced::blockEncrypt(const uint8_t* input, const uint8_t* key, uint8_t *output)
+{
+    // Abort if no workspace to avoid crashing..
+    if(!OTAES128E_Bitsliced::setKey(key)) { return; }
+    encryptBlocks(rk, input, output, 1);
+    // Clean up private state.
+    OTAES128E_Bitsliced::cleanup();
+}
+
+
+    }
+
+#endif
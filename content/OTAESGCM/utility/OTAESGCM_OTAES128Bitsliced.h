@@ -0,0 +1,107 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Deniz Erbilgin 2015--2017
+                           Damon Hart-Davis 2015--2017
+*/
+
+
+/* Constant-time bitsliced AES(128) implementation for hosts. */
+/* Not intended for small MCUs: works on 64-bit words. */
+
+#ifndef ARDUINO_LIB_OTAESGCM_OTAES128BITSLICED_H
+#define ARDUINO_LIB_OTAESGCM_OTAES128BITSLICED_H
+
+#include <stdint.h>
+#include <string.h>
+#include "OTAESGCM_OTAES128.h"
+
+
+// Use namespaces to help avoid collisions.
+namespace OTAESGCM
+    {
+
+
+    // Bitsliced encrypt-only implementation on 64-bit words,
+    // encrypting 8 blocks per pass (as two interleaved sets of 4).
+    // Constant-time: no secret-dependent table lookups or branches,
+    // so suitable for hosts without AES-NI where cache timing matters,
+    // eg older ARM and x86 gateways.
+    // Fastest with multiple independent blocks, eg GCM counter blocks;
+    // a single block costs about as much as 4.
+    // Neither re-entrant nor ISR-safe except where stated.
+    // Carries workspace but logically no state is carried from one operation to the next,
+    // except the expanded key between setKey() and endSession().
+    // Residual state should be regarded as sensitive, and eg overwritten before being released to heap.
+    class OTAES128E_Bitsliced : public OTAES128E
+        {
+        public:
+            // Blocks encrypted per pass of encrypt8().
+            static constexpr uint8_t ParallelBlocks = 8;
+
+        protected:
+            // Number of 64-bit words in the expanded, bitsliced key: 8 per round key.
+            static constexpr uint8_t RoundKeyWords = 88;
+
+            // Aligned start of the round keys within the caller's workspace;
+            // NULL if insufficient workspace is passed in.
+            uint64_t * const rk;
+            // True while a keyed session is active.
+            bool keyed = false;
+
+            // Round the workspace start up to a uint64_t boundary
+            // if at least required bytes are supplied, else NULL.
+            static uint64_t *alignedRoundKeys(uint8_t *const workspace, const size_t workspaceLen, const size_t required)
+                { return(((NULL == workspace) || (workspaceLen < required)) ? NULL :
+                    (uint64_t *)(((uintptr_t)workspace + (sizeof(uint64_t)-1)) & ~(uintptr_t)(sizeof(uint64_t)-1))); }
+
+        public:
+            // Minimum workspace required, unaligned; strictly positive.
+            // Covers the expanded key plus slack to align it.
+            // This constant, defined per class, is effectively part of the API.
+            static constexpr size_t workspaceRequired = RoundKeyWords * sizeof(uint64_t) + (sizeof(uint64_t)-1);
+
+            // Construct an instance: supplied workspace must be large enough.
+            // Only the initial 'workspaceRequired' bytes will be used.
+            OTAES128E_Bitsliced(uint8_t *const workspace, const size_t workspaceLen)
+              : rk(alignedRoundKeys(workspace, workspaceLen, workspaceRequired))
+                { }
+
+            // Expand a 16-byte key into RoundKeyWords bitsliced words at rkOut.
+            static void expandKey(const uint8_t *key, uint64_t *rkOut);
+            // Encrypt ParallelBlocks (8) blocks with the expanded key; in and out may be the same.
+            static void encrypt8(const uint64_t *rkIn, const uint8_t *in, uint8_t *out);
+            // Encrypt nBlocks with the expanded key; in and out may be the same.
+            static void encryptBlocks(const uint64_t *rkIn, const uint8_t *in, uint8_t *out, size_t nBlocks);
+
+            // Clean up sensitive state.
+            void cleanup() { if((NULL != rk) && keyed)
+                { memset(rk, 0, RoundKeyWords * sizeof(uint64_t)); keyed = false; } }
+
+            // One-block session; cleans up internal sensitive state when done.
+            virtual void blockEncrypt(const uint8_t* input, const uint8_t* key, uint8_t *output) override;
+
+            // Keyed session: the round keys are expanded once by setKey()
+            // and retained in the workspace until endSession()/cleanup().
+            virtual bool setKey(const uint8_t *key) override;
+            virtual void encryptBlocks(const uint8_t *input, uint8_t *output, size_t nBlocks) override
+                { if(keyed) { encryptBlocks(rk, input, output, nBlocks); } }
+            virtual void endSession() override { cleanup(); }
+        };
+
+
+    }
+
+#endif
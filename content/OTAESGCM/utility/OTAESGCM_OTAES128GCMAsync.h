@@ -0,0 +1,175 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Deniz Erbilgin 2015--2017
+                           Damon Hart-Davis 2015--2017
+*/
+
+/* C++20 coroutine front end for AES(128)-GCM, offloading large frames. */
+
+#ifndef ARDUINO_LIB_OTAESGCM_OTAES128GCMASYNC_H
+#define ARDUINO_LIB_OTAESGCM_OTAES128GCMASYNC_H
+
+// Only with compiler support for coroutines (eg -std=c++20), and not on AVR.
+#if defined(__cpp_impl_coroutine) && (__cpp_impl_coroutine >= 201902L) && \
+    !defined(__AVR_ARCH__) && !defined(ARDUINO_ARCH_AVR)
+
+#include <stddef.h>
+#include <stdint.h>
+#include <coroutine>
+
+#include "OTAESGCM_OTAESGCM.h"
+#include "OTAESGCM_OTAES128GCMThreadPool.h"
+
+/*
+
+In a coroutine, eg on an event loop thread:
+
+    const bool ok = co_await async.asyncEncrypt(frame);
+
+Frames of at most the inline threshold are done at once on the calling thread
+(no suspension, no allocation, no cross-thread traffic).
+Larger frames are submitted as jobs to an OTAES128GCMThreadPool,
+and the coroutine is suspended until done;
+it is then handed (on the worker thread) to a post function,
+which must queue it back onto the calling thread, eg the event loop.
+The coroutine is never resumed on the worker itself,
+as its later frames would then use the inline GCM instance from that thread.
+If the pool's queue is full the frame is done inline instead.
+
+The frame is as for gcmEncryptLarge()/gcmDecryptLarge() (see OTAES128GCMFrameDescriptor),
+with either a key or a key context, and all it points to must stay valid until the co_await completes.
+A key context that is not read-only when keyed (see OTAES128GCMSharedKeyContext)
+may not be used by another thread, so such frames are always done inline.
+
+*/
+
+// Use namespaces to help avoid collisions.
+namespace OTAESGCM
+    {
+
+
+    // Front end for co_await-able GCM operations.
+    // The inline GCM instance is used only from the threads calling
+    // asyncEncrypt()/asyncDecrypt(), so those must not run concurrently
+    // unless each thread has its own OTAES128GCMAsync.
+    class OTAES128GCMAsync final
+        {
+        public:
+            // Called (on a worker thread) to have a coroutine suspended by an offloaded frame
+            // resumed on the thread that awaited it; must not resume it directly.
+            typedef void (*post_t)(std::coroutine_handle<> h, void *postContext);
+
+            // Awaitable result of asyncEncrypt()/asyncDecrypt(); co_await it at once.
+            // co_await yields true iff successful (and for decryption the tag matched).
+            class Operation final
+                {
+                friend class OTAES128GCMAsync;
+                private:
+                    const OTAES128GCMAsync &owner;
+                    OTAES128GCMJob job;
+                    std::coroutine_handle<> h;
+                    bool ok = false;
+
+                    Operation(const OTAES128GCMAsync &o, const OTAES128GCMFrameDescriptor &frame, const bool decrypt)
+                        : owner(o), job()
+                        { job.frame = frame; job.decrypt = decrypt; job.done = complete; job.user = this; }
+                    void runInline()
+                        {
+                        const OTAES128GCMFrameDescriptor &f = job.frame;
+                        if(job.decrypt)
+                            {
+                            ok = (NULL != f.kc) ?
+                                owner.gcm.gcmDecryptLarge(*f.kc, f.IV, f.input, f.length, f.ADATA, f.ADATALength, f.tag, f.output) :
+                                owner.gcm.gcmDecryptLarge(f.key, f.IV, f.input, f.length, f.ADATA, f.ADATALength, f.tag, f.output);
+                            }
+                        else
+                            {
+                            ok = (NULL != f.kc) ?
+                                owner.gcm.gcmEncryptLarge(*f.kc, f.IV, f.input, f.length, f.ADATA, f.ADATALength, f.output, f.tag) :
+                                owner.gcm.gcmEncryptLarge(f.key, f.IV, f.input, f.length, f.ADATA, f.ADATALength, f.output, f.tag);
+                            }
+                        }
+                    static void complete(OTAES128GCMJob *j, const bool result)
+                        {
+                        Operation *const op = static_cast<Operation *>(j->user);
+                        op->ok = result;
+                        op->owner.post(op->h, op->owner.postContext);
+                        }
+
+                    // True if the frame may be done on a worker thread:
+                    // there is a post function and the key context (if any) can be shared.
+                    bool offloadable() const
+                        {
+                        const OTAES128GCMKeyContext *const kc = job.frame.kc;
+                        return((NULL != owner.post) && ((NULL == kc) || kc->isReadOnlyWhenKeyed()));
+                        }
+
+                public:
+                    Operation(const Operation &) = delete;
+                    Operation &operator=(const Operation &) = delete;
+
+                    // Small frames, and those that cannot be offloaded,
+                    // are done inline without suspending.
+                    bool await_ready()
+                        {
+                        if((job.frame.length > owner.inlineThreshold) && offloadable()) { return(false); }
+                        runInline();
+                        return(true);
+                        }
+                    // Offload; if the queue is full do it inline and do not suspend.
+                    // Once submitted the job may complete (and resume the caller)
+                    // before this returns, so nothing here is touched after.
+                    bool await_suspend(std::coroutine_handle<> caller)
+                        {
+                        h = caller;
+                        if(owner.pool.submit(&job)) { return(true); }
+                        runInline();
+                        return(false);
+                        }
+                    bool await_resume() const { return(ok); }
+                };
+
+            // Frames of at most inlineThresholdBytes of text are done inline with gcm,
+            // others on pool, with the suspended coroutine handed back through post;
+            // if post is NULL all frames are done inline.
+            OTAES128GCMAsync(OTAES128GCMThreadPool &poolIn, OTAES128GCMGenericBase &gcmIn,
+                             const post_t postIn, void *const postContextIn,
+                             const size_t inlineThresholdBytes = DefaultInlineThreshold)
+                : pool(poolIn), gcm(gcmIn), inlineThreshold(inlineThresholdBytes),
+                  post(postIn), postContext(postContextIn) { }
+
+            // Default inline threshold (bytes of text):
+            // below this offloading costs more than it saves.
+            static constexpr size_t DefaultInlineThreshold = 1024;
+
+            // Encrypt (writing frame.tag) or decrypt (checking frame.tag) one frame.
+            Operation asyncEncrypt(const OTAES128GCMFrameDescriptor &frame) { return(Operation(*this, frame, false)); }
+            Operation asyncDecrypt(const OTAES128GCMFrameDescriptor &frame) { return(Operation(*this, frame, true)); }
+
+        private:
+            OTAES128GCMThreadPool &pool;
+            OTAES128GCMGenericBase &gcm;
+            const size_t inlineThreshold;
+            const post_t post;
+            void *const postContext;
+        };
+
+
+    }
+
+#endif // coroutines && !AVR
+
+#endif
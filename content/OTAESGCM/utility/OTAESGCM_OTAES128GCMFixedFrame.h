@@ -0,0 +1,250 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Deniz Erbilgin 2015--2017
+                           Damon Hart-Davis 2015--2017
+*/
+
+/* Straight-line AES(128)-GCM codecs for fixed-size frames. */
+
+#ifndef ARDUINO_LIB_OTAESGCM_OTAES128GCMFIXEDFRAME_H
+#define ARDUINO_LIB_OTAESGCM_OTAES128GCMFIXEDFRAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "OTAESGCM_OTAESGCM.h"
+
+// Use namespaces to help avoid collisions.
+namespace OTAESGCM
+    {
+
+    namespace FFC
+    {
+        // Calls f(0) .. f(N-1) in order, expanded at compile time.
+        template<size_t N> struct Unroll final
+            {
+            template<class F> static void run(F &f) { Unroll<N-1>::run(f); f(N-1); }
+            };
+        template<> struct Unroll<0> final
+            {
+            template<class F> static void run(F &) { }
+            };
+
+        // out = in ^ key stream for text block i, with the key stream from block 2 of ks.
+        // Unrolled per block (not per byte) to bound template depth and code size.
+        struct XorBlock final
+            {
+            uint8_t *out; const uint8_t *in; const uint8_t (*ks)[AES128GCM_BLOCK_SIZE];
+            void operator()(const size_t i)
+                {
+                uint8_t *const o = out + i * AES128GCM_BLOCK_SIZE;
+                const uint8_t *const p = in + i * AES128GCM_BLOCK_SIZE;
+                const uint8_t *const k = ks[2 + i];
+                for(uint8_t j = 0; j < AES128GCM_BLOCK_SIZE; ++j) { o[j] = uint8_t(p[j] ^ k[j]); }
+                }
+            };
+
+        /**
+         * @struct  Exact-size OTAES128GCMFixedFrameCodec workspace, beyond the AES and GHASH space.
+         * @note    (2 + TextBlocks) + (AADBlocks + TextBlocks + 1) + 1 blocks.
+         */
+        template<size_t TextBlocks, size_t AADBlocks>
+        struct FixedFrameWorkspace final
+        {
+            // H = E(0^128), E(J0), then the text key stream, all ciphered in one call.
+            // H stays here as the GHASH implementation may retain a pointer to it.
+            uint8_t ks[2 + TextBlocks][AES128GCM_BLOCK_SIZE];
+            // A || 0^v || C || [len(A)]64 || [len(C)]64, hashed in one call;
+            // C starts immediately after the padded AAD actually present.
+            uint8_t hashIn[AADBlocks + TextBlocks + 1][AES128GCM_BLOCK_SIZE];
+            // GHASH accumulator, then the tag.
+            uint8_t S[AES128GCM_BLOCK_SIZE];
+        };
+    }
+
+    // AES(128)-GCM for frames whose text is always exactly TextBytes long
+    // (a non-zero multiple of the block size) with 0 to MaxAADBytes of AAD,
+    // and 12-byte nonce and 16-byte tag, as the fixed32BTextSize12BNonce16BTag* functions.
+    // With the block count fixed at compile time there is no length dispatch:
+    //   * the counter blocks differ only in their last byte,
+    //     so are written directly rather than incremented;
+    //   * H, E(J0) and the whole key stream come from one AES call;
+    //   * AAD, cipher text and lengths are hashed in one GHASH call;
+    //   * the per-block loops are unrolled.
+    // Decryption checks the tag before writing any plain text,
+    // and leaves the output untouched on failure.
+    // Workspace is the AES space, then the GHASH space,
+    // then exactly FFC::FixedFrameWorkspace; all is wiped after each call.
+    // Neither re-entrant nor ISR-safe except where stated.
+    template<size_t TextBytes, size_t MaxAADBytes,
+             class OTAESImpl = OTAESGCM::OTAES128E_default_t, class OTGHASHImpl = OTAESGCM::OTGHASH128_default_t>
+    class OTAES128GCMFixedFrameCodec final
+        {
+        public:
+            static_assert((0 != TextBytes) && (0 == (TextBytes % AES128GCM_BLOCK_SIZE)), "text must be whole blocks");
+            // Counter blocks inc32(J0) .. must not carry out of the last byte.
+            static_assert(TextBytes / AES128GCM_BLOCK_SIZE < 255, "text too long");
+            // The AAD size is passed as a uint8_t.
+            static_assert(MaxAADBytes <= 255, "AAD too long");
+
+            // Suitable type to hold size of workspace required.
+            typedef size_t workspacesize_t;
+
+            static constexpr size_t TextBlocks = TextBytes / AES128GCM_BLOCK_SIZE;
+            static constexpr size_t AADBlocks = (MaxAADBytes + AES128GCM_BLOCK_SIZE - 1) / AES128GCM_BLOCK_SIZE;
+            typedef FFC::FixedFrameWorkspace<TextBlocks, AADBlocks> frameworkspace_t;
+
+            constexpr static workspacesize_t workspaceRequiredAES = OTAESImpl::workspaceRequired;
+            constexpr static workspacesize_t workspaceRequiredGHASH = OTGHASHImpl::workspaceRequired;
+            constexpr static workspacesize_t workspaceRequiredImpl = workspaceRequiredAES + workspaceRequiredGHASH;
+            // Workspace required.
+            constexpr static workspacesize_t workspaceRequired = workspaceRequiredImpl + sizeof(frameworkspace_t);
+
+        private:
+            OTAESImpl aes;
+            OTGHASHImpl gh;
+            // Frame part of the workspace, else NULL if insufficient workspace.
+            frameworkspace_t *const ws;
+
+            // Common body: leaves the calculated tag in ws->S
+            // and the key stream in ws->ks[2..];
+            // when encrypting the cipher text is also left in the hash input.
+            // Returns a pointer to the cipher text in the hash input,
+            // or NULL (with nothing done) if the workspace or key is unusable.
+            uint8_t *run(const uint8_t *key, const uint8_t *IV,
+                         const uint8_t *ADATA, const uint8_t ADATALength,
+                         const uint8_t *in, const bool decrypt)
+                {
+                if(NULL == ws) { return(NULL); }
+                if(!aes.OTAESImpl::setKey(key)) { return(NULL); }
+
+                // 0^128, J0 = IV || 0^31 || 1, then inc32(J0) .. for the text.
+                memset(ws->ks, 0, sizeof(ws->ks));
+                struct { frameworkspace_t *w; const uint8_t *iv; void operator()(size_t i)
+                    { memcpy(w->ks[1 + i], iv, AES128GCM_IV_SIZE); w->ks[1 + i][AES128GCM_BLOCK_SIZE - 1] = uint8_t(1 + i); } }
+                    counters = { ws, IV };
+                FFC::Unroll<1 + TextBlocks>::run(counters);
+                aes.OTAESImpl::encryptBlocks(ws->ks[0], ws->ks[0], 2 + TextBlocks);
+                if(!gh.OTGHASHImpl::setKey(ws->ks[0])) { wipe(); return(NULL); }
+
+                // A || 0^v, then C.
+                memset(ws->hashIn, 0, sizeof(ws->hashIn));
+                if(0 != ADATALength) { memcpy(ws->hashIn, ADATA, ADATALength); }
+                const uint8_t aadBlocks = uint8_t((ADATALength + AES128GCM_BLOCK_SIZE - 1) / AES128GCM_BLOCK_SIZE);
+                uint8_t *const c = ws->hashIn[aadBlocks];
+                if(decrypt) { memcpy(c, in, TextBytes); }
+                else
+                    {
+                    FFC::XorBlock xorText = { c, in, ws->ks };
+                    FFC::Unroll<TextBlocks>::run(xorText);
+                    }
+
+                // [len(A)]64 || [len(C)]64, with len(C) a compile-time constant.
+                uint8_t *const lengths = c + TextBytes;
+                lengths[6] = uint8_t(ADATALength >> 5);
+                lengths[7] = uint8_t(ADATALength << 3);
+                lengths[14] = uint8_t((TextBytes << 3) >> 8);
+                lengths[15] = uint8_t(TextBytes << 3);
+
+                // S = GHASH_H(A || 0^v || C || lengths); tag = E(J0) ^ S.
+                memset(ws->S, 0, AES128GCM_BLOCK_SIZE);
+                gh.OTGHASHImpl::update(ws->S, ws->hashIn[0], aadBlocks + TextBlocks + 1U);
+                for(uint8_t i = 0; i < AES128GCM_TAG_SIZE; ++i) { ws->S[i] ^= ws->ks[1][i]; }
+                return(c);
+                }
+
+            // Erase the expanded key, H, GHASH tables and workspace.
+            void wipe()
+                {
+                gh.OTGHASHImpl::endSession();
+                aes.OTAESImpl::endSession();
+                memset(ws, 0, sizeof(*ws));
+                }
+
+        public:
+            // Construct an instance, supplied with workspace.
+            // Calls will fail if the workspace is NULL or too small.
+            OTAES128GCMFixedFrameCodec(uint8_t *const workspace, const workspacesize_t workspaceSize)
+              : aes(workspace, isWorkspaceSufficient(workspace, workspaceSize) ? workspaceRequiredAES : 0),
+                gh((NULL == workspace) ? NULL : workspace + workspaceRequiredAES,
+                   isWorkspaceSufficient(workspace, workspaceSize) ? workspaceRequiredGHASH : 0),
+                ws(isWorkspaceSufficient(workspace, workspaceSize) ?
+                   (frameworkspace_t *)(workspace + workspaceRequiredImpl) : NULL)
+                { }
+            // Verify that the workspace is adequate.
+            static constexpr bool isWorkspaceSufficient(uint8_t *const workspace, const workspacesize_t workspaceSize)
+                { return((NULL != workspace) && (workspaceSize >= workspaceRequired)); }
+
+            // Encrypt exactly TextBytes of plain text; true iff successful.
+            // Fails if any pointer but authtext is NULL,
+            // or if authtext is NULL with a non-zero size,
+            // or if the authtext is longer than MaxAADBytes.
+            bool encrypt(const uint8_t *key, const uint8_t *iv,
+                         const uint8_t *authtext, const uint8_t authtextSize,
+                         const uint8_t *plaintext,
+                         uint8_t *ciphertextOut, uint8_t *tagOut)
+                {
+                if((NULL == key) || (NULL == iv) || (NULL == plaintext) || (NULL == ciphertextOut) || (NULL == tagOut)) { return(false); }
+                if((authtextSize > MaxAADBytes) || ((0 != authtextSize) && (NULL == authtext))) { return(false); }
+                const uint8_t *const c = run(key, iv, authtext, authtextSize, plaintext, false);
+                if(NULL == c) { return(false); }
+                memcpy(ciphertextOut, c, TextBytes);
+                memcpy(tagOut, ws->S, AES128GCM_TAG_SIZE);
+                wipe();
+                return(true);
+                }
+
+            // Decrypt and authenticate exactly TextBytes of cipher text; true iff successful.
+            // The plain text is only written if the tag matches.
+            // Argument checks are as for encrypt().
+            bool decrypt(const uint8_t *key, const uint8_t *iv,
+                         const uint8_t *authtext, const uint8_t authtextSize,
+                         const uint8_t *ciphertext, const uint8_t *tag,
+                         uint8_t *plaintextOut)
+                {
+                if((NULL == key) || (NULL == iv) || (NULL == ciphertext) || (NULL == tag) || (NULL == plaintextOut)) { return(false); }
+                if((authtextSize > MaxAADBytes) || ((0 != authtextSize) && (NULL == authtext))) { return(false); }
+                const uint8_t *const c = run(key, iv, authtext, authtextSize, ciphertext, true);
+                if(NULL == c) { return(false); }
+                // Compare in time independent of where any mismatch is.
+                uint8_t diff = 0;
+                for(uint8_t i = 0; i < AES128GCM_TAG_SIZE; ++i) { diff |= uint8_t(ws->S[i] ^ tag[i]); }
+                if(0 == diff)
+                    {
+                    FFC::XorBlock xorText = { plaintextOut, c, ws->ks };
+                    FFC::Unroll<TextBlocks>::run(xorText);
+                    }
+                wipe();
+                return(0 == diff);
+                }
+        };
+
+    // Codecs for the common frame body sizes;
+    // MaxAADBytes defaults to two blocks.
+    template<size_t MaxAADBytes = 32, class OTAESImpl = OTAESGCM::OTAES128E_default_t, class OTGHASHImpl = OTAESGCM::OTGHASH128_default_t>
+    using OTAES128GCMFixedFrameCodec16 = OTAES128GCMFixedFrameCodec<16, MaxAADBytes, OTAESImpl, OTGHASHImpl>;
+    template<size_t MaxAADBytes = 32, class OTAESImpl = OTAESGCM::OTAES128E_default_t, class OTGHASHImpl = OTAESGCM::OTGHASH128_default_t>
+    using OTAES128GCMFixedFrameCodec32 = OTAES128GCMFixedFrameCodec<32, MaxAADBytes, OTAESImpl, OTGHASHImpl>;
+    template<size_t MaxAADBytes = 32, class OTAESImpl = OTAESGCM::OTAES128E_default_t, class OTGHASHImpl = OTAESGCM::OTGHASH128_default_t>
+    using OTAES128GCMFixedFrameCodec48 = OTAES128GCMFixedFrameCodec<48, MaxAADBytes, OTAESImpl, OTGHASHImpl>;
+    template<size_t MaxAADBytes = 32, class OTAESImpl = OTAESGCM::OTAES128E_default_t, class OTGHASHImpl = OTAESGCM::OTGHASH128_default_t>
+    using OTAES128GCMFixedFrameCodec64 = OTAES128GCMFixedFrameCodec<64, MaxAADBytes, OTAESImpl, OTGHASHImpl>;
+
+
+    }
+
+#endif
@@ -0,0 +1,208 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Deniz Erbilgin 2015--2017
+                           Damon Hart-Davis 2015--2017
+*/
+
+/* Compile-time (constexpr) AES(128)-GCM key setup, for keys fixed at build time. */
+
+#ifndef ARDUINO_LIB_OTAESGCM_OTAES128GCMFIXEDKEY_H
+#define ARDUINO_LIB_OTAESGCM_OTAES128GCMFIXEDKEY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "OTAESGCM_OTAES128AVR.h"
+#include "OTAESGCM_OTGHASH128Portable.h"
+#include "OTAESGCM_OTAESGCM.h"
+
+/*
+
+A key known at build time can be expanded by the compiler,
+and the result placed directly in flash with no run-time initialisation, eg:
+
+    static constexpr OTAESGCM::OTAES128FixedKeyBytes key = {{ 0x2b, 0x7e, ... }};
+    static const OTAESGCM::OTAES128GCMFixedKey fk PROGMEM = OTAESGCM::makeOTAES128GCMFixedKey(key);
+
+(on hosts PROGMEM is empty and the constant goes in .rodata).
+fk.roundKeys is then the 'key' for OTAES128E_AVRFixed,
+so KeyExpansion() never runs and no RoundKey RAM workspace is needed,
+and fk.H is the GHASH subkey from which Shoup tables can be built too.
+
+All functions here are C++11 constexpr (single return expression),
+intended for compile-time evaluation only:
+they are very slow if evaluated at run time.
+
+*/
+
+// Use namespaces to help avoid collisions.
+namespace OTAESGCM
+    {
+
+    // 16-byte AES key or block as a literal type.
+    struct OTAES128FixedKeyBytes final { uint8_t b[16]; };
+
+    // Fixed-key context: the expanded AES key schedule and the GHASH subkey H.
+    // A literal type, for constant initialisation in flash.
+    struct OTAES128GCMFixedKey final
+        {
+        // Nr+1 round keys in FIPS-197 byte order; the first is the key itself.
+        uint8_t roundKeys[176];
+        // Hash subkey H = AES_K(0^128).
+        uint8_t H[16];
+        };
+
+    // Precomputed table for OTGHASH128_Shoup4::setTable().
+    struct OTGHASH128Shoup4Table final { uint64_t M[32]; };
+#if !defined(__AVR_ARCH__) && !defined(ARDUINO_ARCH_AVR) // Hosts only: too big for small MCUs.
+    // Precomputed table for OTGHASH128_Shoup8::setTable().
+    struct OTGHASH128Shoup8Table final { uint64_t M[512]; };
+#endif
+
+    // Compile-time helpers.
+    namespace FKCX
+    {
+        // Pack of indices 0 .. N-1, to build arrays element by element
+        // (C++11 has no std::index_sequence).
+        template<size_t... I> struct Indices { };
+        template<size_t N, size_t... I> struct MakeIndices : MakeIndices<N-1, N-1, I...> { };
+        template<size_t... I> struct MakeIndices<0, I...> { typedef Indices<I...> type; };
+
+        typedef OTAES128FixedKeyBytes Block;
+        typedef MakeIndices<16>::type Block16;
+
+        // AES S-box (as in OTAESGCM_OTAES128AVR.cpp).
+        static constexpr uint8_t sbox[256] = {
+            0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+            0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+            0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+            0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+            0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+            0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+            0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+            0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+            0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+            0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+            0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+            0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+            0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+            0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+            0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+            0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16 };
+
+        // Multiply by x in GF(2^8).
+        constexpr uint8_t xtime(const uint8_t x)
+            { return(uint8_t((x << 1) ^ ((x & 0x80) ? 0x1b : 0))); }
+        // Round constant for round n >= 1.
+        constexpr uint8_t rcon(const unsigned n)
+            { return((n <= 1) ? 1 : xtime(rcon(n - 1))); }
+
+        // Byte k of the round key following p:
+        // word c is SubWord(RotWord(p word 3)) ^ Rcon ^ p words 0 .. c.
+        constexpr uint8_t nextRoundKeyByte(const Block &p, const uint8_t rc, const size_t k)
+            { return(uint8_t(sbox[p.b[12 + ((k + 1) & 3)]] ^ ((0 == (k & 3)) ? rc : 0) ^
+                             p.b[k & 3] ^ ((k >= 4) ? p.b[4 + (k & 3)] : 0) ^
+                             ((k >= 8) ? p.b[8 + (k & 3)] : 0) ^ ((k >= 12) ? p.b[12 + (k & 3)] : 0))); }
+        template<size_t... I>
+        constexpr Block nextRoundKey(const Block &p, const uint8_t rc, Indices<I...>)
+            { return(Block{{ nextRoundKeyByte(p, rc, I)... }}); }
+        // Round key n (0 .. 10).
+        constexpr Block roundKey(const Block &key, const unsigned n)
+            { return((0 == n) ? key : nextRoundKey(roundKey(key, n - 1), rcon(n), Block16())); }
+
+        // Byte k of ShiftRows(SubBytes(s)): row k&3 is rotated left by its row number.
+        constexpr uint8_t subShift(const Block &s, const size_t k)
+            { return(sbox[s.b[(k + 4 * (k & 3)) & 15]]); }
+        // Byte k of MixColumns(ShiftRows(SubBytes(s))) ^ rk.
+        constexpr uint8_t mixByte(const Block &s, const Block &rk, const size_t k)
+            { return(uint8_t(xtime(subShift(s, k)) ^ xtime(subShift(s, (k & 12) | ((k + 1) & 3))) ^
+                             subShift(s, (k & 12) | ((k + 1) & 3)) ^ subShift(s, (k & 12) | ((k + 2) & 3)) ^
+                             subShift(s, (k & 12) | ((k + 3) & 3)) ^ rk.b[k])); }
+        // One cipher round; the last has no MixColumns.
+        template<size_t... I>
+        constexpr Block cipherRound(const Block &s, const Block &rk, const bool last, Indices<I...>)
+            { return(Block{{ uint8_t(last ? (subShift(s, I) ^ rk.b[I]) : mixByte(s, rk, I))... }}); }
+        template<size_t... I>
+        constexpr Block xorBlock(const Block &a, const Block &b, Indices<I...>)
+            { return(Block{{ uint8_t(a.b[I] ^ b.b[I])... }}); }
+        // Rounds n .. 10.
+        constexpr Block cipherFrom(const Block &s, const Block &key, const unsigned n)
+            { return((n > 10) ? s : cipherFrom(cipherRound(s, roundKey(key, n), 10 == n, Block16()), key, n + 1)); }
+        constexpr Block encrypt(const Block &in, const Block &key)
+            { return(cipherFrom(xorBlock(in, key, Block16()), key, 1)); }
+
+        template<size_t... I>
+        constexpr OTAES128GCMFixedKey makeFixedKey(const Block &key, const Block &H, Indices<I...>)
+            { return(OTAES128GCMFixedKey{ { roundKey(key, unsigned(I / 16)).b[I % 16]... },
+                                          { H.b[0], H.b[1], H.b[2], H.b[3], H.b[4], H.b[5], H.b[6], H.b[7],
+                                            H.b[8], H.b[9], H.b[10], H.b[11], H.b[12], H.b[13], H.b[14], H.b[15] } }); }
+
+        // 128-bit GF(2^128) element as big-endian (hi, lo) halves, as in the Shoup tables.
+        struct U128 { uint64_t hi, lo; };
+        constexpr uint64_t getU64(const uint8_t *p)
+            { return((uint64_t(p[0]) << 56) | (uint64_t(p[1]) << 48) | (uint64_t(p[2]) << 40) | (uint64_t(p[3]) << 32) |
+                     (uint64_t(p[4]) << 24) | (uint64_t(p[5]) << 16) | (uint64_t(p[6]) << 8) | uint64_t(p[7])); }
+        // Multiply by x (bit-reflected, so a right shift with reduction).
+        constexpr U128 mulX(const U128 &v)
+            { return(U128{ (v.hi >> 1) ^ ((v.lo & 1) ? 0xe100000000000000ULL : 0), (v.lo >> 1) | (v.hi << 63) }); }
+        constexpr U128 xorU128(const U128 &a, const U128 &b)
+            { return(U128{ a.hi ^ b.hi, a.lo ^ b.lo }); }
+        // Table entry i: v times the bits of i from mask m down,
+        // where v is H times the power of x for the top bit.
+        constexpr U128 entry(const U128 &v, const unsigned i, const unsigned m)
+            { return((0 == m) ? U128{ 0, 0 } : xorU128((i & m) ? v : U128{ 0, 0 }, entry(mulX(v), i, m >> 1))); }
+        constexpr uint64_t tableWord(const U128 &h, const unsigned w, const unsigned top)
+            { return((w & 1) ? entry(h, w >> 1, top).lo : entry(h, w >> 1, top).hi); }
+        template<size_t... I>
+        constexpr OTGHASH128Shoup4Table makeShoup4Table(const U128 &h, Indices<I...>)
+            { return(OTGHASH128Shoup4Table{{ tableWord(h, unsigned(I), 8)... }}); }
+#if !defined(__AVR_ARCH__) && !defined(ARDUINO_ARCH_AVR)
+        template<size_t... I>
+        constexpr OTGHASH128Shoup8Table makeShoup8Table(const U128 &h, Indices<I...>)
+            { return(OTGHASH128Shoup8Table{{ tableWord(h, unsigned(I), 128)... }}); }
+#endif
+    }
+
+    // AES128 encryption of one block at compile time.
+    constexpr OTAES128FixedKeyBytes encryptOTAES128Constexpr(const OTAES128FixedKeyBytes &input,
+                                                             const OTAES128FixedKeyBytes &key)
+        { return(FKCX::encrypt(input, key)); }
+
+    // Expand a fixed key and derive H at compile time.
+    constexpr OTAES128GCMFixedKey makeOTAES128GCMFixedKey(const OTAES128FixedKeyBytes &key)
+        { return(FKCX::makeFixedKey(key, FKCX::encrypt(OTAES128FixedKeyBytes{{ 0 }}, key),
+                                    FKCX::MakeIndices<176>::type())); }
+
+    // Build the GHASH tables for H at compile time, eg from OTAES128GCMFixedKey::H.
+    constexpr OTGHASH128Shoup4Table makeOTGHASH128Shoup4Table(const uint8_t (&H)[16])
+        { return(FKCX::makeShoup4Table(FKCX::U128{ FKCX::getU64(H), FKCX::getU64(H + 8) },
+                                       FKCX::MakeIndices<32>::type())); }
+#if !defined(__AVR_ARCH__) && !defined(ARDUINO_ARCH_AVR)
+    constexpr OTGHASH128Shoup8Table makeOTGHASH128Shoup8Table(const uint8_t (&H)[16])
+        { return(FKCX::makeShoup8Table(FKCX::U128{ FKCX::getU64(H), FKCX::getU64(H + 8) },
+                                       FKCX::MakeIndices<512>::type())); }
+#endif
+
+    // Key context for a key fixed at build time: key it with
+    // setKey(fk.roundKeys) for an OTAES128GCMFixedKey fk in flash.
+    // Only the GHASH implementation needs workspace; H is derived
+    // with a single block encryption from the schedule in flash.
+    template<class OTGHASHImpl = OTAESGCM::OTGHASH128_default_t>
+    using OTAES128GCMFixedKeyContext = OTAES128GCMKeyContextWithWorkspace<OTAES128E_AVRFixed, OTGHASHImpl>;
+
+    }
+
+#endif
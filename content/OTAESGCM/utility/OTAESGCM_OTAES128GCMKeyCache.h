@@ -0,0 +1,324 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Deniz Erbilgin 2015--2017
+                           Damon Hart-Davis 2015--2017
+*/
+
+/* Concurrent sharded cache of AES(128)-GCM key contexts, eg for gateways. */
+
+#ifndef ARDUINO_LIB_OTAESGCM_OTAES128GCMKEYCACHE_H
+#define ARDUINO_LIB_OTAESGCM_OTAES128GCMKEYCACHE_H
+
+#if !defined(__AVR_ARCH__) && !defined(ARDUINO_ARCH_AVR)
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+#include <mutex>
+
+#include "OTAESGCM_OTAESGCM.h"
+#include "OTAESGCM_OTAES128GCMShared.h"
+
+/*
+
+A gateway receiving frames from many nodes, each with its own key,
+would otherwise expand the key schedule and derive H and the GHASH tables
+for every frame; the cache keeps those for recent senders, eg:
+
+    typedef OTAESGCM::OTAES128GCMKeyCache<> cache_t;
+    static cache_t *const cache = new cache_t; // ~2.3MB on x86 with CLMUL tables.
+    ...
+    // In each thread, with its own OTAES128GCMGenericBase instance gcm:
+    cache->gcmDecryptLarge(gcm, nodeID, key, iv, ...);
+
+Entries are found by a 64-bit tag: a caller-supplied node ID,
+or else fingerprint(key). The key itself is also held and compared
+(in constant time) so that a collision or a node re-keying is just a miss.
+
+The entries are split into Shards sets of Ways entries,
+the shard being chosen by a hash of the tag.
+Lookups take no lock: an entry in use is pinned with an atomic count
+and cannot be evicted or re-keyed until released.
+Inserts take the shard's lock, choose a victim by CLOCK (second chance),
+and zeroise it (key context cleared, key copy wiped) before re-keying it.
+If every entry in the shard is pinned the caller's raw key is used instead.
+
+*/
+
+// Use namespaces to help avoid collisions.
+namespace OTAESGCM
+    {
+
+
+    // Concurrent bounded cache of keyed (read-only, shared) key contexts.
+    // Total memory is fixed at Shards * Ways entries of sizeof(Entry) each.
+    // All methods may be called concurrently from any number of threads.
+    // Zeroises all entries on destruction, which must not overlap any use.
+    template<class OTAESImpl = OTAESGCM::OTAES128E_fast_t, class OTGHASHImpl = OTAESGCM::OTGHASH128_fast_t,
+             size_t Shards = 64, size_t Ways = 8>
+    class OTAES128GCMKeyCache final
+        {
+        static_assert(Shards > 0, "need at least one shard");
+        static_assert((Ways > 0) && (Ways <= 255), "need 1 to 255 ways per shard");
+
+        public:
+            // Shared key context type held in each entry.
+            typedef OTAES128GCMSharedKeyContext<OTAESImpl, OTGHASHImpl> kc_t;
+
+        private:
+            // Pin count value while an entry is being (re)keyed exclusively.
+            static constexpr uint32_t Busy = 0x80000000U;
+
+            struct Entry final
+                {
+                // Tag; only meaningful while valid.
+                std::atomic<uint64_t> tag;
+                // Readers using the entry, or Busy while being (re)keyed.
+                std::atomic<uint32_t> pins;
+                // True while keyed and findable.
+                std::atomic<bool> valid;
+                // CLOCK reference bit, set on each hit.
+                std::atomic<bool> referenced;
+                // Copy of the key, to confirm a match.
+                uint8_t key[16];
+                uint8_t ws[kc_t::workspaceRequired];
+                kc_t kc;
+                Entry() : tag(0), pins(0), valid(false), referenced(false), key(), ws(), kc(ws, sizeof(ws)) { }
+                };
+
+            struct Shard final
+                {
+                // Serialises inserts (not lookups) in this shard.
+                std::mutex insertLock;
+                // Next CLOCK victim candidate; only changed under insertLock.
+                uint8_t hand = 0;
+                std::atomic<uint64_t> hits;
+                std::atomic<uint64_t> misses;
+                std::atomic<uint64_t> evictions;
+                Entry entries[Ways];
+                Shard() : hits(0), misses(0), evictions(0) { }
+                };
+
+            Shard shards[Shards];
+
+            // Pick the shard for a tag, mixing its bits so that sequential IDs spread.
+            static Shard &shardFor(Shard *s, uint64_t tag)
+                {
+                tag ^= tag >> 33; tag *= 0xff51afd7ed558ccdULL;
+                tag ^= tag >> 33; tag *= 0xc4ceb9fe1a85ec53ULL;
+                tag ^= tag >> 33;
+                return(s[tag % Shards]);
+                }
+            // Constant-time comparison of two 16-byte keys.
+            static bool keysEqual(const uint8_t *a, const uint8_t *b)
+                {
+                uint8_t diff = 0;
+                for(uint8_t i = 0; i < 16; ++i) { diff |= uint8_t(a[i] ^ b[i]); }
+                return(0 == diff);
+                }
+            // Pin e if it currently holds tag and key; true if so (then caller must unpin).
+            static bool tryPin(Entry &e, uint64_t tag, const uint8_t *key)
+                {
+                if(!e.valid.load(std::memory_order_acquire) || (tag != e.tag.load(std::memory_order_acquire))) { return(false); }
+                uint32_t p = e.pins.load(std::memory_order_relaxed);
+                do { if(0 != (p & Busy)) { return(false); } }
+                while(!e.pins.compare_exchange_weak(p, p + 1, std::memory_order_acquire, std::memory_order_relaxed));
+                // Recheck now that the entry cannot change.
+                if(e.valid.load(std::memory_order_acquire) && (tag == e.tag.load(std::memory_order_relaxed)) && keysEqual(e.key, key))
+                    { return(true); }
+                e.pins.fetch_sub(1, std::memory_order_release);
+                return(false);
+                }
+            // Find a pinned matching entry in the shard, else NULL.
+            static Entry *find(Shard &s, uint64_t tag, const uint8_t *key)
+                {
+                for(size_t w = 0; w < Ways; ++w)
+                    { if(tryPin(s.entries[w], tag, key)) { return(&s.entries[w]); } }
+                return(NULL);
+                }
+            // Under insertLock, choose and take exclusively a victim entry by CLOCK,
+            // preferring invalid entries; NULL if all are pinned.
+            static Entry *takeVictim(Shard &s)
+                {
+                for(size_t w = 0; w < Ways; ++w)
+                    {
+                    Entry &e = s.entries[w];
+                    uint32_t expected = 0;
+                    if(!e.valid.load(std::memory_order_relaxed) &&
+                       e.pins.compare_exchange_strong(expected, Busy, std::memory_order_acquire))
+                        { return(&e); }
+                    }
+                // Two sweeps: the first may only clear reference bits.
+                for(size_t n = 0; n < 2 * Ways; ++n)
+                    {
+                    Entry &e = s.entries[s.hand];
+                    s.hand = uint8_t((s.hand + 1) % Ways);
+                    if(0 != e.pins.load(std::memory_order_relaxed)) { continue; }
+                    if(e.referenced.exchange(false, std::memory_order_relaxed)) { continue; }
+                    uint32_t expected = 0;
+                    if(e.pins.compare_exchange_strong(expected, Busy, std::memory_order_acquire))
+                        {
+                        s.evictions.fetch_add(1, std::memory_order_relaxed);
+                        return(&e);
+                        }
+                    }
+                return(NULL);
+                }
+            // Zeroise an entry held exclusively (Busy).
+            static void zeroise(Entry &e)
+                {
+                e.valid.store(false, std::memory_order_relaxed);
+                e.kc.clear();
+                volatile uint8_t *k = e.key;
+                for(uint8_t i = 0; i < 16; ++i) { k[i] = 0; }
+                }
+
+        public:
+            // Pinned use of a cached key context; movable, not copyable.
+            // Release (or destroy) promptly as a pinned entry cannot be evicted.
+            class Lease final
+                {
+                friend class OTAES128GCMKeyCache;
+                private:
+                    Entry *e;
+                    explicit Lease(Entry *ep) : e(ep) { }
+                public:
+                    Lease() : e(NULL) { }
+                    Lease(Lease &&other) : e(other.e) { other.e = NULL; }
+                    Lease &operator=(Lease &&other) { if(this != &other) { release(); e = other.e; other.e = NULL; } return(*this); }
+                    Lease(const Lease &) = delete;
+                    Lease &operator=(const Lease &) = delete;
+                    ~Lease() { release(); }
+                    // Key context, or NULL if none could be had.
+                    OTAES128GCMKeyContext *get() const { return((NULL == e) ? NULL : &e->kc); }
+                    explicit operator bool() const { return(NULL != e); }
+                    // Unpin; idempotent.
+                    void release() { if(NULL != e) { e->pins.fetch_sub(1, std::memory_order_release); e = NULL; } }
+                };
+
+            // Hit/miss/eviction counts summed over all shards.
+            struct Stats final { uint64_t hits, misses, evictions; };
+
+            OTAES128GCMKeyCache() { }
+            ~OTAES128GCMKeyCache() { clear(); }
+            OTAES128GCMKeyCache(const OTAES128GCMKeyCache &) = delete;
+            OTAES128GCMKeyCache &operator=(const OTAES128GCMKeyCache &) = delete;
+
+            // Memory used by each entry, ie the budget per cached key.
+            static constexpr size_t entrySize = sizeof(Entry);
+            // Maximum number of keys cached.
+            static constexpr size_t capacity = Shards * Ways;
+
+            // 64-bit tag derived from a 16-byte key, for callers without a node ID.
+            // (Not secret-preserving: only for lookups held in this process.)
+            static uint64_t fingerprint(const uint8_t *key)
+                {
+                uint64_t h = 0xcbf29ce484222325ULL; // FNV-1a.
+                for(uint8_t i = 0; i < 16; ++i) { h = (h ^ key[i]) * 0x100000001b3ULL; }
+                return(h);
+                }
+
+            // Get a keyed context for tag and key, keying (and possibly evicting) on a miss.
+            // Returns an empty lease if key is NULL or all entries in the shard are in use.
+            Lease acquire(const uint64_t tag, const uint8_t *const key)
+                {
+                if(NULL == key) { return(Lease()); }
+                Shard &s = shardFor(shards, tag);
+                Entry *e = find(s, tag, key);
+                if(NULL != e)
+                    {
+                    e->referenced.store(true, std::memory_order_relaxed);
+                    s.hits.fetch_add(1, std::memory_order_relaxed);
+                    return(Lease(e));
+                    }
+                s.misses.fetch_add(1, std::memory_order_relaxed);
+                std::lock_guard<std::mutex> lock(s.insertLock);
+                // Another thread may have inserted it meanwhile.
+                e = find(s, tag, key);
+                if(NULL != e) { return(Lease(e)); }
+                // A stale entry for this tag (eg the node has re-keyed) becomes the preferred victim.
+                for(size_t w = 0; w < Ways; ++w)
+                    {
+                    Entry &o = s.entries[w];
+                    if(o.valid.load(std::memory_order_relaxed) && (tag == o.tag.load(std::memory_order_relaxed)))
+                        { o.valid.store(false, std::memory_order_release); }
+                    }
+                e = takeVictim(s);
+                if(NULL == e) { return(Lease()); }
+                zeroise(*e);
+                if(!e->kc.setKey(key)) { e->pins.store(0, std::memory_order_release); return(Lease()); }
+                memcpy(e->key, key, 16);
+                e->tag.store(tag, std::memory_order_relaxed);
+                e->referenced.store(false, std::memory_order_relaxed);
+                e->valid.store(true, std::memory_order_relaxed);
+                // Publish the entry, pinned once for this caller.
+                e->pins.store(1, std::memory_order_release);
+                return(Lease(e));
+                }
+            Lease acquire(const uint8_t *const key)
+                { return((NULL == key) ? Lease() : acquire(fingerprint(key), key)); }
+
+            // As the OTAES128GCMGenericBase calls of the same name,
+            // but keyed from the cache, else from the raw key via gcm
+            // (which fails if gcm has no AES/GHASH workspace of its own).
+            bool gcmEncryptLarge(OTAES128GCMGenericBase &gcm, const uint64_t tag, const uint8_t *key,
+                                 const uint8_t* IV, const uint8_t* PDATA, size_t PDATALength,
+                                 const uint8_t* ADATA, size_t ADATALength, uint8_t* CDATA, uint8_t *tag16)
+                {
+                const Lease l = acquire(tag, key);
+                if(!l) { return(gcm.gcmEncryptLarge(key, IV, PDATA, PDATALength, ADATA, ADATALength, CDATA, tag16)); }
+                return(gcm.gcmEncryptLarge(*l.get(), IV, PDATA, PDATALength, ADATA, ADATALength, CDATA, tag16));
+                }
+            bool gcmDecryptLarge(OTAES128GCMGenericBase &gcm, const uint64_t tag, const uint8_t *key,
+                                 const uint8_t* IV, const uint8_t* CDATA, size_t CDATALength,
+                                 const uint8_t* ADATA, size_t ADATALength, const uint8_t* messageTag, uint8_t *PDATA)
+                {
+                const Lease l = acquire(tag, key);
+                if(!l) { return(gcm.gcmDecryptLarge(key, IV, CDATA, CDATALength, ADATA, ADATALength, messageTag, PDATA)); }
+                return(gcm.gcmDecryptLarge(*l.get(), IV, CDATA, CDATALength, ADATA, ADATALength, messageTag, PDATA));
+                }
+
+            // Counts so far; each is individually (not jointly) exact.
+            Stats stats() const
+                {
+                Stats r = { 0, 0, 0 };
+                for(size_t i = 0; i < Shards; ++i)
+                    {
+                    r.hits += shards[i].hits.load(std::memory_order_relaxed);
+                    r.misses += shards[i].misses.load(std::memory_order_relaxed);
+                    r.evictions += shards[i].evictions.load(std::memory_order_relaxed);
+                    }
+                return(r);
+                }
+
+            // Zeroise and drop every entry; must not overlap any other use.
+            void clear()
+                {
+                for(size_t i = 0; i < Shards; ++i)
+                    {
+                    std::lock_guard<std::mutex> lock(shards[i].insertLock);
+                    for(size_t w = 0; w < Ways; ++w) { zeroise(shards[i].entries[w]); }
+                    }
+                }
+        };
+
+
+    }
+
+#endif // !defined(__AVR_ARCH__) && !defined(ARDUINO_ARCH_AVR)
+
+#endif
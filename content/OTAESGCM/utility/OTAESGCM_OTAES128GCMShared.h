@@ -0,0 +1,115 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Deniz Erbilgin 2015--2017
+                           Damon Hart-Davis 2015--2017
+*/
+
+/* AES(128)-GCM key contexts keyed once and shared read-only between threads. */
+
+#ifndef ARDUINO_LIB_OTAESGCM_OTAES128GCMSHARED_H
+#define ARDUINO_LIB_OTAESGCM_OTAES128GCMSHARED_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "OTAESGCM_OTAES128Impls.h"
+#include "OTAESGCM_OTGHASH128Impls.h"
+#include "OTAESGCM_OTAESGCM.h"
+
+/*
+
+Per-key state (AES round keys, H, GHASH tables) lives in a key context,
+and per-call scratch (counter block, GHASH accumulator, partial blocks)
+lives in the OTAES128GCMGenericBase instance making the call.
+Where the AES and GHASH implementations write nothing once keyed,
+one key context can be keyed once and then used concurrently,
+without locks, by any number of threads each with its own front end, eg:
+
+    static uint8_t kcWS[OTAESGCM::OTAES128GCMSharedKeyContext<>::workspaceRequired];
+    static OTAESGCM::OTAES128GCMSharedKeyContext<> kc(kcWS, sizeof(kcWS));
+    kc.setKey(key); // Before starting any threads.
+    ...
+    // In each thread:
+    OTAESGCM::OTAES128GCMThreadScratch gcm;
+    gcm.gcmEncryptLarge(kc, iv, ...);
+
+The key context must not be re-keyed or cleared while in use.
+
+*/
+
+// Use namespaces to help avoid collisions.
+namespace OTAESGCM
+    {
+
+
+    // Rejects at compile time any AES or GHASH implementation that is not shareable.
+    template<class OTAESImpl, class OTGHASHImpl>
+    struct OTAES128GCMSharedKeyContextType final
+        {
+        static_assert(OTAESGCMReadOnlyWhenKeyed<OTAESImpl>::value, "AES implementation not read-only when keyed");
+        static_assert(OTAESGCMReadOnlyWhenKeyed<OTGHASHImpl>::value, "GHASH implementation not read-only when keyed");
+        typedef OTAES128GCMKeyContextWithWorkspace<OTAESImpl, OTGHASHImpl> type;
+        };
+
+    // Key context that may be shared read-only between threads once keyed.
+    // Key it with setKey() before sharing it,
+    // and do not call setKey() or clear() again while any thread may be using it.
+    // Use it only through the key-context overloads of OTAES128GCMGenericBase,
+    // each thread (or concurrent caller) with its own instance,
+    // eg an OTAES128GCMThreadScratch.
+    template<class OTAESImpl = OTAESGCM::OTAES128E_fast_t, class OTGHASHImpl = OTAESGCM::OTGHASH128_fast_t>
+    using OTAES128GCMSharedKeyContext = typename OTAES128GCMSharedKeyContextType<OTAESImpl, OTGHASHImpl>::type;
+
+    // Per-thread front end for use with a shared key context:
+    // holds only the small per-call scratch (a few blocks), no key material.
+    // Only the overloads taking a key context (and the batch calls
+    // with frames carrying a key context) work;
+    // those taking a raw key fail cleanly as this has no AES or GHASH workspace.
+    // Neither re-entrant nor ISR-safe except where stated.
+    class OTAES128GCMThreadScratch final : OTAES128E_AVRSmall, OTGHASH128_BitSerial, public OTAES128GCMGenericBase
+        {
+        private:
+            // Union of temporary workspaces for the GCM functions.
+            // Only one is ever needed for any one call,
+            // and calls cannot be made concurrently on any one instance.
+            union
+                {
+#if defined(OTAESGCM_ALLOW_UNPADDED)
+                GGBWS::GCMEncryptWorkspace encWS;
+#endif
+                GGBWS::GCMEncryptPaddedWorkspace encPaddedWS;
+                GGBWS::GCMDecryptWorkspace decWS;
+                };
+            // Return appropriate temporary workspace.
+#if defined(OTAESGCM_ALLOW_UNPADDED)
+            virtual GGBWS::GCMEncryptWorkspace &getGCMEncryptWorkspace() override { return(encWS); }
+#endif
+            virtual GGBWS::GCMEncryptPaddedWorkspace &getGCMEncryptPaddedWorkspace() override { return(encPaddedWS); }
+            virtual GGBWS::GCMDecryptWorkspace &getGCMDecryptWorkspace() override { return(decWS); }
+
+        public:
+            // Construct an instance.
+            // The AES and GHASH implementations get no workspace, so can never be keyed.
+            OTAES128GCMThreadScratch()
+                : OTAES128E_AVRSmall(NULL, 0),
+                  OTGHASH128_BitSerial(NULL, 0),
+                  OTAES128GCMGenericBase(this, this) { }
+        };
+
+
+    }
+
+#endif
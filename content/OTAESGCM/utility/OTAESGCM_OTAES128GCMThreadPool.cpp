@@ -0,0 +1,297 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Deniz Erbilgin 2015--2017
+                           Damon Hart-Davis 2015--2017
+*/
+
+/* Worker thread pool running AES(128)-GCM jobs submitted from any thread. */
+
+#if !defined(__AVR_ARCH__) && !defined(ARDUINO_ARCH_AVR) // Not for Atmel AVR.
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "OTAESGCM_OTAES128Impls.h"
+#include "OTAESGCM_OTGHASH128Impls.h"
+#include "OTAESGCM_OTAES128GCMThreadPool.h"
+
+
+// Use namespaces to help avoid collisions.
+namespace OTAESGCM
+    {
+
+
+// Per-worker GCM instance and stealable deque of jobs taken but not yet run.
+struct OTAES128GCMThreadPool::Worker final
+{
+    typedef OTAES128GCMGenericWithWorkspace<OTAES128E_fast_t, OTGHASH128_fast_t> gcm_t;
+    std::unique_ptr<uint8_t[]> ws;
+    gcm_t gcm;
+    // Guards jobs; held only briefly by the owner and by thieves.
+    std::mutex lock;
+    std::deque<OTAES128GCMJob *> jobs;
+    std::thread thread;
+    Worker() : ws(new uint8_t[gcm_t::workspaceRequired]()), gcm(ws.get(), gcm_t::workspaceRequired) { }
+};
+
+/**
+ * @brief   orders jobs by direction then key context (or key),
+ *          so that jobs which can share a batch are adjacent
+ */
+static bool groupOrder(const OTAES128GCMJob *a, const OTAES128GCMJob *b)
+{
+    if(a->decrypt != b->decrypt) { return(!a->decrypt); }
+    const uintptr_t ka = (NULL != a->frame.kc) ? (uintptr_t)a->frame.kc : (uintptr_t)a->frame.key;
+    const uintptr_t kb = (NULL != b->frame.kc) ? (uintptr_t)b->frame.kc : (uintptr_t)b->frame.key;
+    return(ka < kb);
+}
+
+#if defined(__linux__)
+/**
+ * @brief   binds thread t to the n-th (modulo count) CPU
+ *          this process may run on; failure is ignored
+ */
+static void pinToCPU(std::thread &t, const unsigned n)
+{
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if(0 != sched_getaffinity(0, sizeof(allowed), &allowed)) { return; }
+    const int count = CPU_COUNT(&allowed);
+    if(count <= 0) { return; }
+    int skip = int(n % unsigned(count));
+    for(int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if(!CPU_ISSET(cpu, &allowed)) { continue; }
+        if(0 != skip--) { continue; }
+        cpu_set_t one;
+        CPU_ZERO(&one);
+        CPU_SET(cpu, &one);
+        pthread_setaffinity_np(t.native_handle(), sizeof(one), &one);
+        return;
+    }
+}
+#endif
+
+/**
+ * @brief   starts the workers
+ * @param   nWorkersIn      number of workers, or 0 for one per hardware thread
+ * @param   queueCapacity   minimum submission queue capacity, rounded up to a power of two
+ * @param   pin             if true bind each worker to a CPU where supported
+ */
+OTAES128GCMThreadPool::OTAES128GCMThreadPool(const unsigned nWorkersIn, const size_t queueCapacity, const bool pin)
+  : nWorkers((0 != nWorkersIn) ? nWorkersIn : std::max(1U, std::thread::hardware_concurrency())),
+    mask([](size_t c) { size_t p = 2; while(p < c) { p <<= 1; } return(p - 1); }(queueCapacity)),
+    cells(new Cell[mask + 1]), enqueuePos(0), dequeuePos(0),
+    pool(new std::unique_ptr<Worker>[nWorkers]), sleepers(0), stopping(false)
+{
+    for(size_t i = 0; i <= mask; ++i) { cells[i].seq.store(i, std::memory_order_relaxed); cells[i].job = NULL; }
+    // All workers exist before any runs, so any may be stolen from.
+    for(unsigned i = 0; i < nWorkers; ++i) { pool[i].reset(new Worker); }
+    for(unsigned i = 0; i < nWorkers; ++i) {
+        pool[i]->thread = std::thread(&OTAES128GCMThreadPool::run, this, i);
+#if defined(__linux__)
+        if(pin) { pinToCPU(pool[i]->thread, i); }
+#else
+        (void)pin;
+#endif
+    }
+}
+
+/**
+ * @brief   finishes all jobs submitted so far then stops the workers
+ */
+OTAES128GCMThreadPool::~OTAES128GCMThreadPool()
+{
+    stopping.store(true);
+    {
+        std::lock_guard<std::mutex> lk(sleepLock);
+        wake.notify_all();
+    }
+    for(unsigned i = 0; i < nWorkers; ++i) { pool[i]->thread.join(); }
+}
+
+/**
+ * @brief   queues a job for the workers; lock-free
+ * @retval  true if queued, false if job is NULL,
+ *          if its key context is not read-only when keyed, or if the queue is full
+ */
+bool OTAES128GCMThreadPool::submit(OTAES128GCMJob *const job)
+{
+    if(NULL == job) { return(false); }
+    // Workers may use the job's key context concurrently.
+    const OTAES128GCMKeyContext *const kc = job->frame.kc;
+    if((NULL != kc) && !kc->isReadOnlyWhenKeyed()) { return(false); }
+    size_t pos = enqueuePos.load(std::memory_order_relaxed);
+    Cell *cell;
+    for( ; ; ) {
+        cell = &cells[pos & mask];
+        const size_t seq = cell->seq.load(std::memory_order_acquire);
+        const intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+        if(0 == dif) {
+            if(enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) { break; }
+        } else if(dif < 0) {
+            return(false); // Full.
+        } else {
+            pos = enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+    cell->job = job;
+    cell->seq.store(pos + 1, std::memory_order_release);
+    // Pairs with the sleeper count raised before an idle worker's last look at the queue.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    wakeOne();
+    return(true);
+}
+
+/**
+ * @brief   takes a job off the submission queue; lock-free
+ * @retval  the job, or NULL if the queue is empty
+ */
+OTAES128GCMJob *OTAES128GCMThreadPool::dequeue()
+{
+    size_t pos = dequeuePos.load(std::memory_order_relaxed);
+    Cell *cell;
+    for( ; ; ) {
+        cell = &cells[pos & mask];
+        const size_t seq = cell->seq.load(std::memory_order_acquire);
+        const intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+        if(0 == dif) {
+            if(dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) { break; }
+        } else if(dif < 0) {
+            return(NULL); // Empty.
+        } else {
+            pos = dequeuePos.load(std::memory_order_relaxed);
+        }
+    }
+    OTAES128GCMJob *const job = cell->job;
+    cell->seq.store(pos + mask + 1, std::memory_order_release);
+    return(job);
+}
+
+void OTAES128GCMThreadPool::wakeOne()
+{
+    if(0 == sleepers.load()) { return; }
+    // Taking the lock ensures that a worker counted as a sleeper is waiting.
+    std::lock_guard<std::mutex> lk(sleepLock);
+    wake.notify_one();
+}
+
+/**
+ * @brief   takes up to BatchMax jobs for worker self:
+ *          first from its own deque, else a grouped batch off the queue
+ *          (leaving any excess in its deque for thieves),
+ *          else stolen from the far end of another worker's deque
+ * @retval  number of jobs placed in batch
+ */
+size_t OTAES128GCMThreadPool::takeBatch(const unsigned self, OTAES128GCMJob **const batch)
+{
+    Worker &w = *pool[self];
+    size_t n = 0;
+    {
+        std::lock_guard<std::mutex> lk(w.lock);
+        while((n < BatchMax) && !w.jobs.empty()) { batch[n++] = w.jobs.front(); w.jobs.pop_front(); }
+    }
+    if(0 != n) { return(n); }
+
+    OTAES128GCMJob *pulled[2 * BatchMax];
+    size_t m = 0;
+    while(m < 2 * BatchMax) {
+        OTAES128GCMJob *const job = dequeue();
+        if(NULL == job) { break; }
+        pulled[m++] = job;
+    }
+    if(0 != m) {
+        std::stable_sort(pulled, pulled + m, groupOrder);
+        n = (m < BatchMax) ? m : BatchMax;
+        std::copy(pulled, pulled + n, batch);
+        if(m > n) {
+            {
+                std::lock_guard<std::mutex> lk(w.lock);
+                w.jobs.insert(w.jobs.end(), pulled + n, pulled + m);
+            }
+            wakeOne();
+        }
+        return(n);
+    }
+
+    for(unsigned k = 1; k < nWorkers; ++k) {
+        Worker &victim = *pool[(self + k) % nWorkers];
+        std::lock_guard<std::mutex> lk(victim.lock);
+        const size_t half = (victim.jobs.size() + 1) / 2;
+        const size_t take = (half < BatchMax) ? half : BatchMax;
+        while(n < take) { batch[n++] = victim.jobs.back(); victim.jobs.pop_back(); }
+        if(0 != n) { std::reverse(batch, batch + n); return(n); }
+    }
+    return(0);
+}
+
+/**
+ * @brief   runs a batch through the worker's GCM instance,
+ *          one gcmEncryptBatch()/gcmDecryptBatch() call per direction,
+ *          and completes each job
+ */
+void OTAES128GCMThreadPool::runBatch(Worker &w, OTAES128GCMJob **const batch, const size_t n)
+{
+    std::stable_sort(batch, batch + n, groupOrder);
+    OTAES128GCMFrameDescriptor frames[BatchMax];
+    uint8_t ok[(BatchMax + 7) / 8];
+    size_t i = 0;
+    while(i < n) {
+        const bool decrypt = batch[i]->decrypt;
+        size_t end = i;
+        while((end < n) && (batch[end]->decrypt == decrypt)) { frames[end - i] = batch[end]->frame; ++end; }
+        if(decrypt) { w.gcm.gcmDecryptBatch(frames, end - i, ok); }
+        else { w.gcm.gcmEncryptBatch(frames, end - i, ok); }
+        for(size_t j = i; j < end; ++j) {
+            OTAES128GCMJob *const job = batch[j];
+            const size_t b = j - i;
+            // The callback may release the job, so it is the last use.
+            if(NULL != job->done) { job->done(job, 0 != (ok[b >> 3] & (1 << (b & 7)))); }
+        }
+        i = end;
+    }
+}
+
+/**
+ * @brief   worker thread: runs batches until stopping and no work is left anywhere
+ */
+void OTAES128GCMThreadPool::run(const unsigned self)
+{
+    OTAES128GCMJob *batch[BatchMax];
+    for( ; ; ) {
+        const size_t n = takeBatch(self, batch);
+        if(0 != n) { runBatch(*pool[self], batch, n); continue; }
+        if(stopping.load()) { return; }
+        std::unique_lock<std::mutex> lk(sleepLock);
+        sleepers.fetch_add(1);
+        // With the count raised, either a submitter will see it and notify,
+        // or this sees the submitter's job.
+        // The timeout covers work left in other workers' deques.
+        if((enqueuePos.load() == dequeuePos.load()) && !stopping.load())
+            { wake.wait_for(lk, std::chrono::milliseconds(10)); }
+        sleepers.fetch_sub(1);
+    }
+}
+
+
+    }
+
+#endif
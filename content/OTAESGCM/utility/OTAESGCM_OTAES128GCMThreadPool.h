@@ -0,0 +1,154 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Deniz Erbilgin 2015--2017
+                           Damon Hart-Davis 2015--2017
+*/
+
+/* Worker thread pool running AES(128)-GCM jobs submitted from any thread. */
+
+#ifndef ARDUINO_LIB_OTAESGCM_OTAES128GCMTHREADPOOL_H
+#define ARDUINO_LIB_OTAESGCM_OTAES128GCMTHREADPOOL_H
+
+#if !defined(__AVR_ARCH__) && !defined(ARDUINO_ARCH_AVR)
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "OTAESGCM_OTAESGCM.h"
+
+/*
+
+Jobs are submitted through a bounded lock-free multi-producer/multi-consumer
+queue, and taken off it by workers in small batches,
+which are sorted so that jobs sharing a key context (or key)
+and direction are adjacent, and so run through gcmEncryptBatch()/gcmDecryptBatch()
+reusing one key schedule with interleaved AES work.
+Each worker keeps the jobs it has taken but not yet run in its own deque,
+from which idle workers steal (from the opposite end).
+Each worker has its own GCM instance and workspace,
+and a job's key context may be used by several workers at once,
+so must be read-only when keyed (see OTAES128GCMSharedKeyContext);
+submit() rejects jobs with any other key context.
+Jobs with a raw key are keyed by the worker for each batch.
+
+*/
+
+// Use namespaces to help avoid collisions.
+namespace OTAESGCM
+    {
+
+
+    // One GCM encrypt or decrypt job.
+    // Value-initialise, then fill in frame (as for gcmEncryptBatch()/gcmDecryptBatch()),
+    // decrypt, and optionally done and user.
+    // All pointed-to data, and any key context, must remain valid
+    // until completion, and the job must not be changed meanwhile.
+    struct OTAES128GCMJob
+        {
+        OTAES128GCMFrameDescriptor frame;
+        // True to decrypt and check the tag, else encrypt and write it.
+        bool decrypt;
+        // Completion callback, run on a worker thread; may be NULL.
+        // ok is false if the tag did not match or the frame was invalid.
+        // The job may be released or re-submitted from within the callback.
+        void (*done)(OTAES128GCMJob *job, bool ok);
+        // For the caller's use, eg by done().
+        void *user;
+        };
+
+    // Job completing through a future rather than a callback.
+    struct OTAES128GCMFutureJob final : public OTAES128GCMJob
+        {
+        std::promise<bool> promise;
+        OTAES128GCMFutureJob() : OTAES128GCMJob() { done = fulfil; }
+        // Get the future for this job; call once, before submitting it.
+        std::future<bool> future() { return(promise.get_future()); }
+        private:
+            static void fulfil(OTAES128GCMJob *job, bool ok)
+                { static_cast<OTAES128GCMFutureJob *>(job)->promise.set_value(ok); }
+        };
+
+    // Pool of worker threads running GCM jobs.
+    // submit() may be called concurrently from any number of threads.
+    // Destruction finishes all jobs submitted so far then stops the workers,
+    // and must not overlap any submit().
+    class OTAES128GCMThreadPool final
+        {
+        public:
+            // Maximum jobs run together in one batch.
+            static constexpr size_t BatchMax = 16;
+
+            // Start nWorkers workers (0 for one per hardware thread),
+            // with a submission queue of at least queueCapacity jobs.
+            // If pin is true each worker is bound to one CPU where supported (Linux).
+            explicit OTAES128GCMThreadPool(unsigned nWorkers = 0, size_t queueCapacity = 1024, bool pin = true);
+            ~OTAES128GCMThreadPool();
+            OTAES128GCMThreadPool(const OTAES128GCMThreadPool &) = delete;
+            OTAES128GCMThreadPool &operator=(const OTAES128GCMThreadPool &) = delete;
+
+            // Queue a job; false (and the job is not run) if NULL,
+            // if its key context is not read-only when keyed, or if the queue is full.
+            bool submit(OTAES128GCMJob *job);
+
+            // Number of worker threads.
+            unsigned workers() const { return(nWorkers); }
+
+        private:
+            // Cell of the bounded MPMC queue (after D Vyukov).
+            struct Cell final
+                {
+                std::atomic<size_t> seq;
+                OTAES128GCMJob *job;
+                };
+            struct Worker;
+
+            const unsigned nWorkers;
+            const size_t mask;
+            std::unique_ptr<Cell[]> cells;
+            std::atomic<size_t> enqueuePos;
+            std::atomic<size_t> dequeuePos;
+            std::unique_ptr<std::unique_ptr<Worker>[]> pool;
+
+            // Idle workers wait here.
+            std::mutex sleepLock;
+            std::condition_variable wake;
+            std::atomic<unsigned> sleepers;
+            std::atomic<bool> stopping;
+
+            OTAES128GCMJob *dequeue();
+            // Take up to BatchMax jobs for worker self: own deque, queue, then stealing.
+            size_t takeBatch(unsigned self, OTAES128GCMJob **batch);
+            // Run and complete a batch, grouped by direction and key.
+            static void runBatch(Worker &w, OTAES128GCMJob **batch, size_t n);
+            // Worker thread body.
+            void run(unsigned self);
+            // Wake one idle worker, if any.
+            void wakeOne();
+        };
+
+
+    }
+
+#endif // !defined(__AVR_ARCH__) && !defined(ARDUINO_ARCH_AVR)
+
+#endif
@@ -32,25 +32,45 @@ Author(s) / Copyright (s): Deniz Erbilgin 2015--2017
 namespace OTAESGCM
     {
     typedef OTAES128E_AVR OTAES128E_fast_t;
-    typedef OTAES128E_AVR OTAES128E_small_t;
+    // Round keys derived on the fly: 16 rather than 176 bytes of workspace.
+    typedef OTAES128E_AVRSmall OTAES128E_small_t;
     typedef OTAES128E_AVR OTAES128E_default_t;
     typedef OTAES128DE_AVR OTAES128DE_fast_t;
     typedef OTAES128DE_AVR OTAES128DE_small_t;
     typedef OTAES128DE_AVR OTAES128DE_default_t;
+    // No data cache, so the table-driven AVR impl has no cache-timing channel.
+    typedef OTAES128E_AVR OTAES128E_ct_t;
     }
 #else
 
 // Take this as a generic impl for MCUs.
 #include "OTAESGCM_OTAES128AVR.h"
+// Word-oriented T-table impl for hosts with 32/64-bit CPUs and plenty of ROM.
+#include "OTAESGCM_OTAES128TTable.h"
+// Constant-time bitsliced impl for hosts with 64-bit words.
+#include "OTAESGCM_OTAES128Bitsliced.h"
+// AES-NI and SSSE3 vector-permute impls and run-time dispatch for x86 hosts.
+#include "OTAESGCM_OTAES128AESNI.h"
 // Fast, small and default implementations, enc and enc+dec, for this architecture.
 namespace OTAESGCM
     {
-    typedef OTAES128E_AVR OTAES128E_fast_t;
-    typedef OTAES128E_AVR OTAES128E_small_t;
+#if defined(OTAESGCM_X86_INTRINSICS)
+    // AES-NI where the CPU has it, else vector-permute with SSSE3,
+    // else T-table, checked once at run time.
+    typedef OTAES128E_RuntimeDispatch OTAES128E_fast_t;
+    typedef OTAES128DE_RuntimeDispatch OTAES128DE_fast_t;
+#else
+    typedef OTAES128E_TTable OTAES128E_fast_t;
+    typedef OTAES128DE_TTable OTAES128DE_fast_t;
+#endif
+    // Round keys derived on the fly: 16 rather than 176 bytes of workspace.
+    typedef OTAES128E_AVRSmall OTAES128E_small_t;
     typedef OTAES128E_AVR OTAES128E_default_t;
-    typedef OTAES128DE_AVR OTAES128DE_fast_t;
     typedef OTAES128DE_AVR OTAES128DE_small_t;
     typedef OTAES128DE_AVR OTAES128DE_default_t;
+    // Constant-time (no secret-dependent table lookups) encryption,
+    // for hosts where cache-timing attacks matter and AES-NI may be absent.
+    typedef OTAES128E_Bitsliced OTAES128E_ct_t;
     }
 
 
@@ -0,0 +1,376 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Deniz Erbilgin 2015--2017
+                           Damon Hart-Davis 2015--2017
+*/
+
+/* Word-oriented (32-bit T-table) AES(128) implementation for hosts. */
+
+#if !defined(__AVR_ARCH__) && !defined(ARDUINO_ARCH_AVR) // Not for Atmel AVR.
+
+#include <stdint.h>
+#include <string.h>
+
+#include "OTAESGCM_OTAES128.h"
+#include "OTAESGCM_OTAES128TTable.h"
+
+
+// Use namespaces to help avoid collisions.
+namespace OTAESGCM
+    {
+
+
+/*
+
+Word-oriented AES128 using precomputed 32-bit tables combining
+SubBytes, ShiftRows and MixColumns for each round (after Daemen & Rijmen,
+"The Design of Rijndael", section 4.2, and the widely-used public domain
+rijndael-alg-fst.c).
+
+Words are big-endian, ie the first byte of a column is in the top 8 bits,
+so the implementation is independent of host byte order.
+
+All tables are computed at compile time from the GF(2^8) definitions
+rather than being transcribed, so that they cannot be mistyped.
+
+*/
+
+
+/*****************************************************************************/
+/* Compile-time table generation:                                            */
+/*****************************************************************************/
+
+// Multiply by {02} in GF(2^8).
+static constexpr uint8_t xtime(const uint8_t x)
+    { return(uint8_t((x << 1) ^ ((x & 0x80) ? 0x1b : 0))); }
+// General multiplication in GF(2^8).
+static constexpr uint8_t gmul(const uint8_t a, const uint8_t b)
+    { return((0 == b) ? 0 : uint8_t(((b & 1) ? a : 0) ^ gmul(xtime(a), uint8_t(b >> 1)))); }
+// Product of sq^(2^0) .. sq^(2^(7-i)); used to form x^254 = x^-1.
+static constexpr uint8_t ginvStep(const uint8_t sq, const uint8_t i)
+    { return((8 == i) ? 1 : gmul(sq, ginvStep(gmul(sq, sq), uint8_t(i + 1)))); }
+// Multiplicative inverse in GF(2^8), with 0 mapping to 0.
+static constexpr uint8_t ginv(const uint8_t x)
+    { return(ginvStep(gmul(x, x), 1)); }
+// Rotate a byte left.
+static constexpr uint8_t rotl8(const uint8_t x, const uint8_t s)
+    { return(uint8_t((x << s) | (x >> (8 - s)))); }
+// AES S-box: affine transform of the inverse.
+static constexpr uint8_t sboxAffine(const uint8_t b)
+    { return(uint8_t(b ^ rotl8(b, 1) ^ rotl8(b, 2) ^ rotl8(b, 3) ^ rotl8(b, 4) ^ 0x63)); }
+static constexpr uint8_t sboxValue(const int x)
+    { return(sboxAffine(ginv(uint8_t(x)))); }
+// AES inverse S-box: inverse of the inverse affine transform.
+static constexpr uint8_t rsboxValue(const int x)
+    { return(ginv(uint8_t(rotl8(uint8_t(x), 1) ^ rotl8(uint8_t(x), 3) ^ rotl8(uint8_t(x), 6) ^ 0x05))); }
+
+// Pack four bytes into a big-endian word.
+static constexpr uint32_t word(const uint8_t b0, const uint8_t b1, const uint8_t b2, const uint8_t b3)
+    { return((uint32_t(b0) << 24) | (uint32_t(b1) << 16) | (uint32_t(b2) << 8) | uint32_t(b3)); }
+// Rotate a word right.
+static constexpr uint32_t ror32(const uint32_t x, const uint8_t s)
+    { return((x >> s) | (x << (32 - s))); }
+
+// Forward round column for S-box output s: (2s, s, s, 3s).
+static constexpr uint32_t te0Column(const uint8_t s)
+    { return(word(xtime(s), s, s, uint8_t(xtime(s) ^ s))); }
+static constexpr uint32_t te0Value(const int x) { return(te0Column(sboxValue(x))); }
+static constexpr uint32_t te1Value(const int x) { return(ror32(te0Value(x), 8)); }
+static constexpr uint32_t te2Value(const int x) { return(ror32(te0Value(x), 16)); }
+static constexpr uint32_t te3Value(const int x) { return(ror32(te0Value(x), 24)); }
+// Inverse round column for inverse S-box output s: (14s, 9s, 13s, 11s).
+static constexpr uint32_t td0Column(const uint8_t s)
+    { return(word(gmul(s, 0x0e), gmul(s, 0x09), gmul(s, 0x0d), gmul(s, 0x0b))); }
+static constexpr uint32_t td0Value(const int x) { return(td0Column(rsboxValue(x))); }
+static constexpr uint32_t td1Value(const int x) { return(ror32(td0Value(x), 8)); }
+static constexpr uint32_t td2Value(const int x) { return(ror32(td0Value(x), 16)); }
+static constexpr uint32_t td3Value(const int x) { return(ror32(td0Value(x), 24)); }
+
+// Expand f(0) .. f(255) as an initialiser list.
+#define OTAES_TT4(f, i) f(i), f((i)+1), f((i)+2), f((i)+3)
+#define OTAES_TT16(f, i) OTAES_TT4(f, i), OTAES_TT4(f, (i)+4), OTAES_TT4(f, (i)+8), OTAES_TT4(f, (i)+12)
+#define OTAES_TT64(f, i) OTAES_TT16(f, i), OTAES_TT16(f, (i)+16), OTAES_TT16(f, (i)+32), OTAES_TT16(f, (i)+48)
+#define OTAES_TT256(f) OTAES_TT64(f, 0), OTAES_TT64(f, 64), OTAES_TT64(f, 128), OTAES_TT64(f, 192)
+
+static constexpr uint8_t sbox[256] = { OTAES_TT256(sboxValue) };
+static constexpr uint8_t rsbox[256] = { OTAES_TT256(rsboxValue) };
+static constexpr uint32_t Te0[256] = { OTAES_TT256(te0Value) };
+static constexpr uint32_t Te1[256] = { OTAES_TT256(te1Value) };
+static constexpr uint32_t Te2[256] = { OTAES_TT256(te2Value) };
+static constexpr uint32_t Te3[256] = { OTAES_TT256(te3Value) };
+static constexpr uint32_t Td0[256] = { OTAES_TT256(td0Value) };
+static constexpr uint32_t Td1[256] = { OTAES_TT256(td1Value) };
+static constexpr uint32_t Td2[256] = { OTAES_TT256(td2Value) };
+static constexpr uint32_t Td3[256] = { OTAES_TT256(td3Value) };
+
+#undef OTAES_TT256
+#undef OTAES_TT64
+#undef OTAES_TT16
+#undef OTAES_TT4
+
+// Spot checks against FIPS-197.
+static_assert(0x63 == sbox[0x00], "bad sbox");
+static_assert(0x16 == sbox[0xff], "bad sbox");
+static_assert(0xed == sbox[0x53], "bad sbox");
+static_assert(0x52 == rsbox[0x00], "bad rsbox");
+static_assert(0x7d == rsbox[0xff], "bad rsbox");
+static_assert(0xc66363a5 == Te0[0x00], "bad Te0");
+static_assert(0x51f4a750 == Td0[0x00], "bad Td0");
+
+// Round constants for key expansion, in the top byte.
+static constexpr uint32_t rcon[10] =
+    { 0x01000000, 0x02000000, 0x04000000, 0x08000000, 0x10000000,
+      0x20000000, 0x40000000, 0x80000000, 0x1b000000, 0x36000000 };
+
+
+/*****************************************************************************/
+/* Private functions:                                                        */
+/*****************************************************************************/
+
+// Big-endian load/store, independent of host byte order and alignment.
+static inline uint32_t getU32(const uint8_t *p)
+    { return(word(p[0], p[1], p[2], p[3])); }
+static inline void putU32(uint8_t *p, const uint32_t v)
+    { p[0] = uint8_t(v >> 24); p[1] = uint8_t(v >> 16); p[2] = uint8_t(v >> 8); p[3] = uint8_t(v); }
+
+// Byte n (0 = most significant) of a word.
+#define B0(x) ((x) >> 24)
+#define B1(x) (((x) >> 16) & 0xff)
+#define B2(x) (((x) >> 8) & 0xff)
+#define B3(x) ((x) & 0xff)
+
+// One full forward round from s* to t* with round keys r[0..3].
+#define EROUND(t0,t1,t2,t3, s0,s1,s2,s3, r) \
+    t0 = Te0[B0(s0)] ^ Te1[B1(s1)] ^ Te2[B2(s2)] ^ Te3[B3(s3)] ^ (r)[0]; \
+    t1 = Te0[B0(s1)] ^ Te1[B1(s2)] ^ Te2[B2(s3)] ^ Te3[B3(s0)] ^ (r)[1]; \
+    t2 = Te0[B0(s2)] ^ Te1[B1(s3)] ^ Te2[B2(s0)] ^ Te3[B3(s1)] ^ (r)[2]; \
+    t3 = Te0[B0(s3)] ^ Te1[B1(s0)] ^ Te2[B2(s1)] ^ Te3[B3(s2)] ^ (r)[3]
+
+// One full inverse round from s* to t* with round keys r[0..3].
+#define DROUND(t0,t1,t2,t3, s0,s1,s2,s3, r) \
+    t0 = Td0[B0(s0)] ^ Td1[B1(s3)] ^ Td2[B2(s2)] ^ Td3[B3(s1)] ^ (r)[0]; \
+    t1 = Td0[B0(s1)] ^ Td1[B1(s0)] ^ Td2[B2(s3)] ^ Td3[B3(s2)] ^ (r)[1]; \
+    t2 = Td0[B0(s2)] ^ Td1[B1(s1)] ^ Td2[B2(s0)] ^ Td3[B3(s3)] ^ (r)[2]; \
+    t3 = Td0[B0(s3)] ^ Td1[B1(s2)] ^ Td2[B2(s1)] ^ Td3[B3(s0)] ^ (r)[3]
+
+/**
+ * @brief   expand the 128-bit key into 44 big-endian round-key words
+ */
+void OTAES128E_TTable::expandKey(const uint8_t *key, uint32_t *rkOut)
+{
+    uint32_t *r = rkOut;
+    r[0] = getU32(key);
+    r[1] = getU32(key + 4);
+    r[2] = getU32(key + 8);
+    r[3] = getU32(key + 12);
+    for(uint8_t i = 0; i < 10; ++i, r += 4)
+    {
+        const uint32_t temp = r[3];
+        // SubWord(RotWord(temp)) ^ Rcon.
+        r[4] = r[0] ^
+            (uint32_t(sbox[B1(temp)]) << 24) ^
+            (uint32_t(sbox[B2(temp)]) << 16) ^
+            (uint32_t(sbox[B3(temp)]) << 8) ^
+            uint32_t(sbox[B0(temp)]) ^
+            rcon[i];
+        r[5] = r[1] ^ r[4];
+        r[6] = r[2] ^ r[5];
+        r[7] = r[3] ^ r[6];
+    }
+}
+
+/**
+ * @brief   encrypt one block, all 10 rounds unrolled
+ */
+void OTAES128E_TTable::encryptBlock(const uint32_t *r, const uint8_t *in, uint8_t *out)
+{
+    uint32_t s0, s1, s2, s3, t0, t1, t2, t3;
+    s0 = getU32(in) ^ r[0];
+    s1 = getU32(in + 4) ^ r[1];
+    s2 = getU32(in + 8) ^ r[2];
+    s3 = getU32(in + 12) ^ r[3];
+    EROUND(t0,t1,t2,t3, s0,s1,s2,s3, r + 4);
+    EROUND(s0,s1,s2,s3, t0,t1,t2,t3, r + 8);
+    EROUND(t0,t1,t2,t3, s0,s1,s2,s3, r + 12);
+    EROUND(s0,s1,s2,s3, t0,t1,t2,t3, r + 16);
+    EROUND(t0,t1,t2,t3, s0,s1,s2,s3, r + 20);
+    EROUND(s0,s1,s2,s3, t0,t1,t2,t3, r + 24);
+    EROUND(t0,t1,t2,t3, s0,s1,s2,s3, r + 28);
+    EROUND(s0,s1,s2,s3, t0,t1,t2,t3, r + 32);
+    EROUND(t0,t1,t2,t3, s0,s1,s2,s3, r + 36);
+    // Final round: no MixColumns.
+    r += 40;
+    s0 = word(sbox[B0(t0)], sbox[B1(t1)], sbox[B2(t2)], sbox[B3(t3)]) ^ r[0];
+    s1 = word(sbox[B0(t1)], sbox[B1(t2)], sbox[B2(t3)], sbox[B3(t0)]) ^ r[1];
+    s2 = word(sbox[B0(t2)], sbox[B1(t3)], sbox[B2(t0)], sbox[B3(t1)]) ^ r[2];
+    s3 = word(sbox[B0(t3)], sbox[B1(t0)], sbox[B2(t1)], sbox[B3(t2)]) ^ r[3];
+    putU32(out, s0);
+    putU32(out + 4, s1);
+    putU32(out + 8, s2);
+    putU32(out + 12, s3);
+}
+
+/**
+ * @brief   derive the equivalent-inverse-cipher round keys:
+ *          reverse the round order and apply InvMixColumns to rounds 1..9
+ */
+void OTAES128DE_TTable::invertKey(const uint32_t *rkIn, uint32_t *drkOut)
+{
+    for(uint8_t round = 0; round <= 10; ++round)
+    {
+        const uint32_t *src = rkIn + 4 * (10 - round);
+        uint32_t *dst = drkOut + 4 * round;
+        for(uint8_t i = 0; i < 4; ++i)
+        {
+            const uint32_t w = src[i];
+            // Td*[sbox[x]] is the InvMixColumns contribution of byte x.
+            dst[i] = ((0 == round) || (10 == round)) ? w :
+                (Td0[sbox[B0(w)]] ^ Td1[sbox[B1(w)]] ^ Td2[sbox[B2(w)]] ^ Td3[sbox[B3(w)]]);
+        }
+    }
+}
+
+/**
+ * @brief   decrypt one block, all 10 rounds unrolled
+ */
+void OTAES128DE_TTable::decryptBlock(const uint32_t *r, const uint8_t *in, uint8_t *out)
+{
+    uint32_t s0, s1, s2, s3, t0, t1, t2, t3;
+    s0 = getU32(in) ^ r[0];
+    s1 = getU32(in + 4) ^ r[1];
+    s2 = getU32(in + 8) ^ r[2];
+    s3 = getU32(in + 12) ^ r[3];
+    DROUND(t0,t1,t2,t3, s0,s1,s2,s3, r + 4);
+    DROUND(s0,s1,s2,s3, t0,t1,t2,t3, r + 8);
+    DROUND(t0,t1,t2,t3, s0,s1,s2,s3, r + 12);
+    DROUND(s0,s1,s2,s3, t0,t1,t2,t3, r + 16);
+    DROUND(t0,t1,t2,t3, s0,s1,s2,s3, r + 20);
+    DROUND(s0,s1,s2,s3, t0,t1,t2,t3, r + 24);
+    DROUND(t0,t1,t2,t3, s0,s1,s2,s3, r + 28);
+    DROUND(s0,s1,s2,s3, t0,t1,t2,t3, r + 32);
+    DROUND(t0,t1,t2,t3, s0,s1,s2,s3, r + 36);
+    // Final round: no InvMixColumns.
+    r += 40;
+    s0 = word(rsbox[B0(t0)], rsbox[B1(t3)], rsbox[B2(t2)], rsbox[B3(t1)]) ^ r[0];
+    s1 = word(rsbox[B0(t1)], rsbox[B1(t0)], rsbox[B2(t3)], rsbox[B3(t2)]) ^ r[1];
+    s2 = word(rsbox[B0(t2)], rsbox[B1(t1)], rsbox[B2(t0)], rsbox[B3(t3)]) ^ r[2];
+    s3 = word(rsbox[B0(t3)], rsbox[B1(t2)], rsbox[B2(t1)], rsbox[B3(t0)]) ^ r[3];
+    putU32(out, s0);
+    putU32(out + 4, s1);
+    putU32(out + 8, s2);
+    putU32(out + 12, s3);
+}
+
+#undef DROUND
+#undef EROUND
+#undef B3
+#undef B2
+#undef B1
+#undef B0
+
+
+/*****************************************************************************/
+/* Public functions:                                                         */
+/*****************************************************************************/
+
+/**
+ *    @brief    start keyed session: expand the round keys once into the workspace
+ *    @retval   true if the session was started, false if no workspace or key
+ */
+bool OTAES128E_TTable::setKey(const uint8_t *key)
+{
+    // Abort if no workspace to avoid crashing.
+    if((NULL == rk) || (NULL == key)) { return(false); }
+    expandKey(key, rk);
+    keyed = true;
+    return(true);
+}
+
+/**
+ *    @brief    AES128 encryption of whole blocks with the session round keys
+ */
+void OTAES128E_TTable::encryptBlocks(const uint8_t *input, uint8_t *output, size_t nBlocks)
+{
+    // Abort if no session to avoid crashing or leaking.
+    if(!keyed) { return; }
+    for( ; nBlocks > 0; --nBlocks)
+    {
+        encryptBlock(rk, input, output);
+        input += 16;
+        output += 16;
+    }
+}
+
+/**
+ *    @brief    AES128 block encryption
+ *
+ * One-block session.
+ * Cleans up internal sensitive state when done.
+ */
+void OTAES128E_TTable::blockEncrypt(const uint8_t* input, const uint8_t* key, uint8_t *output)
+{
+    // Abort if no workspace to avoid crashing..
+    if(!OTAES128E_TTable::setKey(key)) { return; }
+    encryptBlock(rk, input, output);
+    // Clean up private state.
+    OTAES128E_TTable::cleanup();
+}
+
+/**
+ *    @brief    start keyed session: expand both round-key schedules once
+ *    @retval   true if the session was started, false if no workspace or key
+ */
+bool OTAES128DE_TTable::setKey(const uint8_t *key)
+{
+    if(!OTAES128E_TTable::setKey(key)) { return(false); }
+    invertKey(rk, drk);
+    return(true);
+}
+
+/**
+ *    @brief    AES128 decryption of whole blocks with the session round keys
+ */
+void OTAES128DE_TTable::decryptBlocks(const uint8_t *input, uint8_t *output, size_t nBlocks)
+{
+    // Abort if no session to avoid crashing or leaking.
+    if(!keyed) { return; }
+    for( ; nBlocks > 0; --nBlocks)
+    {
+        decryptBlock(drk, input, output);
+        input += 16;
+        output += 16;
+    }
+}
+
+/**
+ *    @brief    AES128 block decryption
+ *
+ * One-block session.
+ * Cleans up internal sensitive state when done.
+ */
+void OTAES128DE_TTable::blockDecrypt(const uint8_t* input, const uint8_t* key, uint8_t *output)
+{
+    // Abort if no workspace to avoid crashing..
+    if(!setKey(key)) { return; }
+    decryptBlock(drk, input, output);
+    // Clean up private state.
+    cleanup();
+}
+
+
+    }
+
+#endif // !defined(__AVR_ARCH__) && !defined(ARDUINO_ARCH_AVR)
@@ -0,0 +1,139 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Deniz Erbilgin 2015--2017
+                           Damon Hart-Davis 2015--2017
+*/
+
+/* Word-oriented (32-bit T-table) AES(128) implementation for hosts. */
+/* Not intended for small MCUs: needs ~8kB of tables in ROM. */
+
+#ifndef ARDUINO_LIB_OTAESGCM_OTAES128TTABLE_H
+#define ARDUINO_LIB_OTAESGCM_OTAES128TTABLE_H
+
+#include <stdint.h>
+#include <string.h>
+#include "OTAESGCM_OTAES128.h"
+
+
+// Use namespaces to help avoid collisions.
+namespace OTAESGCM
+    {
+
+
+    // 32-bit T-table encrypt-only implementation, fully unrolled.
+    // Suitable for 32/64-bit hosts with data caches, eg x86 and ARM Linux.
+    // Note that the table lookups are secret-indexed and so not constant-time
+    // on CPUs with data caches.
+    // Neither re-entrant nor ISR-safe except where stated.
+    // Carries workspace but logically no state is carried from one operation to the next,
+    // except the expanded key between setKey() and endSession().
+    // Residual state should be regarded as sensitive, and eg overwritten before being released to heap.
+    class OTAES128E_TTable : public OTAES128E
+        {
+        protected:
+            // Number of 32-bit words in the expanded (encryption) key.
+            static constexpr uint8_t RoundKeyWords = 44;
+
+            // Aligned start of the round keys within the caller's workspace;
+            // NULL if insufficient workspace is passed in.
+            uint32_t * const rk;
+            // True while a keyed session is active.
+            bool keyed = false;
+
+            // Round the workspace start up to a uint32_t boundary
+            // if at least required bytes are supplied, else NULL.
+            static uint32_t *alignedRoundKeys(uint8_t *const workspace, const size_t workspaceLen, const size_t required)
+                { return(((NULL == workspace) || (workspaceLen < required)) ? NULL :
+                    (uint32_t *)(((uintptr_t)workspace + (sizeof(uint32_t)-1)) & ~(uintptr_t)(sizeof(uint32_t)-1))); }
+
+        public:
+            // Minimum workspace required, unaligned; strictly positive.
+            // Covers the expanded key plus slack to align it.
+            // This constant, defined per class, is effectively part of the API.
+            static constexpr size_t workspaceRequired = RoundKeyWords * sizeof(uint32_t) + (sizeof(uint32_t)-1);
+
+            // Construct an instance: supplied workspace must be large enough.
+            // Only the initial 'workspaceRequired' bytes will be used.
+            OTAES128E_TTable(uint8_t *const workspace, const size_t workspaceLen)
+              : rk(alignedRoundKeys(workspace, workspaceLen, workspaceRequired))
+                { }
+
+            // Expand a 16-byte key into RoundKeyWords words at rkOut.
+            static void expandKey(const uint8_t *key, uint32_t *rkOut);
+            // Encrypt one block with the expanded key; in and out may be the same.
+            static void encryptBlock(const uint32_t *rkIn, const uint8_t *in, uint8_t *out);
+
+            // Clean up sensitive state.
+            void cleanup() { if((NULL != rk) && keyed)
+                { memset(rk, 0, RoundKeyWords * sizeof(uint32_t)); keyed = false; } }
+
+            // One-block session; cleans up internal sensitive state when done.
+            virtual void blockEncrypt(const uint8_t* input, const uint8_t* key, uint8_t *output) override;
+
+            // Keyed session: the round keys are expanded once by setKey()
+            // and retained in the workspace until endSession()/cleanup().
+            virtual bool setKey(const uint8_t *key) override;
+            virtual void encryptBlocks(const uint8_t *input, uint8_t *output, size_t nBlocks) override;
+            virtual void endSession() override { cleanup(); }
+        };
+
+    // 32-bit T-table decrypt and encrypt implementation, fully unrolled.
+    // Decryption uses the equivalent inverse cipher,
+    // with its own (second) round-key schedule derived once per setKey().
+    // Neither re-entrant nor ISR-safe except where stated.
+    // Carries workspace but logically no state is carried from one operation to the next,
+    // except the expanded keys between setKey() and endSession().
+    class OTAES128DE_TTable final : public OTAES128D, public OTAES128E_TTable
+        {
+        public:
+            // External workspace/scratch required minimum size, unaligned; strictly positive.
+            // Covers encryption and decryption round keys plus alignment slack.
+            // This constant, defined per class, is effectively part of the API.
+            static constexpr size_t workspaceRequired = 2 * RoundKeyWords * sizeof(uint32_t) + (sizeof(uint32_t)-1);
+
+        protected:
+            // Decryption round keys, immediately following the encryption keys.
+            uint32_t * const drk;
+
+        public:
+            // Construct an instance: supplied workspace must be large enough.
+            OTAES128DE_TTable(uint8_t *const workspace, const size_t workspaceLen)
+              : OTAES128E_TTable(workspace, (workspaceLen >= workspaceRequired) ? workspaceLen : 0),
+                drk((NULL == rk) ? NULL : rk + RoundKeyWords)
+                { }
+
+            // Derive the equivalent-inverse-cipher schedule from the encryption one.
+            static void invertKey(const uint32_t *rkIn, uint32_t *drkOut);
+            // Decrypt one block with the inverted key; in and out may be the same.
+            static void decryptBlock(const uint32_t *drkIn, const uint8_t *in, uint8_t *out);
+
+            // Clean up sensitive state.
+            void cleanup() { if((NULL != drk) && keyed)
+                { memset(drk, 0, RoundKeyWords * sizeof(uint32_t)); } OTAES128E_TTable::cleanup(); }
+
+            // One-block session; cleans up internal sensitive state when done.
+            virtual void blockDecrypt(const uint8_t* input, const uint8_t* key, uint8_t *output) override;
+
+            // Keyed session shared with encryption.
+            virtual bool setKey(const uint8_t *key) override;
+            virtual void decryptBlocks(const uint8_t *input, uint8_t *output, size_t nBlocks) override;
+            virtual void endSession() override { cleanup(); }
+        };
+
+
+    }
+
+#endif
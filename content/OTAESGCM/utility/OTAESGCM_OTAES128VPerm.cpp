@@ -0,0 +1,442 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Deniz Erbilgin 2015--2017
+                           Damon Hart-Davis 2015--2017
+*/
+
+/* x86 SSSE3 vector-permute constant-time AES(128) implementation. */
+
+#include "OTAESGCM_CPUFeatures.h"
+
+#if defined(OTAESGCM_X86_INTRINSICS)
+
+#include <stdint.h>
+#include <string.h>
+#include <emmintrin.h>
+#include <tmmintrin.h>
+
+#include "OTAESGCM_OTAES128.h"
+#include "OTAESGCM_OTAES128VPerm.h"
+
+// Compile individual functions for SSSE3 without needing -mssse3 globally.
+#define OTAESGCM_TARGET_SSSE3 __attribute__((target("ssse3")))
+
+
+// Use namespaces to help avoid collisions.
+namespace OTAESGCM
+    {
+
+
+/*
+
+AES128 with vector permutes, after M. Hamburg,
+"Accelerating AES with Vector Permute Instructions" (CHES 2009).
+
+pshufb looks up all 16 bytes of a register in a 16-entry table
+held in another register, so any function of a nibble costs one
+instruction and no memory access indexed by secret data.
+
+Each state byte is mapped (by a linear change of basis, looked up
+by nibble) to a pair of GF(2^4) elements (i, k), representing
+i.t + k in GF(2^4)[t]/(t^2 + 2t + 2) (GF(2^4) mod z^4+z+1).
+With j = i^k, the inverse is then a linear function of
+    io = 1/(1/i + 2/k) + j   and   jo = 1/(1/j + 2/k) + i
+which needs only nibble reciprocals, nibble scaling and XORs.
+1/0 is looked up as 0x80, which pshufb then maps to 0,
+so that zero (and zero denominators) come out correctly.
+The final lookups by io and jo also apply the change of basis back,
+the S-box affine map, and the MixColumns (or InvMixColumns) multipliers.
+
+The S-box affine constant 0x63 passes unchanged through ShiftRows
+and both MixColumns and InvMixColumns, so is folded into the round keys.
+
+The tables were derived and checked exhaustively against
+the FIPS-197 S-box and its inverse.
+
+*/
+
+// Number of independent blocks kept in flight to cover shuffle latency.
+static constexpr uint8_t PIPELINE_BLOCKS = 2;
+
+// Indices of the 16-byte nibble tables.
+enum VPTable : uint8_t
+    {
+    VP_INV, VP_INVA, VP_IPTLO, VP_IPTHI,
+    VP_SB1A, VP_SB1B, VP_SB2A, VP_SB2B,
+    VP_DIPTLO, VP_DIPTHI,
+    VP_D1A, VP_D1B, VP_D9A, VP_D9B, VP_D11A, VP_D11B,
+    VP_D13A, VP_D13B, VP_D14A, VP_D14B,
+    VP_TABLES
+    };
+
+alignas(16) static const uint8_t Tables[VP_TABLES][16] =
+    {
+    // 1/x in GF(2^4), 0x80 (shuffles to 0) for 1/0
+    { 0x80, 0x01, 0x09, 0x0e, 0x0d, 0x0b, 0x07, 0x06, 0x0f, 0x02, 0x0c, 0x05, 0x0a, 0x04, 0x03, 0x08 },
+    // a/x in GF(2^4), 0x80 for 0
+    { 0x80, 0x02, 0x01, 0x0f, 0x09, 0x05, 0x0e, 0x0c, 0x0d, 0x04, 0x0b, 0x0a, 0x07, 0x08, 0x06, 0x03 },
+    // encryption input basis change, low nibble
+    { 0x00, 0x01, 0x1c, 0x1d, 0x2d, 0x2c, 0x31, 0x30, 0x27, 0x26, 0x3b, 0x3a, 0x0a, 0x0b, 0x16, 0x17 },
+    // encryption input basis change, high nibble
+    { 0x00, 0x86, 0xfd, 0x7b, 0x8e, 0x08, 0x73, 0xf5, 0x77, 0xf1, 0x8a, 0x0c, 0xf9, 0x7f, 0x04, 0x82 },
+    // S-box output, from io
+    { 0x00, 0xcb, 0xd7, 0xb0, 0x21, 0x8d, 0x67, 0xac, 0x7b, 0x5a, 0xea, 0x3d, 0x46, 0xf6, 0x91, 0x1c },
+    // S-box output, from jo
+    { 0x00, 0x9f, 0x61, 0x16, 0xc2, 0x2a, 0x77, 0xe8, 0x89, 0x4b, 0x5d, 0x3c, 0xb5, 0xa3, 0xd4, 0xfe },
+    // 2 * S-box output, from io
+    { 0x00, 0x8d, 0xb5, 0x7b, 0x42, 0x01, 0xce, 0x43, 0xf6, 0xb4, 0xcf, 0x7a, 0x8c, 0xf7, 0x39, 0x38 },
+    // 2 * S-box output, from jo
+    { 0x00, 0x25, 0xc2, 0x2c, 0x9f, 0x54, 0xee, 0xcb, 0x09, 0x96, 0xba, 0x78, 0x71, 0x5d, 0xb3, 0xe7 },
+    // decryption input basis change (inverse affine), low nibble
+    { 0x00, 0xb5, 0xdc, 0x69, 0xdb, 0x6e, 0x07, 0xb2, 0x14, 0xa1, 0xc8, 0x7d, 0xcf, 0x7a, 0x13, 0xa6 },
+    // decryption input basis change (inverse affine), high nibble
+    { 0x00, 0xa7, 0xa8, 0x0f, 0xed, 0x4a, 0x45, 0xe2, 0xd1, 0x76, 0x79, 0xde, 0x3c, 0x9b, 0x94, 0x33 },
+    // 1 * inverse S-box output, from io
+    { 0x00, 0x3b, 0xe4, 0xc8, 0x03, 0x14, 0x2c, 0x17, 0xf3, 0xf0, 0x38, 0xdc, 0x2f, 0xe7, 0xcb, 0xdf },
+    // 1 * inverse S-box output, from jo
+    { 0x00, 0x24, 0x91, 0x19, 0x23, 0x8f, 0x88, 0xac, 0x3d, 0x1e, 0x07, 0x96, 0xab, 0xb2, 0x3a, 0xb5 },
+    // 9 * inverse S-box output, from io
+    { 0x00, 0xf8, 0x85, 0xd2, 0x1b, 0xb4, 0x57, 0xaf, 0x2a, 0x31, 0xe3, 0x66, 0x4c, 0x9e, 0xc9, 0x7d },
+    // 9 * inverse S-box output, from jo
+    { 0x00, 0x1f, 0x75, 0xd1, 0x20, 0x9b, 0xa4, 0xbb, 0xce, 0xee, 0x3f, 0x4a, 0x84, 0x55, 0xf1, 0x6a },
+    // 11 * inverse S-box output, from io
+    { 0x00, 0x8e, 0x56, 0x59, 0x1d, 0x9c, 0x0f, 0x81, 0xd7, 0xca, 0x93, 0xc5, 0x12, 0x4b, 0x44, 0xd8 },
+    // 11 * inverse S-box output, from jo
+    { 0x00, 0x57, 0x4c, 0xe3, 0x66, 0x9e, 0xaf, 0xf8, 0xb4, 0xd2, 0x31, 0x7d, 0xc9, 0x2a, 0x85, 0x1b },
+    // 13 * inverse S-box output, from io
+    { 0x00, 0x14, 0x38, 0xdf, 0x17, 0xe4, 0xe7, 0xf3, 0xcb, 0xdc, 0x03, 0x3b, 0xf0, 0x2f, 0xc8, 0x2c },
+    // 13 * inverse S-box output, from jo
+    { 0x00, 0x8f, 0x07, 0xb5, 0xac, 0x91, 0xb2, 0x3d, 0x3a, 0x96, 0x23, 0x24, 0x1e, 0xab, 0x19, 0x88 },
+    // 14 * inverse S-box output, from io
+    { 0x00, 0x59, 0x0f, 0x9c, 0x12, 0xd8, 0x93, 0xca, 0xc5, 0xd7, 0x4b, 0x44, 0x81, 0x1d, 0x8e, 0x56 },
+    // 14 * inverse S-box output, from jo
+    { 0x00, 0xe3, 0xaf, 0x9e, 0xc9, 0x1b, 0x31, 0xd2, 0x7d, 0xb4, 0x2a, 0x85, 0xf8, 0x66, 0x57, 0x4c },
+    };
+
+// Indices of the 16-byte byte permutations.
+enum VPShuffle : uint8_t { VP_SR, VP_ISR, VP_ROT1, VP_ROT2, VP_ROT3, VP_SHUFFLES };
+
+alignas(16) static const uint8_t Shuffles[VP_SHUFFLES][16] =
+    {
+    // ShiftRows.
+    {  0,  5, 10, 15,  4,  9, 14,  3,  8, 13,  2,  7, 12,  1,  6, 11 },
+    // InvShiftRows.
+    {  0, 13, 10,  7,  4,  1, 14, 11,  8,  5,  2, 15, 12,  9,  6,  3 },
+    // Rotate each column (4-byte word) by 1, 2 and 3 rows.
+    {  1,  2,  3,  0,  5,  6,  7,  4,  9, 10, 11,  8, 13, 14, 15, 12 },
+    {  2,  3,  0,  1,  6,  7,  4,  5, 10, 11,  8,  9, 14, 15, 12, 13 },
+    {  3,  0,  1,  2,  7,  4,  5,  6, 11,  8,  9, 10, 15, 12, 13, 14 },
+    };
+
+// S-box affine constant, folded into round keys 1 to 10.
+static constexpr uint8_t SBOX_CONSTANT = 0x63;
+
+// Load a nibble table or permutation.
+OTAESGCM_TARGET_SSSE3
+static inline __m128i table(const uint8_t n) { return(_mm_load_si128((const __m128i *)Tables[n])); }
+OTAESGCM_TARGET_SSSE3
+static inline __m128i permute(const __m128i x, const uint8_t n)
+    { return(_mm_shuffle_epi8(x, _mm_load_si128((const __m128i *)Shuffles[n]))); }
+
+// Look up x in a pair of tables, by low and by high nibble, and combine.
+OTAESGCM_TARGET_SSSE3
+static inline __m128i lookupNibbles(const __m128i x, const uint8_t lo, const uint8_t hi)
+{
+    const __m128i m = _mm_set1_epi8(0x0f);
+    return(_mm_xor_si128(_mm_shuffle_epi8(table(lo), _mm_and_si128(x, m)),
+                         _mm_shuffle_epi8(table(hi), _mm_and_si128(_mm_srli_epi16(x, 4), m))));
+}
+
+// Look up io and jo in a pair of output tables and combine.
+OTAESGCM_TARGET_SSSE3
+static inline __m128i lookupOut(const __m128i io, const __m128i jo, const uint8_t a)
+{
+    return(_mm_xor_si128(_mm_shuffle_epi8(table(a), io), _mm_shuffle_epi8(table(uint8_t(a + 1)), jo)));
+}
+
+/**
+ * @brief   GF(2^8) inversion of all 16 bytes, in the GF(2^4)^2 basis
+ * @param   y   bytes as (i << 4) | k
+ * @param   io  set to 1/(1/i + 2/k) + j
+ * @param   jo  set to 1/(1/j + 2/k) + i
+ */
+OTAESGCM_TARGET_SSSE3
+static inline void invert(const __m128i y, __m128i &io, __m128i &jo)
+{
+    const __m128i m = _mm_set1_epi8(0x0f);
+    const __m128i inv = table(VP_INV);
+    const __m128i k = _mm_and_si128(y, m);
+    const __m128i i = _mm_and_si128(_mm_srli_epi16(y, 4), m);
+    const __m128i j = _mm_xor_si128(i, k);
+    const __m128i ak = _mm_shuffle_epi8(table(VP_INVA), k);
+    const __m128i iak = _mm_xor_si128(_mm_shuffle_epi8(inv, i), ak);
+    const __m128i jak = _mm_xor_si128(_mm_shuffle_epi8(inv, j), ak);
+    io = _mm_xor_si128(_mm_shuffle_epi8(inv, iak), j);
+    jo = _mm_xor_si128(_mm_shuffle_epi8(inv, jak), i);
+}
+
+/**
+ * @brief   SubBytes without the affine constant
+ * @param   s2  set to 2 * the result, for MixColumns
+ */
+OTAESGCM_TARGET_SSSE3
+static inline __m128i subBytes(const __m128i s, __m128i &s2)
+{
+    __m128i io, jo;
+    invert(lookupNibbles(s, VP_IPTLO, VP_IPTHI), io, jo);
+    s2 = lookupOut(io, jo, VP_SB2A);
+    return(lookupOut(io, jo, VP_SB1A));
+}
+
+// One full encryption round.
+OTAESGCM_TARGET_SSSE3
+static inline __m128i encRound(const __m128i s, const __m128i k)
+{
+    __m128i s2;
+    const __m128i s1 = permute(subBytes(s, s2), VP_SR);
+    s2 = permute(s2, VP_SR);
+    // MixColumns: 2a0 + 3a1 + a2 + a3 for each row of each column.
+    __m128i r = _mm_xor_si128(s2, permute(_mm_xor_si128(s2, s1), VP_ROT1));
+    r = _mm_xor_si128(r, permute(s1, VP_ROT2));
+    r = _mm_xor_si128(r, permute(s1, VP_ROT3));
+    return(_mm_xor_si128(r, k));
+}
+
+// Final encryption round, without MixColumns.
+OTAESGCM_TARGET_SSSE3
+static inline __m128i encLastRound(const __m128i s, const __m128i k)
+{
+    __m128i s2;
+    return(_mm_xor_si128(permute(subBytes(s, s2), VP_SR), k));
+}
+
+// One full equivalent-inverse-cipher round.
+OTAESGCM_TARGET_SSSE3
+static inline __m128i decRound(const __m128i s, const __m128i k)
+{
+    __m128i io, jo;
+    invert(lookupNibbles(permute(s, VP_ISR), VP_DIPTLO, VP_DIPTHI), io, jo);
+    // InvMixColumns: 14a0 + 11a1 + 13a2 + 9a3 for each row of each column.
+    __m128i r = lookupOut(io, jo, VP_D14A);
+    r = _mm_xor_si128(r, permute(lookupOut(io, jo, VP_D11A), VP_ROT1));
+    r = _mm_xor_si128(r, permute(lookupOut(io, jo, VP_D13A), VP_ROT2));
+    r = _mm_xor_si128(r, permute(lookupOut(io, jo, VP_D9A), VP_ROT3));
+    return(_mm_xor_si128(r, k));
+}
+
+// Final decryption round, without InvMixColumns.
+OTAESGCM_TARGET_SSSE3
+static inline __m128i decLastRound(const __m128i s, const __m128i k)
+{
+    __m128i io, jo;
+    invert(lookupNibbles(permute(s, VP_ISR), VP_DIPTLO, VP_DIPTHI), io, jo);
+    return(_mm_xor_si128(lookupOut(io, jo, VP_D1A), k));
+}
+
+/**
+ * @brief   expand the 128-bit key into 11 round keys,
+ *          folding the S-box constant into all but the first
+ */
+OTAESGCM_TARGET_SSSE3
+void OTAES128E_VPerm::expandKey(const uint8_t *key, uint8_t *rkOut)
+{
+    static const uint8_t Rcon[10] = { 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1b, 0x36 };
+    // RotWord of the last word, broadcast to all four words.
+    const __m128i rotLast = _mm_setr_epi8(13, 14, 15, 12, 13, 14, 15, 12, 13, 14, 15, 12, 13, 14, 15, 12);
+    const __m128i c = _mm_set1_epi8((char)SBOX_CONSTANT);
+    __m128i *const r = (__m128i *)rkOut;
+    __m128i k = _mm_loadu_si128((const __m128i *)key);
+    _mm_storeu_si128(r, k);
+    for(uint8_t i = 1; i <= 10; ++i)
+    {
+        __m128i s2;
+        __m128i t = _mm_xor_si128(subBytes(k, s2), c);
+        t = _mm_xor_si128(_mm_shuffle_epi8(t, rotLast), _mm_set1_epi32(Rcon[i - 1]));
+        k = _mm_xor_si128(k, _mm_slli_si128(k, 4));
+        k = _mm_xor_si128(k, _mm_slli_si128(k, 8));
+        k = _mm_xor_si128(k, t);
+        _mm_storeu_si128(r + i, _mm_xor_si128(k, c));
+    }
+}
+
+/**
+ * @brief   encrypt nBlocks, PIPELINE_BLOCKS at a time where possible
+ */
+OTAESGCM_TARGET_SSSE3
+void OTAES128E_VPerm::encryptBlocks(const uint8_t *rkIn, const uint8_t *in, uint8_t *out, size_t nBlocks)
+{
+    const __m128i *const r = (const __m128i *)rkIn;
+    __m128i k[11];
+    for(uint8_t i = 0; i < 11; ++i) { k[i] = _mm_loadu_si128(r + i); }
+
+    for( ; nBlocks >= PIPELINE_BLOCKS; nBlocks -= PIPELINE_BLOCKS)
+    {
+        __m128i b0 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)in), k[0]);
+        __m128i b1 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(in + 16)), k[0]);
+        for(uint8_t i = 1; i < 10; ++i)
+        {
+            b0 = encRound(b0, k[i]);
+            b1 = encRound(b1, k[i]);
+        }
+        _mm_storeu_si128((__m128i *)out, encLastRound(b0, k[10]));
+        _mm_storeu_si128((__m128i *)(out + 16), encLastRound(b1, k[10]));
+        in += PIPELINE_BLOCKS * 16;
+        out += PIPELINE_BLOCKS * 16;
+    }
+    for( ; nBlocks > 0; --nBlocks)
+    {
+        __m128i b = _mm_xor_si128(_mm_loadu_si128((const __m128i *)in), k[0]);
+        for(uint8_t i = 1; i < 10; ++i) { b = encRound(b, k[i]); }
+        _mm_storeu_si128((__m128i *)out, encLastRound(b, k[10]));
+        in += 16;
+        out += 16;
+    }
+}
+
+// Multiply by x in GF(2^8), without branching on the data.
+static inline uint8_t xtime(const uint8_t x)
+    { return(uint8_t((x << 1) ^ (0x1b & (0 - (x >> 7))))); }
+
+// Multiply by a public constant in GF(2^8), without branching on the data.
+static inline uint8_t gmul(uint8_t x, uint8_t m)
+{
+    uint8_t r = 0;
+    for( ; 0 != m; m >>= 1, x = xtime(x)) { if(m & 1) { r ^= x; } }
+    return(r);
+}
+
+/**
+ * @brief   derive the equivalent inverse cipher schedule:
+ *          reverse order with InvMixColumns applied to the middle round keys
+ *
+ * InvMixColumns leaves the folded S-box constant unchanged.
+ */
+void OTAES128DE_VPerm::invertKey(const uint8_t *rkIn, uint8_t *drkOut)
+{
+    memcpy(drkOut, rkIn + 160, 16);
+    for(uint8_t i = 1; i < 10; ++i)
+    {
+        const uint8_t *const s = rkIn + 16 * (10 - i);
+        uint8_t *const d = drkOut + 16 * i;
+        for(uint8_t c = 0; c < 16; c += 4)
+        {
+            for(uint8_t row = 0; row < 4; ++row)
+            {
+                d[c + row] = uint8_t(gmul(s[c + row], 14) ^ gmul(s[c + ((row + 1) & 3)], 11) ^
+                                     gmul(s[c + ((row + 2) & 3)], 13) ^ gmul(s[c + ((row + 3) & 3)], 9));
+            }
+        }
+    }
+    memcpy(drkOut + 160, rkIn, 16);
+}
+
+/**
+ * @brief   decrypt nBlocks, PIPELINE_BLOCKS at a time where possible
+ */
+OTAESGCM_TARGET_SSSE3
+void OTAES128DE_VPerm::decryptBlocks(const uint8_t *drkIn, const uint8_t *in, uint8_t *out, size_t nBlocks)
+{
+    const __m128i *const r = (const __m128i *)drkIn;
+    __m128i k[11];
+    for(uint8_t i = 0; i < 11; ++i) { k[i] = _mm_loadu_si128(r + i); }
+
+    for( ; nBlocks >= PIPELINE_BLOCKS; nBlocks -= PIPELINE_BLOCKS)
+    {
+        __m128i b0 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)in), k[0]);
+        __m128i b1 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(in + 16)), k[0]);
+        for(uint8_t i = 1; i < 10; ++i)
+        {
+            b0 = decRound(b0, k[i]);
+            b1 = decRound(b1, k[i]);
+        }
+        _mm_storeu_si128((__m128i *)out, decLastRound(b0, k[10]));
+        _mm_storeu_si128((__m128i *)(out + 16), decLastRound(b1, k[10]));
+        in += PIPELINE_BLOCKS * 16;
+        out += PIPELINE_BLOCKS * 16;
+    }
+    for( ; nBlocks > 0; --nBlocks)
+    {
+        __m128i b = _mm_xor_si128(_mm_loadu_si128((const __m128i *)in), k[0]);
+        for(uint8_t i = 1; i < 10; ++i) { b = decRound(b, k[i]); }
+        _mm_storeu_si128((__m128i *)out, decLastRound(b, k[10]));
+        in += 16;
+        out += 16;
+    }
+}
+
+
+/*****************************************************************************/
+/* Public functions:                                                         */
+/*****************************************************************************/
+
+/**
+ *    @brief    start keyed session: expand the round keys once into the workspace
+ *    @retval   true if the session was started, false if no workspace or key
+ */
+bool OTAES128E_VPerm::setKey(const uint8_t *key)
+{
+    // Abort if no workspace to avoid crashing.
+    if((NULL == rk) || (NULL == key)) { return(false); }
+    expandKey(key, rk);
+    keyed = true;
+    return(true);
+}
+
+/**
+ *    @brief    AES128 block encryption
+ *
+ * One-block session.
+ * Cleans up internal sensitive state when done.
+ */
+void OTAES128E_VPerm::blockEncrypt(const uint8_t* input, const uint8_t* key, uint8_t *output)
+{
+    // Abort if no workspace to avoid crashing..
+    if(!OTAES128E_VPerm::setKey(key)) { return; }
+    encryptBlocks(rk, input, output, 1);
+    // Clean up private state.
+    OTAES128E_VPerm::cleanup();
+}
+
+/**
+ *    @brief    start keyed session: expand both round-key schedules once
+ *    @retval   true if the session was started, false if no workspace or key
+ */
+bool OTAES128DE_VPerm::setKey(const uint8_t *key)
+{
+    if(!OTAES128E_VPerm::setKey(key)) { return(false); }
+    invertKey(rk, drk);
+    return(true);
+}
+
+/**
+ *    @brief    AES128 block decryption
+ *
+ * One-block session.
+ * Cleans up internal sensitive state when done.
+ */
+void OTAES128DE_VPerm::blockDecrypt(const uint8_t* input, const uint8_t* key, uint8_t *output)
+{
+    // Abort if no workspace to avoid crashing..
+    if(!setKey(key)) { return; }
+    decryptBlocks(drk, input, output, 1);
+    // Clean up private state.
+    cleanup();
+}
+
+
+    }
+
+#endif // defined(OTAESGCM_X86_INTRINSICS)
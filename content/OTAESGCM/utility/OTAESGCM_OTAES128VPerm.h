@@ -0,0 +1,138 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Deniz Erbilgin 2015--2017
+                           Damon Hart-Davis 2015--2017
+*/
+
+/* x86 SSSE3 vector-permute constant-time AES(128) implementation. */
+
+#ifndef ARDUINO_LIB_OTAESGCM_OTAES128VPERM_H
+#define ARDUINO_LIB_OTAESGCM_OTAES128VPERM_H
+
+#include <stdint.h>
+#include <string.h>
+#include "OTAESGCM_OTAES128.h"
+#include "OTAESGCM_CPUFeatures.h"
+
+#if defined(OTAESGCM_X86_INTRINSICS)
+
+// Use namespaces to help avoid collisions.
+namespace OTAESGCM
+    {
+
+
+    // Vector-permute encrypt-only implementation,
+    // using SSSE3 byte shuffles (pshufb) as 16-entry in-register tables
+    // to invert in GF(2^8) via GF(2^4) (after M. Hamburg, CHES 2009).
+    // Constant-time with no memory lookups indexed by secrets,
+    // for hosts without AES-NI (eg where a hypervisor masks it).
+    // Must only be used if cpuHasSSSE3() is true,
+    // else will fault with an illegal instruction;
+    // use OTAES128E_RuntimeDispatch to select automatically.
+    // Neither re-entrant nor ISR-safe except where stated.
+    // Carries workspace but logically no state is carried from one operation to the next,
+    // except the expanded key between setKey() and endSession().
+    // Residual state should be regarded as sensitive, and eg overwritten before being released to heap.
+    class OTAES128E_VPerm : public OTAES128E
+        {
+        protected:
+            // Size of the expanded (encryption) key (bytes), 11 x 128 bits.
+            static constexpr uint8_t RoundKeySize = 176;
+
+            // Round keys within the caller's workspace, no alignment needed;
+            // NULL if insufficient workspace is passed in.
+            // Round keys 1 to 10 have the S-box affine constant folded in.
+            uint8_t * const rk;
+            // True while a keyed session is active.
+            bool keyed = false;
+
+        public:
+            // Minimum workspace required, unaligned; strictly positive.
+            // This constant, defined per class, is effectively part of the API.
+            static constexpr size_t workspaceRequired = RoundKeySize;
+
+            // Construct an instance: supplied workspace must be large enough.
+            OTAES128E_VPerm(uint8_t *const workspace, const size_t workspaceLen)
+              : rk(((NULL == workspace) || (workspaceLen < workspaceRequired)) ? NULL : workspace)
+                { }
+
+            // Expand a 16-byte key into RoundKeySize bytes at rkOut.
+            static void expandKey(const uint8_t *key, uint8_t *rkOut);
+            // Encrypt nBlocks with the expanded key; in and out may be the same.
+            static void encryptBlocks(const uint8_t *rkIn, const uint8_t *in, uint8_t *out, size_t nBlocks);
+
+            // Clean up sensitive state.
+            void cleanup() { if((NULL != rk) && keyed)
+                { memset(rk, 0, RoundKeySize); keyed = false; } }
+
+            // One-block session; cleans up internal sensitive state when done.
+            virtual void blockEncrypt(const uint8_t* input, const uint8_t* key, uint8_t *output) override;
+
+            // Keyed session: the round keys are expanded once by setKey()
+            // and retained in the workspace until endSession()/cleanup().
+            virtual bool setKey(const uint8_t *key) override;
+            virtual void encryptBlocks(const uint8_t *input, uint8_t *output, size_t nBlocks) override
+                { if(keyed) { encryptBlocks(rk, input, output, nBlocks); } }
+            virtual void endSession() override { cleanup(); }
+        };
+
+    // Vector-permute decrypt and encrypt implementation.
+    // Decryption uses the equivalent inverse cipher,
+    // its schedule derived once per setKey().
+    // Must only be used if cpuHasSSSE3() is true.
+    class OTAES128DE_VPerm final : public OTAES128D, public OTAES128E_VPerm
+        {
+        public:
+            // External workspace/scratch required minimum size, unaligned; strictly positive.
+            // This constant, defined per class, is effectively part of the API.
+            static constexpr size_t workspaceRequired = 2 * (size_t)RoundKeySize;
+
+        protected:
+            // Decryption round keys, immediately following the encryption keys.
+            uint8_t * const drk;
+
+        public:
+            // Construct an instance: supplied workspace must be large enough.
+            OTAES128DE_VPerm(uint8_t *const workspace, const size_t workspaceLen)
+              : OTAES128E_VPerm(workspace, (workspaceLen >= workspaceRequired) ? workspaceLen : 0),
+                drk((NULL == rk) ? NULL : rk + RoundKeySize)
+                { }
+
+            // Derive the decryption schedule from the encryption one.
+            static void invertKey(const uint8_t *rkIn, uint8_t *drkOut);
+            // Decrypt nBlocks with the inverted key; in and out may be the same.
+            static void decryptBlocks(const uint8_t *drkIn, const uint8_t *in, uint8_t *out, size_t nBlocks);
+
+            // Clean up sensitive state.
+            void cleanup() { if((NULL != drk) && keyed)
+                { memset(drk, 0, RoundKeySize); } OTAES128E_VPerm::cleanup(); }
+
+            // One-block session; cleans up internal sensitive state when done.
+            virtual void blockDecrypt(const uint8_t* input, const uint8_t* key, uint8_t *output) override;
+
+            // Keyed session shared with encryption.
+            virtual bool setKey(const uint8_t *key) override;
+            virtual void decryptBlocks(const uint8_t *input, uint8_t *output, size_t nBlocks) override
+                { if(keyed) { decryptBlocks(drk, input, output, nBlocks); } }
+            virtual void endSession() override { cleanup(); }
+        };
+
+
+    }
+
+#endif // defined(OTAESGCM_X86_INTRINSICS)
+
+#endif
@@ -27,6 +27,11 @@ Author(s) / Copyright (s): Deniz Erbilgin 2015--2017
 #if !defined(ARDUINO_ARCH_AVR)
 #include <stdio.h>
 #endif
+#if !defined(__AVR_ARCH__) && !defined(ARDUINO_ARCH_AVR)
+#include <thread>
+#include <vector>
+#include "OTAESGCM_OTGHASH128Portable.h"
+#endif
 
 
 // Use namespaces to help avoid collisions.
@@ -44,6 +49,16 @@ namespace OTAESGCM
 /******************* Global Variables ********************/
 //
 /******************* Private Variables *******************/
+// Blocks of counter laid out and ciphered per call in the generic cryptAndHash() loop.
+// The output buffer holds them, so no extra workspace is needed.
+static constexpr uint8_t CTR_CHUNK_BLOCKS = 16;
+// Blocks of key stream generated per AES call across frames in gcmBatch(),
+// held on the stack, so kept small on AVR.
+#if defined(__AVR_ARCH__) || defined(ARDUINO_ARCH_AVR)
+static constexpr uint8_t BATCH_BLOCKS = 4;
+#else
+static constexpr uint8_t BATCH_BLOCKS = 16;
+#endif
 
 /******************* Private Functions *******************/
 /**
@@ -59,31 +74,6 @@ static void xorBlock(uint8_t *dest, const uint8_t *src)
     }
 }
 
-/**
- * @note    shift_block_right
- * @brief    bitshifts 128bit block (16 byte array) right once
- * @param    block:    pointer to block to shift
- * @note    I separated the pointer decrement from the bit shift as it was
- *             mangling the first byte
- */
-static void shiftBlockRight(uint8_t *block)
-{
-    block += 15;
-
-    // bitshift LSB (last byte in array)
-    *block = *block >> 1;
-    block--;
-
-    // loop through remaining bytes
-    for (uint8_t i = 0; i < AES128GCM_BLOCK_SIZE-1; i++) {
-        // if lsb is set, set msb of next byte in array
-        if(*block & 0x01) *(block + 1) |= 0x80;
-        // bit shift byte
-        *block = *block >> 1;
-        block--;
-    }
-}
-
 /**
  * @brief   checks if tags match
  * @param   tag1        pointer to array containing tag1
@@ -105,43 +95,6 @@ static uint8_t checkTag(const uint8_t *tag1, const uint8_t *tag2)
     return result;
 }
 
-/**
- * @note    gf_mult
- * @brief    Performs multiplications in 128 bit galois bit field
- * @todo    learn how multiplication algorithm works
- * @param    x: pointer to input 1
- * @param    y: pointer to input 2
- * @param    result:    pointer to array to put result in
- * @note    output straight to *x and save on a memcpy loop?
- */
-static void gFieldMultiply(GGBWS::GHASHWorkspace * const workspace, const uint8_t *x, const uint8_t *y)
-{
-    // init result to 0s and copy y to temp
-    memcpy(workspace->gFieldMultiplyTmp, y, AES128GCM_BLOCK_SIZE);
-    memset(workspace->ghashTmp, 0, AES128GCM_BLOCK_SIZE);
-    
-        // multiplication algorithm
-    for (uint8_t i = 0; i < AES128GCM_BLOCK_SIZE; i++) {
-        for (uint8_t j = 0; j < 8; j++) {
-
-            if (x[i] & (1 << (7 - j))) {
-                /* Z_(i + 1) = Z_i XOR V_i */
-                xorBlock(workspace->ghashTmp, workspace->gFieldMultiplyTmp);
-            }
-            // if temp is odd, do something?
-            if (workspace->gFieldMultiplyTmp[15] & 0x01) {
-                /* V_(i + 1) = (V_i >> 1) XOR R */
-                shiftBlockRight(workspace->gFieldMultiplyTmp);
-                /* R = 11100001 || 0^120 */
-                workspace->gFieldMultiplyTmp[0] ^= 0xe1;
-            } else {
-                /* V_(i + 1) = V_i >> 1 */
-                shiftBlockRight(workspace->gFieldMultiplyTmp);
-            }
-        }
-    }
-}
-
 /**
  * @note    inc32
  * @brief    increments the rightmost 32 bits (4 bytes) of block, %(2^32)
@@ -169,12 +122,12 @@ static void incr32(uint8_t *pBlock)
  * @brief   performs gcntr operation for encryption
  * @param   pInput          pointer to input data (need not be block multiple)
  * @param   inputLength     length of input array
- * @param   pKey            pointer to 128 bit AES key
  * @param   pICB            initial counter block J0
- * @param   pOutput         pointer to output data. length inputLength rounded up to 16.
+ * @param   pOutput         pointer to output data. length inputLength rounded up to 16. Must not overlap input.
+ * @note    ap must have an active keyed session.
  */
 static void GCTR(OTAES128E * const ap, GGBWS::GCTRWorkspace * const workspace,
-                    const uint8_t *pInput, const uint8_t inputLength, const uint8_t *pKey,
+                    const uint8_t *pInput, const uint8_t inputLength,
                     const uint8_t *pCtrBlock, uint8_t *pOutput)
 {
     const uint8_t *xpos = pInput;
@@ -189,25 +142,21 @@ static void GCTR(OTAES128E * const ap, GGBWS::GCTRWorkspace * const workspace,
     // copy ICB to ctrBlock
     memcpy(workspace->ctrBlock, pCtrBlock, AES128GCM_BLOCK_SIZE);
 
-    // for full blocks
+    // key stream for all the full blocks in one call, combined with input
+    ap->ctrKeystream(workspace->ctrBlock, ypos, n);
     for (uint8_t i = 0; i < n; i++) {
-        // cipher counterblock and combine with input
-        ap->blockEncrypt(workspace->ctrBlock, pKey, ypos);
         xorBlock(ypos, xpos);
 
         // increment pointers to next block
         xpos += AES128GCM_BLOCK_SIZE;
         ypos += AES128GCM_BLOCK_SIZE;
-
-        // increment counter
-        incr32(workspace->ctrBlock);
     }
 
     // check if there is a partial block at end.
     const uint8_t last = uint8_t(pInput + inputLength - xpos);
     if (last) {
         // encrypt into tmp and combine with last block of input
-        ap->blockEncrypt(workspace->ctrBlock, pKey, workspace->tmp);
+        ap->encryptBlocks(workspace->ctrBlock, workspace->tmp, 1);
         for (uint8_t i = 0; i < last; i++)
             *ypos++ = *xpos++ ^ workspace->tmp[i];
     }
@@ -218,12 +167,12 @@ static void GCTR(OTAES128E * const ap, GGBWS::GCTRWorkspace * const workspace,
  * @brief   performs gcntr operation for encryption
  * @param   pInput          pointer to input data (MUST BE be block multiple)
  * @param   inputLength     length of input array
- * @param   pKey            pointer to 128 bit AES key
  * @param   pICB            initial counter block J0
- * @param   pOutput         pointer to output data. length inputLength rounded up to 16.
+ * @param   pOutput         pointer to output data. length inputLength rounded up to 16. Must not overlap input.
+ * @note    ap must have an active keyed session.
  */
 static void GCTRPadded(OTAES128E * const ap, GGBWS::GCTRPaddedWorkspace * const workspace,
-                    const uint8_t *pInput, const uint8_t inputLength, const uint8_t *pKey,
+                    const uint8_t *pInput, const uint8_t inputLength,
                     const uint8_t *pCtrBlock, uint8_t *pOutput)
 {
     const uint8_t *xpos = pInput;
@@ -238,25 +187,21 @@ static void GCTRPadded(OTAES128E * const ap, GGBWS::GCTRPaddedWorkspace * const
     // copy ICB to ctrBlock
     memcpy(workspace->ctrBlock, pCtrBlock, AES128GCM_BLOCK_SIZE);
 
-    // for full blocks
+    // key stream for all the full blocks in one call, combined with input
+    ap->ctrKeystream(workspace->ctrBlock, ypos, n);
     for (uint8_t i = 0; i < n; i++) {
-        // cipher counterblock and combine with input
-        ap->blockEncrypt(workspace->ctrBlock, pKey, ypos);
         xorBlock(ypos, xpos);
 
         // increment pointers to next block
         xpos += AES128GCM_BLOCK_SIZE;
         ypos += AES128GCM_BLOCK_SIZE;
-
-        // increment counter
-        incr32(workspace->ctrBlock);
     }
 
 //    // check if there is a partial block at end.
 //    const uint8_t last = uint8_t(pInput + inputLength - xpos);
 //    if (last) {
 //        // encrypt into tmp and combine with last block of input
-//        ap->blockEncrypt(workspace->ctrBlock, pKey, workspace->tmp);
+//        ap->encryptBlocks(workspace->ctrBlock, workspace->tmp, 1);
 //        for (uint8_t i = 0; i < last; i++)
 //            *ypos++ = *xpos++ ^ workspace->tmp[i];
 //    }
@@ -265,44 +210,30 @@ static void GCTRPadded(OTAES128E * const ap, GGBWS::GCTRPaddedWorkspace * const
 /**
  * @note    ghash
  * @brief   performs authentication hashing
- * @todo    is final memcpy always persistent?
+ * @param   gp              GHASH implementation with an active keyed session
  * @param   pInput          pointer to input data
  * @param   inputLength     length of input array
- * @param   pAuthKey        pointer to 128 bit authentication subkey H
- * @param   pOutput         pointer to 16 byte output array
+ * @param   pOutput         pointer to 16 byte hash accumulator, updated in place
  */
-static void GHASH(  GGBWS::GHASHWorkspace * const workspace,
-                    const uint8_t *pInput, uint8_t inputLength,
-                    const uint8_t *pAuthKey, uint8_t *pOutput )
+static void GHASH(  OTGHASH128 * const gp,
+                    const uint8_t *pInput, size_t inputLength,
+                    uint8_t *pOutput )
 {
-    const uint8_t *xpos = pInput;
     // Calculate number of full blocks to hash.
-    const uint8_t m = inputLength / AES128GCM_BLOCK_SIZE;
+    const size_t m = inputLength / AES128GCM_BLOCK_SIZE;
 
-    // Hash full blocks.
-    for (uint8_t i = 0; i < m; i++) {
-        // Y_i = (Y^(i-1) XOR X_i) dot H
-        xorBlock(pOutput, xpos);
-        xpos += 16; // move to next block
-
-        gFieldMultiply(workspace, pOutput, pAuthKey);
-
-        // copy tmp to output
-        memcpy(pOutput, workspace->ghashTmp, AES128GCM_BLOCK_SIZE);
-    }
+    // Hash full blocks: Y_i = (Y^(i-1) XOR X_i) dot H
+    gp->update(pOutput, pInput, m);
 
     // Check if final partial block.
     // Can be omitted if we use full blocks.
-    if (pInput + inputLength > xpos) {
-        // zero pad
-        const uint8_t last = uint8_t(pInput + inputLength - xpos);
-        memcpy(workspace->ghashTmp, xpos, last);
-        memset(workspace->ghashTmp + last, 0, sizeof(workspace->ghashTmp) - last);
-
-        // Y_i = (Y^(i-1) XOR X_i) dot H
-        xorBlock(pOutput, workspace->ghashTmp);
-        gFieldMultiply(workspace, pOutput, pAuthKey);
-        memcpy(pOutput, workspace->ghashTmp, AES128GCM_BLOCK_SIZE);
+    const uint8_t last = uint8_t(inputLength & (AES128GCM_BLOCK_SIZE-1));
+    if (last) {
+        // XOR in the zero-padded block directly, so no copy is needed.
+        const uint8_t *xpos = pInput + (inputLength - last);
+        for (uint8_t i = 0; i < last; i++)
+            pOutput[i] ^= xpos[i];
+        gp->multiplyH(pOutput);
     }
 }
 
@@ -331,7 +262,7 @@ static void generateICB(const uint8_t *pIV, uint8_t *pOutput)
  */
 static void generateCDATA(OTAES128E * const ap, GGBWS::GenCDATAWorkspace * const workspace,
                             const uint8_t *pICB, const uint8_t *pPDATA, uint8_t PDATALength,
-                            uint8_t *pCDATA, const uint8_t *pKey )
+                            uint8_t *pCDATA)
 {
     // Exit if no data to encrypt.
     if(PDATALength == 0) return;
@@ -340,52 +271,51 @@ static void generateCDATA(OTAES128E * const ap, GGBWS::GenCDATAWorkspace * const
     incr32(workspace->ctrBlock);
 
     // Encrypt.
-    GCTR(ap, &workspace->gctrSpace, pPDATA, PDATALength, pKey, workspace->ctrBlock, pCDATA);
+    GCTR(ap, &workspace->gctrSpace, pPDATA, PDATALength, workspace->ctrBlock, pCDATA);
 }
 #endif
 /**
- * @note    aes_gcm_ctr
- * @brief   encrypt PDATA to get CDATA
- * @param   pICB        pointer to initial counter block
- * @param   pPDATA      pointer to plain text
- * @param   PDATALength length of plain text (MUST BE block-size multiple)
- * @param   pCDATA      pointer to array for cipher text. Length PDATALength rounded up to next 16 bytes
+ * @brief   writes a length in bytes as a 64-bit big-endian length in bits
+ * @param   pOutput     pointer to 8 byte output, already zeroed
+ * @param   length      length in bytes
+ * @note    Only as many bytes as size_t can fill are written,
+ *          so this stays cheap where size_t is 16 bits.
  */
-static void generateCDATAPadded(OTAES128E * const ap, GGBWS::GenCDATAPaddedWorkspace * const cdataSpace,
-                            const uint8_t *pICB, const uint8_t *pPDATAPadded, uint8_t PDATALength,
-                            uint8_t *pCDATA, const uint8_t *pKey )
+static void putBitLength64(uint8_t *pOutput, size_t length)
 {
-    // Exit if no data to encrypt.
-    if(PDATALength == 0) return;
-
-    // Generate counter block J.
-    memcpy(cdataSpace->ctrBlock, pICB, AES128GCM_BLOCK_SIZE);
-    incr32(cdataSpace->ctrBlock);
-
-    // Encrypt.
-    GCTRPadded(ap, &cdataSpace->gctrSpace, pPDATAPadded, PDATALength, pKey, cdataSpace->ctrBlock, pCDATA);
+    pOutput[7] = uint8_t(length << 3);
+    length >>= 5;
+    for (int8_t i = 6; (i >= 0) && (0 != length); i--) {
+        pOutput[i] = uint8_t(length);
+        length >>= 8;
+    }
 }
 
 /**
- * @note    aes_gcm_ghash
- * @brief   makes message S from ADATA and CDATA
+ * @brief   starts the tag: S = GHASH_H(A || 0^v)
  * @param   pADATA          pointer to array containing authentication data
  * @param   ADATALength     length of ADATA array
- * @param   pCDATA          pointer to array containing encrypted data
- * @param   CDATALength     length of CDATA array
- * @param   pAuthKey        pointer to 128 bit authentication subkey H
- * @param   pTag            pointer to array to store tag
+ * @note    gp must have an active session keyed with the authentication subkey H.
  */
-static void generateTag(OTAES128E * const ap,
+static void startTag(OTGHASH128 * const gp,
                             GGBWS::GenerateTagWorkspace * const workspace,
-                            const uint8_t *pKey, const uint8_t *pAuthKey,
-                            const uint8_t *pADATA, uint8_t ADATALength,
-                            const uint8_t *pCDATA, uint8_t CDATALength,
-                            uint8_t * pTag, const uint8_t *pICB)
+                            const uint8_t *pADATA, size_t ADATALength)
 {
-    uint16_t temp;
-    memset(workspace->lengthBuffer, 0, sizeof(workspace->lengthBuffer));
     memset(workspace->S, 0, sizeof(workspace->S));
+    GHASH(gp, pADATA, ADATALength, workspace->S);
+}
+
+/**
+ * @brief   hashes the lengths block into S
+ * @param   ADATALength     length of ADATA array, already hashed into S
+ * @param   CDATALength     length of CDATA array, already hashed into S
+ * @note    gp must have an active keyed session.
+ */
+static void hashLengths(OTGHASH128 * const gp,
+                            GGBWS::GenerateTagWorkspace * const workspace,
+                            size_t ADATALength, size_t CDATALength)
+{
+    memset(workspace->lengthBuffer, 0, sizeof(workspace->lengthBuffer));
     /*
      * u = 128 * ceil[len(C)/128] - len(C)
      * v = 128 * ceil[len(A)/128] - len(A)
@@ -393,41 +323,475 @@ static void generateTag(OTAES128E * const ap,
      * (i.e., zero padded to block size A || C and lengths of each in bits)
      */
 
-    // function to put [len(A)]64 || [len(C)]64 in temp. could be saved as using fixed method length
-    temp = (uint16_t) ADATALength * 8;
-    //lengthBuffer[4] = (temp >> 24) & 0xff;    // these two are not needed as only using 16 bit values
-    //lengthBuffer[5] = (temp >> 16) & 0xff;
-    workspace->lengthBuffer[6] = (temp >> 8) & 0xff;
-    workspace->lengthBuffer[7] = temp & 0xff;
+    // put [len(A)]64 || [len(C)]64 in lengthBuffer.
+    putBitLength64(workspace->lengthBuffer, ADATALength);
+    putBitLength64(workspace->lengthBuffer + 8, CDATALength);
 
-    temp = (uint16_t) CDATALength * 8;
-    //lengthBuffer[12] = (temp >> 24) & 0xff;
-    //lengthBuffer[13] = (temp >> 16) & 0xff;
-    workspace->lengthBuffer[14] = (temp >> 8) & 0xff;
-    workspace->lengthBuffer[15] = temp & 0xff;
+    GHASH(gp, workspace->lengthBuffer, sizeof(workspace->lengthBuffer), workspace->S);
+}
+
+/**
+ * @brief   finishes the tag: hashes the lengths into S and encrypts S with the ICB
+ * @param   ADATALength     length of ADATA array
+ * @param   CDATALength     length of CDATA array, already hashed into S
+ * @param   pTag            pointer to array to store tag
+ * @param   pICB            initial counter block J0
+ * @note    ap and gp must have active keyed sessions.
+ */
+static void finishTag(OTAES128E * const ap, OTGHASH128 * const gp,
+                            GGBWS::GenerateTagWorkspace * const workspace,
+                            size_t ADATALength, size_t CDATALength,
+                            uint8_t * pTag, const uint8_t *pICB)
+{
+    hashLengths(gp, workspace, ADATALength, CDATALength);
 
-    GHASH(&workspace->ghashSpace, pADATA, ADATALength, pAuthKey, workspace->S);
-    GHASH(&workspace->ghashSpace, pCDATA, CDATALength, pAuthKey, workspace->S);
-    GHASH(&workspace->ghashSpace, workspace->lengthBuffer, sizeof(workspace->lengthBuffer), pAuthKey, workspace->S);
+//    GCTR(ap, &workspace->gctrSpace, workspace->S, sizeof(workspace->S), pICB, pTag);
+    GCTRPadded(ap, &workspace->gctrSpace, workspace->S, sizeof(workspace->S), pICB, pTag);
+}
 
-//    GCTR(ap, &workspace->gctrSpace, workspace->S, sizeof(workspace->S), pKey, pICB, pTag);
-    GCTRPadded(ap, &workspace->gctrSpace, workspace->S, sizeof(workspace->S), pKey, pICB, pTag);
+#if defined(OTAESGCM_ALLOW_UNPADDED)
+/**
+ * @note    aes_gcm_ghash
+ * @brief   makes message S from ADATA and CDATA
+ * @param   pADATA          pointer to array containing authentication data
+ * @param   ADATALength     length of ADATA array
+ * @param   pCDATA          pointer to array containing encrypted data
+ * @param   CDATALength     length of CDATA array
+ * @param   pTag            pointer to array to store tag
+ * @note    gp must have an active session keyed with the authentication subkey H.
+ */
+static void generateTag(OTAES128E * const ap, OTGHASH128 * const gp,
+                            GGBWS::GenerateTagWorkspace * const workspace,
+                            const uint8_t *pADATA, uint8_t ADATALength,
+                            const uint8_t *pCDATA, uint8_t CDATALength,
+                            uint8_t * pTag, const uint8_t *pICB)
+{
+    startTag(gp, workspace, pADATA, ADATALength);
+    GHASH(gp, pCDATA, CDATALength, workspace->S);
+    finishTag(ap, gp, workspace, ADATALength, CDATALength, pTag, pICB);
 }
+#endif
 
 /**
  * @note    aes_gcm_init_hash_subkey
  * @brief   generates authentication subkey H
- * @param   pKey            pointer to 128 bit AES key
  * @param   pOutput         pointer to 16 byte array put to subkey H in
  * @note    tested arduino 1.6.5
+ * @note    ap must have an active keyed session.
  */
-static void generateAuthKey(OTAES128E * const ap, const uint8_t *pKey, uint8_t *pAuthKey)
+static void generateAuthKey(OTAES128E * const ap, uint8_t *pAuthKey)
 {
     // original has if(aes == NULL) return NULL;
 
     // Encrypt 128 bit block of 0s to generate authentication sub-key.
     memset(pAuthKey, 0, AES128GCM_BLOCK_SIZE);
-    ap->blockEncrypt(pAuthKey, pKey, pAuthKey);
+    ap->encryptBlocks(pAuthKey, pAuthKey, 1);
+}
+
+/**
+ * @brief   expands the key, and derives H and any GHASH tables from it
+ * @param   key     pointer to 16 byte (128 bit) key
+ * @retval  true if successful, else false (and left cleared)
+ */
+bool OTAES128GCMKeyContext::setKey(const uint8_t *key)
+{
+    clear();
+    if(NULL == key) { return(false); }
+    // Expand the key once for all the blocks to come.
+    if(!ap->setKey(key)) { return(false); }
+    generateAuthKey(ap, authKey);
+    // Prepare GHASH (eg per-key tables) for H.
+    if(!gp->setKey(authKey)) { ap->endSession(); memset(authKey, 0, sizeof(authKey)); return(false); }
+    keyed = true;
+    return(true);
+}
+
+/**
+ * @brief   erases the expanded key, H and GHASH tables
+ */
+void OTAES128GCMKeyContext::clear()
+{
+    if(!keyed) { return; }
+    gp->endSession();
+    ap->endSession();
+    memset(authKey, 0, sizeof(authKey));
+    keyed = false;
+}
+
+
+/**
+ * @brief   encrypts or decrypts whole blocks and hashes the cipher text into S in a single pass
+ * @param   kc          keyed AES and GHASH implementations
+ * @param   ctrBlock    next counter block, incremented (inc32) per block and updated
+ * @param   S           GHASH accumulator, updated in place
+ * @param   pInput      pointer to nBlocks of input data
+ * @param   nBlocks     number of 16-byte blocks, can be zero
+ * @param   pOutput     pointer to nBlocks of output data; must not overlap input
+ * @param   decrypt     true if the input is the cipher text, else the output is
+ * @note    kc must be keyed.
+ *
+ * Each chunk of blocks is hashed while still in cache (or registers)
+ * rather than being re-read in a second pass.
+ * Uses a stitched kernel specific to the AES and GHASH implementations
+ * where one is available.
+ * The counter is incremented modulo 2^32 (inc32) as per SP800-38D;
+ * callers limit the length so that it cannot wrap.
+ */
+void OTAES128GCMGenericBase::cryptAndHashBlocks(OTAES128GCMKeyContext &kc,
+                    uint8_t * const ctrBlock, uint8_t * const S,
+                    const uint8_t *pInput, size_t nBlocks,
+                    uint8_t *pOutput, const bool decrypt)
+{
+    if(kc.stitchedCTRGHASH(ctrBlock, pInput, pOutput, nBlocks, S, decrypt)) { return; }
+    OTAES128E * const ap = kc.ap;
+    OTGHASH128 * const gp = kc.gp;
+
+    // Generic loop in chunks, so that the AES and GHASH implementations
+    // can each work on several blocks per call.
+    while (nBlocks > 0) {
+        const uint8_t k = (nBlocks < CTR_CHUNK_BLOCKS) ? uint8_t(nBlocks) : CTR_CHUNK_BLOCKS;
+        // Cipher text in is hashed before the output is written.
+        if(decrypt) { gp->update(S, pInput, k); }
+        // Key stream straight into the output.
+        ap->ctrKeystream(ctrBlock, pOutput, k);
+        // combine with input
+        for (uint8_t i = 0; i < k; i++) {
+            xorBlock(pOutput + i*AES128GCM_BLOCK_SIZE, pInput + i*AES128GCM_BLOCK_SIZE);
+        }
+        if(!decrypt) { gp->update(S, pOutput, k); }
+        pInput += k * AES128GCM_BLOCK_SIZE;
+        pOutput += k * AES128GCM_BLOCK_SIZE;
+        nBlocks -= k;
+    }
+}
+
+/**
+ * @brief   encrypts or decrypts data and hashes the cipher text into S in a single pass
+ * @param   pICB        initial counter block J0
+ * @param   pInput      pointer to input data; need not be a block multiple
+ * @param   inputLength length of input array
+ * @param   pOutput     pointer to output data, same length as input; must not overlap input
+ * @param   decrypt     true if the input is the cipher text, else the output is
+ * @note    kc must be keyed, and S must have been started.
+ */
+void OTAES128GCMGenericBase::cryptAndHash(OTAES128GCMKeyContext &kc,
+                    GGBWS::GenerateTagWorkspace * const workspace,
+                    const uint8_t *pICB, const uint8_t *pInput, const size_t inputLength,
+                    uint8_t *pOutput, const bool decrypt)
+{
+    // Exit if no data.
+    if(inputLength == 0) return;
+
+    // Generate counter block J; the GCTR workspace is free until the tag is finished.
+    uint8_t *const ctrBlock = workspace->gctrSpace.ctrBlock;
+    memcpy(ctrBlock, pICB, AES128GCM_BLOCK_SIZE);
+    incr32(ctrBlock);
+
+    cryptAndHashText(kc, ctrBlock, workspace->S, pInput, inputLength, pOutput, decrypt);
+}
+
+/**
+ * @brief   encrypts or decrypts text from a counter block and hashes the cipher text into S in a single pass
+ * @param   ctrBlock    counter block for the first block of text; clobbered
+ * @param   S           GHASH accumulator, updated in place
+ * @param   pInput      pointer to input data; need not be a block multiple
+ * @param   inputLength length of input array
+ * @param   pOutput     pointer to output data, same length as input; must not overlap input
+ * @param   decrypt     true if the input is the cipher text, else the output is
+ * @note    kc must be keyed.
+ */
+void OTAES128GCMGenericBase::cryptAndHashText(OTAES128GCMKeyContext &kc,
+                    uint8_t * const ctrBlock, uint8_t * const S,
+                    const uint8_t *pInput, const size_t inputLength,
+                    uint8_t *pOutput, const bool decrypt)
+{
+    // cipher the full blocks
+    const size_t n = inputLength / AES128GCM_BLOCK_SIZE;
+    cryptAndHashBlocks(kc, ctrBlock, S, pInput, n, pOutput, decrypt);
+    const uint8_t *xpos = pInput + n * AES128GCM_BLOCK_SIZE;
+    uint8_t *ypos = pOutput + n * AES128GCM_BLOCK_SIZE;
+
+    // check if there is a partial block at end.
+    const uint8_t last = uint8_t(inputLength & (AES128GCM_BLOCK_SIZE-1));
+    if (last) {
+        if(decrypt) { GHASH(kc.gp, xpos, last, S); }
+        // The counter block is not needed again so becomes the key stream.
+        kc.ap->encryptBlocks(ctrBlock, ctrBlock, 1);
+        for (uint8_t i = 0; i < last; i++)
+            ypos[i] = xpos[i] ^ ctrBlock[i];
+        if(!decrypt) { GHASH(kc.gp, ypos, last, S); }
+    }
+}
+
+#if !defined(__AVR_ARCH__) && !defined(ARDUINO_ARCH_AVR)
+/**
+ * @brief   adds n to the rightmost 32 bits (4 bytes) of block, %(2^32), as n calls of incr32()
+ */
+static void add32(uint8_t *pBlock, const uint32_t n)
+{
+    uint32_t c = (uint32_t(pBlock[12]) << 24) | (uint32_t(pBlock[13]) << 16) |
+                 (uint32_t(pBlock[14]) << 8) | uint32_t(pBlock[15]);
+    c += n;
+    pBlock[12] = uint8_t(c >> 24);
+    pBlock[13] = uint8_t(c >> 16);
+    pBlock[14] = uint8_t(c >> 8);
+    pBlock[15] = uint8_t(c);
+}
+
+/**
+ * @brief   computes H^n for n >= 1 by square-and-multiply
+ * @param   H       hash subkey
+ * @param   n       power, at least 1
+ * @param   pOutput 16-byte output
+ *
+ * Uses the bit-serial multiplier (any multiplicand, no tables);
+ * some 2 * log2(n) multiplications, insignificant beside a large chunk.
+ */
+static void powerH(const uint8_t *H, size_t n, uint8_t *pOutput)
+{
+    uint8_t ws[OTGHASH128_BitSerial::workspaceRequired];
+    OTGHASH128_BitSerial m(ws, sizeof(ws));
+    uint8_t base[AES128GCM_BLOCK_SIZE];
+    memcpy(base, H, sizeof(base));
+    bool started = false;
+    while(0 != n) {
+        if(0 != (n & 1)) {
+            if(!started) { memcpy(pOutput, base, sizeof(base)); started = true; }
+            else { m.setKey(base); m.multiplyH(pOutput); }
+        }
+        n >>= 1;
+        // Squaring in place is safe as the multiplier copies H before writing Y.
+        if(0 != n) { m.setKey(base); m.multiplyH(base); }
+    }
+    m.endSession();
+    memset(base, 0, sizeof(base));
+    memset(ws, 0, sizeof(ws));
+}
+
+/**
+ * @brief   encrypts or decrypts and hashes the cipher text into S,
+ *          with the text split into chunks on several threads
+ * @param   pICB        initial counter block J0
+ * @param   maxThreads  most threads to use, including the caller's; 0 for one per hardware thread
+ * @note    kc must be keyed and read-only when keyed, and S must have been started.
+ *
+ * Hashing n blocks X_1..X_n from accumulator Y gives
+ * Y.H^n + GHASH_H(X_1..X_n) from zero,
+ * so each chunk is hashed from zero concurrently,
+ * and S = S.H^n_i + Y_i for each chunk i in turn.
+ * Each chunk but the last is a whole number of blocks.
+ */
+void OTAES128GCMGenericBase::cryptAndHashParallel(OTAES128GCMKeyContext &kc,
+                    GGBWS::GenerateTagWorkspace * const workspace,
+                    const uint8_t *pICB, const uint8_t *pInput, const size_t inputLength,
+                    uint8_t *pOutput, const bool decrypt, unsigned maxThreads)
+{
+    if(0 == maxThreads) { maxThreads = std::thread::hardware_concurrency(); }
+    if(maxThreads > ParallelMaxThreads) { maxThreads = ParallelMaxThreads; }
+    const size_t byLength = inputLength / ParallelMinChunkBytes;
+    const unsigned nThreads = (byLength < maxThreads) ? unsigned(byLength) : maxThreads;
+    if(nThreads <= 1) { cryptAndHash(kc, workspace, pICB, pInput, inputLength, pOutput, decrypt); return; }
+
+    // Blocks per chunk (the last chunk may be shorter), and chunk count.
+    const size_t nBlocks = (inputLength + AES128GCM_BLOCK_SIZE - 1) / AES128GCM_BLOCK_SIZE;
+    const size_t chunkBlocks = (nBlocks + nThreads - 1) / nThreads;
+    const unsigned nChunks = unsigned((nBlocks + chunkBlocks - 1) / chunkBlocks);
+    const size_t chunkBytes = chunkBlocks * AES128GCM_BLOCK_SIZE;
+
+    // Partial hash of each chunk.
+    uint8_t Y[ParallelMaxThreads][AES128GCM_BLOCK_SIZE];
+    auto runChunk = [&](const unsigned i)
+        {
+        const size_t offset = i * chunkBytes;
+        const size_t len = (i + 1 == nChunks) ? (inputLength - offset) : chunkBytes;
+        uint8_t ctrBlock[AES128GCM_BLOCK_SIZE];
+        memcpy(ctrBlock, pICB, sizeof(ctrBlock));
+        add32(ctrBlock, uint32_t(1 + i * chunkBlocks));
+        memset(Y[i], 0, AES128GCM_BLOCK_SIZE);
+        cryptAndHashText(kc, ctrBlock, Y[i], pInput + offset, len, pOutput + offset, decrypt);
+        memset(ctrBlock, 0, sizeof(ctrBlock));
+        };
+    std::vector<std::thread> threads;
+    threads.reserve(nChunks - 1);
+    for(unsigned i = 1; i < nChunks; ++i) {
+        // If no thread can be started the caller does the chunk.
+        try { threads.push_back(std::thread(runChunk, i)); }
+        catch(...) { runChunk(i); }
+    }
+    runChunk(0);
+    for(std::thread &t : threads) { t.join(); }
+
+    // Combine in order; only the last chunk may differ in length.
+    uint8_t Hn[AES128GCM_BLOCK_SIZE], HLast[AES128GCM_BLOCK_SIZE];
+    powerH(kc.authKey, chunkBlocks, Hn);
+    powerH(kc.authKey, nBlocks - (nChunks - 1) * chunkBlocks, HLast);
+    uint8_t ws[OTGHASH128_BitSerial::workspaceRequired];
+    OTGHASH128_BitSerial m(ws, sizeof(ws));
+    for(unsigned i = 0; i < nChunks; ++i) {
+        m.setKey((i + 1 == nChunks) ? HLast : Hn);
+        m.multiplyH(workspace->S);
+        xorBlock(workspace->S, Y[i]);
+    }
+    m.endSession();
+    memset(Y, 0, sizeof(Y));
+    memset(Hn, 0, sizeof(Hn));
+    memset(HLast, 0, sizeof(HLast));
+    memset(ws, 0, sizeof(ws));
+}
+#endif
+
+/**
+ * @brief   encrypts or decrypts text of any length from a counter block, without hashing
+ * @param   ctrBlock    counter block for the first block of text; clobbered
+ * @param   pInput      pointer to input data; need not be a block multiple
+ * @param   inputLength length of input array
+ * @param   pOutput     pointer to output data, same length as input; must not overlap input
+ * @note    ap must have an active keyed session.
+ */
+static void CTRText(OTAES128E * const ap, uint8_t * const ctrBlock,
+                    const uint8_t *pInput, const size_t inputLength, uint8_t *pOutput)
+{
+    size_t n = inputLength / AES128GCM_BLOCK_SIZE;
+    while (n > 0) {
+        const uint8_t k = (n < CTR_CHUNK_BLOCKS) ? uint8_t(n) : CTR_CHUNK_BLOCKS;
+        // Key stream straight into the output, combined with input.
+        ap->ctrKeystream(ctrBlock, pOutput, k);
+        for (uint8_t i = 0; i < k; i++) {
+            xorBlock(pOutput + i*AES128GCM_BLOCK_SIZE, pInput + i*AES128GCM_BLOCK_SIZE);
+        }
+        pInput += k * AES128GCM_BLOCK_SIZE;
+        pOutput += k * AES128GCM_BLOCK_SIZE;
+        n -= k;
+    }
+
+    // check if there is a partial block at end.
+    const uint8_t last = uint8_t(inputLength & (AES128GCM_BLOCK_SIZE-1));
+    if (last) {
+        ap->encryptBlocks(ctrBlock, ctrBlock, 1);
+        for (uint8_t i = 0; i < last; i++)
+            pOutput[i] = pInput[i] ^ ctrBlock[i];
+    }
+}
+
+/**
+ * @brief   encryption common to the public entry points, once arguments are checked
+ * @param   kc          keyed AES and GHASH implementations
+ * @note    The workspace is wiped; the key context is left keyed.
+ */
+void OTAES128GCMGenericBase::gcmEncryptCore(OTAES128GCMKeyContext &kc,
+                        GGBWS::GCMEncryptPaddedWorkspace &workspace, const uint8_t* IV,
+                        const uint8_t* PDATA, size_t PDATALength,
+                        const uint8_t* ADATA, size_t ADATALength,
+                        uint8_t* CDATA, uint8_t *tag)
+{
+    // Encrypt data.
+    generateICB(IV, workspace.ICB);
+    startTag(kc.gp, &workspace.tagWorkspace, ADATA, ADATALength);
+    // ICB is hashed with the key then XORed with PDATA to encrypt plain text,
+    // and the cipher text is hashed in the same pass.
+    cryptAndHash(kc, &workspace.tagWorkspace, workspace.ICB, PDATA, PDATALength, CDATA, false);
+
+    // Generate authentication tag.
+    finishTag(kc.ap, kc.gp, &workspace.tagWorkspace, ADATALength, PDATALength, tag, workspace.ICB);
+
+    // Erase workspace for security.
+    memset(&workspace, 0, sizeof(workspace));
+}
+
+/**
+ * @brief   decryption common to the public entry points, once arguments are checked
+ * @param   kc          keyed AES and GHASH implementations
+ * @param   verifyFirst if true, the tag is checked before any plain text is generated,
+ *                      and PDATA is left untouched on failure
+ * @retval  true if decryption and authentication successful, else false
+ * @note    The workspace is wiped; the key context is left keyed.
+ */
+bool OTAES128GCMGenericBase::gcmDecryptCore(OTAES128GCMKeyContext &kc,
+                        GGBWS::GCMDecryptWorkspace &workspace, const uint8_t* IV,
+                        const uint8_t* CDATA, size_t CDATALength,
+                        const uint8_t* ADATA, size_t ADATALength,
+                        const uint8_t* messageTag, uint8_t *PDATA,
+                        const bool verifyFirst)
+{
+    // Decrypt CDATA.
+    generateICB(IV, workspace.ICB);
+
+    startTag(kc.gp, &workspace.tagWorkspace, ADATA, ADATALength);
+    if(verifyFirst) {
+        // Only hash the cipher text for now: no key stream until authenticated.
+        GHASH(kc.gp, CDATA, CDATALength, workspace.tagWorkspace.S);
+    } else {
+        // ICB is hashed with the key then XORed with CDATA to decrypt cipher text,
+        // and the cipher text is hashed in the same pass.
+        cryptAndHash(kc, &workspace.tagWorkspace, workspace.ICB, CDATA, CDATALength, PDATA, true);
+    }
+
+    // Authenticate and return true if tag matches.
+    finishTag(kc.ap, kc.gp, &workspace.tagWorkspace, ADATALength, CDATALength, workspace.calculatedTag, workspace.ICB);
+    const bool success = (0 == checkTag(workspace.calculatedTag, messageTag));
+
+    if(verifyFirst && success && (0 != CDATALength)) {
+        // Now decrypt, from inc32(J0); the GCTR workspace is free again.
+        uint8_t *const ctrBlock = workspace.tagWorkspace.gctrSpace.ctrBlock;
+        memcpy(ctrBlock, workspace.ICB, AES128GCM_BLOCK_SIZE);
+        incr32(ctrBlock);
+        CTRText(kc.ap, ctrBlock, CDATA, CDATALength, PDATA);
+    }
+
+    // Erase workspace for security.
+    memset(&workspace, 0, sizeof(workspace));
+
+    return(success);
+}
+
+/**
+ * @brief   encrypts with this instance's own key context, keyed for just this call
+ * @retval  true if encryption is successful, else false
+ */
+bool OTAES128GCMGenericBase::gcmEncryptOnce(
+                        const uint8_t* key, const uint8_t* IV,
+                        const uint8_t* PDATA, size_t PDATALength,
+                        const uint8_t* ADATA, size_t ADATALength,
+                        uint8_t* CDATA, uint8_t *tag)
+{
+    // The AES and GHASH sessions are in use by a stream.
+    if(NULL != stream) { return(false); }
+    // Expand the key and derive H once for all the blocks below.
+    if(!setKey(key)) { return(false); }
+    gcmEncryptCore(*this, getGCMEncryptPaddedWorkspace(), IV, PDATA, PDATALength, ADATA, ADATALength, CDATA, tag);
+    // Erase expanded key and GHASH tables for security.
+    clear();
+    return(true);
+}
+
+/**
+ * @brief   decrypts with this instance's own key context, keyed for just this call
+ * @retval  true if decryption and authentication successful, else false
+ */
+bool OTAES128GCMGenericBase::gcmDecryptOnce(
+                        const uint8_t* key, const uint8_t* IV,
+                        const uint8_t* CDATA, size_t CDATALength,
+                        const uint8_t* ADATA, size_t ADATALength,
+                        const uint8_t* messageTag, uint8_t *PDATA)
+{
+    // The AES and GHASH sessions are in use by a stream.
+    if(NULL != stream) { return(false); }
+    // Expand the key and derive H once for all the blocks below.
+    if(!setKey(key)) { return(false); }
+    const bool success = gcmDecryptCore(*this, getGCMDecryptWorkspace(), IV, CDATA, CDATALength, ADATA, ADATALength, messageTag, PDATA, verifyFirst);
+    // Erase expanded key and GHASH tables for security.
+    clear();
+    return(success);
+}
+
+/**
+ * @brief   checks lengths against the SP800-38D limits for the large-message API
+ * @retval  true if both lengths are acceptable
+ */
+static bool largeLengthsValid(const size_t textLength, const size_t aadLength)
+{
+    return(((uint64_t)textLength <= AES128GCM_MAX_TEXT_LENGTH) &&
+           ((uint64_t)aadLength <= AES128GCM_MAX_AAD_LENGTH));
 }
 
 
@@ -462,18 +826,23 @@ bool OTAES128GCMGenericBase::gcmEncrypt(
     if(PDATALength >= (uint8_t)(256U - (uint16_t)AES128GCM_BLOCK_SIZE)) { return(false); } // Too big.
     const uint8_t CDATALength = (PDATALength + AES128GCM_BLOCK_SIZE-1) & ~(AES128GCM_BLOCK_SIZE-1);
 
+    // The AES and GHASH sessions are in use by a stream.
+    if(NULL != stream) { return(false); }
     GGBWS::GCMEncryptWorkspace workspace = getGCMEncryptWorkspace();
 
+    // Expand the key and derive H once for all the blocks below.
+    if(!setKey(key)) { return(false); }
+
     // Encrypt data.
-    generateAuthKey(ap, key, workspace.authKey);
     generateICB(IV, workspace.ICB);
     // ICB is hashed with the key then XORed with PDATA to encrypt plain text.
-    generateCDATA(ap, &workspace.cdataWorkspace, workspace.ICB, PDATA, PDATALength, CDATA, key);
+    generateCDATA(ap, &workspace.cdataWorkspace, workspace.ICB, PDATA, PDATALength, CDATA);
 
     // Generate authentication tag.
-    generateTag(ap, &workspace.tagWorkspace, key, workspace.authKey, ADATA, ADATALength, CDATA, CDATALength, tag, workspace.ICB);
+    generateTag(ap, gp, &workspace.tagWorkspace, ADATA, ADATALength, CDATA, CDATALength, tag, workspace.ICB);
 
-    // Erase workspace for security.
+    // Erase workspace, expanded key and GHASH tables for security.
+    clear();
     memset(&workspace, 0, sizeof(workspace));
 
     return(true);
@@ -524,23 +893,7 @@ bool OTAES128GCMGenericBase::gcmEncryptPadded(
     // Fail if there is nothing to encrypt and/or authenticate.
     if((PDATALength == 0) && (ADATALength == 0)) { return(false); }
 
-    const uint8_t CDATALength = PDATALength;
-
-    GGBWS::GCMEncryptPaddedWorkspace &workspace = getGCMEncryptPaddedWorkspace();
-
-    // Encrypt data.
-    generateAuthKey(ap, key, workspace.authKey);
-    generateICB(IV, workspace.ICB);
-    // ICB is hashed with the key then XORed with PDATA to encrypt plain text.
-    generateCDATAPadded(ap, &workspace.cdataWorkspace, workspace.ICB, PDATAPadded, PDATALength, CDATA, key);
-
-    // Generate authentication tag.
-    generateTag(ap, &workspace.tagWorkspace, key, workspace.authKey, ADATA, ADATALength, CDATA, CDATALength, tag, workspace.ICB);
-
-    // Erase workspace for security.
-    memset(&workspace, 0, sizeof(workspace));
-
-    return(true);
+    return(gcmEncryptOnce(key, IV, PDATAPadded, PDATALength, ADATA, ADATALength, CDATA, tag));
 }
 
 /**
@@ -566,24 +919,623 @@ bool OTAES128GCMGenericBase::gcmDecrypt(
 
     // Fail if the CDATA length is not a multiple of the block size.
     if(0 != (CDATALength & (AES128GCM_BLOCK_SIZE-1))) { return(false); }
-    GGBWS::GCMDecryptWorkspace &workspace = getGCMDecryptWorkspace();
 
-    // Decrypt CDATA.
-    generateAuthKey(ap, key, workspace.authKey);
-    generateICB(IV, workspace.ICB);
+    return(gcmDecryptOnce(key, IV, CDATA, CDATALength, ADATA, ADATALength, messageTag, PDATA));
+}
 
-    // ICB is hashed with the key then XORed with CDATA to decrypt cipher text.
-    generateCDATAPadded(ap, &workspace.cdataWorkspace, workspace.ICB, CDATA, CDATALength, PDATA, key);
+/**
+ * @brief   performs AES-GCM encryption on data of any size up to the SP800-38D limits.
+ * @param   key             pointer to 16 byte (128 bit) key; never NULL
+ * @param   IV              pointer to 12 byte (96 bit) IV; never NULL
+ * @param   PDATA           pointer to plaintext array; NULL if length 0.
+ * @param   PDATALength     length of plaintext in bytes, can be zero,
+ *                          need not be blocksize multiple;
+ *                          at most AES128GCM_MAX_TEXT_LENGTH.
+ * @param   ADATA           pointer to additional data array; NULL if length 0.
+ * @param   ADATALength     length of additional data in bytes, can be zero
+ * @param   CDATA           buffer to output ciphertext to, PDATALength bytes,
+ *                          not overlapping PDATA; NULL if length 0.
+ * @param   tag             pointer to 16 byte tag output buffer; never NULL
+ * @retval  true if encryption is successful, else false
+ *
+ * Unlike gcmEncryptPadded(), both lengths may be zero (an authentication tag only).
+ */
+bool OTAES128GCMGenericBase::gcmEncryptLarge(
+                        const uint8_t* key, const uint8_t* IV,
+                        const uint8_t* PDATA, size_t PDATALength,
+                        const uint8_t* ADATA, size_t ADATALength,
+                        uint8_t* CDATA, uint8_t *tag)
+{
+    if((NULL == key) || (NULL == IV) || (NULL == tag)) { return(false); }
+    if((0 != PDATALength) && ((NULL == PDATA) || (NULL == CDATA))) { return(false); }
+    if((0 != ADATALength) && (NULL == ADATA)) { return(false); }
+    if(!largeLengthsValid(PDATALength, ADATALength)) { return(false); }
 
-    // Authenticate and return true if tag matches.
-    generateTag(ap, &workspace.tagWorkspace, key, workspace.authKey, ADATA, ADATALength, CDATA, CDATALength, workspace.calculatedTag, workspace.ICB);
-    const bool success = (0 == checkTag(workspace.calculatedTag, messageTag));
+    return(gcmEncryptOnce(key, IV, PDATA, PDATALength, ADATA, ADATALength, CDATA, tag));
+}
+
+/**
+ * @brief   performs AES-GCM decryption and authentication on data of any size up to the SP800-38D limits.
+ * @param   key             pointer to 16 byte (128 bit) key; never NULL
+ * @param   IV              pointer to 12 byte (96 bit) IV; never NULL
+ * @param   CDATA           pointer to ciphertext array; NULL if length 0.
+ * @param   CDATALength     length of ciphertext in bytes, can be zero,
+ *                          need not be blocksize multiple;
+ *                          at most AES128GCM_MAX_TEXT_LENGTH.
+ * @param   ADATA           pointer to additional data array; NULL if length 0.
+ * @param   ADATALength     length of additional data in bytes, can be zero
+ * @param   messageTag      pointer to 16 byte tag to check; never NULL
+ * @param   PDATA           buffer to output plaintext to, CDATALength bytes,
+ *                          not overlapping CDATA; NULL if length 0.
+ * @retval  true if decryption and authentication successful, else false
+ */
+bool OTAES128GCMGenericBase::gcmDecryptLarge(
+                        const uint8_t* key, const uint8_t* IV,
+                        const uint8_t* CDATA, size_t CDATALength,
+                        const uint8_t* ADATA, size_t ADATALength,
+                        const uint8_t* messageTag, uint8_t *PDATA)
+{
+    if((NULL == key) || (NULL == IV) || (NULL == messageTag)) { return(false); }
+    if((0 != CDATALength) && ((NULL == CDATA) || (NULL == PDATA))) { return(false); }
+    if((0 != ADATALength) && (NULL == ADATA)) { return(false); }
+    if(!largeLengthsValid(CDATALength, ADATALength)) { return(false); }
+
+    return(gcmDecryptOnce(key, IV, CDATA, CDATALength, ADATA, ADATALength, messageTag, PDATA));
+}
+
+/**
+ * @brief   performs AES-GCM encryption with a key context keyed in advance
+ * @param   kc      keyed key context; left keyed
+ * @note    Otherwise as gcmEncryptPadded() taking a key.
+ */
+bool OTAES128GCMGenericBase::gcmEncryptPadded(
+                        OTAES128GCMKeyContext &kc, const uint8_t* IV,
+                        const uint8_t* PDATAPadded, uint8_t PDATALength,
+                        const uint8_t* ADATA, uint8_t ADATALength,
+                        uint8_t* CDATA, uint8_t *tag)
+{
+    if(!kc.isKeyed() || (NULL == IV) || (NULL == tag)) { return(false); }
+    if(NULL == CDATA) { return(false); }
+    if(0 != (PDATALength & (AES128GCM_BLOCK_SIZE-1))) { return(false); } // Reject non-padded data.
+    if((PDATALength == 0) && (ADATALength == 0)) { return(false); }
+    gcmEncryptCore(kc, getGCMEncryptPaddedWorkspace(), IV, PDATAPadded, PDATALength, ADATA, ADATALength, CDATA, tag);
+    return(true);
+}
+
+/**
+ * @brief   performs AES-GCM decryption and authentication with a key context keyed in advance
+ * @param   kc      keyed key context; left keyed
+ * @note    Otherwise as gcmDecrypt() taking a key.
+ */
+bool OTAES128GCMGenericBase::gcmDecrypt(
+                        OTAES128GCMKeyContext &kc, const uint8_t* IV,
+                        const uint8_t* CDATA, uint8_t CDATALength,
+                        const uint8_t* ADATA, uint8_t ADATALength,
+                        const uint8_t* messageTag, uint8_t *PDATA)
+{
+    if(!kc.isKeyed() || (NULL == IV) || (NULL == messageTag)) { return(false); }
+    if((CDATALength == 0) && (ADATALength == 0)) { return(false); }
+    if(0 != (CDATALength & (AES128GCM_BLOCK_SIZE-1))) { return(false); }
+    return(gcmDecryptCore(kc, getGCMDecryptWorkspace(), IV, CDATA, CDATALength, ADATA, ADATALength, messageTag, PDATA, verifyFirst));
+}
+
+/**
+ * @brief   performs AES-GCM encryption on data of any size with a key context keyed in advance
+ * @param   kc      keyed key context; left keyed
+ * @note    Otherwise as gcmEncryptLarge() taking a key.
+ */
+bool OTAES128GCMGenericBase::gcmEncryptLarge(
+                        OTAES128GCMKeyContext &kc, const uint8_t* IV,
+                        const uint8_t* PDATA, size_t PDATALength,
+                        const uint8_t* ADATA, size_t ADATALength,
+                        uint8_t* CDATA, uint8_t *tag)
+{
+    if(!kc.isKeyed() || (NULL == IV) || (NULL == tag)) { return(false); }
+    if((0 != PDATALength) && ((NULL == PDATA) || (NULL == CDATA))) { return(false); }
+    if((0 != ADATALength) && (NULL == ADATA)) { return(false); }
+    if(!largeLengthsValid(PDATALength, ADATALength)) { return(false); }
+    gcmEncryptCore(kc, getGCMEncryptPaddedWorkspace(), IV, PDATA, PDATALength, ADATA, ADATALength, CDATA, tag);
+    return(true);
+}
 
+/**
+ * @brief   performs AES-GCM decryption and authentication on data of any size with a key context keyed in advance
+ * @param   kc      keyed key context; left keyed
+ * @note    Otherwise as gcmDecryptLarge() taking a key.
+ */
+bool OTAES128GCMGenericBase::gcmDecryptLarge(
+                        OTAES128GCMKeyContext &kc, const uint8_t* IV,
+                        const uint8_t* CDATA, size_t CDATALength,
+                        const uint8_t* ADATA, size_t ADATALength,
+                        const uint8_t* messageTag, uint8_t *PDATA)
+{
+    if(!kc.isKeyed() || (NULL == IV) || (NULL == messageTag)) { return(false); }
+    if((0 != CDATALength) && ((NULL == CDATA) || (NULL == PDATA))) { return(false); }
+    if((0 != ADATALength) && (NULL == ADATA)) { return(false); }
+    if(!largeLengthsValid(CDATALength, ADATALength)) { return(false); }
+    return(gcmDecryptCore(kc, getGCMDecryptWorkspace(), IV, CDATA, CDATALength, ADATA, ADATALength, messageTag, PDATA, verifyFirst));
+}
+
+#if !defined(__AVR_ARCH__) && !defined(ARDUINO_ARCH_AVR)
+/**
+ * @brief   performs AES-GCM encryption on large data, split across several threads
+ * @param   kc          keyed key context; left keyed;
+ *                      if not read-only when keyed the call runs serially
+ * @param   maxThreads  most threads to use, including the caller's; 0 for one per hardware thread
+ * @note    Otherwise as gcmEncryptLarge() with a key context.
+ */
+bool OTAES128GCMGenericBase::gcmEncryptLargeParallel(
+                        OTAES128GCMKeyContext &kc, const uint8_t* IV,
+                        const uint8_t* PDATA, size_t PDATALength,
+                        const uint8_t* ADATA, size_t ADATALength,
+                        uint8_t* CDATA, uint8_t *tag, const unsigned maxThreads)
+{
+    // Only a context that is read-only when keyed may be used by several threads.
+    if(!kc.isReadOnlyWhenKeyed()) { return(gcmEncryptLarge(kc, IV, PDATA, PDATALength, ADATA, ADATALength, CDATA, tag)); }
+    if(!kc.isKeyed() || (NULL == IV) || (NULL == tag)) { return(false); }
+    if((0 != PDATALength) && ((NULL == PDATA) || (NULL == CDATA))) { return(false); }
+    if((0 != ADATALength) && (NULL == ADATA)) { return(false); }
+    if(!largeLengthsValid(PDATALength, ADATALength)) { return(false); }
+    GGBWS::GCMEncryptPaddedWorkspace &workspace = getGCMEncryptPaddedWorkspace();
+    generateICB(IV, workspace.ICB);
+    startTag(kc.gp, &workspace.tagWorkspace, ADATA, ADATALength);
+    cryptAndHashParallel(kc, &workspace.tagWorkspace, workspace.ICB, PDATA, PDATALength, CDATA, false, maxThreads);
+    finishTag(kc.ap, kc.gp, &workspace.tagWorkspace, ADATALength, PDATALength, tag, workspace.ICB);
     // Erase workspace for security.
     memset(&workspace, 0, sizeof(workspace));
+    return(true);
+}
 
+/**
+ * @brief   performs AES-GCM decryption and authentication on large data, split across several threads
+ * @param   kc          keyed key context; left keyed;
+ *                      if not read-only when keyed the call runs serially
+ * @param   maxThreads  most threads to use, including the caller's; 0 for one per hardware thread
+ * @note    Otherwise as gcmDecryptLarge() with a key context.
+ */
+bool OTAES128GCMGenericBase::gcmDecryptLargeParallel(
+                        OTAES128GCMKeyContext &kc, const uint8_t* IV,
+                        const uint8_t* CDATA, size_t CDATALength,
+                        const uint8_t* ADATA, size_t ADATALength,
+                        const uint8_t* messageTag, uint8_t *PDATA, const unsigned maxThreads)
+{
+    // Only a context that is read-only when keyed may be used by several threads.
+    if(!kc.isReadOnlyWhenKeyed()) { return(gcmDecryptLarge(kc, IV, CDATA, CDATALength, ADATA, ADATALength, messageTag, PDATA)); }
+    if(!kc.isKeyed() || (NULL == IV) || (NULL == messageTag)) { return(false); }
+    if((0 != CDATALength) && ((NULL == CDATA) || (NULL == PDATA))) { return(false); }
+    if((0 != ADATALength) && (NULL == ADATA)) { return(false); }
+    if(!largeLengthsValid(CDATALength, ADATALength)) { return(false); }
+    GGBWS::GCMDecryptWorkspace &workspace = getGCMDecryptWorkspace();
+    // Authenticating first needs all the cipher text hashed before decrypting any.
+    if(verifyFirst) { return(gcmDecryptCore(kc, workspace, IV, CDATA, CDATALength, ADATA, ADATALength, messageTag, PDATA, true)); }
+    generateICB(IV, workspace.ICB);
+    startTag(kc.gp, &workspace.tagWorkspace, ADATA, ADATALength);
+    cryptAndHashParallel(kc, &workspace.tagWorkspace, workspace.ICB, CDATA, CDATALength, PDATA, true, maxThreads);
+    finishTag(kc.ap, kc.gp, &workspace.tagWorkspace, ADATALength, CDATALength, workspace.calculatedTag, workspace.ICB);
+    const bool success = (0 == checkTag(workspace.calculatedTag, messageTag));
+    // Erase workspace for security.
+    memset(&workspace, 0, sizeof(workspace));
     return(success);
 }
+#endif
+
+/**
+ * @brief   checks a batch frame's pointers and lengths, other than the key
+ * @retval  true if acceptable
+ */
+static bool frameValid(const OTAES128GCMFrameDescriptor &f)
+{
+    if((NULL == f.IV) || (NULL == f.tag)) { return(false); }
+    if((0 != f.length) && ((NULL == f.input) || (NULL == f.output))) { return(false); }
+    if((0 != f.ADATALength) && (NULL == f.ADATA)) { return(false); }
+    return(largeLengthsValid(f.length, f.ADATALength));
+}
+
+/**
+ * @brief   number of AES blocks for a batch frame: the tag mask and the key stream
+ */
+static size_t frameBlocks(const OTAES128GCMFrameDescriptor &f)
+{
+    return(1 + (f.length + AES128GCM_BLOCK_SIZE-1) / AES128GCM_BLOCK_SIZE);
+}
+
+/**
+ * @brief   lays out and enciphers counter blocks for frames of a gcmBatch() wave
+ * @param   frames      the wave's frames
+ * @param   n           number of frames in the wave
+ * @param   want        per-frame flags, only flagged frames get blocks; NULL for all
+ * @param   withMask    if true each frame gets J0, for its tag mask
+ * @param   withText    if true each frame gets its data counters (after any J0), for its key stream
+ * @param   ap          keyed AES for all blocks, unless frameRK is not NULL
+ * @param   frameRK     per-frame AES-NI round keys for a wave of several keys, else NULL
+ * @param   ks          output, BATCH_BLOCKS blocks, laid out frame by frame in order
+ */
+static void cipherWave(const OTAES128GCMFrameDescriptor *const frames, const size_t n,
+                          const bool *const want, const bool withMask, const bool withText,
+                          OTAES128E *const ap, const uint8_t *const *const frameRK, uint8_t *const ks)
+{
+#if defined(OTAESGCM_X86_INTRINSICS)
+    const uint8_t *rks[BATCH_BLOCKS];
+#endif
+    uint8_t used = 0;
+    for(size_t j = 0; j < n; ++j) {
+        if((NULL != want) && !want[j]) { continue; }
+        const size_t textBlocks = frameBlocks(frames[j]) - 1;
+        const size_t nb = (withMask ? 1 : 0) + (withText ? textBlocks : 0);
+        if(0 == nb) { continue; }
+        uint8_t *const first = ks + used * AES128GCM_BLOCK_SIZE;
+        generateICB(frames[j].IV, first);
+        if(!withMask) { incr32(first); }
+        for(size_t b = 1; b < nb; ++b) {
+            memcpy(first + b * AES128GCM_BLOCK_SIZE, first + (b-1) * AES128GCM_BLOCK_SIZE, AES128GCM_BLOCK_SIZE);
+            incr32(first + b * AES128GCM_BLOCK_SIZE);
+        }
+#if defined(OTAESGCM_X86_INTRINSICS)
+        if(NULL != frameRK) { for(size_t b = 0; b < nb; ++b) { rks[used + b] = frameRK[j]; } }
+#endif
+        used = uint8_t(used + nb);
+    }
+    if(0 == used) { return; }
+#if defined(OTAESGCM_X86_INTRINSICS)
+    if(NULL != frameRK) { OTAES128E_AESNI::encryptBlocksMultiKey(rks, ks, ks, used); return; }
+#endif
+    ap->encryptBlocks(ks, ks, used);
+}
+
+/**
+ * @brief   encrypts or decrypts a batch of independent frames
+ * @param   frames      array of nFrames frame descriptors
+ * @param   nFrames     number of frames, can be zero
+ * @param   successBits bitmap of (nFrames+7)/8 bytes for per-frame success; may be NULL
+ * @param   decrypt     true to decrypt and authenticate, else encrypt
+ * @retval  number of frames successfully processed
+ *
+ * Consecutive frames sharing a key are gathered in waves
+ * whose counter blocks (J0, then the data counters) are laid out together
+ * and enciphered in a single AES call,
+ * so that eg AES-NI can pipeline blocks from several short frames;
+ * with AES-NI key contexts, frames of different keys share a wave too,
+ * each block being enciphered in lockstep with its own frame's key;
+ * each frame in the wave is then hashed and has its text and tag
+ * combined with its key stream.
+ * In verify-before-decrypt mode only the J0 blocks are enciphered at first,
+ * and the key stream only for frames whose tags then match.
+ * Frames too big for one wave go through the single-frame path.
+ */
+size_t OTAES128GCMGenericBase::gcmBatch(const OTAES128GCMFrameDescriptor *const frames, const size_t nFrames,
+                        uint8_t *const successBits, const bool decrypt)
+{
+    if(NULL != successBits) { memset(successBits, 0, (nFrames + 7) / 8); }
+    if(NULL == frames) { return(0); }
+
+    // Key stream for one wave.
+    uint8_t ks[BATCH_BLOCKS * AES128GCM_BLOCK_SIZE];
+    // Key pointer this instance's own key context is keyed with, else NULL.
+    const uint8_t *ownKey = NULL;
+    size_t succeeded = 0;
+
+    size_t i = 0;
+    while(i < nFrames) {
+        const OTAES128GCMFrameDescriptor &first = frames[i];
+        // Find the key context for this wave, keying our own if need be.
+        OTAES128GCMKeyContext *kc = first.kc;
+        if(NULL == kc) {
+            if((NULL != first.key) && (NULL == stream) && (first.key != ownKey)) {
+                ownKey = setKey(first.key) ? first.key : NULL;
+            }
+            if((NULL != first.key) && (first.key == ownKey)) { kc = this; }
+        }
+        if((NULL == kc) || !kc->isKeyed() || !frameValid(first)) { ++i; continue; }
+
+        if(frameBlocks(first) > BATCH_BLOCKS) {
+            // Too big to share a wave.
+            bool good = true;
+            if(decrypt) {
+                good = gcmDecryptCore(*kc, getGCMDecryptWorkspace(), first.IV, first.input, first.length,
+                                       first.ADATA, first.ADATALength, first.tag, first.output, verifyFirst);
+            } else {
+                gcmEncryptCore(*kc, getGCMEncryptPaddedWorkspace(), first.IV, first.input, first.length,
+                               first.ADATA, first.ADATALength, first.output, first.tag);
+            }
+            if(good) {
+                ++succeeded;
+                if(NULL != successBits) { successBits[i >> 3] |= uint8_t(1 << (i & 7)); }
+            }
+            ++i;
+            continue;
+        }
+
+        // Gather the wave.
+        // Frames of other keys may join if both keys have AES-NI round keys,
+        // each block then being enciphered with its own frame's key.
+        OTAES128GCMKeyContext *waveKC[BATCH_BLOCKS];
+        const uint8_t *const *frameRK = NULL;
+#if defined(OTAESGCM_X86_INTRINSICS)
+        const uint8_t *waveRK[BATCH_BLOCKS];
+        const uint8_t *const firstRK = kc->roundKeysAESNI();
+#endif
+        size_t end = i;
+        size_t blocks = 0;
+        while(end < nFrames) {
+            const OTAES128GCMFrameDescriptor &f = frames[end];
+            OTAES128GCMKeyContext *const fkc = (NULL != f.kc) ? f.kc :
+                (((NULL != f.key) && (f.key == ownKey)) ? static_cast<OTAES128GCMKeyContext *>(this) : NULL);
+            bool joins = (fkc == kc);
+#if defined(OTAESGCM_X86_INTRINSICS)
+            const uint8_t *const rk = joins ? firstRK :
+                (((NULL != firstRK) && (NULL != fkc) && fkc->isKeyed()) ? fkc->roundKeysAESNI() : NULL);
+            if(!joins) { joins = (NULL != rk); }
+#endif
+            if(!joins || !frameValid(f) || (blocks + frameBlocks(f) > BATCH_BLOCKS)) { break; }
+#if defined(OTAESGCM_X86_INTRINSICS)
+            waveRK[end - i] = rk;
+            if(fkc != kc) { frameRK = waveRK; }
+#endif
+            waveKC[end - i] = fkc;
+            blocks += frameBlocks(f);
+            ++end;
+        }
+        const size_t n = end - i;
+
+        // Encipher J0 (the tag mask) then the data counters of each frame,
+        // or when verifying before decrypting only the tag masks for now.
+        const bool masksOnly = decrypt && verifyFirst;
+        cipherWave(frames + i, n, NULL, true, !masksOnly, kc->ap, frameRK, ks);
+
+        // Hash each frame, and combine its text and tag with its key stream.
+        GGBWS::GenerateTagWorkspace &tws = getGCMEncryptPaddedWorkspace().tagWorkspace;
+        bool good[BATCH_BLOCKS];
+        size_t used = 0;
+        for(size_t j = 0; j < n; ++j) {
+            const OTAES128GCMFrameDescriptor &f = frames[i + j];
+            const uint8_t *const mask = ks + used * AES128GCM_BLOCK_SIZE;
+            const uint8_t *const keyStream = mask + AES128GCM_BLOCK_SIZE;
+            OTGHASH128 *const fgp = waveKC[j]->gp;
+            startTag(fgp, &tws, f.ADATA, f.ADATALength);
+            if(!decrypt) {
+                for(size_t k = 0; k < f.length; ++k) { f.output[k] = uint8_t(f.input[k] ^ keyStream[k]); }
+            }
+            GHASH(fgp, decrypt ? f.input : f.output, f.length, tws.S);
+            hashLengths(fgp, &tws, f.ADATALength, f.length);
+            xorBlock(tws.S, mask);
+            good[j] = true;
+            if(decrypt) {
+                good[j] = (0 == checkTag(tws.S, f.tag));
+                // The key stream may already be to hand, so verifying first costs nothing.
+                if(good[j] && !masksOnly) {
+                    for(size_t k = 0; k < f.length; ++k) { f.output[k] = uint8_t(f.input[k] ^ keyStream[k]); }
+                }
+            }
+            else { memcpy(f.tag, tws.S, AES128GCM_TAG_SIZE); }
+            used += masksOnly ? 1 : frameBlocks(f);
+        }
+
+        if(masksOnly) {
+            // Key stream only for the frames that authenticated.
+            cipherWave(frames + i, n, good, false, true, kc->ap, frameRK, ks);
+            used = 0;
+            for(size_t j = 0; j < n; ++j) {
+                if(!good[j]) { continue; }
+                const OTAES128GCMFrameDescriptor &f = frames[i + j];
+                const uint8_t *const keyStream = ks + used * AES128GCM_BLOCK_SIZE;
+                for(size_t k = 0; k < f.length; ++k) { f.output[k] = uint8_t(f.input[k] ^ keyStream[k]); }
+                used += frameBlocks(f) - 1;
+            }
+        }
+
+        for(size_t j = 0; j < n; ++j) {
+            if(good[j]) {
+                ++succeeded;
+                if(NULL != successBits) { successBits[(i + j) >> 3] |= uint8_t(1 << ((i + j) & 7)); }
+            }
+        }
+        i = end;
+    }
+
+    // Erase key stream, workspace, and any key in our own context for security.
+    memset(ks, 0, sizeof(ks));
+    memset(&getGCMEncryptPaddedWorkspace(), 0, sizeof(GGBWS::GCMEncryptPaddedWorkspace));
+    if(NULL != ownKey) { clear(); }
+    return(succeeded);
+}
+
+/**
+ * @brief   starts streaming encryption or decryption
+ * @param   ctx         caller's stream context; need not be initialised
+ * @param   key         pointer to 16 byte (128 bit) key; never NULL
+ * @param   IV          pointer to 12 byte (96 bit) IV; never NULL
+ * @param   decrypt     true to decrypt, else encrypt
+ * @retval  true if successful, else false,
+ *          eg if another stream is active on this instance,
+ *          or if decrypting in verify-before-decrypt mode
+ *
+ * Restarting an active stream with the same context discards it.
+ */
+bool OTAES128GCMGenericBase::gcmStreamInit(OTAES128GCMStreamContext &ctx,
+                        const uint8_t* key, const uint8_t* IV, const bool decrypt)
+{
+    if(&ctx == stream) { gcmStreamAbort(ctx); }
+    if(NULL != stream) { return(false); }
+    if((NULL == key) || (NULL == IV)) { return(false); }
+    // Streaming releases plain text before the tag can be checked.
+    if(decrypt && verifyFirst) { return(false); }
+
+    memset(&ctx, 0, sizeof(ctx));
+    // Expand the key and derive H once for the whole stream.
+    if(!setKey(key)) { return(false); }
+    generateICB(IV, ctx.ICB);
+    memcpy(ctx.tagWorkspace.gctrSpace.ctrBlock, ctx.ICB, AES128GCM_BLOCK_SIZE);
+    incr32(ctx.tagWorkspace.gctrSpace.ctrBlock);
+    ctx.decrypt = decrypt;
+    ctx.phase = 1;
+    stream = &ctx;
+    return(true);
+}
+
+/**
+ * @brief   adds additional data to the stream, before any text
+ * @param   ctx         active stream context
+ * @param   ADATA       pointer to additional data; NULL if length 0
+ * @param   ADATALength length of additional data in bytes, can be zero
+ * @retval  true if successful, else false
+ */
+bool OTAES128GCMGenericBase::gcmStreamAAD(OTAES128GCMStreamContext &ctx,
+                        const uint8_t* ADATA, size_t ADATALength)
+{
+    if(&ctx != stream) { return(false); }
+    // No more additional data once text has started.
+    if(1 != ctx.phase) { gcmStreamAbort(ctx); return(false); }
+    if((0 != ADATALength) && (NULL == ADATA)) { gcmStreamAbort(ctx); return(false); }
+    if((uint64_t)ADATALength > AES128GCM_MAX_AAD_LENGTH - (uint64_t)ctx.ADATALength) { gcmStreamAbort(ctx); return(false); }
+    ctx.ADATALength += ADATALength;
+
+    uint8_t *const S = ctx.tagWorkspace.S;
+    // Top up any partial block first.
+    if(0 != ctx.partial) {
+        while((ADATALength > 0) && (ctx.partial < AES128GCM_BLOCK_SIZE)) {
+            ctx.buf[ctx.partial++] = *ADATA++;
+            --ADATALength;
+        }
+        if(ctx.partial < AES128GCM_BLOCK_SIZE) { return(true); }
+        gp->update(S, ctx.buf, 1);
+        ctx.partial = 0;
+    }
+    // Hash whole blocks straight from the caller's buffer.
+    const size_t n = ADATALength / AES128GCM_BLOCK_SIZE;
+    gp->update(S, ADATA, n);
+    ADATA += n * AES128GCM_BLOCK_SIZE;
+    // Buffer the rest.
+    ctx.partial = uint8_t(ADATALength & (AES128GCM_BLOCK_SIZE-1));
+    memcpy(ctx.buf, ADATA, ctx.partial);
+    return(true);
+}
+
+/**
+ * @brief   hashes any buffered partial block, zero padded
+ */
+static void streamFlushPartial(OTGHASH128 * const gp, OTAES128GCMStreamContext &ctx)
+{
+    if(0 == ctx.partial) { return; }
+    memset(ctx.buf + ctx.partial, 0, AES128GCM_BLOCK_SIZE - ctx.partial);
+    gp->update(ctx.tagWorkspace.S, ctx.buf, 1);
+    ctx.partial = 0;
+}
+
+/**
+ * @brief   encrypts or decrypts the next chunk of text
+ * @param   ctx         active stream context
+ * @param   input       pointer to input text; NULL if length 0
+ * @param   length      length of input in bytes, can be zero,
+ *                      need not be a multiple of block size
+ * @param   output      buffer for length bytes of output; must not overlap input
+ * @retval  true if successful, else false
+ *
+ * Once text has been passed no more additional data may be.
+ */
+bool OTAES128GCMGenericBase::gcmStreamUpdate(OTAES128GCMStreamContext &ctx,
+                        const uint8_t* input, size_t length, uint8_t *output)
+{
+    if((&ctx != stream) || (0 == ctx.phase)) { return(false); }
+    if((0 != length) && ((NULL == input) || (NULL == output))) { gcmStreamAbort(ctx); return(false); }
+    if((uint64_t)length > AES128GCM_MAX_TEXT_LENGTH - (uint64_t)ctx.textLength) { gcmStreamAbort(ctx); return(false); }
+    if(1 == ctx.phase) { streamFlushPartial(gp, ctx); ctx.phase = 2; }
+    ctx.textLength += length;
+
+    uint8_t *const S = ctx.tagWorkspace.S;
+    uint8_t *const ctrBlock = ctx.tagWorkspace.gctrSpace.ctrBlock;
+    // Use up the key stream of any partial block first,
+    // keeping the cipher text in its place for hashing.
+    if(0 != ctx.partial) {
+        while((length > 0) && (ctx.partial < AES128GCM_BLOCK_SIZE)) {
+            const uint8_t k = ctx.buf[ctx.partial];
+            const uint8_t c = ctx.decrypt ? *input : uint8_t(*input ^ k);
+            *output++ = uint8_t(*input++ ^ k);
+            ctx.buf[ctx.partial++] = c;
+            --length;
+        }
+        if(ctx.partial < AES128GCM_BLOCK_SIZE) { return(true); }
+        gp->update(S, ctx.buf, 1);
+        ctx.partial = 0;
+    }
+    // Whole blocks straight between the caller's buffers.
+    const size_t n = length / AES128GCM_BLOCK_SIZE;
+    cryptAndHashBlocks(*this, ctrBlock, S, input, n, output, ctx.decrypt);
+    input += n * AES128GCM_BLOCK_SIZE;
+    output += n * AES128GCM_BLOCK_SIZE;
+    // Start a partial block with the rest.
+    const uint8_t last = uint8_t(length & (AES128GCM_BLOCK_SIZE-1));
+    if(0 != last) {
+        ap->encryptBlocks(ctrBlock, ctx.buf, 1);
+        incr32(ctrBlock);
+        for(uint8_t i = 0; i < last; i++) {
+            const uint8_t k = ctx.buf[i];
+            ctx.buf[i] = ctx.decrypt ? input[i] : uint8_t(input[i] ^ k);
+            output[i] = uint8_t(input[i] ^ k);
+        }
+        ctx.partial = last;
+    }
+    return(true);
+}
+
+/**
+ * @brief   finishes the stream, computing the tag, and ends it
+ * @param   pTag        16 byte tag output; may be ctx.buf
+ */
+static void streamTag(OTAES128E * const ap, OTGHASH128 * const gp,
+                      OTAES128GCMStreamContext &ctx, uint8_t *pTag)
+{
+    streamFlushPartial(gp, ctx);
+    finishTag(ap, gp, &ctx.tagWorkspace, ctx.ADATALength, ctx.textLength, pTag, ctx.ICB);
+}
+
+/**
+ * @brief   finishes streaming encryption, outputting the tag
+ * @param   ctx         active encryption stream context
+ * @param   tag         pointer to 16 byte tag output buffer; never NULL
+ * @retval  true if successful, else false
+ *
+ * The stream is ended and the context wiped in any case.
+ */
+bool OTAES128GCMGenericBase::gcmStreamFinal(OTAES128GCMStreamContext &ctx, uint8_t *tag)
+{
+    if((&ctx != stream) || (0 == ctx.phase)) { return(false); }
+    const bool ok = (!ctx.decrypt) && (NULL != tag);
+    if(ok) { streamTag(ap, gp, ctx, tag); }
+    gcmStreamAbort(ctx);
+    return(ok);
+}
+
+/**
+ * @brief   finishes streaming decryption, checking the tag in constant time
+ * @param   ctx         active decryption stream context
+ * @param   messageTag  pointer to 16 byte tag to check; never NULL
+ * @retval  true if the text is authentic, else false
+ *
+ * The stream is ended and the context wiped in any case.
+ */
+bool OTAES128GCMGenericBase::gcmStreamVerify(OTAES128GCMStreamContext &ctx, const uint8_t *messageTag)
+{
+    if((&ctx != stream) || (0 == ctx.phase)) { return(false); }
+    bool ok = ctx.decrypt && (NULL != messageTag);
+    if(ok) {
+        streamTag(ap, gp, ctx, ctx.buf);
+        ok = (0 == checkTag(ctx.buf, messageTag));
+    }
+    gcmStreamAbort(ctx);
+    return(ok);
+}
+
+/**
+ * @brief   abandons the stream, ending the AES and GHASH sessions and wiping the context
+ * @param   ctx         stream context; ignored if not active
+ */
+void OTAES128GCMGenericBase::gcmStreamAbort(OTAES128GCMStreamContext &ctx)
+{
+    if(&ctx != stream) { return; }
+    clear();
+    memset(&ctx, 0, sizeof(ctx));
+    stream = NULL;
+}
 
 #if defined(OTAESGCM_ALLOW_NON_WORKSPACE)
 // AES-GCM 128-bit-key fixed-size text (256-bit/32-byte) encryption/authentication function.
@@ -28,6 +28,9 @@ Author(s) / Copyright (s): Deniz Erbilgin 2015--2017
 // Get available AES API and cipher implementations.
 #include "OTAESGCM_OTAES128.h"
 #include "OTAESGCM_OTAES128Impls.h"
+// Get available GHASH API and implementations.
+#include "OTAESGCM_OTGHASH128.h"
+#include "OTAESGCM_OTGHASH128Impls.h"
 
 // IF DEFINED: Allow encryption/decryption functions to take unpadded input.
 // These are disabled by default as original implementation was incorrect,
@@ -48,6 +51,11 @@ namespace OTAESGCM
 static constexpr uint8_t AES128GCM_BLOCK_SIZE = 16; // GCM block size in bytes. This must be the same as the AES block size.
 static constexpr uint8_t AES128GCM_IV_SIZE    = 12; // GCM initialisation size in bytes.
 static constexpr uint8_t AES128GCM_TAG_SIZE   = 16; // GCM authentication tag size in bytes.
+// SP800-38D limits for gcmEncryptLarge()/gcmDecryptLarge(), in bytes:
+// text at most 2^32 - 2 blocks (so the 32-bit counter cannot wrap),
+// additional data at most 2^64 - 1 bits.
+static constexpr uint64_t AES128GCM_MAX_TEXT_LENGTH = ((uint64_t(1) << 32) - 2) * AES128GCM_BLOCK_SIZE;
+static constexpr uint64_t AES128GCM_MAX_AAD_LENGTH  = ~uint64_t(0) >> 3;
 
 
     // Base class / interface for AES128-GCM encryption/decryption.
@@ -174,16 +182,6 @@ static constexpr uint8_t AES128GCM_TAG_SIZE   = 16; // GCM authentication tag si
     // allows more visibility and (potentially) control.
     namespace GGBWS
     {
-        /**
-         * @struct  Bulk of GHASH() workspace.
-         * @note    32 bytes for AES128.
-         * */
-        struct GHASHWorkspace final
-        {
-            uint8_t ghashTmp[AES128GCM_BLOCK_SIZE]; // If using full blocks, no need for tmp.
-            uint8_t gFieldMultiplyTmp[AES128GCM_BLOCK_SIZE]; // If using full blocks, no need for tmp.
-        };
-
         /**
          * @struct  Bulk of GCTR() workspace.
          * @note    32 bytes for AES128.
@@ -213,24 +211,16 @@ static constexpr uint8_t AES128GCM_TAG_SIZE   = 16; // GCM authentication tag si
             GCTRWorkspace gctrSpace;
         };
         /**
-         * @struct  Bulk of generateCDATAPadded() workspace.
+         * @struct  Bulk of generateTag() and cryptAndHash() workspace.
          * @note    32 = 16 + 16 bytes.
-         */
-        struct GenCDATAPaddedWorkspace final
-        {
-            uint8_t ctrBlock[AES128GCM_BLOCK_SIZE];
-            GCTRPaddedWorkspace gctrSpace;
-        };
-        /**
-         * @struct  Bulk of generateTag() workspace.
-         * @note    64 = 16 + 32 + 16 bytes.
+         * @note    GHASH() workspace is provided by the OTGHASH128 implementation.
          */
         struct GenerateTagWorkspace final
         {
             uint8_t S[AES128GCM_BLOCK_SIZE];
-            GHASHWorkspace ghashSpace;
             // lengthBuffer and gctrSpace are/contain 16 byte uint8_t arrays
-            // and are not used simultaneously.
+            // and are not used simultaneously;
+            // gctrSpace also holds the data counter block in cryptAndHash().
             union
             {
                 uint8_t lengthBuffer[16];
@@ -239,11 +229,11 @@ static constexpr uint8_t AES128GCM_TAG_SIZE   = 16; // GCM authentication tag si
         };
         /**
          * @struct  Bulk of gcmEncrypt() workspace
-         * @note    96 = 16 + 16 + 64 bytes.
+         * @note    64 = 16 + 48 bytes.
+         * @note    H is held by the OTAES128GCMKeyContext.
          */
         struct GCMEncryptWorkspace final
         {
-            uint8_t authKey[AES128GCM_BLOCK_SIZE];
             uint8_t ICB[AES128GCM_BLOCK_SIZE];
             // generateCDATA and generateTag are called separately
             // and so their workspaces can be a union.
@@ -253,35 +243,27 @@ static constexpr uint8_t AES128GCM_TAG_SIZE   = 16; // GCM authentication tag si
             };
         };
         /**
-         * @struct  Bulk of generateCDATA() workspace
-         * @note    96 = 16 + 16 + 64 bytes.
+         * @struct  Bulk of gcmEncryptPadded() workspace
+         * @note    48 = 16 + 32 bytes.
          */
         struct GCMEncryptPaddedWorkspace final
         {
-            uint8_t authKey[AES128GCM_BLOCK_SIZE];
             uint8_t ICB[AES128GCM_BLOCK_SIZE];
-            // generateCDATA and generateTag are called separately
-            // and so their workspaces can be a union.
-            union {
-                GenCDATAPaddedWorkspace cdataWorkspace;
-                GenerateTagWorkspace tagWorkspace;
-            };
+            // Encryption and hashing are done in a single pass
+            // so share the tag workspace.
+            GenerateTagWorkspace tagWorkspace;
         };
         /**
-         * @struct  Bulk of generateCDATA() workspace
-         * @note    112 = 16 + 16 + 16 + 64 bytes.
+         * @struct  Bulk of gcmDecrypt() workspace
+         * @note    64 = 16 + 16 + 32 bytes.
          */
         struct GCMDecryptWorkspace final
         {
-            uint8_t authKey[AES128GCM_BLOCK_SIZE];
             uint8_t ICB[AES128GCM_BLOCK_SIZE];
             uint8_t calculatedTag[AES128GCM_TAG_SIZE];
-            // generateCDATA and generateTag are called separately
-            // and so their workspaces can be a union.
-            union {
-                GenCDATAPaddedWorkspace cdataWorkspace;
-                GenerateTagWorkspace tagWorkspace;
-            };
+            // Decryption and hashing are done in a single pass
+            // so share the tag workspace.
+            GenerateTagWorkspace tagWorkspace;
         };
 
         // Workspace required for OTAES128GCMGenericBase functions.
@@ -302,15 +284,126 @@ static constexpr uint8_t AES128GCM_TAG_SIZE   = 16; // GCM authentication tag si
             (maxEncWS > gcmDecryptWorkspaceRequired) ? maxEncWS : gcmDecryptWorkspaceRequired;
     }
 
-    // Generic implementation, parameterised with type of underlying AES implementation.
-    // The default AES implementation for the architecture is used unless otherwise specified.
-    // This implementation is not specialised for a particular CPU/MCU for example.
-    // This implementation carries no state beyond that of the AES128 implementation.
-    class OTAES128GCMGenericBase : public OTAES128GCM
+    // State of one streaming (incremental) encryption or decryption,
+    // see OTAES128GCMGenericBase::gcmStreamInit().
+    // Owned by the caller, and opaque other than its size;
+    // wiped when the stream is finished or aborted.
+    struct OTAES128GCMStreamContext final
         {
+        // Initial counter block J0, for the tag.
+        uint8_t ICB[AES128GCM_BLOCK_SIZE];
+        // GHASH accumulator S, and the next data counter block
+        // (which becomes the tag length block at the end).
+        GGBWS::GenerateTagWorkspace tagWorkspace;
+        // Partial block: buffered additional data,
+        // or key stream with the cipher text bytes so far overwriting it.
+        uint8_t buf[AES128GCM_BLOCK_SIZE];
+        // Lengths so far.
+        size_t ADATALength;
+        size_t textLength;
+        // Bytes used in buf.
+        uint8_t partial;
+        // Phase: 0 idle, 1 additional data, 2 text.
+        uint8_t phase;
+        // True if decrypting.
+        bool decrypt;
+        };
+
+    // Per-key state: the expanded AES key schedule, H, and any GHASH tables,
+    // held in AES and GHASH implementation instances,
+    // so that these are computed once per key rather than once per message.
+    // Pass to the OTAES128GCMGenericBase overloads taking a key context and IV.
+    // See OTAES128GCMKeyContextWithWorkspace for a concrete type.
+    // Holds key material until clear() is called, so the caller should call it when done.
+    // Neither re-entrant nor ISR-safe except where stated.
+    class OTAES128GCMKeyContext
+        {
+        friend class OTAES128GCMGenericBase;
         private:
             // Pointer to an AES block encryption implementation instance; never NULL.
             OTAES128E * const ap;
+            // Pointer to a GHASH implementation instance; never NULL.
+            OTGHASH128 * const gp;
+            // Hash subkey H; the GHASH implementation may retain a pointer to it.
+            uint8_t authKey[AES128GCM_BLOCK_SIZE];
+            // True while keyed.
+            bool keyed;
+
+            // Optional stitched single-pass CTR + GHASH kernel over whole blocks,
+            // specific to the AES and GHASH implementations in use.
+            // Returns false (having done nothing) if there is none,
+            // in which case the generic fused loop is used.
+            virtual bool stitchedCTRGHASH(uint8_t * /*ctrBlock*/, const uint8_t * /*in*/, uint8_t * /*out*/,
+                                          size_t /*nBlocks*/, uint8_t * /*S*/, bool /*decrypt*/)
+                { return(false); }
+#if defined(OTAESGCM_X86_INTRINSICS)
+            // AES-NI expanded key of the keyed AES implementation, else NULL;
+            // lets gcmBatch() encipher frames of different keys in one AES-NI call.
+            virtual const uint8_t *roundKeysAESNI() const { return(NULL); }
+#endif
+
+        protected:
+            // Create an instance pointing at suitable AES block enc and GHASH implementations.
+            constexpr OTAES128GCMKeyContext(OTAES128E *aptr, OTGHASH128 *gptr)
+                : ap(aptr), gp(gptr), authKey(), keyed(false) { }
+
+        public:
+            // Expand the 16-byte key and derive H and its GHASH tables,
+            // replacing any previous key; true iff successful.
+            bool setKey(const uint8_t *key);
+            // Erase all key material.
+            void clear();
+            // True if keyed.
+            bool isKeyed() const { return(keyed); }
+            // True if, once keyed, using this context only reads it,
+            // so that it may be used from several threads at once
+            // (see OTAESGCMReadOnlyWhenKeyed and OTAES128GCMSharedKeyContext).
+            // Callers that would share a context between threads
+            // check this and otherwise avoid concurrent use.
+            virtual bool isReadOnlyWhenKeyed() const { return(false); }
+
+#if 0 // Defining the virtual destructor uses ~800+ bytes of Flash by forcing use of malloc()/free().
+            virtual ~OTAES128GCMKeyContext() { clear(); }
+#else
+#define OTAES128GCMKeyContext_NO_VIRT_DEST // Beware, no virtual destructor so be careful of use via base pointers.
+#endif
+        };
+
+    // Descriptor of one independent frame for gcmEncryptBatch()/gcmDecryptBatch().
+    // Lengths and pointers are as for gcmEncryptLarge()/gcmDecryptLarge().
+    struct OTAES128GCMFrameDescriptor final
+        {
+        // Keyed key context, or NULL to use key.
+        OTAES128GCMKeyContext *kc;
+        // 16-byte key, used if kc is NULL.
+        const uint8_t *key;
+        // 12-byte IV.
+        const uint8_t *IV;
+        // Additional data.
+        const uint8_t *ADATA;
+        size_t ADATALength;
+        // Input text: plain text to encrypt or cipher text to decrypt.
+        const uint8_t *input;
+        size_t length;
+        // Output text, length bytes, not overlapping input.
+        uint8_t *output;
+        // 16-byte tag: written when encrypting, checked when decrypting.
+        uint8_t *tag;
+        };
+
+    // Generic implementation, parameterised with type of underlying AES and GHASH implementations.
+    // The default AES and GHASH implementations for the architecture are used unless otherwise specified.
+    // This implementation is not specialised for a particular CPU/MCU for example.
+    // This implementation carries no state beyond that of the AES128 and GHASH implementations,
+    // which are keyed afresh for each one-shot call,
+    // and can equally work with a key context keyed once.
+    class OTAES128GCMGenericBase : public OTAES128GCM, private OTAES128GCMKeyContext
+        {
+        private:
+            // Stream holding the AES and GHASH sessions, else NULL.
+            OTAES128GCMStreamContext *stream;
+            // True to authenticate cipher text before decrypting it.
+            bool verifyFirst;
             // Only one is ever needed for any one call,
             // and calls cannot be made concurrently on any one instance.
             // Return appropriate temporary workspace.
@@ -320,11 +413,70 @@ static constexpr uint8_t AES128GCM_TAG_SIZE   = 16; // GCM authentication tag si
             virtual GGBWS::GCMEncryptPaddedWorkspace &getGCMEncryptPaddedWorkspace() = 0;
             virtual GGBWS::GCMDecryptWorkspace &getGCMDecryptWorkspace() = 0;
 
+            // Encrypt or decrypt whole blocks and hash the cipher text in one pass.
+            static void cryptAndHashBlocks(OTAES128GCMKeyContext &kc, uint8_t *ctrBlock, uint8_t *S,
+                                           const uint8_t *pInput, size_t nBlocks,
+                                           uint8_t *pOutput, bool decrypt);
+            // Encrypt or decrypt text of any length from ctrBlock and hash the cipher text in one pass.
+            static void cryptAndHashText(OTAES128GCMKeyContext &kc, uint8_t *ctrBlock, uint8_t *S,
+                                         const uint8_t *pInput, size_t inputLength,
+                                         uint8_t *pOutput, bool decrypt);
+            // Encrypt or decrypt and hash the cipher text in one pass.
+            static void cryptAndHash(OTAES128GCMKeyContext &kc, GGBWS::GenerateTagWorkspace *workspace,
+                                     const uint8_t *pICB, const uint8_t *pInput, size_t inputLength,
+                                     uint8_t *pOutput, bool decrypt);
+#if !defined(__AVR_ARCH__) && !defined(ARDUINO_ARCH_AVR)
+            // Encrypt or decrypt and hash the text in chunks on several threads,
+            // combining the partial hashes into S.
+            void cryptAndHashParallel(OTAES128GCMKeyContext &kc, GGBWS::GenerateTagWorkspace *workspace,
+                                      const uint8_t *pICB, const uint8_t *pInput, size_t inputLength,
+                                      uint8_t *pOutput, bool decrypt, unsigned maxThreads);
+#endif
+            // Key this instance's own key context for one call, and encrypt/decrypt.
+            bool gcmEncryptOnce(const uint8_t* key, const uint8_t* IV,
+                                const uint8_t* PDATA, size_t PDATALength,
+                                const uint8_t* ADATA, size_t ADATALength,
+                                uint8_t* CDATA, uint8_t *tag);
+            bool gcmDecryptOnce(const uint8_t* key, const uint8_t* IV,
+                                const uint8_t* CDATA, size_t CDATALength,
+                                const uint8_t* ADATA, size_t ADATALength,
+                                const uint8_t* messageTag, uint8_t *PDATA);
+            // Bodies of encryption and decryption with a keyed context,
+            // shared by the entry points once arguments are checked.
+            static void gcmEncryptCore(OTAES128GCMKeyContext &kc,
+                                       GGBWS::GCMEncryptPaddedWorkspace &workspace, const uint8_t* IV,
+                                       const uint8_t* PDATA, size_t PDATALength,
+                                       const uint8_t* ADATA, size_t ADATALength,
+                                       uint8_t* CDATA, uint8_t *tag);
+            static bool gcmDecryptCore(OTAES128GCMKeyContext &kc,
+                                       GGBWS::GCMDecryptWorkspace &workspace, const uint8_t* IV,
+                                       const uint8_t* CDATA, size_t CDATALength,
+                                       const uint8_t* ADATA, size_t ADATALength,
+                                       const uint8_t* messageTag, uint8_t *PDATA,
+                                       bool verifyFirst);
+            // Body of gcmEncryptBatch() and gcmDecryptBatch().
+            size_t gcmBatch(const OTAES128GCMFrameDescriptor *frames, size_t nFrames,
+                            uint8_t *successBits, bool decrypt);
+
         public:
-            // Create an instance pointing at a suitable AES block enc/dec implementation.
-            // The AES impl should not carry logical state between operations,
+            // Create an instance pointing at suitable AES block enc/dec and GHASH implementations.
+            // The AES and GHASH impls should not carry logical state between operations,
             // but may hold temporary workspace or non-key/data-dependent state.
-            constexpr OTAES128GCMGenericBase(OTAES128E *aptr) : ap(aptr) { }
+            constexpr OTAES128GCMGenericBase(OTAES128E *aptr, OTGHASH128 *gptr)
+                : OTAES128GCMKeyContext(aptr, gptr), stream(NULL), verifyFirst(false) { }
+
+            // Select verify-before-decrypt mode (off by default).
+            // When on, decryption first hashes the cipher text and checks the tag,
+            // and only if it matches generates the key stream and writes the plain text,
+            // so a forged or corrupted message costs just GHASH plus one AES block
+            // and leaves the output untouched;
+            // a good message costs a second pass over the text.
+            // When off, decryption and hashing are fused in one pass
+            // and the output holds unauthenticated plain text on failure.
+            // Batch decryption never writes a failed frame's output when waves are used.
+            // Streaming decryption cannot verify first, so gcmStreamInit() refuses it when on.
+            void setVerifyBeforeDecrypt(const bool on) { verifyFirst = on; }
+            bool isVerifyBeforeDecrypt() const { return(verifyFirst); }
 
             // Encrypt; true iff successful.
             // Plain text need not be padded to a block-size multiple.
@@ -353,26 +505,300 @@ static constexpr uint8_t AES128GCM_TAG_SIZE   = 16; // GCM authentication tag si
                  const uint8_t* CDATA, uint8_t CDATALength,
                  const uint8_t* ADATA, uint8_t ADATALength,
                  const uint8_t* messageTag, uint8_t *PDATA) override;
+
+            /**
+             * @brief    performs AES-GCM encryption on data of any size
+             *           up to AES128GCM_MAX_TEXT_LENGTH and AES128GCM_MAX_AAD_LENGTH.
+             * @param    key             pointer to 16 byte (128 bit) key
+             * @param    IV              pointer to 12 byte (96 bit) IV
+             * @param    PDATA           pointer to plaintext array,
+             *                           need not be a multiple of block size;
+             *                           NULL if length 0
+             * @param    PDATALength     length of plaintext array
+             * @param    ADATA           pointer to additional data array
+             * @param    ADATALength     length of additional data
+             * @param    CDATA           buffer to output ciphertext to;
+             *                           same length as PDATA and must not overlap it
+             * @param    tag             pointer to 16 byte buffer to output tag to
+             * @retval   true if encryption successful, else false
+             *
+             * Both lengths may be zero, eg for GMAC over nothing.
+             * Not part of the OTAES128GCM interface, so that the size_t
+             * large-message path is not pulled into every vtable (and flash).
+             */
+            bool gcmEncryptLarge(
+                const uint8_t* key, const uint8_t* IV,
+                const uint8_t* PDATA, size_t PDATALength,
+                const uint8_t* ADATA, size_t ADATALength,
+                uint8_t* CDATA, uint8_t *tag);
+
+            /**
+             * @brief    performs AES-GCM decryption and authentication on data of any size
+             *           up to AES128GCM_MAX_TEXT_LENGTH and AES128GCM_MAX_AAD_LENGTH.
+             * @param    key             pointer to 16 byte (128 bit) key
+             * @param    IV              pointer to 12 byte (96 bit) IV
+             * @param    CDATA           pointer to ciphertext array,
+             *                           need not be a multiple of block size;
+             *                           NULL if length 0
+             * @param    CDATALength     length of ciphertext array
+             * @param    ADATA           pointer to additional data array
+             * @param    ADATALength     length of additional data
+             * @param    messageTag      pointer to 16 byte tag to authenticate against
+             * @param    PDATA           buffer to output plaintext to;
+             *                           same length as CDATA and must not overlap it
+             * @retval   true if decryption and authentication successful,
+             *           else false
+             */
+            bool gcmDecryptLarge(
+                 const uint8_t* key, const uint8_t* IV,
+                 const uint8_t* CDATA, size_t CDATALength,
+                 const uint8_t* ADATA, size_t ADATALength,
+                 const uint8_t* messageTag, uint8_t *PDATA);
+
+            // As above, but with a key context keyed in advance
+            // (which saves expanding the key and deriving H and any GHASH tables
+            // for each message) and using this instance's workspace.
+            // The key context is left keyed.
+            bool gcmEncryptPadded(
+                OTAES128GCMKeyContext &kc, const uint8_t* IV,
+                const uint8_t* PDATAPadded, uint8_t PDATALength,
+                const uint8_t* ADATA, uint8_t ADATALength,
+                uint8_t* CDATA, uint8_t *tag);
+            bool gcmDecrypt(
+                 OTAES128GCMKeyContext &kc, const uint8_t* IV,
+                 const uint8_t* CDATA, uint8_t CDATALength,
+                 const uint8_t* ADATA, uint8_t ADATALength,
+                 const uint8_t* messageTag, uint8_t *PDATA);
+            bool gcmEncryptLarge(
+                OTAES128GCMKeyContext &kc, const uint8_t* IV,
+                const uint8_t* PDATA, size_t PDATALength,
+                const uint8_t* ADATA, size_t ADATALength,
+                uint8_t* CDATA, uint8_t *tag);
+            bool gcmDecryptLarge(
+                 OTAES128GCMKeyContext &kc, const uint8_t* IV,
+                 const uint8_t* CDATA, size_t CDATALength,
+                 const uint8_t* ADATA, size_t ADATALength,
+                 const uint8_t* messageTag, uint8_t *PDATA);
+
+#if !defined(__AVR_ARCH__) && !defined(ARDUINO_ARCH_AVR)
+            // As the key context gcmEncryptLarge()/gcmDecryptLarge(),
+            // but for large texts the CTR and GHASH work is split into chunks
+            // run on up to maxThreads threads (0 for one per hardware thread),
+            // including the caller's.
+            // Each chunk is hashed from zero, and the partial hashes are combined
+            // with powers of H, so output and tag are identical to the serial ones.
+            // kc is used from several threads at once, so if it is not
+            // read-only when keyed (see kc.isReadOnlyWhenKeyed() and
+            // OTAES128GCMSharedKeyContext) the call runs serially instead.
+            // At least ParallelMinChunkBytes of text are given to each thread,
+            // so smaller texts run serially on the calling thread.
+            // In verify-before-decrypt mode decryption runs serially.
+            bool gcmEncryptLargeParallel(
+                OTAES128GCMKeyContext &kc, const uint8_t* IV,
+                const uint8_t* PDATA, size_t PDATALength,
+                const uint8_t* ADATA, size_t ADATALength,
+                uint8_t* CDATA, uint8_t *tag, unsigned maxThreads = 0);
+            bool gcmDecryptLargeParallel(
+                 OTAES128GCMKeyContext &kc, const uint8_t* IV,
+                 const uint8_t* CDATA, size_t CDATALength,
+                 const uint8_t* ADATA, size_t ADATALength,
+                 const uint8_t* messageTag, uint8_t *PDATA, unsigned maxThreads = 0);
+            // Minimum text per thread for gcmEncryptLargeParallel()/gcmDecryptLargeParallel().
+            static constexpr size_t ParallelMinChunkBytes = 256 * 1024;
+            // Maximum threads used by gcmEncryptLargeParallel()/gcmDecryptLargeParallel().
+            static constexpr unsigned ParallelMaxThreads = 64;
+#endif
+
+            // Encrypt/decrypt a batch of independent frames,
+            // interleaving the AES work of consecutive frames sharing a key
+            // (same key context, or same key pointer) to keep the pipeline full,
+            // or with AES-NI, of consecutive frames with keyed key contexts
+            // even if of different keys (multi-buffer).
+            // Sets bit (i & 7) of successBits[i >> 3] iff frame i succeeded,
+            // clearing the others; successBits may be NULL.
+            // Returns the number of frames that succeeded.
+            // Frames using a key rather than a key context
+            // fail while a stream is active on this instance.
+            size_t gcmEncryptBatch(const OTAES128GCMFrameDescriptor *frames, size_t nFrames, uint8_t *successBits)
+                { return(gcmBatch(frames, nFrames, successBits, false)); }
+            size_t gcmDecryptBatch(const OTAES128GCMFrameDescriptor *frames, size_t nFrames, uint8_t *successBits)
+                { return(gcmBatch(frames, nFrames, successBits, true)); }
+
+            // Streaming encryption/decryption, in arbitrarily-sized chunks.
+            // Call gcmStreamInit(), then gcmStreamAAD() zero or more times,
+            // then gcmStreamUpdate() zero or more times,
+            // then gcmStreamFinal() (encrypt) or gcmStreamVerify() (decrypt),
+            // or gcmStreamAbort() at any point.
+            // All return true iff successful; on failure the stream is aborted,
+            // unless ctx is not this instance's active stream, when nothing is done.
+            // While a stream is active it holds this instance's AES and GHASH sessions,
+            // so other streams and the one-shot functions fail until it is finished.
+            // When decrypting, plain text is released before the tag is checked
+            // and must not be used unless gcmStreamVerify() succeeds.
+            bool gcmStreamInit(OTAES128GCMStreamContext &ctx,
+                               const uint8_t* key, const uint8_t* IV, bool decrypt);
+            bool gcmStreamAAD(OTAES128GCMStreamContext &ctx,
+                              const uint8_t* ADATA, size_t ADATALength);
+            bool gcmStreamUpdate(OTAES128GCMStreamContext &ctx,
+                                 const uint8_t* input, size_t length, uint8_t *output);
+            bool gcmStreamFinal(OTAES128GCMStreamContext &ctx, uint8_t *tag);
+            bool gcmStreamVerify(OTAES128GCMStreamContext &ctx, const uint8_t *messageTag);
+            void gcmStreamAbort(OTAES128GCMStreamContext &ctx);
+        };
+
+    // Selects a stitched single-pass CTR + GHASH kernel
+    // for a given pair of AES and GHASH implementations.
+    // By default there is none.
+    template<class OTAESImpl, class OTGHASHImpl>
+    struct OTAES128GCMStitch final
+        {
+        static bool run(const OTAESImpl &, const OTGHASHImpl &,
+                        uint8_t *, const uint8_t *, uint8_t *, size_t, uint8_t *, bool)
+            { return(false); }
+        };
+#if defined(OTAESGCM_X86_INTRINSICS)
+    // AES-NI with PCLMULQDQ.
+    template<>
+    struct OTAES128GCMStitch<OTAES128E_AESNI, OTGHASH128_CLMUL> final
+        {
+        static bool run(const OTAES128E_AESNI &a, const OTGHASH128_CLMUL &g,
+                        uint8_t *ctrBlock, const uint8_t *in, uint8_t *out, size_t nBlocks, uint8_t *S, bool decrypt)
+            {
+            const uint8_t *const rk = a.sessionRoundKeys();
+            const uint8_t *const hp = g.sessionPowers();
+            if((NULL == rk) || (NULL == hp)) { return(false); }
+            gcmCTRGHASH_AESNI_CLMUL(rk, hp, ctrBlock, in, out, nBlocks, S, decrypt);
+            return(true);
+            }
+        };
+    // Run-time dispatch, where both selected the hardware implementations.
+    template<>
+    struct OTAES128GCMStitch<OTAES128E_RuntimeDispatch, OTGHASH128_RuntimeDispatch> final
+        {
+        static bool run(const OTAES128E_RuntimeDispatch &a, const OTGHASH128_RuntimeDispatch &g,
+                        uint8_t *ctrBlock, const uint8_t *in, uint8_t *out, size_t nBlocks, uint8_t *S, bool decrypt)
+            {
+            const uint8_t *const rk = a.sessionRoundKeysHW();
+            const uint8_t *const hp = g.sessionPowersHW();
+            if((NULL == rk) || (NULL == hp)) { return(false); }
+            gcmCTRGHASH_AESNI_CLMUL(rk, hp, ctrBlock, in, out, nBlocks, S, decrypt);
+            return(true);
+            }
+        };
+#endif
+
+    // Exposes the AES-NI expanded key of a keyed AES implementation, if it has one,
+    // for multi-key AES-NI calls across frames (see gcmBatch()).
+    // By default there is none.
+    template<class OTAESImpl>
+    struct OTAES128MultiKey final
+        {
+        static const uint8_t *roundKeys(const OTAESImpl &) { return(NULL); }
+        };
+#if defined(OTAESGCM_X86_INTRINSICS)
+    template<>
+    struct OTAES128MultiKey<OTAES128E_AESNI> final
+        {
+        static const uint8_t *roundKeys(const OTAES128E_AESNI &a) { return(a.sessionRoundKeys()); }
         };
+    template<>
+    struct OTAES128MultiKey<OTAES128E_RuntimeDispatch> final
+        {
+        static const uint8_t *roundKeys(const OTAES128E_RuntimeDispatch &a) { return(a.sessionRoundKeysHW()); }
+        };
+#endif
+
+    // True if once keyed the AES (or GHASH) implementation writes nothing
+    // in itself or its workspace when encrypting (or hashing),
+    // all per-call state being on the stack or in the caller's buffers,
+    // so that one keyed instance can be used from many threads at once.
+    // False (the safe default) unless specialised below.
+    // OTAES128E_AVRSmall (rolling round key) and
+    // OTGHASH128_BitSerial (temporary in workspace) are not shareable.
+    template<class Impl>
+    struct OTAESGCMReadOnlyWhenKeyed final { static constexpr bool value = false; };
+    template<> struct OTAESGCMReadOnlyWhenKeyed<OTAES128E_AVR> final { static constexpr bool value = true; };
+    template<> struct OTAESGCMReadOnlyWhenKeyed<OTAES128E_AVRFixed> final { static constexpr bool value = true; };
+    template<> struct OTAESGCMReadOnlyWhenKeyed<OTGHASH128_Shoup4> final { static constexpr bool value = true; };
+#if !defined(__AVR_ARCH__) && !defined(ARDUINO_ARCH_AVR)
+    template<> struct OTAESGCMReadOnlyWhenKeyed<OTAES128E_TTable> final { static constexpr bool value = true; };
+    template<> struct OTAESGCMReadOnlyWhenKeyed<OTAES128E_Bitsliced> final { static constexpr bool value = true; };
+    template<> struct OTAESGCMReadOnlyWhenKeyed<OTGHASH128_Shoup8> final { static constexpr bool value = true; };
+#endif
+#if defined(OTAESGCM_X86_INTRINSICS)
+    template<> struct OTAESGCMReadOnlyWhenKeyed<OTAES128E_AESNI> final { static constexpr bool value = true; };
+    template<> struct OTAESGCMReadOnlyWhenKeyed<OTAES128E_VPerm> final { static constexpr bool value = true; };
+    template<> struct OTAESGCMReadOnlyWhenKeyed<OTAES128E_RuntimeDispatch> final { static constexpr bool value = true; };
+    template<> struct OTAESGCMReadOnlyWhenKeyed<OTGHASH128_CLMUL> final { static constexpr bool value = true; };
+    template<> struct OTAESGCMReadOnlyWhenKeyed<OTGHASH128_RuntimeDispatch> final { static constexpr bool value = true; };
+#endif
+
+    // Key context, parameterised with types of underlying AES and GHASH implementations,
+    // which must match those of any OTAES128GCMGenericWithWorkspace it is used with
+    // for any stitched kernel to apply (though any pairing works).
+    // Workspace is laid out starting with AES space followed by GHASH space,
+    // and holds the key schedule and tables while keyed.
+    template<class OTAESImpl = OTAESGCM::OTAES128E_default_t, class OTGHASHImpl = OTAESGCM::OTGHASH128_default_t>
+    class OTAES128GCMKeyContextWithWorkspace final : OTAESImpl, OTGHASHImpl, public OTAES128GCMKeyContext
+        {
+        private:
+            // Use any stitched kernel for this pair of implementations.
+            virtual bool stitchedCTRGHASH(uint8_t *ctrBlock, const uint8_t *in, uint8_t *out,
+                                          size_t nBlocks, uint8_t *S, bool decrypt) override
+                { return(OTAES128GCMStitch<OTAESImpl, OTGHASHImpl>::run(*this, *this, ctrBlock, in, out, nBlocks, S, decrypt)); }
+#if defined(OTAESGCM_X86_INTRINSICS)
+            virtual const uint8_t *roundKeysAESNI() const override
+                { return(OTAES128MultiKey<OTAESImpl>::roundKeys(*this)); }
+#endif
+
+        public:
+            virtual bool isReadOnlyWhenKeyed() const override
+                { return(OTAESGCMReadOnlyWhenKeyed<OTAESImpl>::value && OTAESGCMReadOnlyWhenKeyed<OTGHASHImpl>::value); }
+
+            // Suitable type to hold size of workspace required.
+            typedef size_t workspacesize_t;
+
+            constexpr static workspacesize_t workspaceRequiredAES = OTAESImpl::workspaceRequired;
+            constexpr static workspacesize_t workspaceRequiredGHASH = OTGHASHImpl::workspaceRequired;
+            // Workspace required.
+            constexpr static workspacesize_t workspaceRequired = workspaceRequiredAES + workspaceRequiredGHASH;
+
+            // Construct an instance, supplied with workspace.
+            // setKey() will fail if the workspace is NULL or too small.
+            constexpr OTAES128GCMKeyContextWithWorkspace(uint8_t *const workspace, const workspacesize_t workspaceSize)
+                : OTAESImpl(workspace, isWorkspaceSufficient(workspace, workspaceSize) ? workspaceRequiredAES : 0),
+                  OTGHASHImpl((NULL == workspace) ? NULL : workspace + workspaceRequiredAES,
+                              isWorkspaceSufficient(workspace, workspaceSize) ? workspaceRequiredGHASH : 0),
+                  OTAES128GCMKeyContext(this, this)
+                { }
+            // Verify that the workspace is adequate.
+            static constexpr bool isWorkspaceSufficient(uint8_t *const workspace, const workspacesize_t workspaceSize)
+                { return((NULL != workspace) && (workspaceSize >= workspaceRequired)); }
+            // Key this context, rather than the underlying implementations directly.
+            using OTAES128GCMKeyContext::setKey;
+        };
+
 #if defined(OTAESGCM_ALLOW_NON_WORKSPACE)
-    // Generic implementation, parameterised with type of underlying AES implementation.
-    // Carries the AES working state with it.
+    // Generic implementation, parameterised with types of underlying AES and GHASH implementations.
+    // Carries the AES and GHASH working state with it.
     //
     // For security, as far as is reasonably possible:
-    //   * the OTAESImpl methods should erase private state before returning.
+    //   * the OTAESImpl and OTGHASHImpl methods should erase private state before returning.
     //   * the gcm function methods should erase private state before returning.
-    template<class OTAESImpl = OTAESGCM::OTAES128E_default_t>
-    class OTAES128GCMGeneric final : OTAESImpl, public OTAES128GCMGenericBase
+    template<class OTAESImpl = OTAESGCM::OTAES128E_default_t, class OTGHASHImpl = OTAESGCM::OTGHASH128_default_t>
+    class OTAES128GCMGeneric final : OTAESImpl, OTGHASHImpl, public OTAES128GCMGenericBase
         {
         private:
             // Minimum size of workspace required.
-            constexpr static uint8_t workspaceRequiredAES = OTAESImpl::workspaceRequired;
+            constexpr static size_t workspaceRequiredAES = OTAESImpl::workspaceRequired;
+            constexpr static size_t workspaceRequiredGHASH = OTGHASHImpl::workspaceRequired;
             // Workspace is laid out starting with AES space
-            // and followed by the GCM function workspace.
+            // and followed by the GHASH and GCM function workspaces.
             // Note that we validate at compile time that at least the
             // minimum requirement is met.
             // The other non-minimal functions will need a runtime check.
             uint8_t workspaceAES[workspaceRequiredAES];
+            uint8_t workspaceGHASH[workspaceRequiredGHASH];
 
             // Union of temporary workspaces for the GCM functions.
             // Only one is ever needed for any one call,
@@ -391,20 +817,31 @@ static constexpr uint8_t AES128GCM_TAG_SIZE   = 16; // GCM authentication tag si
 #endif
             virtual GGBWS::GCMEncryptPaddedWorkspace &getGCMEncryptPaddedWorkspace() override { return(encPaddedWS); }
             virtual GGBWS::GCMDecryptWorkspace &getGCMDecryptWorkspace() override { return(decWS); }
+            // Use any stitched kernel for this pair of implementations.
+            virtual bool stitchedCTRGHASH(uint8_t *ctrBlock, const uint8_t *in, uint8_t *out,
+                                          size_t nBlocks, uint8_t *S, bool decrypt) override
+                { return(OTAES128GCMStitch<OTAESImpl, OTGHASHImpl>::run(*this, *this, ctrBlock, in, out, nBlocks, S, decrypt)); }
+#if defined(OTAESGCM_X86_INTRINSICS)
+            virtual const uint8_t *roundKeysAESNI() const override
+                { return(OTAES128MultiKey<OTAESImpl>::roundKeys(*this)); }
+#endif
 
         public:
             // Construct an instance.
-            constexpr OTAES128GCMGeneric() : OTAESImpl(workspaceAES, workspaceRequiredAES), OTAES128GCMGenericBase(this) { }
+            constexpr OTAES128GCMGeneric()
+                : OTAESImpl(workspaceAES, workspaceRequiredAES),
+                  OTGHASHImpl(workspaceGHASH, workspaceRequiredGHASH),
+                  OTAES128GCMGenericBase(this, this) { }
         };
 #endif
-    // Generic implementation, parameterised with type of underlying AES implementation.
-    // Carries the AES working state with it.
+    // Generic implementation, parameterised with types of underlying AES and GHASH implementations.
+    // Carries the AES and GHASH working state with it.
     //
     // For security, as far as is reasonably possible:
-    //   * the OTAESImpl methods should erase private state before returning.
+    //   * the OTAESImpl and OTGHASHImpl methods should erase private state before returning.
     //   * the gcm function methods should erase private state before returning.
-    template<class OTAESImpl = OTAESGCM::OTAES128E_default_t>
-    class OTAES128GCMGenericWithWorkspace final : OTAESImpl, public OTAES128GCMGenericBase
+    template<class OTAESImpl = OTAESGCM::OTAES128E_default_t, class OTGHASHImpl = OTAESGCM::OTGHASH128_default_t>
+    class OTAES128GCMGenericWithWorkspace final : OTAESImpl, OTGHASHImpl, public OTAES128GCMGenericBase
         {
         private:
             // GCM workspace part of that passed into to constructor.
@@ -416,9 +853,25 @@ static constexpr uint8_t AES128GCM_TAG_SIZE   = 16; // GCM authentication tag si
 #endif
             virtual GGBWS::GCMEncryptPaddedWorkspace &getGCMEncryptPaddedWorkspace() override { return(*(GGBWS::GCMEncryptPaddedWorkspace *)(gcmWorkspace)); }
             virtual GGBWS::GCMDecryptWorkspace &getGCMDecryptWorkspace() override { return(*(GGBWS::GCMDecryptWorkspace *)(gcmWorkspace)); }
+            // Use any stitched kernel for this pair of implementations.
+            virtual bool stitchedCTRGHASH(uint8_t *ctrBlock, const uint8_t *in, uint8_t *out,
+                                          size_t nBlocks, uint8_t *S, bool decrypt) override
+                { return(OTAES128GCMStitch<OTAESImpl, OTGHASHImpl>::run(*this, *this, ctrBlock, in, out, nBlocks, S, decrypt)); }
+#if defined(OTAESGCM_X86_INTRINSICS)
+            virtual const uint8_t *roundKeysAESNI() const override
+                { return(OTAES128MultiKey<OTAESImpl>::roundKeys(*this)); }
+#endif
 
         public:
-            constexpr static uint8_t workspaceRequiredAES = OTAESImpl::workspaceRequired;
+            // Suitable type to hold size of workspace required.
+            typedef size_t workspacesize_t;
+
+            // AES workspace need not fit in a uint8_t, eg for host table-driven impls.
+            constexpr static workspacesize_t workspaceRequiredAES = OTAESImpl::workspaceRequired;
+            // GHASH workspace, eg for per-key tables; follows the AES workspace.
+            constexpr static workspacesize_t workspaceRequiredGHASH = OTGHASHImpl::workspaceRequired;
+            // Combined AES and GHASH workspace, preceding the GCM function workspace.
+            constexpr static workspacesize_t workspaceRequiredImpl = workspaceRequiredAES + workspaceRequiredGHASH;
 
 //            // on top of AES requirement.
 //            // Implicitly this ensures total size can fit in a uint8_t also.
@@ -426,23 +879,23 @@ static constexpr uint8_t AES128GCM_TAG_SIZE   = 16; // GCM authentication tag si
 //            static_assert(GGBWS::gcmEncryptPaddedWorkspaceRequired + workspaceRequiredAES < 256U, "too big");
 //            static_assert(GGBWS::gcmDecryptWorkspaceRequired + workspaceRequiredAES < 256U, "too big");
 
-            // Suitable type to hold size of workspace required.
-            typedef size_t workspacesize_t;
-
             // Minimum and maximum size of workspace required
             // (dependent on which function is to be called).
             constexpr static workspacesize_t workspaceRequiredMin =
-                workspaceRequiredAES + GGBWS::minWS;
+                workspaceRequiredImpl + GGBWS::minWS;
             constexpr static workspacesize_t workspaceRequiredMax =
-                workspaceRequiredAES + GGBWS::maxWS;
+                workspaceRequiredImpl + GGBWS::maxWS;
             // Conservatively/statically request the maximum workspace needed.
             constexpr static workspacesize_t workspaceRequired = workspaceRequiredMax;
             // Construct an instance, supplied with workspace.
-            // Pass the AES support class the leading part of the workspace.
+            // Pass the AES support class the leading part of the workspace,
+            // and the GHASH support class the next part.
             constexpr OTAES128GCMGenericWithWorkspace(uint8_t *const workspace, const workspacesize_t workspaceSize)
                 : OTAESImpl(workspace, isWorkspaceSufficientMin(workspace, workspaceSize) ? workspaceRequiredAES : 0),
-                  OTAES128GCMGenericBase(this),
-                  gcmWorkspace(workspace + workspaceRequiredAES)
+                  OTGHASHImpl((NULL == workspace) ? NULL : workspace + workspaceRequiredAES,
+                              isWorkspaceSufficientMin(workspace, workspaceSize) ? workspaceRequiredGHASH : 0),
+                  OTAES128GCMGenericBase(this, this),
+                  gcmWorkspace((NULL == workspace) ? NULL : workspace + workspaceRequiredImpl)
                 { }
             // Verify that the workspace is adequate
             // at least for the least-demanding function.
@@ -456,17 +909,17 @@ static constexpr uint8_t AES128GCM_TAG_SIZE   = 16; // GCM authentication tag si
                 { return((NULL != workspace) && (workspaceSize >= workspaceRequiredMax)); }
 
             // Workspace sufficient for gcmEncrypt().
-            static constexpr workspacesize_t workspaceRequiredEnc = workspaceRequiredAES + (workspacesize_t) GGBWS::gcmEncryptWorkspaceRequired;
+            static constexpr workspacesize_t workspaceRequiredEnc = workspaceRequiredImpl + (workspacesize_t) GGBWS::gcmEncryptWorkspaceRequired;
             // True if workspace sufficient for gcmEncrypt().
             static constexpr bool isWorkspaceSufficientEnc(uint8_t *const workspace, const workspacesize_t workspaceSize)
                 { return((NULL != workspace) && (workspaceSize >= workspaceRequiredEnc)); }
             // Workspace sufficient for gcmEncryptPadded().
-            static constexpr workspacesize_t workspaceRequiredEncPadded = workspaceRequiredAES + (workspacesize_t) GGBWS::gcmEncryptPaddedWorkspaceRequired;
+            static constexpr workspacesize_t workspaceRequiredEncPadded = workspaceRequiredImpl + (workspacesize_t) GGBWS::gcmEncryptPaddedWorkspaceRequired;
             // True if workspace sufficient for gcmEncryptPadded().
             static constexpr bool isWorkspaceSufficientEncPadded(uint8_t *const workspace, const workspacesize_t workspaceSize)
                 { return((NULL != workspace) && (workspaceSize >= workspaceRequiredEncPadded)); }
             // Workspace sufficient for gcmDecrypt().
-            static constexpr workspacesize_t workspaceRequiredDec = workspaceRequiredAES + (workspacesize_t) GGBWS::gcmDecryptWorkspaceRequired;
+            static constexpr workspacesize_t workspaceRequiredDec = workspaceRequiredImpl + (workspacesize_t) GGBWS::gcmDecryptWorkspaceRequired;
             // True if workspace sufficient for gcmDecrypt().
             static constexpr bool isWorkspaceSufficientDec(uint8_t *const workspace, const workspacesize_t workspaceSize)
                 { return((NULL != workspace) && (workspaceSize >= workspaceRequiredDec)); }
@@ -0,0 +1,313 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Deniz Erbilgin 2015--2017
+                           Damon Hart-Davis 2015--2017
+*/
+
+/* Header-only devirtualised AES(128)-GCM engine, and OTAES128GCM adapter. */
+
+#ifndef ARDUINO_LIB_OTAESGCM_OTAESGCMINLINE_H
+#define ARDUINO_LIB_OTAESGCM_OTAESGCMINLINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "OTAESGCM_OTAESGCM.h"
+
+// Use namespaces to help avoid collisions.
+namespace OTAESGCM
+    {
+
+    namespace GGBWS
+    {
+        /**
+         * @struct  Bulk of OTAES128GCMInline workspace, beyond the AES and GHASH space.
+         * @note    80 = 5 * 16 bytes.
+         */
+        struct GCMInlineWorkspace final
+        {
+            // Hash subkey H; the GHASH implementation may retain a pointer to it.
+            uint8_t authKey[AES128GCM_BLOCK_SIZE];
+            uint8_t ICB[AES128GCM_BLOCK_SIZE];
+            uint8_t S[AES128GCM_BLOCK_SIZE];
+            uint8_t ctrBlock[AES128GCM_BLOCK_SIZE];
+            // Partial block key stream, lengths block, and calculated tag.
+            uint8_t tmp[AES128GCM_BLOCK_SIZE];
+        };
+    }
+
+    // Header-only GCM engine over concrete AES and GHASH implementation types,
+    // for small frames where per-call overhead matters.
+    // The implementations are held by value and always called through their
+    // concrete types, so the calls are bound statically and can be inlined,
+    // as can this whole encrypt/decrypt path into the caller.
+    // Any stitched kernel for the pair (see OTAES128GCMStitch) is used.
+    // Workspace is laid out as the AES space, then the GHASH space,
+    // then GGBWS::GCMInlineWorkspace; all is wiped after each call.
+    // Semantics are as for OTAES128GCMGenericBase::gcmEncryptLarge()/gcmDecryptLarge().
+    // Use OTAES128GCMInlineAdapter where an OTAES128GCM is wanted.
+    // Neither re-entrant nor ISR-safe except where stated.
+    template<class OTAESImpl = OTAESGCM::OTAES128E_default_t, class OTGHASHImpl = OTAESGCM::OTGHASH128_default_t>
+    class OTAES128GCMInline final
+        {
+        public:
+            // Suitable type to hold size of workspace required.
+            typedef size_t workspacesize_t;
+
+            constexpr static workspacesize_t workspaceRequiredAES = OTAESImpl::workspaceRequired;
+            constexpr static workspacesize_t workspaceRequiredGHASH = OTGHASHImpl::workspaceRequired;
+            constexpr static workspacesize_t workspaceRequiredImpl = workspaceRequiredAES + workspaceRequiredGHASH;
+            // Workspace required.
+            constexpr static workspacesize_t workspaceRequired =
+                workspaceRequiredImpl + sizeof(GGBWS::GCMInlineWorkspace);
+
+        private:
+            // Blocks of counter laid out in the output and ciphered per AES call;
+            // each chunk is hashed while still in cache.
+            static constexpr uint8_t ChunkBlocks = 16;
+
+            OTAESImpl aes;
+            OTGHASHImpl gh;
+            // GCM part of the workspace, else NULL if insufficient workspace.
+            GGBWS::GCMInlineWorkspace *const ws;
+
+            // Increment the rightmost 32 bits of the block, big-endian.
+            static void incr32(uint8_t *block)
+                { for(uint8_t i = AES128GCM_BLOCK_SIZE - 1; (i >= 12) && (0 == ++block[i]); --i) { } }
+
+            // Hash data (zero-padded to a block multiple) into S.
+            void hash(const uint8_t *data, const size_t length)
+                {
+                const size_t n = length / AES128GCM_BLOCK_SIZE;
+                gh.OTGHASHImpl::update(ws->S, data, n);
+                const uint8_t last = uint8_t(length & (AES128GCM_BLOCK_SIZE-1));
+                if(0 == last) { return; }
+                data += n * AES128GCM_BLOCK_SIZE;
+                for(uint8_t i = 0; i < last; ++i) { ws->S[i] ^= data[i]; }
+                gh.OTGHASHImpl::multiplyH(ws->S);
+                }
+
+            // Write a length in bytes as a 64-bit big-endian length in bits, into zeroed space.
+            static void putBitLength64(uint8_t *out, size_t length)
+                {
+                out[7] = uint8_t(length << 3);
+                length >>= 5;
+                for(int8_t i = 6; (i >= 0) && (0 != length); --i, length >>= 8) { out[i] = uint8_t(length); }
+                }
+
+            // Encrypt or decrypt whole blocks and hash the cipher text in one pass.
+            void cryptAndHashBlocks(const uint8_t *in, size_t nBlocks, uint8_t *out, const bool decrypt)
+                {
+                if(OTAES128GCMStitch<OTAESImpl, OTGHASHImpl>::run(aes, gh, ws->ctrBlock, in, out, nBlocks, ws->S, decrypt)) { return; }
+                while(nBlocks > 0)
+                    {
+                    const uint8_t k = (nBlocks < ChunkBlocks) ? uint8_t(nBlocks) : ChunkBlocks;
+                    if(decrypt) { gh.OTGHASHImpl::update(ws->S, in, k); }
+                    for(uint8_t i = 0; i < k; ++i)
+                        { memcpy(out + i*AES128GCM_BLOCK_SIZE, ws->ctrBlock, AES128GCM_BLOCK_SIZE); incr32(ws->ctrBlock); }
+                    aes.OTAESImpl::encryptBlocks(out, out, k);
+                    for(uint16_t i = 0; i < k * (uint16_t)AES128GCM_BLOCK_SIZE; ++i) { out[i] ^= in[i]; }
+                    if(!decrypt) { gh.OTGHASHImpl::update(ws->S, out, k); }
+                    in += k * AES128GCM_BLOCK_SIZE;
+                    out += k * AES128GCM_BLOCK_SIZE;
+                    nBlocks -= k;
+                    }
+                }
+
+            // Common body: leaves the calculated tag in ws->tmp.
+            // Returns false (with nothing done) if the workspace or key is unusable.
+            bool run(const uint8_t *key, const uint8_t *IV,
+                     const uint8_t *in, const size_t length,
+                     const uint8_t *ADATA, const size_t ADATALength,
+                     uint8_t *out, const bool decrypt)
+                {
+                if(NULL == ws) { return(false); }
+                // Expand the key and derive H once for all the blocks below.
+                if(!aes.OTAESImpl::setKey(key)) { return(false); }
+                memset(ws->authKey, 0, AES128GCM_BLOCK_SIZE);
+                aes.OTAESImpl::encryptBlocks(ws->authKey, ws->authKey, 1);
+                if(!gh.OTGHASHImpl::setKey(ws->authKey)) { wipe(); return(false); }
+
+                // J0 = IV || 0^31 || 1; S = GHASH_H(A || 0^v).
+                memcpy(ws->ICB, IV, AES128GCM_IV_SIZE);
+                memset(ws->ICB + AES128GCM_IV_SIZE, 0, AES128GCM_BLOCK_SIZE - AES128GCM_IV_SIZE);
+                ws->ICB[AES128GCM_BLOCK_SIZE - 1] = 0x01;
+                memset(ws->S, 0, AES128GCM_BLOCK_SIZE);
+                hash(ADATA, ADATALength);
+
+                // Text from counter block inc32(J0).
+                memcpy(ws->ctrBlock, ws->ICB, AES128GCM_BLOCK_SIZE);
+                incr32(ws->ctrBlock);
+                const size_t n = length / AES128GCM_BLOCK_SIZE;
+                cryptAndHashBlocks(in, n, out, decrypt);
+                const uint8_t last = uint8_t(length & (AES128GCM_BLOCK_SIZE-1));
+                if(0 != last)
+                    {
+                    const uint8_t *const x = in + n * AES128GCM_BLOCK_SIZE;
+                    uint8_t *const y = out + n * AES128GCM_BLOCK_SIZE;
+                    aes.OTAESImpl::encryptBlocks(ws->ctrBlock, ws->tmp, 1);
+                    for(uint8_t i = 0; i < last; ++i) { y[i] = uint8_t(x[i] ^ ws->tmp[i]); }
+                    hash(decrypt ? x : y, last);
+                    }
+
+                // S ^= [len(A)]64 || [len(C)]64; tag = E(J0) ^ S.
+                memset(ws->tmp, 0, AES128GCM_BLOCK_SIZE);
+                putBitLength64(ws->tmp, ADATALength);
+                putBitLength64(ws->tmp + 8, length);
+                gh.OTGHASHImpl::update(ws->S, ws->tmp, 1);
+                aes.OTAESImpl::encryptBlocks(ws->ICB, ws->tmp, 1);
+                for(uint8_t i = 0; i < AES128GCM_TAG_SIZE; ++i) { ws->tmp[i] ^= ws->S[i]; }
+                return(true);
+                }
+
+            // Erase the expanded key, H, GHASH tables and workspace.
+            void wipe()
+                {
+                gh.OTGHASHImpl::endSession();
+                aes.OTAESImpl::endSession();
+                memset(ws, 0, sizeof(*ws));
+                }
+
+            // Argument checks common to encryption and decryption.
+            static bool argsValid(const uint8_t *key, const uint8_t *IV, const uint8_t *tag,
+                                  const uint8_t *in, const size_t length, const uint8_t *out,
+                                  const uint8_t *ADATA, const size_t ADATALength)
+                {
+                if((NULL == key) || (NULL == IV) || (NULL == tag)) { return(false); }
+                if((0 != length) && ((NULL == in) || (NULL == out))) { return(false); }
+                if((0 != ADATALength) && (NULL == ADATA)) { return(false); }
+                return(((uint64_t)length <= AES128GCM_MAX_TEXT_LENGTH) &&
+                       ((uint64_t)ADATALength <= AES128GCM_MAX_AAD_LENGTH));
+                }
+
+        public:
+            // Construct an instance, supplied with workspace.
+            // Calls will fail if the workspace is NULL or too small.
+            OTAES128GCMInline(uint8_t *const workspace, const workspacesize_t workspaceSize)
+              : aes(workspace, isWorkspaceSufficient(workspace, workspaceSize) ? workspaceRequiredAES : 0),
+                gh((NULL == workspace) ? NULL : workspace + workspaceRequiredAES,
+                   isWorkspaceSufficient(workspace, workspaceSize) ? workspaceRequiredGHASH : 0),
+                ws(isWorkspaceSufficient(workspace, workspaceSize) ?
+                   (GGBWS::GCMInlineWorkspace *)(workspace + workspaceRequiredImpl) : NULL)
+                { }
+            // Verify that the workspace is adequate.
+            static constexpr bool isWorkspaceSufficient(uint8_t *const workspace, const workspacesize_t workspaceSize)
+                { return((NULL != workspace) && (workspaceSize >= workspaceRequired)); }
+
+            // Encrypt; true iff successful.
+            // As OTAES128GCMGenericBase::gcmEncryptLarge().
+            bool encrypt(const uint8_t* key, const uint8_t* IV,
+                         const uint8_t* PDATA, const size_t PDATALength,
+                         const uint8_t* ADATA, const size_t ADATALength,
+                         uint8_t* CDATA, uint8_t *tag)
+                {
+                if(!argsValid(key, IV, tag, PDATA, PDATALength, CDATA, ADATA, ADATALength)) { return(false); }
+                if(!run(key, IV, PDATA, PDATALength, ADATA, ADATALength, CDATA, false)) { return(false); }
+                memcpy(tag, ws->tmp, AES128GCM_TAG_SIZE);
+                wipe();
+                return(true);
+                }
+
+            // Decrypt and authenticate; true iff successful.
+            // As OTAES128GCMGenericBase::gcmDecryptLarge().
+            bool decrypt(const uint8_t* key, const uint8_t* IV,
+                         const uint8_t* CDATA, const size_t CDATALength,
+                         const uint8_t* ADATA, const size_t ADATALength,
+                         const uint8_t* messageTag, uint8_t *PDATA)
+                {
+                if(!argsValid(key, IV, messageTag, CDATA, CDATALength, PDATA, ADATA, ADATALength)) { return(false); }
+                if(!run(key, IV, CDATA, CDATALength, ADATA, ADATALength, PDATA, true)) { return(false); }
+                // Compare in time independent of where any mismatch is.
+                uint8_t diff = 0;
+                for(uint8_t i = 0; i < AES128GCM_TAG_SIZE; ++i) { diff |= uint8_t(ws->tmp[i] ^ messageTag[i]); }
+                wipe();
+                return(0 == diff);
+                }
+        };
+
+    // Thin OTAES128GCM facade over OTAES128GCMInline,
+    // for use where the virtual interface is wanted;
+    // each virtual call costs one indirect call into the inlined engine.
+    // Neither re-entrant nor ISR-safe except where stated.
+    template<class OTAESImpl = OTAESGCM::OTAES128E_default_t, class OTGHASHImpl = OTAESGCM::OTGHASH128_default_t>
+    class OTAES128GCMInlineAdapter final : public OTAES128GCM
+        {
+        private:
+            typedef OTAES128GCMInline<OTAESImpl, OTGHASHImpl> core_t;
+            core_t core;
+
+        public:
+            // Suitable type to hold size of workspace required.
+            typedef typename core_t::workspacesize_t workspacesize_t;
+            // Workspace required.
+            constexpr static workspacesize_t workspaceRequired = core_t::workspaceRequired;
+
+            // Construct an instance, supplied with workspace.
+            OTAES128GCMInlineAdapter(uint8_t *const workspace, const workspacesize_t workspaceSize)
+              : core(workspace, workspaceSize) { }
+
+#if defined(OTAESGCM_ALLOW_UNPADDED)
+            // Unpadded text, as gcmEncryptLarge().
+            virtual bool gcmEncrypt(
+                const uint8_t* key, const uint8_t* IV,
+                const uint8_t* PDATA, uint8_t PDATALength,
+                const uint8_t* ADATA, uint8_t ADATALength,
+                uint8_t* CDATA, uint8_t *tag) override
+                { return(core.encrypt(key, IV, PDATA, PDATALength, ADATA, ADATALength, CDATA, tag)); }
+#endif
+            // Plain text must be a block-size multiple, and not all lengths zero.
+            virtual bool gcmEncryptPadded(
+                const uint8_t* key, const uint8_t* IV,
+                const uint8_t* PDATAPadded, uint8_t PDATALength,
+                const uint8_t* ADATA, uint8_t ADATALength,
+                uint8_t* CDATA, uint8_t *tag) override
+                {
+                if(NULL == CDATA) { return(false); }
+                if(0 != (PDATALength & (AES128GCM_BLOCK_SIZE-1))) { return(false); }
+                if((PDATALength == 0) && (ADATALength == 0)) { return(false); }
+                return(core.encrypt(key, IV, PDATAPadded, PDATALength, ADATA, ADATALength, CDATA, tag));
+                }
+            // Cipher text must be a block-size multiple, and not all lengths zero.
+            virtual bool gcmDecrypt(
+                 const uint8_t* key, const uint8_t* IV,
+                 const uint8_t* CDATA, uint8_t CDATALength,
+                 const uint8_t* ADATA, uint8_t ADATALength,
+                 const uint8_t* messageTag, uint8_t *PDATA) override
+                {
+                if((CDATALength == 0) && (ADATALength == 0)) { return(false); }
+                if(0 != (CDATALength & (AES128GCM_BLOCK_SIZE-1))) { return(false); }
+                return(core.decrypt(key, IV, CDATA, CDATALength, ADATA, ADATALength, messageTag, PDATA));
+                }
+            // Large-message entry points, as OTAES128GCMGenericBase (not virtual).
+            bool gcmEncryptLarge(
+                const uint8_t* key, const uint8_t* IV,
+                const uint8_t* PDATA, size_t PDATALength,
+                const uint8_t* ADATA, size_t ADATALength,
+                uint8_t* CDATA, uint8_t *tag)
+                { return(core.encrypt(key, IV, PDATA, PDATALength, ADATA, ADATALength, CDATA, tag)); }
+            bool gcmDecryptLarge(
+                 const uint8_t* key, const uint8_t* IV,
+                 const uint8_t* CDATA, size_t CDATALength,
+                 const uint8_t* ADATA, size_t ADATALength,
+                 const uint8_t* messageTag, uint8_t *PDATA)
+                { return(core.decrypt(key, IV, CDATA, CDATALength, ADATA, ADATALength, messageTag, PDATA)); }
+        };
+
+
+    }
+
+#endif
@@ -0,0 +1,93 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Deniz Erbilgin 2015--2017
+                           Damon Hart-Davis 2015--2017
+*/
+
+/* OpenTRV OTAESGCM microcontroller-/IoT- friendly AES(128)-GCM implementation. */
+
+#ifndef ARDUINO_LIB_OTAESGCM_OTGHASH128_H
+#define ARDUINO_LIB_OTAESGCM_OTGHASH128_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+// Use namespaces to help avoid collisions.
+namespace OTAESGCM
+    {
+
+
+    // Base class / interface for the GCM GHASH function,
+    // ie repeated multiplication by the hash subkey H in GF(2^128).
+    // Implementations can be optimised for different characteristics such as speed or size or CPU,
+    // eg by precomputing per-key tables in the workspace passed in.
+    // Neither re-entrant nor ISR-safe except where stated.
+    class OTGHASH128
+        {
+        protected:
+            // Only derived classes can construct an instance.
+            constexpr OTGHASH128() { }
+
+        public:
+            /**
+             *    @brief    start a keyed session for hash subkey H, eg precompute tables
+             *    @param    H takes a pointer to the 16-byte hash subkey; never NULL.
+             *              Implementations may retain the pointer rather than copy,
+             *              so H must remain valid and unchanged until endSession().
+             *    @retval   true if the session was started, false on error (eg no workspace)
+             */
+            virtual bool setKey(const uint8_t *H) = 0;
+            /**
+             *    @brief    multiply in place by H: Y = Y . H
+             *    @param    Y takes a pointer to a 16-byte block; never NULL
+             */
+            virtual void multiplyH(uint8_t *Y) = 0;
+            /**
+             *    @brief    fold whole blocks into the hash: Y = (Y ^ X_i) . H for each X_i
+             *    @param    Y takes a pointer to the 16-byte hash accumulator; never NULL
+             *    @param    X takes a pointer to 16*nBlocks bytes of input; never NULL unless nBlocks is 0
+             *    @param    nBlocks number of 16-byte blocks, can be zero
+             *
+             * Implementations may override to process several blocks at once.
+             */
+            virtual void update(uint8_t *Y, const uint8_t *X, size_t nBlocks)
+                {
+                for( ; nBlocks > 0; --nBlocks)
+                    {
+                    for(uint8_t i = 0; i < 16; ++i) { Y[i] ^= *X++; }
+                    multiplyH(Y);
+                    }
+                }
+            /**
+             *    @brief    end the keyed session and clear sensitive (eg table) state
+             *
+             * Safe to call when no session is active.
+             */
+            virtual void endSession() = 0;
+
+#if 0 // Defining the virtual destructor uses ~800+ bytes of Flash by forcing use of malloc()/free().
+            virtual ~OTGHASH128() { }
+#else
+#define OTGHASH128_NO_VIRT_DEST // Beware, no virtual destructor so be careful of use via base pointers.
+#endif
+        };
+
+
+    }
+
+
+#endif
@@ -0,0 +1,345 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Deniz Erbilgin 2015--2017
+                           Damon Hart-Davis 2015--2017
+*/
+
+/* x86 PCLMULQDQ GHASH implementation. */
+
+#include "OTAESGCM_CPUFeatures.h"
+
+#if defined(OTAESGCM_X86_INTRINSICS)
+
+#include <stdint.h>
+#include <string.h>
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#include <wmmintrin.h>
+
+#include "OTAESGCM_OTGHASH128.h"
+#include "OTAESGCM_OTGHASH128CLMUL.h"
+
+// Compile individual functions for PCLMULQDQ without needing -mpclmul globally.
+#define OTAESGCM_TARGET_CLMUL __attribute__((target("pclmul,ssse3,sse2")))
+// The stitched kernel also needs AES-NI.
+#define OTAESGCM_TARGET_STITCH __attribute__((target("aes,pclmul,ssse3,sse2")))
+
+
+// Use namespaces to help avoid collisions.
+namespace OTAESGCM
+    {
+
+
+/*
+
+GHASH using carry-less multiplication,
+after the Intel white paper "Intel Carry-Less Multiplication Instruction
+and its Usage for Computing the GCM Mode" (Gueron & Kounavis, rev 2.02, 2014).
+
+Blocks are byte-reversed on load so that the bit-reflected GCM field
+elements become ordinary polynomials shifted right by one bit;
+the 256-bit product is shifted left one bit to compensate,
+then reduced modulo x^128 + x^7 + x^2 + x + 1.
+
+Both the shift and the reduction are linear, so the products
+X_1.H^n ^ X_2.H^(n-1) ^ ... ^ X_n.H can be summed unreduced
+and then shifted and reduced once (the "aggregated reduction" method).
+
+*/
+
+// Byte-reverse a 128-bit value.
+OTAESGCM_TARGET_CLMUL
+static inline __m128i bswap128(const __m128i v)
+{
+    const __m128i mask = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    return(_mm_shuffle_epi8(v, mask));
+}
+
+/**
+ * @brief   256-bit carry-less product a.b, accumulated into lo (low half) and hi
+ */
+OTAESGCM_TARGET_CLMUL
+static inline void clmulAccumulate(const __m128i a, const __m128i b, __m128i &lo, __m128i &hi)
+{
+    const __m128i t0 = _mm_clmulepi64_si128(a, b, 0x00);
+    const __m128i t1 = _mm_xor_si128(_mm_clmulepi64_si128(a, b, 0x10), _mm_clmulepi64_si128(a, b, 0x01));
+    const __m128i t3 = _mm_clmulepi64_si128(a, b, 0x11);
+    lo = _mm_xor_si128(lo, _mm_xor_si128(t0, _mm_slli_si128(t1, 8)));
+    hi = _mm_xor_si128(hi, _mm_xor_si128(t3, _mm_srli_si128(t1, 8)));
+}
+
+/**
+ * @brief   shift the 256-bit product [hi:lo] left by one and reduce it to 128 bits
+ */
+OTAESGCM_TARGET_CLMUL
+static inline __m128i shiftReduce(__m128i lo, __m128i hi)
+{
+    // Shift [hi:lo] left by one bit, carrying across 32-bit lanes and halves.
+    __m128i c0 = _mm_srli_epi32(lo, 31);
+    __m128i c1 = _mm_srli_epi32(hi, 31);
+    lo = _mm_slli_epi32(lo, 1);
+    hi = _mm_slli_epi32(hi, 1);
+    const __m128i cross = _mm_srli_si128(c0, 12);
+    c1 = _mm_slli_si128(c1, 4);
+    c0 = _mm_slli_si128(c0, 4);
+    lo = _mm_or_si128(lo, c0);
+    hi = _mm_or_si128(_mm_or_si128(hi, c1), cross);
+
+    // First phase of reduction.
+    __m128i a = _mm_xor_si128(_mm_xor_si128(_mm_slli_epi32(lo, 31), _mm_slli_epi32(lo, 30)), _mm_slli_epi32(lo, 25));
+    const __m128i b = _mm_srli_si128(a, 4);
+    a = _mm_slli_si128(a, 12);
+    lo = _mm_xor_si128(lo, a);
+
+    // Second phase of reduction.
+    __m128i d = _mm_xor_si128(_mm_xor_si128(_mm_srli_epi32(lo, 1), _mm_srli_epi32(lo, 2)), _mm_srli_epi32(lo, 7));
+    d = _mm_xor_si128(d, b);
+    lo = _mm_xor_si128(lo, d);
+    return(_mm_xor_si128(hi, lo));
+}
+
+/**
+ * @brief   field product of two byte-reversed elements
+ */
+OTAESGCM_TARGET_CLMUL
+static inline __m128i gfmul(const __m128i a, const __m128i b)
+{
+    __m128i lo = _mm_setzero_si128();
+    __m128i hi = _mm_setzero_si128();
+    clmulAccumulate(a, b, lo, hi);
+    return(shiftReduce(lo, hi));
+}
+
+/**
+ * @brief   compute and store H^1 .. H^8, byte-reversed
+ */
+OTAESGCM_TARGET_CLMUL
+bool OTGHASH128_CLMUL::setKey(const uint8_t *H)
+{
+    if((NULL == hp) || (NULL == H)) { return(false); }
+    __m128i *const out = (__m128i *)hp;
+    const __m128i h = bswap128(_mm_loadu_si128((const __m128i *)H));
+    __m128i p = h;
+    _mm_storeu_si128(out, p);
+    for(uint8_t i = 1; i < Powers; ++i)
+        {
+        p = gfmul(p, h);
+        _mm_storeu_si128(out + i, p);
+        }
+    keyed = true;
+    return(true);
+}
+
+/**
+ * @brief   Y = Y . H
+ */
+OTAESGCM_TARGET_CLMUL
+void OTGHASH128_CLMUL::multiplyH(uint8_t *Y)
+{
+    if(!keyed) { return; }
+    const __m128i h = _mm_loadu_si128((const __m128i *)hp);
+    const __m128i y = bswap128(_mm_loadu_si128((const __m128i *)Y));
+    _mm_storeu_si128((__m128i *)Y, bswap128(gfmul(y, h)));
+}
+
+/**
+ * @brief   fold nBlocks of X into Y, reducing once per group of up to 8 blocks
+ */
+OTAESGCM_TARGET_CLMUL
+void OTGHASH128_CLMUL::update(uint8_t *Y, const uint8_t *X, size_t nBlocks)
+{
+    if(!keyed) { return; }
+    const __m128i *const hpow = (const __m128i *)hp;
+    const __m128i *in = (const __m128i *)X;
+    __m128i y = bswap128(_mm_loadu_si128((const __m128i *)Y));
+
+    // Groups of 8 then 4: the running hash is folded into the first block,
+    // which is multiplied by the highest power.
+    for(uint8_t group = Powers; group >= 4; group >>= 1)
+        {
+        while(nBlocks >= group)
+            {
+            __m128i lo = _mm_setzero_si128();
+            __m128i hi = _mm_setzero_si128();
+            const __m128i x0 = _mm_xor_si128(y, bswap128(_mm_loadu_si128(in)));
+            clmulAccumulate(x0, _mm_loadu_si128(hpow + group - 1), lo, hi);
+            for(uint8_t i = 1; i < group; ++i)
+                { clmulAccumulate(bswap128(_mm_loadu_si128(in + i)), _mm_loadu_si128(hpow + group - 1 - i), lo, hi); }
+            y = shiftReduce(lo, hi);
+            in += group;
+            nBlocks -= group;
+            }
+        }
+
+    // Remaining blocks one at a time.
+    if(nBlocks > 0)
+        {
+        const __m128i h = _mm_loadu_si128(hpow);
+        for( ; nBlocks > 0; --nBlocks)
+            { y = gfmul(_mm_xor_si128(y, bswap128(_mm_loadu_si128(in++))), h); }
+        }
+
+    _mm_storeu_si128((__m128i *)Y, bswap128(y));
+}
+
+
+/*
+
+Stitched AES-CTR + GHASH, after the Intel white paper
+"Fast Cryptographic Computation on Intel Architecture Processors
+Via Function Stitching" (Gopal et al, 2010):
+each group of 4 counter blocks is pushed through the AES rounds
+while the 4 GHASH multiplications for a group of ciphertext
+are issued between them, so that the two independent
+instruction streams hide each other's latency.
+
+When decrypting the ciphertext is the input and so is hashed
+as the same group is decrypted.
+When encrypting the ciphertext only exists after the AES rounds,
+so each group is hashed while the following group is encrypted.
+
+*/
+
+// Blocks per stitched group.
+static constexpr uint8_t STITCH_BLOCKS = 4;
+
+// One AES round on each of the 4 blocks.
+#define OTAESGCM_AESENC4(k) \
+    b0 = _mm_aesenc_si128(b0, k); b1 = _mm_aesenc_si128(b1, k); \
+    b2 = _mm_aesenc_si128(b2, k); b3 = _mm_aesenc_si128(b3, k)
+
+OTAESGCM_TARGET_STITCH
+void gcmCTRGHASH_AESNI_CLMUL(const uint8_t *rkIn, const uint8_t *hpIn,
+                             uint8_t *ctrBlock, const uint8_t *in, uint8_t *out, size_t nBlocks,
+                             uint8_t *Y, const bool decrypt)
+{
+    __m128i rk[11];
+    for(uint8_t i = 0; i < 11; ++i) { rk[i] = _mm_loadu_si128((const __m128i *)rkIn + i); }
+    const __m128i *const hpow = (const __m128i *)hpIn;
+    const __m128i h1 = _mm_loadu_si128(hpow);
+    const __m128i h2 = _mm_loadu_si128(hpow + 1);
+    const __m128i h3 = _mm_loadu_si128(hpow + 2);
+    const __m128i h4 = _mm_loadu_si128(hpow + 3);
+    // Counter held byte-reversed so that inc32 is a 32-bit lane add.
+    const __m128i one = _mm_set_epi32(0, 0, 0, 1);
+    __m128i ctr = bswap128(_mm_loadu_si128((const __m128i *)ctrBlock));
+    __m128i y = bswap128(_mm_loadu_si128((const __m128i *)Y));
+    const __m128i *src = (const __m128i *)in;
+    __m128i *dst = (__m128i *)out;
+
+    // Byte-reversed ciphertext awaiting hashing (encryption only).
+    __m128i g0 = _mm_setzero_si128(), g1 = g0, g2 = g0, g3 = g0;
+    bool pending = false;
+
+    while(nBlocks >= STITCH_BLOCKS)
+        {
+        __m128i b0 = _mm_xor_si128(bswap128(ctr), rk[0]); ctr = _mm_add_epi32(ctr, one);
+        __m128i b1 = _mm_xor_si128(bswap128(ctr), rk[0]); ctr = _mm_add_epi32(ctr, one);
+        __m128i b2 = _mm_xor_si128(bswap128(ctr), rk[0]); ctr = _mm_add_epi32(ctr, one);
+        __m128i b3 = _mm_xor_si128(bswap128(ctr), rk[0]); ctr = _mm_add_epi32(ctr, one);
+        const __m128i x0 = _mm_loadu_si128(src);
+        const __m128i x1 = _mm_loadu_si128(src + 1);
+        const __m128i x2 = _mm_loadu_si128(src + 2);
+        const __m128i x3 = _mm_loadu_si128(src + 3);
+        if(decrypt)
+            {
+            g0 = bswap128(x0); g1 = bswap128(x1); g2 = bswap128(x2); g3 = bswap128(x3);
+            pending = true;
+            }
+        if(pending)
+            {
+            // Hash one block between each of the early AES rounds.
+            __m128i lo = _mm_setzero_si128();
+            __m128i hi = _mm_setzero_si128();
+            OTAESGCM_AESENC4(rk[1]);
+            clmulAccumulate(_mm_xor_si128(g0, y), h4, lo, hi);
+            OTAESGCM_AESENC4(rk[2]);
+            clmulAccumulate(g1, h3, lo, hi);
+            OTAESGCM_AESENC4(rk[3]);
+            clmulAccumulate(g2, h2, lo, hi);
+            OTAESGCM_AESENC4(rk[4]);
+            clmulAccumulate(g3, h1, lo, hi);
+            OTAESGCM_AESENC4(rk[5]);
+            y = shiftReduce(lo, hi);
+            }
+        else
+            {
+            OTAESGCM_AESENC4(rk[1]);
+            OTAESGCM_AESENC4(rk[2]);
+            OTAESGCM_AESENC4(rk[3]);
+            OTAESGCM_AESENC4(rk[4]);
+            OTAESGCM_AESENC4(rk[5]);
+            }
+        OTAESGCM_AESENC4(rk[6]);
+        OTAESGCM_AESENC4(rk[7]);
+        OTAESGCM_AESENC4(rk[8]);
+        OTAESGCM_AESENC4(rk[9]);
+        b0 = _mm_xor_si128(_mm_aesenclast_si128(b0, rk[10]), x0);
+        b1 = _mm_xor_si128(_mm_aesenclast_si128(b1, rk[10]), x1);
+        b2 = _mm_xor_si128(_mm_aesenclast_si128(b2, rk[10]), x2);
+        b3 = _mm_xor_si128(_mm_aesenclast_si128(b3, rk[10]), x3);
+        _mm_storeu_si128(dst, b0);
+        _mm_storeu_si128(dst + 1, b1);
+        _mm_storeu_si128(dst + 2, b2);
+        _mm_storeu_si128(dst + 3, b3);
+        if(!decrypt)
+            {
+            g0 = bswap128(b0); g1 = bswap128(b1); g2 = bswap128(b2); g3 = bswap128(b3);
+            pending = true;
+            }
+        src += STITCH_BLOCKS;
+        dst += STITCH_BLOCKS;
+        nBlocks -= STITCH_BLOCKS;
+        }
+
+    // Hash the last encrypted group.
+    if(pending && !decrypt)
+        {
+        __m128i lo = _mm_setzero_si128();
+        __m128i hi = _mm_setzero_si128();
+        clmulAccumulate(_mm_xor_si128(g0, y), h4, lo, hi);
+        clmulAccumulate(g1, h3, lo, hi);
+        clmulAccumulate(g2, h2, lo, hi);
+        clmulAccumulate(g3, h1, lo, hi);
+        y = shiftReduce(lo, hi);
+        }
+
+    // Remaining blocks one at a time.
+    for( ; nBlocks > 0; --nBlocks)
+        {
+        __m128i b = _mm_xor_si128(bswap128(ctr), rk[0]);
+        ctr = _mm_add_epi32(ctr, one);
+        for(uint8_t r = 1; r < 10; ++r) { b = _mm_aesenc_si128(b, rk[r]); }
+        const __m128i x = _mm_loadu_si128(src++);
+        b = _mm_xor_si128(_mm_aesenclast_si128(b, rk[10]), x);
+        _mm_storeu_si128(dst++, b);
+        y = gfmul(_mm_xor_si128(y, bswap128(decrypt ? x : b)), h1);
+        }
+
+    _mm_storeu_si128((__m128i *)ctrBlock, bswap128(ctr));
+    _mm_storeu_si128((__m128i *)Y, bswap128(y));
+    // Don't leave round keys on the stack;
+    // volatile so that the stores to this dead local are not elided.
+    volatile uint8_t *const rkBytes = (volatile uint8_t *)rk;
+    for(uint8_t i = 0; i < sizeof(rk); ++i) { rkBytes[i] = 0; }
+}
+
+#undef OTAESGCM_AESENC4
+
+
+    }
+
+#endif // defined(OTAESGCM_X86_INTRINSICS)
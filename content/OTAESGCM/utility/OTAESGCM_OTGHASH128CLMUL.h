@@ -0,0 +1,143 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Deniz Erbilgin 2015--2017
+                           Damon Hart-Davis 2015--2017
+*/
+
+/* x86 PCLMULQDQ GHASH implementation, and run-time dispatch to it. */
+
+#ifndef ARDUINO_LIB_OTAESGCM_OTGHASH128CLMUL_H
+#define ARDUINO_LIB_OTAESGCM_OTGHASH128CLMUL_H
+
+#include <stdint.h>
+#include <string.h>
+#include "OTAESGCM_OTGHASH128.h"
+#include "OTAESGCM_CPUFeatures.h"
+#include "OTAESGCM_OTGHASH128Portable.h"
+
+#if defined(OTAESGCM_X86_INTRINSICS)
+
+// Use namespaces to help avoid collisions.
+namespace OTAESGCM
+    {
+
+
+    // PCLMULQDQ carry-less multiply GHASH.
+    // Precomputes H^1 .. H^8 per key and, in update(), multiplies
+    // groups of 8 (then 4) blocks by descending powers of H,
+    // summing the unreduced products and reducing once per group.
+    // Constant-time.
+    // Must only be used if cpuHasPCLMUL() is true,
+    // else will fault with an illegal instruction;
+    // use OTGHASH128_RuntimeDispatch to select automatically.
+    // Neither re-entrant nor ISR-safe except where stated.
+    class OTGHASH128_CLMUL : public OTGHASH128
+        {
+        public:
+            // Number of powers of H precomputed, and maximum blocks per reduction.
+            static constexpr uint8_t Powers = 8;
+
+        protected:
+            // Powers of H (byte-reflected) within the caller's workspace, H^1 first,
+            // no alignment needed; NULL if insufficient workspace is passed in.
+            uint8_t * const hp;
+            // True while a keyed session is active.
+            bool keyed = false;
+
+        public:
+            // Minimum workspace required, unaligned; strictly positive.
+            // This constant, defined per class, is effectively part of the API.
+            static constexpr size_t workspaceRequired = 16 * (size_t)Powers;
+
+            // Construct an instance: supplied workspace must be large enough.
+            OTGHASH128_CLMUL(uint8_t *const workspace, const size_t workspaceLen)
+              : hp(((NULL == workspace) || (workspaceLen < workspaceRequired)) ? NULL : workspace)
+                { }
+
+            virtual bool setKey(const uint8_t *H) override;
+            virtual void multiplyH(uint8_t *Y) override;
+            virtual void update(uint8_t *Y, const uint8_t *X, size_t nBlocks) override;
+            virtual void endSession() override
+                { if((NULL != hp) && keyed) { memset(hp, 0, workspaceRequired); } keyed = false; }
+
+            // Powers of H of the active session, else NULL; for stitched GCM kernels.
+            const uint8_t *sessionPowers() const { return(keyed ? hp : NULL); }
+        };
+
+    /**
+     * @brief   stitched AES-NI CTR encryption/decryption and CLMUL GHASH
+     *          over whole blocks, in a single pass with interleaved instruction streams
+     * @param   rk          AES-NI expanded key, from OTAES128E_AESNI::sessionRoundKeys()
+     * @param   hpow        powers of H, from OTGHASH128_CLMUL::sessionPowers()
+     * @param   ctrBlock    16-byte counter block, incremented (inc32) per block and updated
+     * @param   in          nBlocks of input; may be the same as out
+     * @param   out         nBlocks of output
+     * @param   nBlocks     number of 16-byte blocks, can be zero
+     * @param   Y           16-byte GHASH accumulator, updated in place
+     * @param   decrypt     if true the input is hashed (ciphertext), else the output is
+     *
+     * Must only be used if both cpuHasAESNI() and cpuHasPCLMUL() are true.
+     */
+    void gcmCTRGHASH_AESNI_CLMUL(const uint8_t *rk, const uint8_t *hpow,
+                                 uint8_t *ctrBlock, const uint8_t *in, uint8_t *out, size_t nBlocks,
+                                 uint8_t *Y, bool decrypt);
+
+    // Run-time dispatch: uses PCLMULQDQ if the CPU supports it,
+    // else falls back to the portable 8-bit Shoup table implementation.
+    // The CPU check is made once per process (see cpuHasPCLMUL()),
+    // and the choice is fixed at construction.
+    // Both candidates share the one workspace, only one being used.
+    // Neither re-entrant nor ISR-safe except where stated.
+    class OTGHASH128_RuntimeDispatch : public OTGHASH128
+        {
+        private:
+            OTGHASH128_CLMUL hw;
+            OTGHASH128_Shoup8 sw;
+            // Selected implementation; never NULL.
+            OTGHASH128 * const impl;
+
+        public:
+            // Minimum workspace required: enough for either candidate.
+            static constexpr size_t workspaceRequired =
+                (OTGHASH128_CLMUL::workspaceRequired > OTGHASH128_Shoup8::workspaceRequired) ?
+                    OTGHASH128_CLMUL::workspaceRequired : OTGHASH128_Shoup8::workspaceRequired;
+
+            // Construct an instance: supplied workspace must be large enough.
+            // If allowHardware is false then the portable implementation
+            // is always used, eg for testing.
+            OTGHASH128_RuntimeDispatch(uint8_t *const workspace, const size_t workspaceLen, const bool allowHardware = true)
+              : hw(workspace, workspaceLen), sw(workspace, workspaceLen),
+                impl((allowHardware && cpuHasPCLMUL()) ? static_cast<OTGHASH128 *>(&hw) : static_cast<OTGHASH128 *>(&sw))
+                { }
+
+            // True if the hardware implementation was selected.
+            bool isHardware() const { return(impl == &hw); }
+            // CLMUL powers of H of the active session, else NULL.
+            const uint8_t *sessionPowersHW() const { return(isHardware() ? hw.sessionPowers() : NULL); }
+
+            virtual bool setKey(const uint8_t *H) override { return(impl->setKey(H)); }
+            virtual void multiplyH(uint8_t *Y) override { impl->multiplyH(Y); }
+            virtual void update(uint8_t *Y, const uint8_t *X, size_t nBlocks) override
+                { impl->update(Y, X, nBlocks); }
+            virtual void endSession() override { impl->endSession(); }
+        };
+
+
+    }
+
+#endif // defined(OTAESGCM_X86_INTRINSICS)
+
+#endif
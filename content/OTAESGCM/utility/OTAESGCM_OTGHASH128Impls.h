@@ -0,0 +1,55 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Deniz Erbilgin 2015--2017
+                           Damon Hart-Davis 2015--2017
+*/
+
+/* OpenTRV OTAESGCM microcontroller-/IoT- friendly GHASH implementations. */
+
+#ifndef ARDUINO_LIB_OTAESGCM_OTGHASH128IMPLS_H
+#define ARDUINO_LIB_OTAESGCM_OTGHASH128IMPLS_H
+
+// Get available GHASH API.
+#include "OTAESGCM_OTGHASH128.h"
+
+// Implementations.
+#include "OTAESGCM_OTGHASH128Portable.h"
+#if defined(__AVR_ARCH__) || defined(ARDUINO_ARCH_AVR) // Atmel AVR only.
+// Fast, small and default implementations for this architecture.
+namespace OTAESGCM
+    {
+    typedef OTGHASH128_Shoup4 OTGHASH128_fast_t;
+    typedef OTGHASH128_BitSerial OTGHASH128_small_t;
+    typedef OTGHASH128_BitSerial OTGHASH128_default_t;
+    }
+#else
+// PCLMULQDQ impl and run-time dispatch for x86 hosts.
+#include "OTAESGCM_OTGHASH128CLMUL.h"
+// Fast, small and default implementations for this architecture.
+namespace OTAESGCM
+    {
+#if defined(OTAESGCM_X86_INTRINSICS)
+    // PCLMULQDQ where the CPU has it, else 8-bit tables, checked once at run time.
+    typedef OTGHASH128_RuntimeDispatch OTGHASH128_fast_t;
+#else
+    typedef OTGHASH128_Shoup8 OTGHASH128_fast_t;
+#endif
+    typedef OTGHASH128_BitSerial OTGHASH128_small_t;
+    typedef OTGHASH128_BitSerial OTGHASH128_default_t;
+    }
+#endif
+
+#endif
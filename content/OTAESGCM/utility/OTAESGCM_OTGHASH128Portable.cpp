@@ -0,0 +1,287 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Deniz Erbilgin 2015--2017
+                           Damon Hart-Davis 2015--2017
+*/
+
+/* Portable GHASH implementations: bit-serial (small) and Shoup tables (fast). */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "OTAESGCM_OTGHASH128.h"
+#include "OTAESGCM_OTGHASH128Portable.h"
+
+
+// Use namespaces to help avoid collisions.
+namespace OTAESGCM
+    {
+
+/*
+
+GF(2^128) multiplication as defined for GCM in NIST SP 800-38D section 6.3,
+with the bit-reflected convention: the first bit of the block is x^0,
+and multiplication by x is a right shift with the reduction constant
+R = 11100001 || 0^120 folded into the top byte.
+
+The table-driven versions are after V. Shoup,
+"On Fast and Provably Secure Message Authentication Based on Universal Hashing"
+(CRYPTO '96), as described in the GCM specification (McGrew & Viega, section 4.1):
+a per-key table of H multiplied by every 4- or 8-bit value,
+and a per-implementation table folding the bits shifted out of the bottom
+back into the top.
+
+*/
+
+/******************* Bit-serial ********************/
+
+/**
+ * @brief    bitshifts 128bit block (16 byte array) right once
+ * @param    block:    pointer to block to shift
+ */
+static void shiftBlockRight(uint8_t *block)
+{
+    block += 15;
+
+    // bitshift LSB (last byte in array)
+    *block = *block >> 1;
+    block--;
+
+    // loop through remaining bytes
+    for (uint8_t i = 0; i < 15; i++) {
+        // if lsb is set, set msb of next byte in array
+        if(*block & 0x01) *(block + 1) |= 0x80;
+        // bit shift byte
+        *block = *block >> 1;
+        block--;
+    }
+}
+
+/**
+ * @brief    xor on 128bit block.
+ */
+static void xorBlock(uint8_t *dest, const uint8_t *src)
+{
+    for(uint8_t i = 0; i < 16; i++){
+        *dest++ ^= *src++;
+    }
+}
+
+/**
+ * @brief    multiply Y by H bit by bit, using 32 bytes of workspace
+ * @note     was gFieldMultiply() in OTAESGCM_OTAESGCM.cpp
+ */
+void OTGHASH128_BitSerial::multiplyH(uint8_t *Y)
+{
+    if(NULL == H) { return; }
+    uint8_t *const V = tmp;
+    uint8_t *const Z = tmp + 16;
+
+    // init result to 0s and copy H to V
+    memcpy(V, H, 16);
+    memset(Z, 0, 16);
+
+    // multiplication algorithm
+    for (uint8_t i = 0; i < 16; i++) {
+        for (uint8_t j = 0; j < 8; j++) {
+
+            if (Y[i] & (1 << (7 - j))) {
+                /* Z_(i + 1) = Z_i XOR V_i */
+                xorBlock(Z, V);
+            }
+            if (V[15] & 0x01) {
+                /* V_(i + 1) = (V_i >> 1) XOR R */
+                shiftBlockRight(V);
+                /* R = 11100001 || 0^120 */
+                V[0] ^= 0xe1;
+            } else {
+                /* V_(i + 1) = V_i >> 1 */
+                shiftBlockRight(V);
+            }
+        }
+    }
+    memcpy(Y, Z, 16);
+}
+
+/******************* Table helpers ********************/
+
+// Reduction for bit b (0 = last shifted out) of k bits shifted out of the bottom,
+// as a 16-bit value to be xored into the top 16 bits.
+static constexpr uint16_t reduceBit(const int r, const uint8_t b, const uint8_t k)
+    { return((r & (1 << b)) ? uint16_t(0xe1 << (9 - k + b)) : uint16_t(0)); }
+static constexpr uint16_t reduce4(const int r)
+    { return(uint16_t(reduceBit(r, 0, 4) ^ reduceBit(r, 1, 4) ^ reduceBit(r, 2, 4) ^ reduceBit(r, 3, 4))); }
+static constexpr uint16_t reduce8(const int r)
+    { return(uint16_t(reduceBit(r, 0, 8) ^ reduceBit(r, 1, 8) ^ reduceBit(r, 2, 8) ^ reduceBit(r, 3, 8) ^
+                      reduceBit(r, 4, 8) ^ reduceBit(r, 5, 8) ^ reduceBit(r, 6, 8) ^ reduceBit(r, 7, 8))); }
+
+// Expand f(0) .. f(N-1) as an initialiser list.
+#define OTGHASH_T4(f, i) f(i), f((i)+1), f((i)+2), f((i)+3)
+#define OTGHASH_T16(f, i) OTGHASH_T4(f, i), OTGHASH_T4(f, (i)+4), OTGHASH_T4(f, (i)+8), OTGHASH_T4(f, (i)+12)
+#define OTGHASH_T64(f, i) OTGHASH_T16(f, i), OTGHASH_T16(f, (i)+16), OTGHASH_T16(f, (i)+32), OTGHASH_T16(f, (i)+48)
+#define OTGHASH_T256(f) OTGHASH_T64(f, 0), OTGHASH_T64(f, 64), OTGHASH_T64(f, 128), OTGHASH_T64(f, 192)
+
+// Reduction tables, computed at compile time.
+static constexpr uint16_t R4[16] = { OTGHASH_T16(reduce4, 0) };
+#if !defined(__AVR_ARCH__) && !defined(ARDUINO_ARCH_AVR)
+static constexpr uint16_t R8[256] = { OTGHASH_T256(reduce8) };
+#endif
+
+#undef OTGHASH_T256
+#undef OTGHASH_T64
+#undef OTGHASH_T16
+#undef OTGHASH_T4
+
+// Spot checks against published tables (eg mbed TLS last4, OpenSSL rem_8bit).
+static_assert(0x1c20 == R4[1], "bad R4");
+static_assert(0xb5e0 == R4[15], "bad R4");
+#if !defined(__AVR_ARCH__) && !defined(ARDUINO_ARCH_AVR)
+static_assert(0x01c2 == R8[1], "bad R8");
+static_assert(0xbebe == R8[255], "bad R8");
+#endif
+
+// Big-endian 64-bit load/store.
+static inline uint64_t getU64(const uint8_t *p)
+    {
+    uint64_t v = 0;
+    for(uint8_t i = 0; i < 8; ++i) { v = (v << 8) | p[i]; }
+    return(v);
+    }
+static inline void putU64(uint8_t *p, uint64_t v)
+    {
+    for(int8_t i = 7; i >= 0; --i) { p[i] = uint8_t(v); v >>= 8; }
+    }
+
+// Fill the table M of 'entries' (hi, lo) pairs with H times each index value,
+// where the top bit of the index is x^0.
+static void buildShoupTable(uint64_t *M, const uint8_t *H, const uint16_t entries)
+    {
+    uint64_t hi = getU64(H);
+    uint64_t lo = getU64(H + 8);
+    const uint16_t top = uint16_t(entries >> 1);
+    M[0] = 0; M[1] = 0;
+    M[2*top] = hi; M[2*top + 1] = lo;
+    // Successive multiplication by x for the single-bit entries.
+    for(uint16_t i = uint16_t(top >> 1); i > 0; i >>= 1)
+        {
+        const uint64_t carry = lo & 1;
+        lo = (lo >> 1) | (hi << 63);
+        hi = (hi >> 1) ^ (carry ? 0xe100000000000000ULL : 0);
+        M[2*i] = hi; M[2*i + 1] = lo;
+        }
+    // Linearity for the rest.
+    for(uint16_t i = 2; i < entries; i <<= 1)
+        {
+        for(uint16_t j = 1; j < i; ++j)
+            {
+            M[2*(i+j)] = M[2*i] ^ M[2*j];
+            M[2*(i+j) + 1] = M[2*i + 1] ^ M[2*j + 1];
+            }
+        }
+    }
+
+/******************* Shoup 4-bit ********************/
+
+// Y = Y . H with the 4-bit table.
+static void mult4(const uint64_t *M, uint8_t *Y)
+    {
+    uint8_t n = Y[15] & 0xf;
+    uint64_t zh = M[2*n], zl = M[2*n + 1];
+    for(int8_t i = 15; i >= 0; --i)
+        {
+        if(15 != i)
+            {
+            n = Y[i] & 0xf;
+            const uint8_t rem = uint8_t(zl & 0xf);
+            zl = (zh << 60) | (zl >> 4);
+            zh = (zh >> 4) ^ (uint64_t(R4[rem]) << 48);
+            zh ^= M[2*n]; zl ^= M[2*n + 1];
+            }
+        n = Y[i] >> 4;
+        const uint8_t rem = uint8_t(zl & 0xf);
+        zl = (zh << 60) | (zl >> 4);
+        zh = (zh >> 4) ^ (uint64_t(R4[rem]) << 48);
+        zh ^= M[2*n]; zl ^= M[2*n + 1];
+        }
+    putU64(Y, zh);
+    putU64(Y + 8, zl);
+    }
+
+bool OTGHASH128_Shoup4::setKey(const uint8_t *H)
+    {
+    if((NULL == M) || (NULL == H)) { return(false); }
+    buildShoupTable(M, H, 16);
+    T = M;
+    return(true);
+    }
+
+void OTGHASH128_Shoup4::multiplyH(uint8_t *Y)
+    { if(NULL != T) { mult4(T, Y); } }
+
+void OTGHASH128_Shoup4::update(uint8_t *Y, const uint8_t *X, size_t nBlocks)
+    {
+    if(NULL == T) { return; }
+    for( ; nBlocks > 0; --nBlocks)
+        {
+        for(uint8_t i = 0; i < 16; ++i) { Y[i] ^= *X++; }
+        mult4(T, Y);
+        }
+    }
+
+/******************* Shoup 8-bit ********************/
+#if !defined(__AVR_ARCH__) && !defined(ARDUINO_ARCH_AVR)
+
+// Y = Y . H with the 8-bit table.
+static void mult8(const uint64_t *M, uint8_t *Y)
+    {
+    uint8_t n = Y[15];
+    uint64_t zh = M[2*n], zl = M[2*n + 1];
+    for(int8_t i = 14; i >= 0; --i)
+        {
+        n = Y[i];
+        const uint8_t rem = uint8_t(zl);
+        zl = (zh << 56) | (zl >> 8);
+        zh = (zh >> 8) ^ (uint64_t(R8[rem]) << 48);
+        zh ^= M[2*n]; zl ^= M[2*n + 1];
+        }
+    putU64(Y, zh);
+    putU64(Y + 8, zl);
+    }
+
+bool OTGHASH128_Shoup8::setKey(const uint8_t *H)
+    {
+    if((NULL == M) || (NULL == H)) { return(false); }
+    buildShoupTable(M, H, 256);
+    T = M;
+    return(true);
+    }
+
+void OTGHASH128_Shoup8::multiplyH(uint8_t *Y)
+    { if(NULL != T) { mult8(T, Y); } }
+
+void OTGHASH128_Shoup8::update(uint8_t *Y, const uint8_t *X, size_t nBlocks)
+    {
+    if(NULL == T) { return; }
+    for( ; nBlocks > 0; --nBlocks)
+        {
+        for(uint8_t i = 0; i < 16; ++i) { Y[i] ^= *X++; }
+        mult8(T, Y);
+        }
+    }
+#endif
+
+
+    }
@@ -0,0 +1,155 @@
+/*
+The OpenTRV project licenses this file to you
+under the Apache Licence, Version 2.0 (the "Licence");
+you may not use this file except in compliance
+with the Licence. You may obtain a copy of the Licence at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing,
+software distributed under the Licence is distributed on an
+"AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+KIND, either express or implied. See the Licence for the
+specific language governing permissions and limitations
+under the Licence.
+
+Author(s) / Copyright (s): Deniz Erbilgin 2015--2017
+                           Damon Hart-Davis 2015--2017
+*/
+
+/* Portable GHASH implementations: bit-serial (small) and Shoup tables (fast). */
+
+#ifndef ARDUINO_LIB_OTAESGCM_OTGHASH128PORTABLE_H
+#define ARDUINO_LIB_OTAESGCM_OTGHASH128PORTABLE_H
+
+#include <stdint.h>
+#include <string.h>
+#include "OTAESGCM_OTGHASH128.h"
+
+
+// Use namespaces to help avoid collisions.
+namespace OTAESGCM
+    {
+
+
+    // Bit-serial GHASH: no per-key tables, 128 shift/conditional-xor steps per block.
+    // Smallest code and workspace, so the default for small MCUs.
+    // Retains a pointer to H (does not copy it).
+    // Neither re-entrant nor ISR-safe except where stated.
+    class OTGHASH128_BitSerial : public OTGHASH128
+        {
+        protected:
+            // Scratch: V (shifted copy of H) then Z (result accumulator).
+            uint8_t * const tmp;
+            // Hash subkey; NULL when no session is active.
+            const uint8_t *H = NULL;
+
+        public:
+            // Minimum workspace required, unaligned; strictly positive.
+            // This constant, defined per class, is effectively part of the API.
+            static constexpr size_t workspaceRequired = 32;
+
+            // Construct an instance: supplied workspace must be large enough.
+            OTGHASH128_BitSerial(uint8_t *const workspace, const size_t workspaceLen)
+              : tmp(((NULL == workspace) || (workspaceLen < workspaceRequired)) ? NULL : workspace)
+                { }
+
+            virtual bool setKey(const uint8_t *Hin) override
+                { if((NULL == tmp) || (NULL == Hin)) { return(false); } H = Hin; return(true); }
+            virtual void multiplyH(uint8_t *Y) override;
+            virtual void endSession() override
+                { if(NULL != tmp) { memset(tmp, 0, workspaceRequired); } H = NULL; }
+        };
+
+    // Shoup's 4-bit table GHASH: 16-entry table of multiples of H per key
+    // (256 bytes) plus a shared 16-entry reduction table in ROM.
+    // Two table lookups per byte of input.
+    // Note that the table lookups are secret-indexed and so not constant-time
+    // on CPUs with data caches.
+    // Neither re-entrant nor ISR-safe except where stated.
+    class OTGHASH128_Shoup4 : public OTGHASH128
+        {
+        protected:
+            // Table size in 64-bit words: 16 entries of (high, low) halves.
+            static constexpr uint8_t TableWords = 32;
+            // Aligned table within the caller's workspace; NULL if insufficient workspace.
+            uint64_t * const M;
+            // Table of the active session: M once built by setKey(), or one precomputed
+            // (see setTable()); NULL when no session is active.
+            const uint64_t *T = NULL;
+
+        public:
+            // Minimum workspace required, unaligned, including alignment slack.
+            // This constant, defined per class, is effectively part of the API.
+            static constexpr size_t workspaceRequired = TableWords * sizeof(uint64_t) + (sizeof(uint64_t)-1);
+
+            // Construct an instance: supplied workspace must be large enough.
+            OTGHASH128_Shoup4(uint8_t *const workspace, const size_t workspaceLen)
+              : M(((NULL == workspace) || (workspaceLen < workspaceRequired)) ? NULL :
+                    (uint64_t *)(((uintptr_t)workspace + (sizeof(uint64_t)-1)) & ~(uintptr_t)(sizeof(uint64_t)-1)))
+                { }
+
+            virtual bool setKey(const uint8_t *H) override;
+            virtual void multiplyH(uint8_t *Y) override;
+            virtual void update(uint8_t *Y, const uint8_t *X, size_t nBlocks) override;
+            virtual void endSession() override
+                { if((NULL != M) && (T == M)) { memset(M, 0, TableWords * sizeof(uint64_t)); } T = NULL; }
+
+            // Start a keyed session with a table precomputed for H, eg at compile time
+            // by makeOTGHASH128Shoup4Table(), instead of building one in the workspace;
+            // no workspace is needed.
+            // The table is retained (not copied) until endSession().
+            // The table must be in RAM (not PROGMEM) on AVR.
+            bool setTable(const uint64_t *table)
+                { endSession(); T = table; return(NULL != T); }
+        };
+
+#if !defined(__AVR_ARCH__) && !defined(ARDUINO_ARCH_AVR) // Hosts only: too big for small MCUs.
+    // Shoup's 8-bit table GHASH: 256-entry table of multiples of H per key
+    // (4096 bytes) plus a shared 256-entry reduction table in ROM.
+    // One table lookup per byte of input.
+    // Note that the table lookups are secret-indexed and so not constant-time
+    // on CPUs with data caches.
+    // Neither re-entrant nor ISR-safe except where stated.
+    class OTGHASH128_Shoup8 : public OTGHASH128
+        {
+        protected:
+            // Table size in 64-bit words: 256 entries of (high, low) halves.
+            static constexpr size_t TableWords = 512;
+            // Aligned table within the caller's workspace; NULL if insufficient workspace.
+            uint64_t * const M;
+            // Table of the active session: M once built by setKey(), or one precomputed
+            // (see setTable()); NULL when no session is active.
+            const uint64_t *T = NULL;
+
+        public:
+            // Minimum workspace required, unaligned, including alignment slack.
+            // This constant, defined per class, is effectively part of the API.
+            static constexpr size_t workspaceRequired = TableWords * sizeof(uint64_t) + (sizeof(uint64_t)-1);
+
+            // Construct an instance: supplied workspace must be large enough.
+            OTGHASH128_Shoup8(uint8_t *const workspace, const size_t workspaceLen)
+              : M(((NULL == workspace) || (workspaceLen < workspaceRequired)) ? NULL :
+                    (uint64_t *)(((uintptr_t)workspace + (sizeof(uint64_t)-1)) & ~(uintptr_t)(sizeof(uint64_t)-1)))
+                { }
+
+            virtual bool setKey(const uint8_t *H) override;
+            virtual void multiplyH(uint8_t *Y) override;
+            virtual void update(uint8_t *Y, const uint8_t *X, size_t nBlocks) override;
+            virtual void endSession() override
+                { if((NULL != M) && (T == M)) { memset(M, 0, TableWords * sizeof(uint64_t)); } T = NULL; }
+
+            // Start a keyed session with a table precomputed for H, eg at compile time
+            // by makeOTGHASH128Shoup8Table(), instead of building one in the workspace;
+            // no workspace is needed.
+            // The table is retained (not copied) until endSession().
+            // The table must be in RAM (not PROGMEM) on AVR.
+            bool setTable(const uint64_t *table)
+                { endSession(); T = table; return(NULL != T); }
+        };
+#endif
+
+
+    }
+
+#endif
@@ -21,6 +21,17 @@ Author(s) / Copyright (s): Damon Hart-Davis 2016
  */
 
 #include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#if defined(__cpp_impl_coroutine) && (__cpp_impl_coroutine >= 201902L)
+#include <coroutine>
+#endif
 #include <gtest/gtest.h>
 #include <OTAESGCM.h>
 
@@ -376,7 +387,7 @@ TEST(Main,GCMVS1ViaFixed32BTextSizeWITH_LWORKSPACE)
             input,
             cipherText, tag));
     ASSERT_FALSE(OTAESGCM::fixed32BTextSize12BNonce16BTagSimpleEnc_DEFAULT_WITH_LWORKSPACE(
-            workspace, OTAESGCM::OTAES128GCMGenericWithWorkspace<>::workspaceRequiredEnc-1,
+            workspace, OTAESGCM::OTAES128GCMGenericWithWorkspace<>::workspaceRequiredEncPadded-1,
             key, nonce,
             aad, sizeof(aad),
             input,
@@ -420,6 +431,1755 @@ TEST(Main,GCMVS1ViaFixed32BTextSizeWITH_LWORKSPACE)
             inputDecoded));
 }
 
+// Check keyed-session multi-block encryption and decryption
+// against the NIST SP 800-38A ECB-AES128 test vectors.
+TEST(Main,AES128KeyedSessionECB)
+{
+    static const uint8_t key[AES_KEY_SIZE/8] = { 0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c };
+    static const uint8_t plain[32] = {
+        0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a,
+        0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c, 0x9e, 0xb7, 0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51 };
+    static const uint8_t cipher[32] = {
+        0x3a, 0xd7, 0x7b, 0xb4, 0x0d, 0x7a, 0x36, 0x60, 0xa8, 0x9e, 0xca, 0xf3, 0x24, 0x66, 0xef, 0x97,
+        0xf5, 0xd3, 0xd5, 0x85, 0x03, 0xb9, 0x69, 0x9d, 0xe7, 0x85, 0x89, 0x5a, 0x96, 0xfd, 0xba, 0xaf };
+    uint8_t workspace[OTAESGCM::OTAES128DE_AVR::workspaceRequired];
+    OTAESGCM::OTAES128DE_AVR aes(workspace, sizeof(workspace));
+    uint8_t out[32];
+    ASSERT_TRUE(aes.setKey(key));
+    aes.encryptBlocks(plain, out, 2);
+    ASSERT_EQ(0, memcmp(cipher, out, sizeof(out)));
+    // In-place decryption in the same session.
+    aes.decryptBlocks(out, out, 2);
+    ASSERT_EQ(0, memcmp(plain, out, sizeof(out)));
+    aes.endSession();
+    // Expanded key must be cleared at the end of the session.
+    for(int i = sizeof(workspace); --i >= 0; ) { ASSERT_EQ(0, workspace[i]); }
+    // One-shot interface must agree.
+    aes.blockEncrypt(plain + 16, key, out);
+    ASSERT_EQ(0, memcmp(cipher + 16, out, 16));
+    // No session without workspace.
+    OTAESGCM::OTAES128E_AVR noWS(NULL, 0);
+    ASSERT_FALSE(noWS.setKey(key));
+}
+
+// Check that the T-table engine matches the NIST SP 800-38A ECB-AES128 vectors
+// and the byte-oriented engine, in both directions, and works under GCM.
+TEST(Main,AES128TTable)
+{
+    static const uint8_t key[AES_KEY_SIZE/8] = { 0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c };
+    static const uint8_t plain[32] = {
+        0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a,
+        0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c, 0x9e, 0xb7, 0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51 };
+    static const uint8_t cipher[32] = {
+        0x3a, 0xd7, 0x7b, 0xb4, 0x0d, 0x7a, 0x36, 0x60, 0xa8, 0x9e, 0xca, 0xf3, 0x24, 0x66, 0xef, 0x97,
+        0xf5, 0xd3, 0xd5, 0x85, 0x03, 0xb9, 0x69, 0x9d, 0xe7, 0x85, 0x89, 0x5a, 0x96, 0xfd, 0xba, 0xaf };
+    // Deliberately misaligned workspace.
+    uint8_t workspace[OTAESGCM::OTAES128DE_TTable::workspaceRequired + 1];
+    OTAESGCM::OTAES128DE_TTable aes(workspace + 1, sizeof(workspace) - 1);
+    uint8_t out[32];
+    ASSERT_TRUE(aes.setKey(key));
+    aes.encryptBlocks(plain, out, 2);
+    ASSERT_EQ(0, memcmp(cipher, out, sizeof(out)));
+    aes.decryptBlocks(out, out, 2);
+    ASSERT_EQ(0, memcmp(plain, out, sizeof(out)));
+    aes.endSession();
+    // Random keys and blocks against the byte-oriented engine.
+    uint8_t wsAVR[OTAESGCM::OTAES128DE_AVR::workspaceRequired];
+    OTAESGCM::OTAES128DE_AVR ref(wsAVR, sizeof(wsAVR));
+    for(int i = 0; i < 100; ++i)
+    {
+        uint8_t k[16], b[16], e1[16], e2[16], d[16];
+        for(int j = 0; j < 16; ++j) { k[j] = (uint8_t)random(); b[j] = (uint8_t)random(); }
+        ref.blockEncrypt(b, k, e1);
+        aes.blockEncrypt(b, k, e2);
+        ASSERT_EQ(0, memcmp(e1, e2, 16));
+        aes.blockDecrypt(e2, k, d);
+        ASSERT_EQ(0, memcmp(b, d, 16));
+    }
+    // Too-small workspace is rejected.
+    OTAESGCM::OTAES128DE_TTable small(workspace, OTAESGCM::OTAES128DE_TTable::workspaceRequired - 1);
+    ASSERT_FALSE(small.setKey(key));
+    // GCM over the fast engine gives the NIST GCMVS results (PTlen = 128, count 0).
+    static const uint8_t gkey[16] = { 0xd4, 0xa2, 0x24, 0x88, 0xf8, 0xdd, 0x1d, 0x5c, 0x6c, 0x19, 0xa7, 0xd6, 0xca, 0x17, 0x96, 0x4c };
+    static const uint8_t nonce[GCM_NONCE_LENGTH] = { 0xf3, 0xd5, 0x83, 0x7f, 0x22, 0xac, 0x1a, 0x04, 0x25, 0xe0, 0xd1, 0xd5 };
+    static const uint8_t input[16] = { 0x7b, 0x43, 0x01, 0x6a, 0x16, 0x89, 0x64, 0x97, 0xfb, 0x45, 0x7b, 0xe6, 0xd2, 0xa5, 0x41, 0x22 };
+    static const uint8_t aad[20] = { 0xf1, 0xc5, 0xd4, 0x24, 0xb8, 0x3f, 0x96, 0xc6, 0xad, 0x8c, 0xb2, 0x8c, 0xa0, 0xd2, 0x0e, 0x47, 0x5e, 0x02, 0x3b, 0x5a };
+    typedef OTAESGCM::OTAES128GCMGenericWithWorkspace<OTAESGCM::OTAES128E_fast_t> fast_t;
+    uint8_t gcmWS[fast_t::workspaceRequired];
+    fast_t gen(gcmWS, sizeof(gcmWS));
+    uint8_t ct[16], tag[GCM_TAG_LENGTH];
+    ASSERT_TRUE(gen.gcmEncryptPadded(gkey, nonce, input, sizeof(input), aad, sizeof(aad), ct, tag));
+    ASSERT_EQ(0xc2, ct[0]);
+    ASSERT_EQ(0xa8, ct[15]);
+    ASSERT_EQ(0xf2, tag[0]);
+    ASSERT_EQ(0x9c, tag[15]);
+}
+
+// Check that the run-time-dispatched fast engine, both with the hardware path
+// (where the CPU supports it) and with the portable fallback forced,
+// matches the byte-oriented engine for multi-block sessions in both directions.
+TEST(Main,AES128FastRuntimeDispatch)
+{
+    uint8_t wsAVR[OTAESGCM::OTAES128DE_AVR::workspaceRequired];
+    OTAESGCM::OTAES128DE_AVR ref(wsAVR, sizeof(wsAVR));
+    uint8_t ws[OTAESGCM::OTAES128DE_fast_t::workspaceRequired];
+    for(int hw = 0; hw < 2; ++hw)
+    {
+#if defined(OTAESGCM_X86_INTRINSICS)
+        OTAESGCM::OTAES128DE_fast_t aes(ws, sizeof(ws), 0 != hw);
+        ASSERT_EQ((0 != hw) && OTAESGCM::cpuHasAESNI(), aes.isHardware());
+#else
+        OTAESGCM::OTAES128DE_fast_t aes(ws, sizeof(ws));
+#endif
+        for(int i = 0; i < 20; ++i)
+        {
+            // Odd block count exercises both the pipelined and tail loops.
+            uint8_t k[16], p[16*7], e1[sizeof(p)], e2[sizeof(p)];
+            for(int j = 0; j < 16; ++j) { k[j] = (uint8_t)random(); }
+            for(size_t j = 0; j < sizeof(p); ++j) { p[j] = (uint8_t)random(); }
+            ASSERT_TRUE(ref.setKey(k));
+            ref.encryptBlocks(p, e1, sizeof(p)/16);
+            ref.endSession();
+            ASSERT_TRUE(aes.setKey(k));
+            aes.encryptBlocks(p, e2, sizeof(p)/16);
+            ASSERT_EQ(0, memcmp(e1, e2, sizeof(p)));
+            aes.decryptBlocks(e2, e2, sizeof(p)/16);
+            ASSERT_EQ(0, memcmp(p, e2, sizeof(p)));
+            aes.endSession();
+        }
+    }
+}
+
+// Check that the table-driven GHASH engines agree with the bit-serial one,
+// and that GCM over each gives the NIST GCMVS results (PTlen = 128, count 0),
+// with a partial final AAD block.
+TEST(Main,GHASH128Engines)
+{
+    uint8_t wsBS[OTAESGCM::OTGHASH128_BitSerial::workspaceRequired];
+    uint8_t ws4[OTAESGCM::OTGHASH128_Shoup4::workspaceRequired];
+    uint8_t ws8[OTAESGCM::OTGHASH128_Shoup8::workspaceRequired];
+    memset(ws8, 0, sizeof(ws8));
+    OTAESGCM::OTGHASH128_BitSerial bs(wsBS, sizeof(wsBS));
+    OTAESGCM::OTGHASH128_Shoup4 s4(ws4, sizeof(ws4));
+    OTAESGCM::OTGHASH128_Shoup8 s8(ws8, sizeof(ws8));
+    for(int i = 0; i < 50; ++i)
+    {
+        uint8_t H[16], X[16*3], Y1[16], Y2[16], Y3[16];
+        for(int j = 0; j < 16; ++j) { H[j] = (uint8_t)random(); Y1[j] = (uint8_t)random(); }
+        for(size_t j = 0; j < sizeof(X); ++j) { X[j] = (uint8_t)random(); }
+        memcpy(Y2, Y1, 16);
+        memcpy(Y3, Y1, 16);
+        ASSERT_TRUE(bs.setKey(H));
+        ASSERT_TRUE(s4.setKey(H));
+        ASSERT_TRUE(s8.setKey(H));
+        bs.update(Y1, X, 3);
+        s4.update(Y2, X, 3);
+        s8.update(Y3, X, 3);
+        ASSERT_EQ(0, memcmp(Y1, Y2, 16));
+        ASSERT_EQ(0, memcmp(Y1, Y3, 16));
+        bs.endSession();
+        s4.endSession();
+        s8.endSession();
+    }
+    // Per-key tables must be cleared at the end of the session.
+    for(int i = sizeof(ws8); --i >= 0; ) { ASSERT_EQ(0, ws8[i]); }
+    // Too-small workspace is rejected.
+    OTAESGCM::OTGHASH128_Shoup4 small(ws4, sizeof(ws4) - 1);
+    ASSERT_FALSE(small.setKey(ws8));
+
+    static const uint8_t key[AES_KEY_SIZE/8] = { 0xd4, 0xa2, 0x24, 0x88, 0xf8, 0xdd, 0x1d, 0x5c, 0x6c, 0x19, 0xa7, 0xd6, 0xca, 0x17, 0x96, 0x4c };
+    static const uint8_t nonce[GCM_NONCE_LENGTH] = { 0xf3, 0xd5, 0x83, 0x7f, 0x22, 0xac, 0x1a, 0x04, 0x25, 0xe0, 0xd1, 0xd5 };
+    static const uint8_t input[16] = { 0x7b, 0x43, 0x01, 0x6a, 0x16, 0x89, 0x64, 0x97, 0xfb, 0x45, 0x7b, 0xe6, 0xd2, 0xa5, 0x41, 0x22 };
+    static const uint8_t aad[20] = { 0xf1, 0xc5, 0xd4, 0x24, 0xb8, 0x3f, 0x96, 0xc6, 0xad, 0x8c, 0xb2, 0x8c, 0xa0, 0xd2, 0x0e, 0x47, 0x5e, 0x02, 0x3b, 0x5a };
+    static const uint8_t expCT[16] = { 0xc2, 0xbd, 0x67, 0xee, 0xf5, 0xe9, 0x5c, 0xac, 0x27, 0xe3, 0xb0, 0x6e, 0x30, 0x31, 0xd0, 0xa8 };
+    static const uint8_t expTag[16] = { 0xf2, 0x3e, 0xac, 0xf9, 0xd1, 0xcd, 0xf8, 0x73, 0x77, 0x26, 0xc5, 0x86, 0x48, 0x82, 0x6e, 0x9c };
+    uint8_t ct[16], tag[GCM_TAG_LENGTH], plain[16];
+    {
+        typedef OTAESGCM::OTAES128GCMGenericWithWorkspace<OTAESGCM::OTAES128E_default_t, OTAESGCM::OTGHASH128_Shoup4> gcm4_t;
+        uint8_t workspace[gcm4_t::workspaceRequired];
+        memset(workspace, 0, sizeof(workspace));
+        gcm4_t gen(workspace, sizeof(workspace));
+        ASSERT_TRUE(gen.gcmEncryptPadded(key, nonce, input, sizeof(input), aad, sizeof(aad), ct, tag));
+        ASSERT_EQ(0, memcmp(expCT, ct, sizeof(ct)));
+        ASSERT_EQ(0, memcmp(expTag, tag, sizeof(tag)));
+        for(int i = sizeof(workspace); --i >= 0; ) { ASSERT_EQ(0, workspace[i]); }
+        ASSERT_TRUE(gen.gcmDecrypt(key, nonce, ct, sizeof(ct), aad, sizeof(aad), tag, plain));
+        ASSERT_EQ(0, memcmp(input, plain, sizeof(input)));
+    }
+    {
+        typedef OTAESGCM::OTAES128GCMGenericWithWorkspace<OTAESGCM::OTAES128E_fast_t, OTAESGCM::OTGHASH128_fast_t> gcmfast_t;
+        uint8_t workspace[gcmfast_t::workspaceRequired];
+        gcmfast_t gen(workspace, sizeof(workspace));
+        ASSERT_TRUE(gen.gcmEncryptPadded(key, nonce, input, sizeof(input), aad, sizeof(aad), ct, tag));
+        ASSERT_EQ(0, memcmp(expCT, ct, sizeof(ct)));
+        ASSERT_EQ(0, memcmp(expTag, tag, sizeof(tag)));
+        ASSERT_TRUE(gen.gcmDecrypt(key, nonce, ct, sizeof(ct), aad, sizeof(aad), tag, plain));
+        ASSERT_EQ(0, memcmp(input, plain, sizeof(input)));
+        tag[3] ^= 1;
+        ASSERT_FALSE(gen.gcmDecrypt(key, nonce, ct, sizeof(ct), aad, sizeof(aad), tag, plain));
+    }
+}
+
+// Check that the run-time-dispatched fast GHASH, both with the hardware path
+// (where the CPU supports it) and with the portable fallback forced,
+// matches the bit-serial engine for runs of blocks that exercise
+// the 8- and 4-block aggregated reductions and the single-block tail.
+TEST(Main,GHASH128FastRuntimeDispatch)
+{
+    uint8_t wsBS[OTAESGCM::OTGHASH128_BitSerial::workspaceRequired];
+    OTAESGCM::OTGHASH128_BitSerial ref(wsBS, sizeof(wsBS));
+    static uint8_t ws[OTAESGCM::OTGHASH128_fast_t::workspaceRequired];
+    for(int hw = 0; hw < 2; ++hw)
+    {
+#if defined(OTAESGCM_X86_INTRINSICS)
+        OTAESGCM::OTGHASH128_fast_t gh(ws, sizeof(ws), 0 != hw);
+        ASSERT_EQ((0 != hw) && OTAESGCM::cpuHasPCLMUL(), gh.isHardware());
+#else
+        OTAESGCM::OTGHASH128_fast_t gh(ws, sizeof(ws));
+#endif
+        for(size_t n = 0; n <= 21; ++n)
+        {
+            uint8_t H[16], X[16*21], Y1[16], Y2[16];
+            for(int j = 0; j < 16; ++j) { H[j] = (uint8_t)random(); Y1[j] = (uint8_t)random(); }
+            for(size_t j = 0; j < 16*n; ++j) { X[j] = (uint8_t)random(); }
+            memcpy(Y2, Y1, 16);
+            ASSERT_TRUE(ref.setKey(H));
+            ref.update(Y1, X, n);
+            ref.endSession();
+            ASSERT_TRUE(gh.setKey(H));
+            gh.update(Y2, X, n);
+            ASSERT_EQ(0, memcmp(Y1, Y2, 16)) << n;
+            ref.setKey(H);
+            ref.multiplyH(Y1);
+            ref.endSession();
+            gh.multiplyH(Y2);
+            ASSERT_EQ(0, memcmp(Y1, Y2, 16)) << n;
+            gh.endSession();
+        }
+    }
+}
+
+// Check that the single-pass CTR + GHASH paths (the stitched AES-NI/CLMUL kernel
+// where the CPU supports it, else the generic fused loop) agree with
+// the small default implementations for all padded lengths,
+// covering whole 4-block groups and tails.
+TEST(Main,GCMStitchedCTRGHASH)
+{
+    typedef OTAESGCM::OTAES128GCMGenericWithWorkspace<OTAESGCM::OTAES128E_fast_t, OTAESGCM::OTGHASH128_fast_t> fast_t;
+    typedef OTAESGCM::OTAES128GCMGenericWithWorkspace<> small_t;
+    static uint8_t wsFast[fast_t::workspaceRequired];
+    uint8_t wsSmall[small_t::workspaceRequired];
+    fast_t fast(wsFast, sizeof(wsFast));
+    small_t small(wsSmall, sizeof(wsSmall));
+    for(uint8_t nBlocks = 0; nBlocks <= 15; ++nBlocks)
+    {
+        const uint8_t len = uint8_t(16 * nBlocks);
+        uint8_t key[16], iv[GCM_NONCE_LENGTH], aad[19], pt[240], ct1[240], ct2[240], dec[240];
+        uint8_t tag1[GCM_TAG_LENGTH], tag2[GCM_TAG_LENGTH];
+        for(int j = 0; j < 16; ++j) { key[j] = (uint8_t)random(); }
+        for(int j = 0; j < GCM_NONCE_LENGTH; ++j) { iv[j] = (uint8_t)random(); }
+        for(size_t j = 0; j < sizeof(aad); ++j) { aad[j] = (uint8_t)random(); }
+        for(int j = 0; j < len; ++j) { pt[j] = (uint8_t)random(); }
+        ASSERT_TRUE(small.gcmEncryptPadded(key, iv, pt, len, aad, sizeof(aad), ct1, tag1));
+        ASSERT_TRUE(fast.gcmEncryptPadded(key, iv, pt, len, aad, sizeof(aad), ct2, tag2));
+        ASSERT_EQ(0, memcmp(ct1, ct2, len)) << (int)nBlocks;
+        ASSERT_EQ(0, memcmp(tag1, tag2, sizeof(tag1))) << (int)nBlocks;
+        ASSERT_TRUE(fast.gcmDecrypt(key, iv, ct2, len, aad, sizeof(aad), tag2, dec));
+        ASSERT_EQ(0, memcmp(pt, dec, len)) << (int)nBlocks;
+        if(len > 0)
+        {
+            ct2[len - 1] ^= 0x80;
+            ASSERT_FALSE(fast.gcmDecrypt(key, iv, ct2, len, aad, sizeof(aad), tag2, dec));
+        }
+    }
+}
+
+// Check the size_t-length API against published vectors
+// (McGrew & Viega, "The Galois/Counter Mode of Operation", test cases 1 and 4)
+// with unpadded text, and check that a large unpadded buffer gives the same
+// result with the fast and the small default implementations.
+TEST(Main,GCMLargeMessages)
+{
+    typedef OTAESGCM::OTAES128GCMGenericWithWorkspace<OTAESGCM::OTAES128E_fast_t, OTAESGCM::OTGHASH128_fast_t> fast_t;
+    typedef OTAESGCM::OTAES128GCMGenericWithWorkspace<> small_t;
+    static uint8_t wsFast[fast_t::workspaceRequired];
+    static uint8_t wsSmall[small_t::workspaceRequired];
+    fast_t fast(wsFast, sizeof(wsFast));
+    small_t small(wsSmall, sizeof(wsSmall));
+
+    // Test case 1: zero key and IV, no data at all.
+    const uint8_t zero[16] = { };
+    const uint8_t tc1Tag[16] = { 0x58, 0xe2, 0xfc, 0xce, 0xfa, 0x7e, 0x30, 0x61, 0x36, 0x7f, 0x1d, 0x57, 0xa4, 0xe7, 0x45, 0x5a };
+    uint8_t tag[16];
+    ASSERT_TRUE(small.gcmEncryptLarge(zero, zero, NULL, 0, NULL, 0, NULL, tag));
+    EXPECT_EQ(0, memcmp(tc1Tag, tag, sizeof(tag)));
+    ASSERT_TRUE(fast.gcmDecryptLarge(zero, zero, NULL, 0, NULL, 0, tc1Tag, NULL));
+
+    // Test case 4: 60 bytes of text and 20 of additional data.
+    const uint8_t key[16] = { 0xfe, 0xff, 0xe9, 0x92, 0x86, 0x65, 0x73, 0x1c, 0x6d, 0x6a, 0x8f, 0x94, 0x67, 0x30, 0x83, 0x08 };
+    const uint8_t iv[12] = { 0xca, 0xfe, 0xba, 0xbe, 0xfa, 0xce, 0xdb, 0xad, 0xde, 0xca, 0xf8, 0x88 };
+    const uint8_t pt[60] = {
+        0xd9, 0x31, 0x32, 0x25, 0xf8, 0x84, 0x06, 0xe5, 0xa5, 0x59, 0x09, 0xc5, 0xaf, 0xf5, 0x26, 0x9a,
+        0x86, 0xa7, 0xa9, 0x53, 0x15, 0x34, 0xf7, 0xda, 0x2e, 0x4c, 0x30, 0x3d, 0x8a, 0x31, 0x8a, 0x72,
+        0x1c, 0x3c, 0x0c, 0x95, 0x95, 0x68, 0x09, 0x53, 0x2f, 0xcf, 0x0e, 0x24, 0x49, 0xa6, 0xb5, 0x25,
+        0xb1, 0x6a, 0xed, 0xf5, 0xaa, 0x0d, 0xe6, 0x57, 0xba, 0x63, 0x7b, 0x39 };
+    const uint8_t aad[20] = {
+        0xfe, 0xed, 0xfa, 0xce, 0xde, 0xad, 0xbe, 0xef, 0xfe, 0xed, 0xfa, 0xce, 0xde, 0xad, 0xbe, 0xef,
+        0xab, 0xad, 0xda, 0xd2 };
+    const uint8_t ct[60] = {
+        0x42, 0x83, 0x1e, 0xc2, 0x21, 0x77, 0x74, 0x24, 0x4b, 0x72, 0x21, 0xb7, 0x84, 0xd0, 0xd4, 0x9c,
+        0xe3, 0xaa, 0x21, 0x2f, 0x2c, 0x02, 0xa4, 0xe0, 0x35, 0xc1, 0x7e, 0x23, 0x29, 0xac, 0xa1, 0x2e,
+        0x21, 0xd5, 0x14, 0xb2, 0x54, 0x66, 0x93, 0x1c, 0x7d, 0x8f, 0x6a, 0x5a, 0xac, 0x84, 0xaa, 0x05,
+        0x1b, 0xa3, 0x0b, 0x39, 0x6a, 0x0a, 0xac, 0x97, 0x3d, 0x58, 0xe0, 0x91 };
+    const uint8_t tc4Tag[16] = { 0x5b, 0xc9, 0x4f, 0xbc, 0x32, 0x21, 0xa5, 0xdb, 0x94, 0xfa, 0xe9, 0x5a, 0xe7, 0x12, 0x1a, 0x47 };
+    uint8_t out[60];
+    ASSERT_TRUE(small.gcmEncryptLarge(key, iv, pt, sizeof(pt), aad, sizeof(aad), out, tag));
+    EXPECT_EQ(0, memcmp(ct, out, sizeof(ct)));
+    EXPECT_EQ(0, memcmp(tc4Tag, tag, sizeof(tag)));
+    ASSERT_TRUE(fast.gcmEncryptLarge(key, iv, pt, sizeof(pt), aad, sizeof(aad), out, tag));
+    EXPECT_EQ(0, memcmp(ct, out, sizeof(ct)));
+    EXPECT_EQ(0, memcmp(tc4Tag, tag, sizeof(tag)));
+    ASSERT_TRUE(fast.gcmDecryptLarge(key, iv, ct, sizeof(ct), aad, sizeof(aad), tc4Tag, out));
+    EXPECT_EQ(0, memcmp(pt, out, sizeof(pt)));
+    // Bad arguments.
+    EXPECT_FALSE(fast.gcmEncryptLarge(key, iv, NULL, sizeof(pt), aad, sizeof(aad), out, tag));
+    EXPECT_FALSE(fast.gcmEncryptLarge(key, iv, pt, sizeof(pt), NULL, sizeof(aad), out, tag));
+    EXPECT_FALSE(fast.gcmDecryptLarge(key, iv, ct, sizeof(ct), aad, sizeof(aad), NULL, out));
+
+    // Large unpadded buffer, with the counter low bytes near wrap.
+    const size_t len = 65536 + 13;
+    std::vector<uint8_t> big(len), c1(len), c2(len), dec(len);
+    for(size_t j = 0; j < len; ++j) { big[j] = (uint8_t)random(); }
+    uint8_t iv2[12];
+    memcpy(iv2, iv, sizeof(iv2));
+    iv2[10] = 0xff; iv2[11] = 0xf0;
+    uint8_t tag1[16], tag2[16];
+    ASSERT_TRUE(small.gcmEncryptLarge(key, iv2, &big[0], len, aad, sizeof(aad), &c1[0], tag1));
+    ASSERT_TRUE(fast.gcmEncryptLarge(key, iv2, &big[0], len, aad, sizeof(aad), &c2[0], tag2));
+    EXPECT_TRUE(c1 == c2);
+    EXPECT_EQ(0, memcmp(tag1, tag2, sizeof(tag1)));
+    ASSERT_TRUE(fast.gcmDecryptLarge(key, iv2, &c2[0], len, aad, sizeof(aad), tag2, &dec[0]));
+    EXPECT_TRUE(big == dec);
+    c2[len / 2] ^= 1;
+    EXPECT_FALSE(fast.gcmDecryptLarge(key, iv2, &c2[0], len, aad, sizeof(aad), tag2, &dec[0]));
+}
+
+
+// Check that streaming in randomly-sized chunks gives the same results
+// as the one-shot functions, and that a stream holds the instance.
+TEST(Main,GCMStreaming)
+{
+    typedef OTAESGCM::OTAES128GCMGenericWithWorkspace<OTAESGCM::OTAES128E_fast_t, OTAESGCM::OTGHASH128_fast_t> fast_t;
+    typedef OTAESGCM::OTAES128GCMGenericWithWorkspace<> small_t;
+    static uint8_t wsFast[fast_t::workspaceRequired];
+    static uint8_t wsSmall[small_t::workspaceRequired];
+    fast_t fast(wsFast, sizeof(wsFast));
+    small_t small(wsSmall, sizeof(wsSmall));
+    OTAESGCM::OTAES128GCMGenericBase *const impls[] = { &fast, &small };
+    for(int trial = 0; trial < 40; ++trial)
+    {
+        OTAESGCM::OTAES128GCMGenericBase &i = *impls[trial & 1];
+        uint8_t key[16], iv[GCM_NONCE_LENGTH], aad[50], pt[300], ct1[300], ct2[300], dec[300];
+        uint8_t tag1[GCM_TAG_LENGTH], tag2[GCM_TAG_LENGTH];
+        const size_t aadLen = (size_t)random() % sizeof(aad);
+        const size_t len = (size_t)random() % sizeof(pt);
+        for(int j = 0; j < 16; ++j) { key[j] = (uint8_t)random(); }
+        for(int j = 0; j < GCM_NONCE_LENGTH; ++j) { iv[j] = (uint8_t)random(); }
+        for(size_t j = 0; j < aadLen; ++j) { aad[j] = (uint8_t)random(); }
+        for(size_t j = 0; j < len; ++j) { pt[j] = (uint8_t)random(); }
+        ASSERT_TRUE(i.gcmEncryptLarge(key, iv, pt, len, aad, aadLen, ct1, tag1));
+
+        OTAESGCM::OTAES128GCMStreamContext ctx;
+        ASSERT_TRUE(i.gcmStreamInit(ctx, key, iv, false));
+        // Busy until finished.
+        EXPECT_FALSE(i.gcmEncryptLarge(key, iv, pt, len, aad, aadLen, ct2, tag2));
+        for(size_t pos = 0; pos < aadLen; )
+        {
+            const size_t n = std::min((size_t)random() % 20, aadLen - pos);
+            ASSERT_TRUE(i.gcmStreamAAD(ctx, aad + pos, n));
+            pos += n;
+        }
+        for(size_t pos = 0; pos < len; )
+        {
+            const size_t n = std::min((size_t)random() % 40, len - pos);
+            ASSERT_TRUE(i.gcmStreamUpdate(ctx, pt + pos, n, ct2 + pos));
+            pos += n;
+        }
+        ASSERT_TRUE(i.gcmStreamFinal(ctx, tag2));
+        EXPECT_EQ(0, memcmp(ct1, ct2, len)) << trial;
+        EXPECT_EQ(0, memcmp(tag1, tag2, sizeof(tag1))) << trial;
+
+        ASSERT_TRUE(i.gcmStreamInit(ctx, key, iv, true));
+        ASSERT_TRUE(i.gcmStreamAAD(ctx, aad, aadLen));
+        for(size_t pos = 0; pos < len; )
+        {
+            const size_t n = std::min((size_t)random() % 40, len - pos);
+            ASSERT_TRUE(i.gcmStreamUpdate(ctx, ct2 + pos, n, dec + pos));
+            pos += n;
+        }
+        EXPECT_TRUE(i.gcmStreamVerify(ctx, tag1));
+        EXPECT_EQ(0, memcmp(pt, dec, len)) << trial;
+
+        tag2[trial % GCM_TAG_LENGTH] ^= 0x40;
+        ASSERT_TRUE(i.gcmStreamInit(ctx, key, iv, true));
+        ASSERT_TRUE(i.gcmStreamAAD(ctx, aad, aadLen));
+        ASSERT_TRUE(i.gcmStreamUpdate(ctx, ct2, len, dec));
+        EXPECT_FALSE(i.gcmStreamVerify(ctx, tag2));
+        // Finished streams are wiped and release the instance.
+        EXPECT_FALSE(i.gcmStreamUpdate(ctx, ct2, len, dec));
+        EXPECT_TRUE(i.gcmEncryptLarge(key, iv, pt, len, aad, aadLen, ct2, tag2));
+
+        // Additional data once text has started aborts the stream.
+        ASSERT_TRUE(i.gcmStreamInit(ctx, key, iv, false));
+        ASSERT_TRUE(i.gcmStreamAAD(ctx, aad, aadLen));
+        ASSERT_TRUE(i.gcmStreamUpdate(ctx, pt, 1, ct2));
+        EXPECT_FALSE(i.gcmStreamAAD(ctx, aad, 0));
+        EXPECT_FALSE(i.gcmStreamUpdate(ctx, pt, 1, ct2));
+        EXPECT_FALSE(i.gcmStreamFinal(ctx, tag2));
+        EXPECT_TRUE(i.gcmEncryptLarge(key, iv, pt, len, aad, aadLen, ct2, tag2));
+    }
+}
+
+
+// Check that encryption and decryption with key contexts keyed once
+// match the one-shot functions over many messages,
+// including with a context of a different implementation from the GCM instance.
+TEST(Main,GCMKeyContext)
+{
+    typedef OTAESGCM::OTAES128GCMGenericWithWorkspace<OTAESGCM::OTAES128E_fast_t, OTAESGCM::OTGHASH128_fast_t> fast_t;
+    typedef OTAESGCM::OTAES128GCMKeyContextWithWorkspace<OTAESGCM::OTAES128E_fast_t, OTAESGCM::OTGHASH128_fast_t> fastKC_t;
+    typedef OTAESGCM::OTAES128GCMKeyContextWithWorkspace<OTAESGCM::OTAES128E_small_t, OTAESGCM::OTGHASH128_fast_t> smallKC_t;
+    static uint8_t wsFast[fast_t::workspaceRequired];
+    static uint8_t wsFastKC[fastKC_t::workspaceRequired];
+    uint8_t wsSmallKC[smallKC_t::workspaceRequired];
+    fast_t gcm(wsFast, sizeof(wsFast));
+    fastKC_t fastKC(wsFastKC, sizeof(wsFastKC));
+    smallKC_t smallKC(wsSmallKC, sizeof(wsSmallKC));
+    smallKC_t noKC(NULL, 0);
+
+    uint8_t key[16], iv[GCM_NONCE_LENGTH], aad[20], pt[48], ct1[48], ct2[48], dec[48];
+    uint8_t tag1[GCM_TAG_LENGTH], tag2[GCM_TAG_LENGTH];
+    for(int j = 0; j < 16; ++j) { key[j] = (uint8_t)random(); }
+    EXPECT_FALSE(noKC.setKey(key));
+    EXPECT_FALSE(gcm.gcmEncryptPadded(noKC, iv, pt, sizeof(pt), aad, sizeof(aad), ct2, tag2));
+    ASSERT_TRUE(fastKC.setKey(key));
+    ASSERT_TRUE(smallKC.setKey(key));
+    OTAESGCM::OTAES128GCMKeyContext *const contexts[] = { &fastKC, &smallKC };
+    for(int msg = 0; msg < 20; ++msg)
+    {
+        OTAESGCM::OTAES128GCMKeyContext &kc = *contexts[msg & 1];
+        for(int j = 0; j < GCM_NONCE_LENGTH; ++j) { iv[j] = (uint8_t)random(); }
+        for(size_t j = 0; j < sizeof(aad); ++j) { aad[j] = (uint8_t)random(); }
+        for(size_t j = 0; j < sizeof(pt); ++j) { pt[j] = (uint8_t)random(); }
+        ASSERT_TRUE(gcm.gcmEncryptPadded(key, iv, pt, sizeof(pt), aad, sizeof(aad), ct1, tag1));
+        ASSERT_TRUE(gcm.gcmEncryptPadded(kc, iv, pt, sizeof(pt), aad, sizeof(aad), ct2, tag2));
+        EXPECT_EQ(0, memcmp(ct1, ct2, sizeof(ct1))) << msg;
+        EXPECT_EQ(0, memcmp(tag1, tag2, sizeof(tag1))) << msg;
+        ASSERT_TRUE(gcm.gcmDecrypt(kc, iv, ct1, sizeof(ct1), aad, sizeof(aad), tag1, dec));
+        EXPECT_EQ(0, memcmp(pt, dec, sizeof(pt))) << msg;
+        // Unpadded lengths.
+        const size_t len = (size_t)random() % sizeof(pt);
+        ASSERT_TRUE(gcm.gcmEncryptLarge(key, iv, pt, len, aad, 7, ct1, tag1));
+        ASSERT_TRUE(gcm.gcmEncryptLarge(kc, iv, pt, len, aad, 7, ct2, tag2));
+        EXPECT_EQ(0, memcmp(ct1, ct2, len)) << msg;
+        EXPECT_EQ(0, memcmp(tag1, tag2, sizeof(tag1))) << msg;
+        ASSERT_TRUE(gcm.gcmDecryptLarge(kc, iv, ct2, len, aad, 7, tag2, dec));
+        tag2[0] ^= 1;
+        EXPECT_FALSE(gcm.gcmDecryptLarge(kc, iv, ct2, len, aad, 7, tag2, dec));
+    }
+    // Cleared contexts are rejected.
+    fastKC.clear();
+    EXPECT_FALSE(fastKC.isKeyed());
+    EXPECT_FALSE(gcm.gcmEncryptPadded(fastKC, iv, pt, sizeof(pt), aad, sizeof(aad), ct2, tag2));
+    smallKC.clear();
+}
+
+
+// Check that batches of frames, mixing key contexts, keys and sizes
+// (including frames too big to share an AES call), give the same results
+// as one frame at a time, and that failures are reported per frame.
+TEST(Main,GCMBatch)
+{
+    typedef OTAESGCM::OTAES128GCMGenericWithWorkspace<OTAESGCM::OTAES128E_fast_t, OTAESGCM::OTGHASH128_fast_t> fast_t;
+    typedef OTAESGCM::OTAES128GCMKeyContextWithWorkspace<OTAESGCM::OTAES128E_fast_t, OTAESGCM::OTGHASH128_fast_t> fastKC_t;
+    static uint8_t wsFast[fast_t::workspaceRequired];
+    static uint8_t wsKC[fastKC_t::workspaceRequired];
+    fast_t gcm(wsFast, sizeof(wsFast));
+    fastKC_t kc(wsKC, sizeof(wsKC));
+    const size_t nFrames = 20;
+    static uint8_t keys[2][16], ivs[nFrames][GCM_NONCE_LENGTH], aads[nFrames][8];
+    static uint8_t pts[nFrames][300], cts[nFrames][300], decs[nFrames][300], tags[nFrames][GCM_TAG_LENGTH];
+    for(int j = 0; j < 32; ++j) { keys[j / 16][j % 16] = (uint8_t)random(); }
+    ASSERT_TRUE(kc.setKey(keys[0]));
+    OTAESGCM::OTAES128GCMFrameDescriptor frames[nFrames];
+    for(size_t f = 0; f < nFrames; ++f)
+    {
+        for(int j = 0; j < GCM_NONCE_LENGTH; ++j) { ivs[f][j] = (uint8_t)random(); }
+        for(int j = 0; j < 8; ++j) { aads[f][j] = (uint8_t)random(); }
+        for(int j = 0; j < 300; ++j) { pts[f][j] = (uint8_t)random(); }
+        OTAESGCM::OTAES128GCMFrameDescriptor &d = frames[f];
+        // Runs of key context frames, then of key frames, with a 300-byte frame in the middle.
+        d.kc = (f < 8) ? &kc : NULL;
+        d.key = keys[(f < 14) ? 0 : 1];
+        d.IV = ivs[f];
+        d.ADATA = aads[f];
+        d.ADATALength = f % 9;
+        d.input = pts[f];
+        d.length = (10 == f) ? 300 : (f * 7) % 49;
+        d.output = cts[f];
+        d.tag = tags[f];
+    }
+    uint8_t bits[(nFrames + 7) / 8];
+    ASSERT_EQ(nFrames, gcm.gcmEncryptBatch(frames, nFrames, bits));
+    EXPECT_EQ(0xff, bits[0]);
+    EXPECT_EQ(0xff, bits[1]);
+    EXPECT_EQ(0x0f, bits[2]);
+    for(size_t f = 0; f < nFrames; ++f)
+    {
+        uint8_t ct[300], tag[GCM_TAG_LENGTH];
+        const OTAESGCM::OTAES128GCMFrameDescriptor &d = frames[f];
+        ASSERT_TRUE(gcm.gcmEncryptLarge(d.key, d.IV, d.input, d.length, d.ADATA, d.ADATALength, ct, tag));
+        EXPECT_EQ(0, memcmp(ct, d.output, d.length)) << f;
+        EXPECT_EQ(0, memcmp(tag, d.tag, sizeof(tag))) << f;
+    }
+
+    // Decrypt, with frames 3 and 10 tampered with and frame 17 invalid.
+    for(size_t f = 0; f < nFrames; ++f)
+    {
+        frames[f].input = cts[f];
+        frames[f].output = decs[f];
+    }
+    tags[3][5] ^= 1;
+    cts[10][299] ^= 1;
+    frames[17].IV = NULL;
+    ASSERT_EQ(nFrames - 3, gcm.gcmDecryptBatch(frames, nFrames, bits));
+    EXPECT_EQ(0xf7, bits[0]);
+    EXPECT_EQ(0xfb, bits[1]);
+    EXPECT_EQ(0x0d, bits[2]);
+    for(size_t f = 0; f < nFrames; ++f)
+    {
+        if((3 == f) || (10 == f) || (17 == f)) { continue; }
+        EXPECT_EQ(0, memcmp(pts[f], decs[f], frames[f].length)) << f;
+    }
+    kc.clear();
+    // Unkeyed context frames fail.
+    EXPECT_EQ(0U, gcm.gcmDecryptBatch(frames, 8, NULL));
+}
+
+
+// Check the constant-time bitsliced AES against FIPS-197 and the T-table impl,
+// including partial passes of fewer than 8 blocks, and when used for GCM.
+TEST(Main,AES128Bitsliced)
+{
+    static const uint8_t key[16] = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f };
+    static const uint8_t pt[16] = { 0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff };
+    static const uint8_t ct[16] = { 0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30, 0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a };
+    static uint8_t wsBS[OTAESGCM::OTAES128E_Bitsliced::workspaceRequired];
+    static uint8_t wsTT[OTAESGCM::OTAES128E_TTable::workspaceRequired];
+    OTAESGCM::OTAES128E_Bitsliced bs(wsBS, sizeof(wsBS));
+    OTAESGCM::OTAES128E_TTable tt(wsTT, sizeof(wsTT));
+    uint8_t out[16];
+    bs.blockEncrypt(pt, key, out);
+    EXPECT_EQ(0, memcmp(ct, out, 16));
+    // Insufficient workspace.
+    OTAESGCM::OTAES128E_Bitsliced bsSmall(wsBS, sizeof(wsBS) - 1);
+    EXPECT_FALSE(bsSmall.setKey(key));
+
+    uint8_t k[16], in[20 * 16], expected[20 * 16], actual[20 * 16];
+    for(int i = 0; i < 16; ++i) { k[i] = (uint8_t)random(); }
+    for(size_t i = 0; i < sizeof(in); ++i) { in[i] = (uint8_t)random(); }
+    ASSERT_TRUE(bs.setKey(k));
+    ASSERT_TRUE(tt.setKey(k));
+    for(size_t n = 0; n <= 20; ++n)
+    {
+        memset(actual, 0, sizeof(actual));
+        tt.encryptBlocks(in, expected, n);
+        bs.encryptBlocks(in, actual, n);
+        EXPECT_EQ(0, memcmp(expected, actual, 16 * n)) << n;
+    }
+    // In place.
+    memcpy(actual, in, sizeof(in));
+    bs.encryptBlocks(actual, actual, 20);
+    EXPECT_EQ(0, memcmp(expected, actual, sizeof(actual)));
+    bs.endSession();
+    tt.endSession();
+
+    // As the block cipher for GCM.
+    typedef OTAESGCM::OTAES128GCMGenericWithWorkspace<OTAESGCM::OTAES128E_ct_t, OTAESGCM::OTGHASH128_fast_t> ct_t;
+    typedef OTAESGCM::OTAES128GCMGenericWithWorkspace<> default_t;
+    static uint8_t wsCT[ct_t::workspaceRequired];
+    static uint8_t wsDef[default_t::workspaceRequired];
+    ct_t gcmCT(wsCT, sizeof(wsCT));
+    default_t gcmDef(wsDef, sizeof(wsDef));
+    uint8_t iv[GCM_NONCE_LENGTH], ctCT[200], ctDef[200], tagCT[GCM_TAG_LENGTH], tagDef[GCM_TAG_LENGTH];
+    for(int i = 0; i < GCM_NONCE_LENGTH; ++i) { iv[i] = (uint8_t)random(); }
+    ASSERT_TRUE(gcmCT.gcmEncryptLarge(k, iv, in, 200, in + 200, 19, ctCT, tagCT));
+    ASSERT_TRUE(gcmDef.gcmEncryptLarge(k, iv, in, 200, in + 200, 19, ctDef, tagDef));
+    EXPECT_EQ(0, memcmp(ctDef, ctCT, sizeof(ctCT)));
+    EXPECT_EQ(0, memcmp(tagDef, tagCT, sizeof(tagCT)));
+}
+
+// Engine implementing only blockEncrypt(), relying on the default multi-block support.
+class BlockOnlyAES final : public OTAESGCM::OTAES128E
+    {
+    private:
+        uint8_t ws[OTAESGCM::OTAES128E_TTable::workspaceRequired];
+        OTAESGCM::OTAES128E_TTable tt;
+    public:
+        BlockOnlyAES() : tt(ws, sizeof(ws)) { }
+        virtual void blockEncrypt(const uint8_t* input, const uint8_t* key, uint8_t *output) override
+            { tt.blockEncrypt(input, key, output); }
+    };
+
+// Check the default multi-block and CTR key stream support against a wide engine,
+// including the inc32 counter wrap.
+TEST(Main,AES128CTRKeystream)
+{
+    static uint8_t wsTT[OTAESGCM::OTAES128E_TTable::workspaceRequired];
+    OTAESGCM::OTAES128E_TTable tt(wsTT, sizeof(wsTT));
+    BlockOnlyAES bo;
+    uint8_t key[16], in[20 * 16], expected[20 * 16], actual[20 * 16];
+    for(int i = 0; i < 16; ++i) { key[i] = (uint8_t)random(); }
+    for(size_t i = 0; i < sizeof(in); ++i) { in[i] = (uint8_t)random(); }
+    // No session.
+    memset(actual, 0, sizeof(actual));
+    bo.encryptBlocks(in, actual, 1);
+    EXPECT_EQ(0, actual[0] | actual[15]);
+    EXPECT_FALSE(bo.setKey(NULL));
+    ASSERT_TRUE(bo.setKey(key));
+    ASSERT_TRUE(tt.setKey(key));
+    tt.encryptBlocks(in, expected, 20);
+    bo.encryptBlocks(in, actual, 20);
+    EXPECT_EQ(0, memcmp(expected, actual, sizeof(actual)));
+
+    // Key stream from a counter about to wrap its low 32 bits.
+    uint8_t ctr0[16], ctrA[16], ctrB[16];
+    for(int i = 0; i < 16; ++i) { ctr0[i] = (uint8_t)random(); }
+    memset(ctr0 + 12, 0xff, 3);
+    ctr0[15] = 0xf8;
+    memcpy(ctrA, ctr0, 16);
+    memcpy(ctrB, ctr0, 16);
+    bo.ctrKeystream(ctrA, actual, 20);
+    // By hand: blocks of counter, then encrypt.
+    for(int b = 0; b < 20; ++b)
+    {
+        memcpy(in + 16*b, ctr0, 12);
+        const uint32_t c = 0xfffffff8U + (uint32_t)b;
+        in[16*b + 12] = (uint8_t)(c >> 24); in[16*b + 13] = (uint8_t)(c >> 16);
+        in[16*b + 14] = (uint8_t)(c >> 8); in[16*b + 15] = (uint8_t)c;
+    }
+    tt.encryptBlocks(in, expected, 20);
+    EXPECT_EQ(0, memcmp(expected, actual, sizeof(actual)));
+    EXPECT_EQ(0, memcmp(ctr0, ctrA, 12));
+    EXPECT_EQ(0x0c, ctrA[15]);
+    tt.ctrKeystream(ctrB, actual, 20);
+    EXPECT_EQ(0, memcmp(expected, actual, sizeof(actual)));
+    EXPECT_EQ(0, memcmp(ctrA, ctrB, 16));
+    bo.endSession();
+    tt.endSession();
+    memset(actual, 0, sizeof(actual));
+    bo.encryptBlocks(in, actual, 1);
+    EXPECT_EQ(0, actual[0] | actual[15]);
+}
+
+// Decryption engine implementing only blockDecrypt(), relying on the default multi-block support.
+class BlockOnlyAESD final : public OTAESGCM::OTAES128D
+    {
+    private:
+        uint8_t ws[OTAESGCM::OTAES128DE_TTable::workspaceRequired];
+        OTAESGCM::OTAES128DE_TTable tt;
+    public:
+        BlockOnlyAESD() : tt(ws, sizeof(ws)) { }
+        virtual void blockDecrypt(const uint8_t* input, const uint8_t* key, uint8_t *output) override
+            { tt.blockDecrypt(input, key, output); }
+    };
+
+// Check the default multi-block decryption support against a wide engine.
+TEST(Main,AES128DecryptBlocksDefault)
+{
+    static uint8_t wsTT[OTAESGCM::OTAES128DE_TTable::workspaceRequired];
+    OTAESGCM::OTAES128DE_TTable tt(wsTT, sizeof(wsTT));
+    BlockOnlyAESD bo;
+    uint8_t key[16], in[7 * 16], expected[7 * 16], actual[7 * 16];
+    for(int i = 0; i < 16; ++i) { key[i] = (uint8_t)random(); }
+    for(size_t i = 0; i < sizeof(in); ++i) { in[i] = (uint8_t)random(); }
+    // No session.
+    memset(actual, 0, sizeof(actual));
+    bo.decryptBlocks(in, actual, 1);
+    EXPECT_EQ(0, actual[0] | actual[15]);
+    EXPECT_FALSE(bo.setKey(NULL));
+    ASSERT_TRUE(bo.setKey(key));
+    ASSERT_TRUE(tt.setKey(key));
+    tt.decryptBlocks(in, expected, 7);
+    bo.decryptBlocks(in, actual, 7);
+    EXPECT_EQ(0, memcmp(expected, actual, sizeof(actual)));
+    // In place.
+    memcpy(actual, in, sizeof(actual));
+    bo.decryptBlocks(actual, actual, 7);
+    EXPECT_EQ(0, memcmp(expected, actual, sizeof(actual)));
+    bo.endSession();
+    tt.endSession();
+    memset(actual, 0, sizeof(actual));
+    bo.decryptBlocks(in, actual, 1);
+    EXPECT_EQ(0, actual[0] | actual[15]);
+}
+
+#if defined(OTAESGCM_X86_INTRINSICS)
+// Check the vector-permute engine against the NIST SP 800-38A ECB-AES128 vectors
+// and the byte-oriented engine, in both directions, where the CPU has SSSE3.
+TEST(Main,AES128VPerm)
+{
+    if(!OTAESGCM::cpuHasSSSE3()) { return; }
+    static const uint8_t key[AES_KEY_SIZE/8] = { 0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c };
+    static const uint8_t plain[32] = {
+        0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a,
+        0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c, 0x9e, 0xb7, 0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51 };
+    static const uint8_t cipher[32] = {
+        0x3a, 0xd7, 0x7b, 0xb4, 0x0d, 0x7a, 0x36, 0x60, 0xa8, 0x9e, 0xca, 0xf3, 0x24, 0x66, 0xef, 0x97,
+        0xf5, 0xd3, 0xd5, 0x85, 0x03, 0xb9, 0x69, 0x9d, 0xe7, 0x85, 0x89, 0x5a, 0x96, 0xfd, 0xba, 0xaf };
+    // Deliberately misaligned workspace.
+    uint8_t workspace[OTAESGCM::OTAES128DE_VPerm::workspaceRequired + 1];
+    OTAESGCM::OTAES128DE_VPerm aes(workspace + 1, sizeof(workspace) - 1);
+    uint8_t out[32];
+    ASSERT_TRUE(aes.setKey(key));
+    aes.encryptBlocks(plain, out, 2);
+    ASSERT_EQ(0, memcmp(cipher, out, sizeof(out)));
+    aes.decryptBlocks(out, out, 2);
+    ASSERT_EQ(0, memcmp(plain, out, sizeof(out)));
+    aes.endSession();
+    // Random keys and odd block counts against the byte-oriented engine.
+    uint8_t wsAVR[OTAESGCM::OTAES128DE_AVR::workspaceRequired];
+    OTAESGCM::OTAES128DE_AVR ref(wsAVR, sizeof(wsAVR));
+    for(int i = 0; i < 50; ++i)
+    {
+        uint8_t k[16], p[16*5], e1[sizeof(p)], e2[sizeof(p)];
+        for(int j = 0; j < 16; ++j) { k[j] = (uint8_t)random(); }
+        for(size_t j = 0; j < sizeof(p); ++j) { p[j] = (uint8_t)random(); }
+        ASSERT_TRUE(ref.setKey(k));
+        ref.encryptBlocks(p, e1, sizeof(p)/16);
+        ref.endSession();
+        ASSERT_TRUE(aes.setKey(k));
+        aes.encryptBlocks(p, e2, sizeof(p)/16);
+        ASSERT_EQ(0, memcmp(e1, e2, sizeof(p)));
+        aes.decryptBlocks(e2, e2, sizeof(p)/16);
+        ASSERT_EQ(0, memcmp(p, e2, sizeof(p)));
+        aes.endSession();
+        aes.blockEncrypt(p, k, e2);
+        ASSERT_EQ(0, memcmp(e1, e2, 16));
+        aes.blockDecrypt(e2, k, e2);
+        ASSERT_EQ(0, memcmp(p, e2, 16));
+    }
+    // Too-small workspace is rejected.
+    OTAESGCM::OTAES128DE_VPerm small(workspace, OTAESGCM::OTAES128DE_VPerm::workspaceRequired - 1);
+    ASSERT_FALSE(small.setKey(key));
+}
+#endif
+
+// Check the header-only GCM engine, directly and via its OTAES128GCM adapter,
+// against the generic implementation, for default and fast (stitched) types,
+// including partial final blocks, tampering and argument checks.
+template<class AES, class GHASH>
+static void checkGCMInline()
+{
+    typedef OTAESGCM::OTAES128GCMInline<AES, GHASH> inline_t;
+    typedef OTAESGCM::OTAES128GCMInlineAdapter<AES, GHASH> adapter_t;
+    typedef OTAESGCM::OTAES128GCMGenericWithWorkspace<AES, GHASH> generic_t;
+    static uint8_t wsI[inline_t::workspaceRequired];
+    static uint8_t wsA[adapter_t::workspaceRequired];
+    static uint8_t wsG[generic_t::workspaceRequired];
+    inline_t gcmI(wsI, sizeof(wsI));
+    adapter_t adapter(wsA, sizeof(wsA));
+    OTAESGCM::OTAES128GCM &gcmA = adapter;
+    generic_t gcmG(wsG, sizeof(wsG));
+    for(int i = 0; i < 20; ++i)
+    {
+        uint8_t key[16], iv[GCM_NONCE_LENGTH], aad[40], pt[300], ctI[300], ctG[300], dec[300];
+        uint8_t tagI[GCM_TAG_LENGTH], tagA[GCM_TAG_LENGTH], tagG[GCM_TAG_LENGTH];
+        for(int j = 0; j < 16; ++j) { key[j] = (uint8_t)random(); }
+        for(int j = 0; j < GCM_NONCE_LENGTH; ++j) { iv[j] = (uint8_t)random(); }
+        for(size_t j = 0; j < sizeof(aad); ++j) { aad[j] = (uint8_t)random(); }
+        for(size_t j = 0; j < sizeof(pt); ++j) { pt[j] = (uint8_t)random(); }
+        const size_t len = (size_t)random() % (sizeof(pt) + 1);
+        const size_t alen = (size_t)random() % (sizeof(aad) + 1);
+        ASSERT_TRUE(gcmG.gcmEncryptLarge(key, iv, pt, len, aad, alen, ctG, tagG));
+        ASSERT_TRUE(gcmI.encrypt(key, iv, pt, len, aad, alen, ctI, tagI));
+        EXPECT_EQ(0, memcmp(ctG, ctI, len));
+        EXPECT_EQ(0, memcmp(tagG, tagI, sizeof(tagG)));
+        ASSERT_TRUE(adapter.gcmEncryptLarge(key, iv, pt, len, aad, alen, ctI, tagA));
+        EXPECT_EQ(0, memcmp(tagG, tagA, sizeof(tagG)));
+        ASSERT_TRUE(gcmI.decrypt(key, iv, ctG, len, aad, alen, tagG, dec));
+        EXPECT_EQ(0, memcmp(pt, dec, len));
+        ASSERT_TRUE(adapter.gcmDecryptLarge(key, iv, ctG, len, aad, alen, tagG, dec));
+        tagG[i % GCM_TAG_LENGTH] ^= 0x10;
+        EXPECT_FALSE(gcmI.decrypt(key, iv, ctG, len, aad, alen, tagG, dec));
+        // Padded 8-bit-length entry points; non-empty AAD, as both empty is rejected.
+        const uint8_t plen = uint8_t((len & ~(size_t)15) % 256);
+        const uint8_t palen = uint8_t(1 + alen % sizeof(aad));
+        ASSERT_TRUE(gcmG.gcmEncryptPadded(key, iv, pt, plen, aad, palen, ctG, tagG));
+        ASSERT_TRUE(gcmA.gcmEncryptPadded(key, iv, pt, plen, aad, palen, ctI, tagA));
+        EXPECT_EQ(0, memcmp(ctG, ctI, plen));
+        EXPECT_EQ(0, memcmp(tagG, tagA, sizeof(tagG)));
+        ASSERT_TRUE(gcmA.gcmDecrypt(key, iv, ctG, plen, aad, palen, tagG, dec));
+        EXPECT_EQ(0, memcmp(pt, dec, plen));
+    }
+    uint8_t key[16] = { }, iv[GCM_NONCE_LENGTH] = { }, tag[GCM_TAG_LENGTH], buf[16] = { };
+    EXPECT_FALSE(gcmA.gcmEncryptPadded(key, iv, buf, 15, NULL, 0, buf, tag));
+    EXPECT_FALSE(gcmI.encrypt(NULL, iv, buf, 16, NULL, 0, buf, tag));
+    EXPECT_FALSE(gcmI.encrypt(key, iv, buf, 16, NULL, 1, buf, tag));
+    // Insufficient workspace.
+    inline_t small(wsI, sizeof(wsI) - 1);
+    EXPECT_FALSE(small.encrypt(key, iv, buf, 16, NULL, 0, buf, tag));
+}
+TEST(Main,GCMInline)
+{
+    checkGCMInline<OTAESGCM::OTAES128E_default_t, OTAESGCM::OTGHASH128_default_t>();
+    checkGCMInline<OTAESGCM::OTAES128E_fast_t, OTAESGCM::OTGHASH128_fast_t>();
+}
+
+// FIPS-197 Appendix A.1 key, expanded at compile time.
+static constexpr OTAESGCM::OTAES128FixedKeyBytes fixedKeyBytes =
+    {{ 0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c }};
+static const OTAESGCM::OTAES128GCMFixedKey fixedKey = OTAESGCM::makeOTAES128GCMFixedKey(fixedKeyBytes);
+// Last round key d014f9a8c9ee2589e13f0cc8b6630ca6.
+static_assert(0xd0 == OTAESGCM::makeOTAES128GCMFixedKey(fixedKeyBytes).roundKeys[160], "bad schedule");
+static_assert(0xa6 == OTAESGCM::makeOTAES128GCMFixedKey(fixedKeyBytes).roundKeys[175], "bad schedule");
+// GCM test case 1 (zero key): H = 66e94bd4ef8a2c3b884cfa59ca342b2e.
+static_assert(0x66 == OTAESGCM::makeOTAES128GCMFixedKey(OTAESGCM::OTAES128FixedKeyBytes{{ 0 }}).H[0], "bad H");
+static_assert(0x2e == OTAESGCM::makeOTAES128GCMFixedKey(OTAESGCM::OTAES128FixedKeyBytes{{ 0 }}).H[15], "bad H");
+static const OTAESGCM::OTGHASH128Shoup4Table fixedTable4 = OTAESGCM::makeOTGHASH128Shoup4Table(fixedKey.H);
+static const OTAESGCM::OTGHASH128Shoup8Table fixedTable8 = OTAESGCM::makeOTGHASH128Shoup8Table(fixedKey.H);
+
+// Check that a key schedule, H and GHASH tables built at compile time
+// match those computed at run time, and drive AES and GCM directly.
+TEST(Main,FixedKey)
+{
+    // AES from the schedule in place, against the run-time expansion.
+    uint8_t ws[OTAESGCM::OTAES128E_default_t::workspaceRequired];
+    OTAESGCM::OTAES128E_default_t ref(ws, sizeof(ws));
+    OTAESGCM::OTAES128E_AVRFixed fixed(NULL, 0);
+    EXPECT_FALSE(fixed.setKey(NULL));
+    ASSERT_TRUE(ref.setKey(fixedKeyBytes.b));
+    ASSERT_TRUE(fixed.setKey(fixedKey.roundKeys));
+    uint8_t pt[64], ct1[64], ct2[64];
+    for(size_t j = 0; j < sizeof(pt); ++j) { pt[j] = (uint8_t)random(); }
+    ref.encryptBlocks(pt, ct1, 4);
+    fixed.encryptBlocks(pt, ct2, 4);
+    EXPECT_EQ(0, memcmp(ct1, ct2, sizeof(ct1)));
+    fixed.endSession();
+    fixed.encryptBlocks(pt, ct2, 1); // No session: does nothing.
+    EXPECT_EQ(0, memcmp(ct1, ct2, sizeof(ct1)));
+    uint8_t H[16];
+    memset(H, 0, sizeof(H));
+    ref.encryptBlocks(H, H, 1);
+    ref.endSession();
+    EXPECT_EQ(0, memcmp(H, fixedKey.H, sizeof(H)));
+    constexpr OTAESGCM::OTAES128FixedKeyBytes ctPlain = OTAESGCM::encryptOTAES128Constexpr(
+        OTAESGCM::OTAES128FixedKeyBytes{{ 0x32, 0x43, 0xf6, 0xa8, 0x88, 0x5a, 0x30, 0x8d, 0x31, 0x31, 0x98, 0xa2, 0xe0, 0x37, 0x07, 0x34 }},
+        fixedKeyBytes);
+    static_assert((0x39 == ctPlain.b[0]) && (0x32 == ctPlain.b[15]), "bad cipher");
+
+    // Precomputed GHASH tables, against tables built from H at run time.
+    uint8_t ws4[OTAESGCM::OTGHASH128_Shoup4::workspaceRequired];
+    uint8_t ws8[OTAESGCM::OTGHASH128_Shoup8::workspaceRequired];
+    OTAESGCM::OTGHASH128_Shoup4 s4(ws4, sizeof(ws4)), p4(NULL, 0);
+    OTAESGCM::OTGHASH128_Shoup8 s8(ws8, sizeof(ws8)), p8(NULL, 0);
+    ASSERT_TRUE(s4.setKey(fixedKey.H));
+    ASSERT_TRUE(s8.setKey(fixedKey.H));
+    ASSERT_TRUE(p4.setTable(fixedTable4.M));
+    ASSERT_TRUE(p8.setTable(fixedTable8.M));
+    uint8_t Y[4][16];
+    for(int i = 0; i < 16; ++i) { Y[0][i] = (uint8_t)random(); }
+    memcpy(Y[1], Y[0], 16); memcpy(Y[2], Y[0], 16); memcpy(Y[3], Y[0], 16);
+    s4.update(Y[0], pt, 4);
+    p4.update(Y[1], pt, 4);
+    s8.update(Y[2], pt, 4);
+    p8.update(Y[3], pt, 4);
+    EXPECT_EQ(0, memcmp(Y[0], Y[1], 16));
+    EXPECT_EQ(0, memcmp(Y[0], Y[2], 16));
+    EXPECT_EQ(0, memcmp(Y[0], Y[3], 16));
+    s4.endSession(); s8.endSession(); p4.endSession(); p8.endSession();
+
+    // Key context from the schedule, against the one-shot functions.
+    typedef OTAESGCM::OTAES128GCMGenericWithWorkspace<> gcm_t;
+    typedef OTAESGCM::OTAES128GCMFixedKeyContext<> kc_t;
+    static uint8_t wsGCM[gcm_t::workspaceRequired];
+    uint8_t wsKC[kc_t::workspaceRequired];
+    gcm_t gcm(wsGCM, sizeof(wsGCM));
+    kc_t kc(wsKC, sizeof(wsKC));
+    ASSERT_TRUE(kc.setKey(fixedKey.roundKeys));
+    uint8_t iv[GCM_NONCE_LENGTH], aad[9], tag1[GCM_TAG_LENGTH], tag2[GCM_TAG_LENGTH], dec[64];
+    for(int j = 0; j < GCM_NONCE_LENGTH; ++j) { iv[j] = (uint8_t)random(); }
+    for(size_t j = 0; j < sizeof(aad); ++j) { aad[j] = (uint8_t)random(); }
+    ASSERT_TRUE(gcm.gcmEncryptLarge(fixedKeyBytes.b, iv, pt, 50, aad, sizeof(aad), ct1, tag1));
+    ASSERT_TRUE(gcm.gcmEncryptLarge(kc, iv, pt, 50, aad, sizeof(aad), ct2, tag2));
+    EXPECT_EQ(0, memcmp(ct1, ct2, 50));
+    EXPECT_EQ(0, memcmp(tag1, tag2, sizeof(tag1)));
+    ASSERT_TRUE(gcm.gcmDecryptLarge(kc, iv, ct2, 50, aad, sizeof(aad), tag2, dec));
+    EXPECT_EQ(0, memcmp(pt, dec, 50));
+    kc.clear();
+}
+
+// Check that the on-the-fly round key (small) AES matches the full schedule one,
+// both in sessions and as the block cipher for GCM with a smaller workspace.
+TEST(Main,AES128Small)
+{
+    static const uint8_t key[16] = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f };
+    static const uint8_t pt[16] = { 0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff };
+    static const uint8_t ct[16] = { 0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30, 0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a };
+    static_assert(16 == OTAESGCM::OTAES128E_small_t::workspaceRequired, "small workspace");
+    uint8_t wsSmall[OTAESGCM::OTAES128E_small_t::workspaceRequired];
+    uint8_t wsDef[OTAESGCM::OTAES128E_default_t::workspaceRequired];
+    OTAESGCM::OTAES128E_small_t small(wsSmall, sizeof(wsSmall));
+    OTAESGCM::OTAES128E_default_t def(wsDef, sizeof(wsDef));
+    uint8_t out[16];
+    small.blockEncrypt(pt, key, out);
+    EXPECT_EQ(0, memcmp(ct, out, 16));
+    // Insufficient workspace.
+    OTAESGCM::OTAES128E_small_t tooSmall(wsSmall, sizeof(wsSmall) - 1);
+    EXPECT_FALSE(tooSmall.setKey(key));
+
+    uint8_t k[16], in[9 * 16], expected[9 * 16], actual[9 * 16];
+    for(int i = 0; i < 16; ++i) { k[i] = (uint8_t)random(); }
+    for(size_t i = 0; i < sizeof(in); ++i) { in[i] = (uint8_t)random(); }
+    ASSERT_TRUE(small.setKey(k));
+    ASSERT_TRUE(def.setKey(k));
+    // Repeated calls check that the rolling key is restored after each block.
+    for(size_t n = 0; n <= 9; ++n)
+    {
+        memset(actual, 0, sizeof(actual));
+        def.encryptBlocks(in, expected, n);
+        small.encryptBlocks(in, actual, n);
+        EXPECT_EQ(0, memcmp(expected, actual, 16 * n)) << n;
+    }
+    // In place.
+    memcpy(actual, in, sizeof(in));
+    small.encryptBlocks(actual, actual, 9);
+    EXPECT_EQ(0, memcmp(expected, actual, sizeof(actual)));
+    small.endSession();
+    def.endSession();
+    for(size_t i = 0; i < sizeof(wsSmall); ++i) { EXPECT_EQ(0, wsSmall[i]); }
+
+    // As the block cipher for GCM: workspace totals shrink with the AES workspace.
+    typedef OTAESGCM::OTAES128GCMGenericWithWorkspace<OTAESGCM::OTAES128E_small_t> gcmSmall_t;
+    typedef OTAESGCM::OTAES128GCMGenericWithWorkspace<> gcmDef_t;
+    static_assert(gcmSmall_t::workspaceRequired + OTAESGCM::OTAES128E_default_t::workspaceRequired ==
+                  gcmDef_t::workspaceRequired + OTAESGCM::OTAES128E_small_t::workspaceRequired, "GCM workspace");
+    uint8_t wsGCMSmall[gcmSmall_t::workspaceRequired];
+    static uint8_t wsGCMDef[gcmDef_t::workspaceRequired];
+    gcmSmall_t gcmSmall(wsGCMSmall, sizeof(wsGCMSmall));
+    gcmDef_t gcmDef(wsGCMDef, sizeof(wsGCMDef));
+    uint8_t iv[GCM_NONCE_LENGTH], ctSmall[64], ctDef[64], dec[64], tagSmall[GCM_TAG_LENGTH], tagDef[GCM_TAG_LENGTH];
+    for(int i = 0; i < GCM_NONCE_LENGTH; ++i) { iv[i] = (uint8_t)random(); }
+    ASSERT_TRUE(gcmSmall.gcmEncryptPadded(k, iv, in, 64, in + 64, 19, ctSmall, tagSmall));
+    ASSERT_TRUE(gcmDef.gcmEncryptPadded(k, iv, in, 64, in + 64, 19, ctDef, tagDef));
+    EXPECT_EQ(0, memcmp(ctDef, ctSmall, sizeof(ctSmall)));
+    EXPECT_EQ(0, memcmp(tagDef, tagSmall, sizeof(tagSmall)));
+    ASSERT_TRUE(gcmSmall.gcmDecrypt(k, iv, ctSmall, 64, in + 64, 19, tagSmall, dec));
+    EXPECT_EQ(0, memcmp(in, dec, sizeof(dec)));
+}
+
+// Check that the byte-oriented engine's decryption matches the T-table engine's
+// (equivalent inverse cipher) for random keys and multi-block sessions,
+// and the one-shot interface.
+TEST(Main,AES128DecryptAVR)
+{
+    uint8_t wsAVR[OTAESGCM::OTAES128DE_AVR::workspaceRequired];
+    uint8_t wsTT[OTAESGCM::OTAES128DE_TTable::workspaceRequired];
+    OTAESGCM::OTAES128DE_AVR avr(wsAVR, sizeof(wsAVR));
+    OTAESGCM::OTAES128DE_TTable tt(wsTT, sizeof(wsTT));
+    for(int i = 0; i < 20; ++i)
+    {
+        uint8_t k[16], c[16*5], d1[sizeof(c)], d2[sizeof(c)], e[sizeof(c)];
+        for(int j = 0; j < 16; ++j) { k[j] = (uint8_t)random(); }
+        for(size_t j = 0; j < sizeof(c); ++j) { c[j] = (uint8_t)random(); }
+        ASSERT_TRUE(tt.setKey(k));
+        tt.decryptBlocks(c, d1, sizeof(c)/16);
+        tt.endSession();
+        ASSERT_TRUE(avr.setKey(k));
+        avr.decryptBlocks(c, d2, sizeof(c)/16);
+        ASSERT_EQ(0, memcmp(d1, d2, sizeof(c)));
+        // Round trip in place within the one session.
+        avr.encryptBlocks(d2, e, sizeof(c)/16);
+        ASSERT_EQ(0, memcmp(c, e, sizeof(c)));
+        avr.endSession();
+        avr.blockDecrypt(c, k, d2);
+        ASSERT_EQ(0, memcmp(d1, d2, 16));
+    }
+}
+
+// Check that key contexts keyed once can be used concurrently
+// from several threads, each with its own per-thread scratch,
+// giving the same results as the one-shot functions,
+// and that the scratch front end refuses calls taking a raw key.
+TEST(Main,GCMSharedKeyContext)
+{
+    typedef OTAESGCM::OTAES128GCMSharedKeyContext<> fastKC_t;
+    typedef OTAESGCM::OTAES128GCMSharedKeyContext<OTAESGCM::OTAES128E_AVR, OTAESGCM::OTGHASH128_Shoup4> avrKC_t;
+    typedef OTAESGCM::OTAES128GCMGenericWithWorkspace<> ref_t;
+    static uint8_t wsFastKC[fastKC_t::workspaceRequired];
+    static uint8_t wsAVRKC[avrKC_t::workspaceRequired];
+    static uint8_t wsRef[ref_t::workspaceRequired];
+    fastKC_t fastKC(wsFastKC, sizeof(wsFastKC));
+    avrKC_t avrKC(wsAVRKC, sizeof(wsAVRKC));
+    ref_t ref(wsRef, sizeof(wsRef));
+
+    constexpr int nThreads = 4;
+    constexpr int nMsgs = 16;
+    constexpr size_t maxLen = 70;
+    uint8_t key[16], iv[nMsgs][GCM_NONCE_LENGTH], aad[nMsgs][9], pt[nMsgs][maxLen];
+    uint8_t ct[nMsgs][maxLen], tag[nMsgs][GCM_TAG_LENGTH];
+    size_t len[nMsgs];
+    for(int j = 0; j < 16; ++j) { key[j] = (uint8_t)random(); }
+    for(int m = 0; m < nMsgs; ++m)
+    {
+        for(int j = 0; j < GCM_NONCE_LENGTH; ++j) { iv[m][j] = (uint8_t)random(); }
+        for(size_t j = 0; j < sizeof(aad[m]); ++j) { aad[m][j] = (uint8_t)random(); }
+        for(size_t j = 0; j < maxLen; ++j) { pt[m][j] = (uint8_t)random(); }
+        len[m] = (size_t)random() % (maxLen + 1);
+        ASSERT_TRUE(ref.gcmEncryptLarge(key, iv[m], pt[m], len[m], aad[m], sizeof(aad[m]), ct[m], tag[m]));
+    }
+
+    OTAESGCM::OTAES128GCMThreadScratch unkeyed;
+    uint8_t out[maxLen], outTag[GCM_TAG_LENGTH];
+    EXPECT_FALSE(unkeyed.gcmEncryptLarge(key, iv[0], pt[0], len[0], aad[0], sizeof(aad[0]), out, outTag));
+
+    ASSERT_TRUE(fastKC.setKey(key));
+    ASSERT_TRUE(avrKC.setKey(key));
+    OTAESGCM::OTAES128GCMKeyContext *const contexts[] = { &fastKC, &avrKC };
+    for(OTAESGCM::OTAES128GCMKeyContext *const kc : contexts)
+    {
+        std::atomic<int> failures(0);
+        std::vector<std::thread> threads;
+        for(int t = 0; t < nThreads; ++t)
+        {
+            threads.push_back(std::thread([&, t]()
+            {
+                OTAESGCM::OTAES128GCMThreadScratch gcm;
+                uint8_t c[maxLen], d[maxLen], tg[GCM_TAG_LENGTH];
+                for(int rep = 0; rep < 20; ++rep)
+                {
+                    for(int i = 0; i < nMsgs; ++i)
+                    {
+                        const int m = (i + t) % nMsgs;
+                        if(!gcm.gcmEncryptLarge(*kc, iv[m], pt[m], len[m], aad[m], sizeof(aad[m]), c, tg) ||
+                           (0 != memcmp(c, ct[m], len[m])) || (0 != memcmp(tg, tag[m], sizeof(tg))) ||
+                           !gcm.gcmDecryptLarge(*kc, iv[m], ct[m], len[m], aad[m], sizeof(aad[m]), tag[m], d) ||
+                           (0 != memcmp(d, pt[m], len[m])))
+                            { ++failures; }
+                    }
+                }
+            }));
+        }
+        for(std::thread &th : threads) { th.join(); }
+        EXPECT_EQ(0, failures.load());
+    }
+    fastKC.clear();
+    avrKC.clear();
+}
+
+
+// Check that the key cache gives the same results as the one-shot functions,
+// counts hits and misses, evicts and zeroises by CLOCK,
+// treats a re-keyed node as a miss, never evicts a pinned entry,
+// and works when hammered from several threads.
+TEST(Main,GCMKeyCache)
+{
+    typedef OTAESGCM::OTAES128GCMKeyCache<OTAESGCM::OTAES128E_fast_t, OTAESGCM::OTGHASH128_fast_t, 1, 2> tiny_t;
+    typedef OTAESGCM::OTAES128GCMKeyCache<OTAESGCM::OTAES128E_fast_t, OTAESGCM::OTGHASH128_fast_t, 2, 2> small_t;
+    typedef OTAESGCM::OTAES128GCMGenericWithWorkspace<> ref_t;
+    static uint8_t wsRef[ref_t::workspaceRequired];
+    ref_t ref(wsRef, sizeof(wsRef));
+    std::unique_ptr<tiny_t> tiny(new tiny_t);
+    std::unique_ptr<small_t> cache(new small_t);
+    EXPECT_EQ(4U, size_t(small_t::capacity));
+
+    constexpr int nKeys = 8;
+    uint8_t keys[nKeys][16], iv[GCM_NONCE_LENGTH], aad[5], pt[40], ct[nKeys][40], tag[nKeys][GCM_TAG_LENGTH];
+    for(int k = 0; k < nKeys; ++k) { for(int j = 0; j < 16; ++j) { keys[k][j] = (uint8_t)random(); } }
+    for(int j = 0; j < GCM_NONCE_LENGTH; ++j) { iv[j] = (uint8_t)random(); }
+    for(size_t j = 0; j < sizeof(aad); ++j) { aad[j] = (uint8_t)random(); }
+    for(size_t j = 0; j < sizeof(pt); ++j) { pt[j] = (uint8_t)random(); }
+    for(int k = 0; k < nKeys; ++k)
+        { ASSERT_TRUE(ref.gcmEncryptLarge(keys[k], iv, pt, sizeof(pt), aad, sizeof(aad), ct[k], tag[k])); }
+
+    // Misses then hits on one small shard; a third key evicts.
+    uint8_t c[40], d[40], tg[GCM_TAG_LENGTH];
+    EXPECT_FALSE(tiny->acquire(1, NULL));
+    for(int rep = 0; rep < 3; ++rep)
+    {
+        for(int k = 0; k < 2; ++k)
+        {
+            ASSERT_TRUE(tiny->gcmEncryptLarge(ref, (uint64_t)k, keys[k], iv, pt, sizeof(pt), aad, sizeof(aad), c, tg));
+            EXPECT_EQ(0, memcmp(c, ct[k], sizeof(c)));
+            EXPECT_EQ(0, memcmp(tg, tag[k], sizeof(tg)));
+        }
+    }
+    EXPECT_EQ(2U, tiny->stats().misses);
+    EXPECT_EQ(4U, tiny->stats().hits);
+    EXPECT_EQ(0U, tiny->stats().evictions);
+    ASSERT_TRUE(tiny->gcmDecryptLarge(ref, 2, keys[2], iv, ct[2], sizeof(pt), aad, sizeof(aad), tag[2], d));
+    EXPECT_EQ(0, memcmp(d, pt, sizeof(pt)));
+    EXPECT_EQ(1U, tiny->stats().evictions);
+    // The same tag with a new key (node re-keyed) is a miss and uses the new key.
+    ASSERT_TRUE(tiny->gcmEncryptLarge(ref, 2, keys[3], iv, pt, sizeof(pt), aad, sizeof(aad), c, tg));
+    EXPECT_EQ(0, memcmp(tg, tag[3], sizeof(tg)));
+    EXPECT_EQ(4U, tiny->stats().misses);
+    // Pinned entries are never evicted: with both ways leased, no third.
+    {
+        const tiny_t::Lease a = tiny->acquire(keys[4]);
+        const tiny_t::Lease b = tiny->acquire(keys[5]);
+        ASSERT_TRUE(a && b);
+        EXPECT_NE(a.get(), b.get());
+        EXPECT_FALSE(tiny->acquire(keys[6]));
+        // Falls back to the raw key.
+        ASSERT_TRUE(tiny->gcmEncryptLarge(ref, 99, keys[6], iv, pt, sizeof(pt), aad, sizeof(aad), c, tg));
+        EXPECT_EQ(0, memcmp(tg, tag[6], sizeof(tg)));
+        EXPECT_TRUE(a.get()->isKeyed());
+    }
+    EXPECT_TRUE(tiny->acquire(keys[6]));
+    tiny->clear();
+
+    // Several threads over more keys than entries.
+    constexpr int nThreads = 4;
+    std::atomic<int> failures(0);
+    std::vector<std::thread> threads;
+    for(int t = 0; t < nThreads; ++t)
+    {
+        threads.push_back(std::thread([&, t]()
+        {
+            OTAESGCM::OTAES128GCMThreadScratch gcm;
+            uint8_t tc[40], td[40], ttg[GCM_TAG_LENGTH];
+            for(int i = 0; i < 200; ++i)
+            {
+                const int k = (i * (t + 1)) % nKeys;
+                const small_t::Lease l = cache->acquire((uint64_t)k, keys[k]);
+                if(!l) { continue; } // All pinned: acceptable.
+                if(!gcm.gcmEncryptLarge(*l.get(), iv, pt, sizeof(pt), aad, sizeof(aad), tc, ttg) ||
+                   (0 != memcmp(tc, ct[k], sizeof(tc))) || (0 != memcmp(ttg, tag[k], sizeof(ttg))) ||
+                   !gcm.gcmDecryptLarge(*l.get(), iv, ct[k], sizeof(pt), aad, sizeof(aad), tag[k], td) ||
+                   (0 != memcmp(td, pt, sizeof(pt))))
+                    { ++failures; }
+            }
+        }));
+    }
+    for(std::thread &th : threads) { th.join(); }
+    EXPECT_EQ(0, failures.load());
+    EXPECT_EQ(uint64_t(nThreads * 200), cache->stats().hits + cache->stats().misses);
+    EXPECT_LT(0U, cache->stats().hits);
+}
+
+
+// Callback for GCMThreadPool: counts completions and failures.
+static void countCompletion(OTAESGCM::OTAES128GCMJob *job, bool ok)
+{
+    std::atomic<int> *const counts = static_cast<std::atomic<int> *>(job->user);
+    if(!ok) { ++counts[1]; }
+    ++counts[0];
+}
+
+// Check that jobs submitted to the thread pool from several threads,
+// mixing key contexts, raw keys, directions and bad tags,
+// complete once each with the same results as the one-shot functions,
+// through both callbacks and futures, even when the queue fills.
+TEST(Main,GCMThreadPool)
+{
+    typedef OTAESGCM::OTAES128GCMSharedKeyContext<> kc_t;
+    typedef OTAESGCM::OTAES128GCMGenericWithWorkspace<> ref_t;
+    static uint8_t wsKC[2][kc_t::workspaceRequired];
+    static uint8_t wsRef[ref_t::workspaceRequired];
+    kc_t kc0(wsKC[0], sizeof(wsKC[0])), kc1(wsKC[1], sizeof(wsKC[1]));
+    ref_t ref(wsRef, sizeof(wsRef));
+
+    constexpr int nJobs = 300;
+    constexpr size_t maxLen = 100;
+    static uint8_t keys[3][16], iv[nJobs][GCM_NONCE_LENGTH], aad[nJobs][4], pt[nJobs][maxLen];
+    static uint8_t ct[nJobs][maxLen], tag[nJobs][GCM_TAG_LENGTH], out[nJobs][maxLen], outTag[nJobs][GCM_TAG_LENGTH];
+    size_t len[nJobs];
+    for(int k = 0; k < 3; ++k) { for(int j = 0; j < 16; ++j) { keys[k][j] = (uint8_t)random(); } }
+    ASSERT_TRUE(kc0.setKey(keys[0]));
+    ASSERT_TRUE(kc1.setKey(keys[1]));
+    OTAESGCM::OTAES128GCMKeyContext *const kcs[] = { &kc0, &kc1, NULL };
+    static OTAESGCM::OTAES128GCMJob jobs[nJobs];
+    std::atomic<int> counts[2];
+    counts[0] = 0; counts[1] = 0;
+    int expectedFailures = 0;
+    for(int i = 0; i < nJobs; ++i)
+    {
+        const int k = i % 3;
+        for(int j = 0; j < GCM_NONCE_LENGTH; ++j) { iv[i][j] = (uint8_t)random(); }
+        for(size_t j = 0; j < sizeof(aad[i]); ++j) { aad[i][j] = (uint8_t)random(); }
+        for(size_t j = 0; j < maxLen; ++j) { pt[i][j] = (uint8_t)random(); }
+        len[i] = (size_t)random() % (maxLen + 1);
+        ASSERT_TRUE(ref.gcmEncryptLarge(keys[k], iv[i], pt[i], len[i], aad[i], sizeof(aad[i]), ct[i], tag[i]));
+        OTAESGCM::OTAES128GCMJob &job = jobs[i];
+        job = OTAESGCM::OTAES128GCMJob();
+        job.decrypt = (0 != (i & 4));
+        job.frame.kc = kcs[k];
+        job.frame.key = keys[k];
+        job.frame.IV = iv[i];
+        job.frame.ADATA = aad[i];
+        job.frame.ADATALength = sizeof(aad[i]);
+        job.frame.input = job.decrypt ? ct[i] : pt[i];
+        job.frame.length = len[i];
+        job.frame.output = out[i];
+        memcpy(outTag[i], tag[i], GCM_TAG_LENGTH);
+        if(job.decrypt && (0 == (i % 7))) { outTag[i][5] ^= 0x10; ++expectedFailures; }
+        job.frame.tag = outTag[i];
+        job.done = countCompletion;
+        job.user = counts;
+    }
+
+    {
+        OTAESGCM::OTAES128GCMThreadPool pool(3, 16, false);
+        EXPECT_EQ(3U, pool.workers());
+        EXPECT_FALSE(pool.submit(NULL));
+        // A key context that is not read-only when keyed is rejected.
+        typedef OTAESGCM::OTAES128GCMKeyContextWithWorkspace<> smallKC_t;
+        static uint8_t wsSmallKC[smallKC_t::workspaceRequired];
+        smallKC_t smallKC(wsSmallKC, sizeof(wsSmallKC));
+        ASSERT_TRUE(smallKC.setKey(keys[2]));
+        OTAESGCM::OTAES128GCMJob rejected = jobs[0];
+        rejected.frame.kc = &smallKC;
+        EXPECT_FALSE(pool.submit(&rejected));
+        smallKC.clear();
+        // Submit from two threads, retrying while the small queue is full.
+        std::vector<std::thread> submitters;
+        for(int t = 0; t < 2; ++t)
+        {
+            submitters.push_back(std::thread([&, t]()
+            {
+                for(int i = t; i < nJobs; i += 2)
+                    { while(!pool.submit(&jobs[i])) { std::this_thread::yield(); } }
+            }));
+        }
+        for(std::thread &th : submitters) { th.join(); }
+        // A job with a future.
+        OTAESGCM::OTAES128GCMFutureJob fj;
+        uint8_t fOut[maxLen], fTag[GCM_TAG_LENGTH];
+        fj.frame = jobs[1].frame;
+        fj.decrypt = false;
+        fj.frame.input = pt[1];
+        fj.frame.output = fOut;
+        fj.frame.tag = fTag;
+        std::future<bool> f = fj.future();
+        ASSERT_TRUE(pool.submit(&fj));
+        EXPECT_TRUE(f.get());
+        EXPECT_EQ(0, memcmp(fOut, ct[1], len[1]));
+        EXPECT_EQ(0, memcmp(fTag, tag[1], GCM_TAG_LENGTH));
+        // Destruction waits for all jobs.
+    }
+    EXPECT_EQ(nJobs, counts[0].load());
+    EXPECT_EQ(expectedFailures, counts[1].load());
+    for(int i = 0; i < nJobs; ++i)
+    {
+        if(jobs[i].decrypt)
+        {
+            if(0 != (i % 7)) { EXPECT_EQ(0, memcmp(out[i], pt[i], len[i])) << i; }
+        }
+        else
+        {
+            EXPECT_EQ(0, memcmp(out[i], ct[i], len[i])) << i;
+            EXPECT_EQ(0, memcmp(outTag[i], tag[i], GCM_TAG_LENGTH)) << i;
+        }
+    }
+    kc0.clear();
+    kc1.clear();
+}
+
+
+#if defined(__cpp_impl_coroutine) && (__cpp_impl_coroutine >= 201902L)
+// Minimal eagerly-started coroutine type for GCMAsync.
+struct AsyncTestTask
+{
+    struct promise_type
+    {
+        AsyncTestTask get_return_object() { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() { }
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+// Event loop queue of coroutines ready to resume, for GCMAsync.
+struct AsyncTestLoop
+{
+    std::mutex lock;
+    std::deque<std::coroutine_handle<>> ready;
+    static void post(std::coroutine_handle<> h, void *ctx)
+    {
+        AsyncTestLoop *const loop = static_cast<AsyncTestLoop *>(ctx);
+        std::lock_guard<std::mutex> lk(loop->lock);
+        loop->ready.push_back(h);
+    }
+};
+// Encrypt then decrypt len bytes of pt, setting done to 1 on success, else -1.
+// Uses kc if not NULL, else key.
+static AsyncTestTask asyncRoundTrip(OTAESGCM::OTAES128GCMAsync &async, const uint8_t *key,
+                                    const uint8_t *iv, const uint8_t *pt, size_t len,
+                                    uint8_t *ct, uint8_t *dec, uint8_t *tag, int &done,
+                                    OTAESGCM::OTAES128GCMKeyContext *kc = NULL)
+{
+    OTAESGCM::OTAES128GCMFrameDescriptor f = { kc, key, iv, NULL, 0, pt, len, ct, tag };
+    const bool encOK = co_await async.asyncEncrypt(f);
+    f.input = ct;
+    f.output = dec;
+    const bool decOK = co_await async.asyncDecrypt(f);
+    done = (encOK && decOK) ? 1 : -1;
+}
+
+// Check that co_await-ed small frames complete inline without suspending,
+// and large ones are offloaded and resumed through the post function,
+// with the same results as the one-shot functions,
+// and that large frames with a non-shareable key context are done inline.
+TEST(Main,GCMAsync)
+{
+    typedef OTAESGCM::OTAES128GCMGenericWithWorkspace<> gcm_t;
+    static uint8_t wsGCM[gcm_t::workspaceRequired];
+    gcm_t gcm(wsGCM, sizeof(wsGCM));
+    OTAESGCM::OTAES128GCMThreadPool pool(2, 16, false);
+    AsyncTestLoop loop;
+    OTAESGCM::OTAES128GCMAsync async(pool, gcm, AsyncTestLoop::post, &loop, 64);
+
+    constexpr size_t bigLen = 5000;
+    static uint8_t key[16], iv[GCM_NONCE_LENGTH], pt[bigLen], ct[bigLen], ctRef[bigLen], dec[bigLen];
+    uint8_t tag[GCM_TAG_LENGTH], tagRef[GCM_TAG_LENGTH];
+    for(int j = 0; j < 16; ++j) { key[j] = (uint8_t)random(); }
+    for(int j = 0; j < GCM_NONCE_LENGTH; ++j) { iv[j] = (uint8_t)random(); }
+    for(size_t j = 0; j < bigLen; ++j) { pt[j] = (uint8_t)random(); }
+
+    const size_t lens[] = { 0, 40, 64, 65, bigLen };
+    for(const size_t len : lens)
+    {
+        ASSERT_TRUE(gcm.gcmEncryptLarge(key, iv, pt, len, NULL, 0, ctRef, tagRef));
+        int done = 0;
+        asyncRoundTrip(async, key, iv, pt, len, ct, dec, tag, done);
+        if(len <= 64) { EXPECT_EQ(1, done) << len; } // Inline.
+        // Run the loop until the coroutine finishes.
+        for(int spins = 0; (0 == done) && (spins < 100000); ++spins)
+        {
+            std::coroutine_handle<> h;
+            {
+                std::lock_guard<std::mutex> lk(loop.lock);
+                if(!loop.ready.empty()) { h = loop.ready.front(); loop.ready.pop_front(); }
+            }
+            if(h) { h.resume(); } else { std::this_thread::sleep_for(std::chrono::microseconds(50)); }
+        }
+        EXPECT_EQ(1, done) << len;
+        EXPECT_EQ(0, memcmp(ct, ctRef, len)) << len;
+        EXPECT_EQ(0, memcmp(tag, tagRef, sizeof(tag))) << len;
+        EXPECT_EQ(0, memcmp(dec, pt, len)) << len;
+    }
+
+    // A key context not read-only when keyed must stay on this thread.
+    typedef OTAESGCM::OTAES128GCMKeyContextWithWorkspace<OTAESGCM::OTAES128E_small_t, OTAESGCM::OTGHASH128_fast_t> smallKC_t;
+    static uint8_t wsSmallKC[smallKC_t::workspaceRequired];
+    smallKC_t smallKC(wsSmallKC, sizeof(wsSmallKC));
+    ASSERT_FALSE(smallKC.isReadOnlyWhenKeyed());
+    ASSERT_TRUE(smallKC.setKey(key));
+    ASSERT_TRUE(gcm.gcmEncryptLarge(key, iv, pt, bigLen, NULL, 0, ctRef, tagRef));
+    int done = 0;
+    asyncRoundTrip(async, key, iv, pt, bigLen, ct, dec, tag, done, &smallKC);
+    EXPECT_EQ(1, done); // Inline.
+    {
+        std::lock_guard<std::mutex> lk(loop.lock);
+        EXPECT_TRUE(loop.ready.empty());
+    }
+    EXPECT_EQ(0, memcmp(ct, ctRef, bigLen));
+    EXPECT_EQ(0, memcmp(tag, tagRef, sizeof(tag)));
+    EXPECT_EQ(0, memcmp(dec, pt, bigLen));
+    smallKC.clear();
+
+    // Without a post function nothing is offloaded,
+    // so the coroutine is never resumed on a worker.
+    OTAESGCM::OTAES128GCMAsync noPost(pool, gcm, NULL, NULL, 64);
+    done = 0;
+    asyncRoundTrip(noPost, key, iv, pt, bigLen, ct, dec, tag, done);
+    EXPECT_EQ(1, done); // Inline.
+    EXPECT_EQ(0, memcmp(ct, ctRef, bigLen));
+    EXPECT_EQ(0, memcmp(tag, tagRef, sizeof(tag)));
+    EXPECT_EQ(0, memcmp(dec, pt, bigLen));
+}
+#endif
+
+
+// Check that GCM split across threads gives output and tags identical
+// to the serial functions, over lengths giving one to several chunks
+// with and without a partial final block, and that bad tags are rejected.
+TEST(Main,GCMLargeParallel)
+{
+    typedef OTAESGCM::OTAES128GCMSharedKeyContext<> kc_t;
+    typedef OTAESGCM::OTAES128GCMThreadScratch gcm_t;
+    static uint8_t wsKC[kc_t::workspaceRequired];
+    kc_t kc(wsKC, sizeof(wsKC));
+    gcm_t gcm;
+
+    constexpr size_t chunk = OTAESGCM::OTAES128GCMGenericBase::ParallelMinChunkBytes;
+    constexpr size_t maxLen = 3 * chunk + 37;
+    std::vector<uint8_t> pt(maxLen), ct1(maxLen), ct2(maxLen), dec(maxLen);
+    uint8_t key[16], iv[GCM_NONCE_LENGTH], aad[21], tag1[GCM_TAG_LENGTH], tag2[GCM_TAG_LENGTH];
+    for(int j = 0; j < 16; ++j) { key[j] = (uint8_t)random(); }
+    for(int j = 0; j < GCM_NONCE_LENGTH; ++j) { iv[j] = (uint8_t)random(); }
+    for(size_t j = 0; j < sizeof(aad); ++j) { aad[j] = (uint8_t)random(); }
+    for(size_t j = 0; j < maxLen; ++j) { pt[j] = (uint8_t)random(); }
+    ASSERT_TRUE(kc.setKey(key));
+
+    const size_t lens[] = { 100, 2 * chunk, 2 * chunk + 5, maxLen };
+    const unsigned threads[] = { 0, 2, 3, 4 };
+    for(const size_t len : lens)
+    {
+        for(const unsigned nThreads : threads)
+        {
+            ASSERT_TRUE(gcm.gcmEncryptLarge(kc, iv, pt.data(), len, aad, sizeof(aad), ct1.data(), tag1));
+            ASSERT_TRUE(gcm.gcmEncryptLargeParallel(kc, iv, pt.data(), len, aad, sizeof(aad), ct2.data(), tag2, nThreads));
+            EXPECT_EQ(0, memcmp(ct1.data(), ct2.data(), len)) << len << " " << nThreads;
+            EXPECT_EQ(0, memcmp(tag1, tag2, sizeof(tag1))) << len << " " << nThreads;
+            EXPECT_TRUE(gcm.gcmDecryptLargeParallel(kc, iv, ct2.data(), len, aad, sizeof(aad), tag2, dec.data(), nThreads));
+            EXPECT_EQ(0, memcmp(pt.data(), dec.data(), len)) << len << " " << nThreads;
+            tag2[3] ^= 0x40;
+            EXPECT_FALSE(gcm.gcmDecryptLargeParallel(kc, iv, ct2.data(), len, aad, sizeof(aad), tag2, dec.data(), nThreads));
+        }
+    }
+    EXPECT_FALSE(gcm.gcmEncryptLargeParallel(kc, NULL, pt.data(), 10, aad, sizeof(aad), ct2.data(), tag2));
+    EXPECT_TRUE(kc.isReadOnlyWhenKeyed());
+    kc.clear();
+    EXPECT_FALSE(gcm.gcmEncryptLargeParallel(kc, iv, pt.data(), 10, aad, sizeof(aad), ct2.data(), tag2));
+
+    // A context that is not read-only when keyed (rolling round key AES) runs serially, with the same results.
+    typedef OTAESGCM::OTAES128GCMKeyContextWithWorkspace<OTAESGCM::OTAES128E_small_t, OTAESGCM::OTGHASH128_fast_t> smallKC_t;
+    static uint8_t wsSmallKC[smallKC_t::workspaceRequired];
+    smallKC_t smallKC(wsSmallKC, sizeof(wsSmallKC));
+    EXPECT_FALSE(smallKC.isReadOnlyWhenKeyed());
+    ASSERT_TRUE(smallKC.setKey(key));
+    const size_t len = 2 * chunk + 5;
+    ASSERT_TRUE(gcm.gcmEncryptLarge(smallKC, iv, pt.data(), len, aad, sizeof(aad), ct1.data(), tag1));
+    ASSERT_TRUE(gcm.gcmEncryptLargeParallel(smallKC, iv, pt.data(), len, aad, sizeof(aad), ct2.data(), tag2, 3));
+    EXPECT_EQ(0, memcmp(ct1.data(), ct2.data(), len));
+    EXPECT_EQ(0, memcmp(tag1, tag2, sizeof(tag1)));
+    EXPECT_TRUE(gcm.gcmDecryptLargeParallel(smallKC, iv, ct2.data(), len, aad, sizeof(aad), tag2, dec.data(), 3));
+    EXPECT_EQ(0, memcmp(pt.data(), dec.data(), len));
+    tag2[3] ^= 0x40;
+    EXPECT_FALSE(gcm.gcmDecryptLargeParallel(smallKC, iv, ct2.data(), len, aad, sizeof(aad), tag2, dec.data(), 3));
+    smallKC.clear();
+}
+
+
+// Check that batches of small frames each with its own key context
+// (multi-buffer AES-NI where available), mixed with frames using raw keys
+// and key contexts without AES-NI, match per-frame calls,
+// and that the multi-key AES-NI primitive matches single-key calls.
+TEST(Main,GCMMultiKeyBatch)
+{
+    typedef OTAESGCM::OTAES128GCMKeyContextWithWorkspace<OTAESGCM::OTAES128E_fast_t, OTAESGCM::OTGHASH128_fast_t> fastKC_t;
+    typedef OTAESGCM::OTAES128GCMKeyContextWithWorkspace<OTAESGCM::OTAES128E_TTable, OTAESGCM::OTGHASH128_fast_t> ttKC_t;
+    typedef OTAESGCM::OTAES128GCMGenericWithWorkspace<OTAESGCM::OTAES128E_fast_t, OTAESGCM::OTGHASH128_fast_t> gcm_t;
+    constexpr int nFrames = 20;
+    static uint8_t wsFast[nFrames][fastKC_t::workspaceRequired];
+    static uint8_t wsTT[ttKC_t::workspaceRequired];
+    static uint8_t wsGCM[gcm_t::workspaceRequired];
+    gcm_t gcm(wsGCM, sizeof(wsGCM));
+    ttKC_t ttKC(wsTT, sizeof(wsTT));
+    std::vector<std::unique_ptr<fastKC_t>> fastKCs;
+
+    uint8_t keys[nFrames][16], iv[nFrames][GCM_NONCE_LENGTH], aad[nFrames][3], pt[nFrames][40];
+    uint8_t ct[nFrames][40], tag[nFrames][GCM_TAG_LENGTH], out[nFrames][40], outTag[nFrames][GCM_TAG_LENGTH];
+    OTAESGCM::OTAES128GCMFrameDescriptor frames[nFrames];
+    for(int i = 0; i < nFrames; ++i)
+    {
+        for(int j = 0; j < 16; ++j) { keys[i][j] = (uint8_t)random(); }
+        for(int j = 0; j < GCM_NONCE_LENGTH; ++j) { iv[i][j] = (uint8_t)random(); }
+        for(size_t j = 0; j < sizeof(aad[i]); ++j) { aad[i][j] = (uint8_t)random(); }
+        for(size_t j = 0; j < sizeof(pt[i]); ++j) { pt[i][j] = (uint8_t)random(); }
+        const size_t len = (size_t)random() % (sizeof(pt[i]) + 1);
+        ASSERT_TRUE(gcm.gcmEncryptLarge(keys[i], iv[i], pt[i], len, aad[i], sizeof(aad[i]), ct[i], tag[i]));
+        fastKCs.push_back(std::unique_ptr<fastKC_t>(new fastKC_t(wsFast[i], sizeof(wsFast[i]))));
+        OTAESGCM::OTAES128GCMKeyContext *kc = fastKCs.back().get();
+        if(3 == (i % 5)) { kc = &ttKC; }
+        if(4 == (i % 5)) { kc = NULL; }
+        if(NULL != kc) { ASSERT_TRUE(kc->setKey(keys[i])); }
+        frames[i] = { kc, keys[i], iv[i], aad[i], sizeof(aad[i]), pt[i], len, out[i], outTag[i] };
+        // The one non-AES-NI context is re-keyed per frame, so run it alone.
+        if(&ttKC == kc)
+        {
+            uint8_t bits[1];
+            EXPECT_EQ(1U, gcm.gcmEncryptBatch(frames + i, 1, bits));
+            frames[i].kc = NULL;
+        }
+    }
+    uint8_t bits[(nFrames + 7) / 8];
+    EXPECT_EQ(size_t(nFrames), gcm.gcmEncryptBatch(frames, nFrames, bits));
+    for(int i = 0; i < nFrames; ++i)
+    {
+        EXPECT_EQ(0, memcmp(out[i], ct[i], frames[i].length)) << i;
+        EXPECT_EQ(0, memcmp(outTag[i], tag[i], GCM_TAG_LENGTH)) << i;
+        frames[i].input = ct[i];
+        if(0 == (i % 7)) { outTag[i][0] ^= 1; }
+    }
+    EXPECT_EQ(size_t(nFrames - 3), gcm.gcmDecryptBatch(frames, nFrames, bits));
+    for(int i = 0; i < nFrames; ++i)
+    {
+        EXPECT_EQ(0 != (i % 7), 0 != (bits[i >> 3] & (1 << (i & 7)))) << i;
+        // Failed frames are left with their cipher text.
+        EXPECT_EQ(0, memcmp(out[i], (0 != (i % 7)) ? pt[i] : ct[i], frames[i].length)) << i;
+    }
+    for(std::unique_ptr<fastKC_t> &kc : fastKCs) { kc->clear(); }
+    ttKC.clear();
+
+#if defined(OTAESGCM_X86_INTRINSICS)
+    if(OTAESGCM::cpuHasAESNI())
+    {
+        constexpr size_t nBlocks = 11;
+        uint8_t rk[nBlocks][176], in[nBlocks * 16], multi[nBlocks * 16], single[16];
+        const uint8_t *rks[nBlocks];
+        for(size_t b = 0; b < nBlocks; ++b)
+        {
+            OTAESGCM::OTAES128E_AESNI::expandKey(keys[b], rk[b]);
+            rks[b] = rk[b];
+        }
+        for(size_t j = 0; j < sizeof(in); ++j) { in[j] = (uint8_t)random(); }
+        OTAESGCM::OTAES128E_AESNI::encryptBlocksMultiKey(rks, in, multi, nBlocks);
+        for(size_t b = 0; b < nBlocks; ++b)
+        {
+            OTAESGCM::OTAES128E_AESNI::encryptBlocks(rk[b], in + 16 * b, single, 1);
+            EXPECT_EQ(0, memcmp(single, multi + 16 * b, 16)) << b;
+        }
+    }
+#endif
+}
+
+
+// Round-trip random frames through a fixed-frame codec,
+// checking against the general large-message path,
+// that bad tags leave the output untouched, and that bad arguments fail.
+template<class codec_t, size_t TextBytes, size_t MaxAADBytes>
+static void fixedFrameCodecCheck()
+{
+    static uint8_t ws[codec_t::workspaceRequired];
+    static uint8_t wsRef[OTAESGCM::OTAES128GCMGenericWithWorkspace<>::workspaceRequired];
+    codec_t codec(ws, sizeof(ws));
+    OTAESGCM::OTAES128GCMGenericWithWorkspace<> ref(wsRef, sizeof(wsRef));
+    for(int r = 0; r < 20; ++r)
+    {
+        uint8_t key[16], iv[GCM_NONCE_LENGTH], aad[MaxAADBytes + 1], pt[TextBytes];
+        for(size_t j = 0; j < sizeof(key); ++j) { key[j] = (uint8_t)random(); }
+        for(size_t j = 0; j < sizeof(iv); ++j) { iv[j] = (uint8_t)random(); }
+        for(size_t j = 0; j < sizeof(aad); ++j) { aad[j] = (uint8_t)random(); }
+        for(size_t j = 0; j < sizeof(pt); ++j) { pt[j] = (uint8_t)random(); }
+        const uint8_t aadLen = (uint8_t)(random() % (MaxAADBytes + 1));
+        uint8_t ct[TextBytes], tag[GCM_TAG_LENGTH], ctRef[TextBytes], tagRef[GCM_TAG_LENGTH], out[TextBytes];
+        ASSERT_TRUE(codec.encrypt(key, iv, aad, aadLen, pt, ct, tag));
+        ASSERT_TRUE(ref.gcmEncryptLarge(key, iv, pt, TextBytes, aad, aadLen, ctRef, tagRef));
+        EXPECT_EQ(0, memcmp(ct, ctRef, TextBytes));
+        EXPECT_EQ(0, memcmp(tag, tagRef, GCM_TAG_LENGTH));
+        EXPECT_TRUE(codec.decrypt(key, iv, aad, aadLen, ct, tag, out));
+        EXPECT_EQ(0, memcmp(out, pt, TextBytes));
+        // Corrupt the tag or cipher text: fails, output untouched.
+        memset(out, 0xa5, sizeof(out));
+        tag[r % GCM_TAG_LENGTH] ^= 0x10;
+        EXPECT_FALSE(codec.decrypt(key, iv, aad, aadLen, ct, tag, out));
+        tag[r % GCM_TAG_LENGTH] ^= 0x10;
+        ct[r % TextBytes] ^= 1;
+        EXPECT_FALSE(codec.decrypt(key, iv, aad, aadLen, ct, tag, out));
+        for(size_t j = 0; j < sizeof(out); ++j) { EXPECT_EQ(0xa5, out[j]); }
+    }
+    uint8_t key[16] = { }, iv[GCM_NONCE_LENGTH] = { }, aad[MaxAADBytes + 1] = { }, pt[TextBytes] = { };
+    uint8_t ct[TextBytes], tag[GCM_TAG_LENGTH];
+    if(MaxAADBytes < 255) { EXPECT_FALSE(codec.encrypt(key, iv, aad, uint8_t(MaxAADBytes + 1), pt, ct, tag)); }
+    EXPECT_FALSE(codec.encrypt(key, iv, NULL, 1, pt, ct, tag));
+    EXPECT_FALSE(codec.encrypt(key, NULL, aad, 0, pt, ct, tag));
+    codec_t small(ws, sizeof(ws) - 1);
+    EXPECT_FALSE(small.encrypt(key, iv, aad, 0, pt, ct, tag));
+}
+
+// Check the fixed-frame codecs for the common body sizes,
+// including against the 32-byte bridge function.
+TEST(Main,GCMFixedFrameCodec)
+{
+    fixedFrameCodecCheck<OTAESGCM::OTAES128GCMFixedFrameCodec16<>, 16, 32>();
+    fixedFrameCodecCheck<OTAESGCM::OTAES128GCMFixedFrameCodec32<>, 32, 32>();
+    fixedFrameCodecCheck<OTAESGCM::OTAES128GCMFixedFrameCodec48<>, 48, 32>();
+    fixedFrameCodecCheck<OTAESGCM::OTAES128GCMFixedFrameCodec64<>, 64, 32>();
+    fixedFrameCodecCheck<OTAESGCM::OTAES128GCMFixedFrameCodec32<0>, 32, 0>();
+    fixedFrameCodecCheck<OTAESGCM::OTAES128GCMFixedFrameCodec<240, 255, OTAESGCM::OTAES128E_fast_t, OTAESGCM::OTGHASH128_fast_t>, 240, 255>();
+    // Longest allowed text.
+    fixedFrameCodecCheck<OTAESGCM::OTAES128GCMFixedFrameCodec<254 * 16, 32, OTAESGCM::OTAES128E_fast_t, OTAESGCM::OTGHASH128_fast_t>, 254 * 16, 32>();
+
+    static uint8_t ws[OTAESGCM::OTAES128GCMFixedFrameCodec32<>::workspaceRequired];
+    static uint8_t wsBridge[OTAESGCM::OTAES128GCMGenericWithWorkspace<>::workspaceRequired];
+    OTAESGCM::OTAES128GCMFixedFrameCodec32<> codec(ws, sizeof(ws));
+    uint8_t key[16], iv[GCM_NONCE_LENGTH], aad[8], pt[32];
+    for(size_t j = 0; j < sizeof(key); ++j) { key[j] = (uint8_t)random(); }
+    for(size_t j = 0; j < sizeof(iv); ++j) { iv[j] = (uint8_t)random(); }
+    for(size_t j = 0; j < sizeof(aad); ++j) { aad[j] = (uint8_t)random(); }
+    for(size_t j = 0; j < sizeof(pt); ++j) { pt[j] = (uint8_t)random(); }
+    uint8_t ct[32], tag[GCM_TAG_LENGTH], ctBridge[32], tagBridge[GCM_TAG_LENGTH];
+    ASSERT_TRUE(codec.encrypt(key, iv, aad, sizeof(aad), pt, ct, tag));
+    ASSERT_TRUE(OTAESGCM::fixed32BTextSize12BNonce16BTagSimpleEnc_DEFAULT_WITH_LWORKSPACE(
+        wsBridge, sizeof(wsBridge), key, iv, aad, sizeof(aad), pt, ctBridge, tagBridge));
+    EXPECT_EQ(0, memcmp(ct, ctBridge, sizeof(ct)));
+    EXPECT_EQ(0, memcmp(tag, tagBridge, sizeof(tag)));
+}
+
+
+// T-table engine counting the blocks enciphered through encryptBlocks().
+class CountingAES : public OTAESGCM::OTAES128E_TTable
+    {
+    public:
+        static size_t blocks;
+        CountingAES(uint8_t *const workspace, const size_t workspaceLen) : OTAES128E_TTable(workspace, workspaceLen) { }
+        virtual void encryptBlocks(const uint8_t *input, uint8_t *output, size_t nBlocks) override
+            { blocks += nBlocks; OTAES128E_TTable::encryptBlocks(input, output, nBlocks); }
+    };
+size_t CountingAES::blocks;
+
+// Check verify-before-decrypt mode: good messages decrypt as before,
+// and forged or corrupted ones fail leaving the output untouched,
+// through the one-shot, key context, parallel and batch entry points,
+// that batch waves make no key stream for forged frames,
+// and that streaming decryption is refused.
+TEST(Main,GCMVerifyBeforeDecrypt)
+{
+    typedef OTAESGCM::OTAES128GCMGenericWithWorkspace<OTAESGCM::OTAES128E_fast_t, OTAESGCM::OTGHASH128_fast_t> gcm_t;
+    typedef OTAESGCM::OTAES128GCMKeyContextWithWorkspace<OTAESGCM::OTAES128E_fast_t, OTAESGCM::OTGHASH128_fast_t> kc_t;
+    static uint8_t ws[gcm_t::workspaceRequired];
+    static uint8_t wsSmall[OTAESGCM::OTAES128GCMGenericWithWorkspace<>::workspaceRequired];
+    static uint8_t wsKC[kc_t::workspaceRequired];
+    gcm_t gcm(ws, sizeof(ws));
+    OTAESGCM::OTAES128GCMGenericWithWorkspace<> gcmSmall(wsSmall, sizeof(wsSmall));
+    kc_t kc(wsKC, sizeof(wsKC));
+    EXPECT_FALSE(gcm.isVerifyBeforeDecrypt());
+    gcm.setVerifyBeforeDecrypt(true);
+    gcmSmall.setVerifyBeforeDecrypt(true);
+    EXPECT_TRUE(gcm.isVerifyBeforeDecrypt());
+
+    uint8_t key[16], iv[GCM_NONCE_LENGTH], aad[5];
+    for(size_t j = 0; j < sizeof(key); ++j) { key[j] = (uint8_t)random(); }
+    for(size_t j = 0; j < sizeof(iv); ++j) { iv[j] = (uint8_t)random(); }
+    for(size_t j = 0; j < sizeof(aad); ++j) { aad[j] = (uint8_t)random(); }
+    ASSERT_TRUE(kc.setKey(key));
+    const size_t lengths[] = { 0, 1, 15, 16, 33, 64, 300, 1000 };
+    for(const size_t len : lengths)
+    {
+        std::vector<uint8_t> pt(len + 1), ct(len + 1), out(len + 1);
+        for(size_t j = 0; j < len; ++j) { pt[j] = (uint8_t)random(); }
+        uint8_t tag[GCM_TAG_LENGTH];
+        ASSERT_TRUE(gcm.gcmEncryptLarge(key, iv, pt.data(), len, aad, sizeof(aad), ct.data(), tag));
+        EXPECT_TRUE(gcm.gcmDecryptLarge(key, iv, ct.data(), len, aad, sizeof(aad), tag, out.data()));
+        EXPECT_EQ(0, memcmp(out.data(), pt.data(), len)) << len;
+        std::fill(out.begin(), out.end(), 0);
+        EXPECT_TRUE(gcmSmall.gcmDecryptLarge(key, iv, ct.data(), len, aad, sizeof(aad), tag, out.data()));
+        EXPECT_EQ(0, memcmp(out.data(), pt.data(), len)) << len;
+        std::fill(out.begin(), out.end(), 0);
+        EXPECT_TRUE(gcm.gcmDecryptLarge(kc, iv, ct.data(), len, aad, sizeof(aad), tag, out.data()));
+        EXPECT_EQ(0, memcmp(out.data(), pt.data(), len)) << len;
+        std::fill(out.begin(), out.end(), 0);
+        EXPECT_TRUE(gcm.gcmDecryptLargeParallel(kc, iv, ct.data(), len, aad, sizeof(aad), tag, out.data(), 2));
+        EXPECT_EQ(0, memcmp(out.data(), pt.data(), len)) << len;
+
+        // Forged tag, then corrupted cipher text: output untouched.
+        std::fill(out.begin(), out.end(), 0xa5);
+        tag[len % GCM_TAG_LENGTH] ^= 0x40;
+        EXPECT_FALSE(gcm.gcmDecryptLarge(key, iv, ct.data(), len, aad, sizeof(aad), tag, out.data()));
+        EXPECT_FALSE(gcm.gcmDecryptLarge(kc, iv, ct.data(), len, aad, sizeof(aad), tag, out.data()));
+        EXPECT_FALSE(gcm.gcmDecryptLargeParallel(kc, iv, ct.data(), len, aad, sizeof(aad), tag, out.data(), 2));
+        EXPECT_FALSE(gcmSmall.gcmDecryptLarge(key, iv, ct.data(), len, aad, sizeof(aad), tag, out.data()));
+        tag[len % GCM_TAG_LENGTH] ^= 0x40;
+        if(0 != len)
+        {
+            ct[len / 2] ^= 0x01;
+            EXPECT_FALSE(gcm.gcmDecryptLarge(key, iv, ct.data(), len, aad, sizeof(aad), tag, out.data()));
+            EXPECT_FALSE(gcm.gcmDecryptLarge(kc, iv, ct.data(), len, aad, sizeof(aad), tag, out.data()));
+        }
+        for(size_t j = 0; j <= len; ++j) { EXPECT_EQ(0xa5, out[j]) << len; }
+    }
+
+    // Padded 8-bit API and batches (waves and single-frame path) also leave failed output untouched.
+    uint8_t pt[32], ct[32], tag[GCM_TAG_LENGTH], out[32];
+    for(size_t j = 0; j < sizeof(pt); ++j) { pt[j] = (uint8_t)random(); }
+    ASSERT_TRUE(gcm.gcmEncryptPadded(key, iv, pt, sizeof(pt), aad, sizeof(aad), ct, tag));
+    EXPECT_TRUE(gcm.gcmDecrypt(kc, iv, ct, sizeof(ct), aad, sizeof(aad), tag, out));
+    EXPECT_EQ(0, memcmp(out, pt, sizeof(pt)));
+    memset(out, 0xa5, sizeof(out));
+    ct[0] ^= 0x80;
+    EXPECT_FALSE(gcm.gcmDecrypt(key, iv, ct, sizeof(ct), aad, sizeof(aad), tag, out));
+    for(size_t j = 0; j < sizeof(out); ++j) { EXPECT_EQ(0xa5, out[j]); }
+    ct[0] ^= 0x80;
+
+    std::vector<uint8_t> bigPt(1000), bigCt(1000), bigOut(1000, 0xa5);
+    uint8_t bigTag[GCM_TAG_LENGTH];
+    ASSERT_TRUE(gcm.gcmEncryptLarge(kc, iv, bigPt.data(), bigPt.size(), NULL, 0, bigCt.data(), bigTag));
+    bigTag[3] ^= 1;
+    uint8_t outs[3][32];
+    memset(outs, 0xa5, sizeof(outs));
+    uint8_t badTag[GCM_TAG_LENGTH];
+    memcpy(badTag, tag, sizeof(tag));
+    badTag[0] ^= 1;
+    const OTAESGCM::OTAES128GCMFrameDescriptor frames[] = {
+        { &kc, NULL, iv, aad, sizeof(aad), ct, sizeof(ct), outs[0], tag },
+        { &kc, NULL, iv, aad, sizeof(aad), ct, sizeof(ct), outs[1], badTag },
+        { &kc, NULL, iv, NULL, 0, bigCt.data(), bigCt.size(), bigOut.data(), bigTag },
+        { &kc, NULL, iv, aad, sizeof(aad), ct, sizeof(ct), outs[2], tag },
+    };
+    uint8_t bits[1];
+    EXPECT_EQ(2U, gcm.gcmDecryptBatch(frames, 4, bits));
+    EXPECT_EQ(0x9, bits[0]);
+    EXPECT_EQ(0, memcmp(outs[0], pt, sizeof(pt)));
+    EXPECT_EQ(0, memcmp(outs[2], pt, sizeof(pt)));
+    for(size_t j = 0; j < sizeof(outs[1]); ++j) { EXPECT_EQ(0xa5, outs[1][j]); }
+    for(size_t j = 0; j < bigOut.size(); ++j) { EXPECT_EQ(0xa5, bigOut[j]); }
+
+    // A wave of several keys (with AES-NI), forged frame first.
+    static uint8_t wsKC2[kc_t::workspaceRequired];
+    kc_t kc2(wsKC2, sizeof(wsKC2));
+    uint8_t key2[16], ct2[32], tag2[GCM_TAG_LENGTH];
+    for(size_t j = 0; j < sizeof(key2); ++j) { key2[j] = (uint8_t)random(); }
+    ASSERT_TRUE(kc2.setKey(key2));
+    ASSERT_TRUE(gcm.gcmEncryptLarge(kc2, iv, pt, sizeof(pt), aad, sizeof(aad), ct2, tag2));
+    const OTAESGCM::OTAES128GCMFrameDescriptor mixed[] = {
+        { &kc, NULL, iv, aad, sizeof(aad), ct, sizeof(ct), outs[0], badTag },
+        { &kc2, NULL, iv, aad, sizeof(aad), ct2, sizeof(ct2), outs[1], tag2 },
+        { &kc, NULL, iv, aad, sizeof(aad), ct, sizeof(ct), outs[2], tag },
+    };
+    memset(outs, 0xa5, sizeof(outs));
+    EXPECT_EQ(2U, gcm.gcmDecryptBatch(mixed, 3, bits));
+    EXPECT_EQ(0x6, bits[0]);
+    for(size_t j = 0; j < sizeof(outs[0]); ++j) { EXPECT_EQ(0xa5, outs[0][j]); }
+    EXPECT_EQ(0, memcmp(outs[1], pt, sizeof(pt)));
+    EXPECT_EQ(0, memcmp(outs[2], pt, sizeof(pt)));
+    kc2.clear();
+
+    // Forged frames in a wave cost only their tag masks.
+    typedef OTAESGCM::OTAES128GCMKeyContextWithWorkspace<CountingAES, OTAESGCM::OTGHASH128_fast_t> countKC_t;
+    static uint8_t wsCount[countKC_t::workspaceRequired];
+    countKC_t countKC(wsCount, sizeof(wsCount));
+    ASSERT_TRUE(countKC.setKey(key));
+    const OTAESGCM::OTAES128GCMFrameDescriptor counted[] = {
+        { &countKC, NULL, iv, aad, sizeof(aad), ct, sizeof(ct), outs[0], badTag },
+        { &countKC, NULL, iv, aad, sizeof(aad), ct, sizeof(ct), outs[1], tag },
+        { &countKC, NULL, iv, aad, sizeof(aad), ct, sizeof(ct), outs[2], badTag },
+    };
+    memset(outs, 0xa5, sizeof(outs));
+    CountingAES::blocks = 0;
+    EXPECT_EQ(1U, gcm.gcmDecryptBatch(counted, 3, bits));
+    EXPECT_EQ(0x2, bits[0]);
+    EXPECT_EQ(3U + 2U, CountingAES::blocks); // Three masks, then one frame's key stream.
+    EXPECT_EQ(0, memcmp(outs[1], pt, sizeof(pt)));
+    for(size_t j = 0; j < sizeof(outs[0]); ++j) { EXPECT_EQ(0xa5, outs[0][j]); EXPECT_EQ(0xa5, outs[2][j]); }
+    CountingAES::blocks = 0;
+    gcm.setVerifyBeforeDecrypt(false);
+    EXPECT_EQ(1U, gcm.gcmDecryptBatch(counted, 3, bits));
+    EXPECT_EQ(3U * 3U, CountingAES::blocks);
+    gcm.setVerifyBeforeDecrypt(true);
+    countKC.clear();
+
+    // Streaming would release plain text before the tag is checked.
+    OTAESGCM::OTAES128GCMStreamContext sctx;
+    EXPECT_FALSE(gcm.gcmStreamInit(sctx, key, iv, true));
+    EXPECT_TRUE(gcm.gcmStreamInit(sctx, key, iv, false));
+    gcm.gcmStreamAbort(sctx);
+    kc.clear();
+}
+
+
 //#if 1 // unpadded encryption disabled
 //// Check that authentication works correctly.
 ////